@@ -96,8 +96,16 @@
 /* when you want to use SINGLE THREAD. Note Default ESP-IDF is FreeRTOS */
 /* TODO: previously saw depth mismatch when disabling SINGLE_THREADED ?
  * (but putty cannot connect: server host key invalid when defined)
- *  fails for both `WOLFSSL_NONBLOCK 0` or `WOLFSSL_NONBLOCK 1` */
-#define SINGLE_THREADED
+ *  fails for both `WOLFSSL_NONBLOCK 0` or `WOLFSSL_NONBLOCK 1`
+ *
+ * Each SSH session runs in its own task, so with more than one session
+ * (CONFIG_SSH_SERVER_MAX_SESSIONS in menuconfig) wolfSSL needs its
+ * mutexes. With one session, the default, keep SINGLE_THREADED as before
+ * until the TODO above is resolved. */
+#if !defined(CONFIG_SSH_SERVER_MAX_SESSIONS) || \
+    (CONFIG_SSH_SERVER_MAX_SESSIONS <= 1)
+    #define SINGLE_THREADED
+#endif
 
 /* Need to increase pthread stack size when using WOLFSSH_TEST_THREADING */
 /* Minimum defined size should be 20096, but not in SINGLE_THREADED */
@@ -295,6 +303,27 @@
 
 #define WOLFSSL_SMALL_STACK
 
+/* Fixed-point ECC: cache precomputed multiples of the curve base point so
+ * the scalar multiply in every ECDSA host-key signature and every ephemeral
+ * ECDH key is much faster. The table is built once at boot by HostKeyInit()
+ * and shared by all sessions; wolfCrypt guards it with a mutex unless
+ * SINGLE_THREADED is defined. Without SINGLE_THREADED, the kex_pool task
+ * builds the tables for the other key exchange curves, and rebuilds any
+ * pushed out. Each entry
+ * costs 2^FP_LUT points, so ALT_ECC_SIZE keeps those points sized for ECC
+ * rather than FP_MAX_BITS. FP_ENTRIES is one per curve, plus one for the
+ * client's public point during ECDH. */
+#if defined(HAVE_ECC) && defined(USE_FAST_MATH)
+    #define FP_ECC
+    #ifdef DEMO_SERVER_384
+        #define FP_ENTRIES 3
+    #else
+        #define FP_ENTRIES 2
+    #endif
+    #define FP_LUT     4
+    #define ALT_ECC_SIZE
+#endif
+
 /* The ESP32 has some detailed statup information available:*/
 #define HAVE_VERSION_EXTENDED_INFO
 /* #define HAVE_WC_INTROSPECTION */
@@ -0,0 +1,145 @@
+/* coalesce.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "coalesce.h"
+
+#include <string.h>
+
+void coalesce_init(coalesce_t* c, size_t maxSz, int64_t delayUs, int newline,
+                   const char* const* prompts)
+{
+    memset(c, 0, sizeof(coalesce_t));
+    c->maxSz = (maxSz > 0) ? maxSz : 1;
+    c->delayUs = (delayUs > 0) ? delayUs : 0;
+    c->newline = newline;
+    c->prompts = prompts;
+    coalesce_reset(c);
+}
+
+void coalesce_reset(coalesce_t* c)
+{
+    c->scanned = 0;
+    c->firstUs = 0;
+    c->flush = 0;
+    c->tailSz = 0;
+    c->sends = 0;
+    c->bytes = 0;
+    /* nothing has been sent yet, so the first output counts as quiet */
+    c->lastSendUs = INT64_MIN / 2;
+}
+
+/* non-zero if the bytes seen so far end with one of the prompts */
+static int coalesce_prompt(const coalesce_t* c)
+{
+    const char* const* p;
+
+    if (c->prompts == NULL) {
+        return 0;
+    }
+
+    for (p = c->prompts; *p != NULL; p++) {
+        size_t len = strlen(*p);
+
+        if ((len > 0) && (len <= c->tailSz) &&
+            (memcmp(c->tail + c->tailSz - len, *p, len) == 0)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void coalesce_scan(coalesce_t* c, const uint8_t* data, size_t sz,
+                   int64_t now)
+{
+    if (sz == 0) {
+        return;
+    }
+
+    if (c->scanned == 0) {
+        c->firstUs = now;
+    }
+    c->scanned += sz;
+
+    if (c->newline && !c->flush &&
+        ((memchr(data, '\n', sz) != NULL) ||
+         (memchr(data, '\r', sz) != NULL))) {
+        c->flush = 1;
+    }
+
+    /* keep the last COALESCE_TAIL_SZ bytes */
+    if (sz >= COALESCE_TAIL_SZ) {
+        memcpy(c->tail, data + sz - COALESCE_TAIL_SZ, COALESCE_TAIL_SZ);
+        c->tailSz = COALESCE_TAIL_SZ;
+    }
+    else {
+        size_t keep = COALESCE_TAIL_SZ - sz;
+
+        if (keep > c->tailSz) {
+            keep = c->tailSz;
+        }
+        memmove(c->tail, c->tail + c->tailSz - keep, keep);
+        memcpy(c->tail + keep, data, sz);
+        c->tailSz = keep + sz;
+    }
+
+    if (!c->flush && coalesce_prompt(c)) {
+        c->flush = 1;
+    }
+}
+
+int64_t coalesce_wait(const coalesce_t* c, size_t pending, int64_t now)
+{
+    int64_t waited;
+
+    if ((pending == 0) || (c->delayUs == 0) || c->flush ||
+        (pending >= c->maxSz)) {
+        return 0;
+    }
+
+    /* output after a quiet spell, or not yet looked at, goes at once */
+    if ((c->scanned == 0) || (c->firstUs - c->lastSendUs >= c->delayUs)) {
+        return 0;
+    }
+
+    waited = now - c->firstUs;
+    if (waited >= c->delayUs) {
+        return 0;
+    }
+
+    return c->delayUs - waited;
+}
+
+void coalesce_sent(coalesce_t* c, size_t sz, size_t remaining, int64_t now)
+{
+    c->sends++;
+    c->bytes += (uint32_t)sz;
+    c->lastSendUs = now;
+
+    if (remaining == 0) {
+        c->scanned = 0;
+        c->flush = 0;
+        c->tailSz = 0;
+    }
+    else {
+        /* whatever is left of a flush still goes without waiting */
+        c->scanned = (c->scanned > sz) ? c->scanned - sz : 0;
+        c->flush = 1;
+    }
+}
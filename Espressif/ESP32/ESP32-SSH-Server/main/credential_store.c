@@ -0,0 +1,541 @@
+/* credential_store.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "credential_store.h"
+
+#include <wolfssl/wolfcrypt/coding.h>
+
+#include <esp_log.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "cred_store";
+
+/* smallest table allocated; must be a power of two */
+#define CRED_STORE_MIN_SZ 8
+
+/* grow when more than 3/4 of the slots are in use */
+#define CRED_STORE_FULL(count, capacity) ((count) * 4 > (capacity) * 3)
+
+/* our own little c word32 to array */
+static WC_INLINE void c32toa(word32 u32, byte* c)
+{
+    c[0] = (u32 >> 24) & 0xff;
+    c[1] = (u32 >> 16) & 0xff;
+    c[2] = (u32 >>  8) & 0xff;
+    c[3] =  u32 & 0xff;
+}
+
+/* Finish the digest of a password or public key of pSz bytes, already
+ * hashed into sha. The length goes last, so that a secret can be hashed
+ * as it is parsed, before its length is known. */
+static int CredDigestFinal(wc_Sha256* sha, word32 pSz, byte* digest)
+{
+    byte flatSz[4];
+    int ret;
+
+    c32toa(pSz, flatSz);
+
+    ret = wc_Sha256Update(sha, flatSz, sizeof(flatSz));
+    if (ret == 0)
+        ret = wc_Sha256Final(sha, digest);
+    wc_Sha256Free(sha);
+
+    return ret;
+}
+
+/* SHA-256 of the password or public key, with its length */
+static int CredDigest(const byte* p, word32 pSz, byte* digest)
+{
+    wc_Sha256 sha;
+    int ret;
+
+    ret = wc_InitSha256(&sha);
+    if (ret == 0)
+        ret = wc_Sha256Update(&sha, p, pSz);
+    if (ret == 0)
+        ret = CredDigestFinal(&sha, pSz, digest);
+
+    return ret;
+}
+
+/* FNV-1a of the user name */
+static word32 CredHash(const byte* username, word32 usernameSz)
+{
+    word32 h = 2166136261U;
+
+    while (usernameSz--) {
+        h ^= *username++;
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+/* Returns 0xff when a and b are equal, otherwise 0, in time that depends
+ * only on sz. */
+static byte CredConstantCompare(const byte* a, const byte* b, word32 sz)
+{
+    byte diff = 0;
+    word32 i;
+
+    for (i = 0; i < sz; i++) {
+        diff |= a[i] ^ b[i];
+    }
+
+    return (byte)(((word32)diff - 1) >> 8);
+}
+
+/* place a filled entry; the table must have a free slot */
+static void CredStorePlace(CredEntry* entries, word32 mask,
+                           const CredEntry* entry)
+{
+    word32 i = CredHash(entry->username, entry->usernameSz) & mask;
+
+    while (entries[i].type != 0) {
+        i = (i + 1) & mask;
+    }
+    entries[i] = *entry;
+}
+
+static int CredStoreResize(CredStore* store, word32 capacity)
+{
+    CredEntry* entries;
+    word32 i;
+
+    entries = (CredEntry*)calloc(capacity, sizeof(CredEntry));
+    if (entries == NULL) {
+        ESP_LOGE(TAG, "Couldn't allocate %u credential entries.",
+                      (unsigned)capacity);
+        return -1;
+    }
+
+    if (store->entries != NULL) {
+        for (i = 0; i <= store->mask; i++) {
+            if (store->entries[i].type != 0) {
+                CredStorePlace(entries, capacity - 1, &store->entries[i]);
+            }
+        }
+        memset(store->entries, 0, (store->mask + 1) * sizeof(CredEntry));
+        free(store->entries);
+    }
+
+    store->entries = entries;
+    store->mask = capacity - 1;
+
+    return 0;
+}
+
+int CredStoreInit(CredStore* store, word32 expected)
+{
+    word32 capacity = CRED_STORE_MIN_SZ;
+
+    if (store == NULL)
+        return -1;
+
+    memset(store, 0, sizeof(CredStore));
+
+    while (CRED_STORE_FULL(expected, capacity)) {
+        capacity <<= 1;
+    }
+
+    return CredStoreResize(store, capacity);
+}
+
+void CredStoreFree(CredStore* store)
+{
+    if (store != NULL && store->entries != NULL) {
+        memset(store->entries, 0, (store->mask + 1) * sizeof(CredEntry));
+        free(store->entries);
+        memset(store, 0, sizeof(CredStore));
+    }
+}
+
+/* add a filled entry, growing the table first if needed */
+static int CredStoreInsert(CredStore* store, const CredEntry* entry)
+{
+    if (CRED_STORE_FULL(store->count + 1, store->mask + 1)) {
+        if (CredStoreResize(store, (store->mask + 1) * 2) != 0)
+            return -1;
+    }
+
+    CredStorePlace(store->entries, store->mask, entry);
+    store->count++;
+
+    return 0;
+}
+
+int CredStoreAdd(CredStore* store, byte type,
+                 const byte* username, word32 usernameSz,
+                 const byte* p, word32 pSz)
+{
+    CredEntry entry;
+    int ret;
+
+    if (store == NULL || store->entries == NULL || type == 0 ||
+        username == NULL || p == NULL) {
+        return -1;
+    }
+
+    /* a longer name could never log in, see CredStoreCheck */
+    if (usernameSz > CRED_USERNAME_MAX_SZ) {
+        ESP_LOGE(TAG, "User name longer than %d bytes.",
+                      CRED_USERNAME_MAX_SZ);
+        return -1;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    entry.type = type;
+    entry.usernameSz = (byte)usernameSz;
+    memcpy(entry.username, username, usernameSz);
+
+    ret = CredDigest(p, pSz, entry.digest);
+    if (ret == 0)
+        ret = CredStoreInsert(store, &entry);
+    memset(&entry, 0, sizeof(entry));
+
+    return (ret == 0) ? 0 : -1;
+}
+
+/* CredLoader.state */
+enum {
+    CRED_STATE_LINE = 0, /* start of a line, skipping blanks */
+    CRED_STATE_COMMENT,  /* '#' line, skipped */
+    CRED_STATE_USER,     /* passwd: user name, up to ':' */
+    CRED_STATE_PASSWORD, /* passwd: password, up to the end of line */
+    CRED_STATE_KEY_TYPE, /* authorized_keys: key type, skipped */
+    CRED_STATE_KEY_SEP,  /* blanks before the key */
+    CRED_STATE_KEY,      /* base64 key blob */
+    CRED_STATE_NAME_SEP, /* blanks before the user name */
+    CRED_STATE_NAME,     /* user name, up to the end of line */
+    CRED_STATE_ERROR     /* a line was malformed; ignore the rest */
+};
+
+static int CredLoaderFail(CredLoader* loader, const char* why)
+{
+    ESP_LOGE(TAG, "Credentials line %u: %s", (unsigned)loader->lineNo, why);
+    if (loader->state == CRED_STATE_PASSWORD ||
+        loader->state == CRED_STATE_KEY ||
+        loader->state == CRED_STATE_NAME_SEP ||
+        loader->state == CRED_STATE_NAME) {
+        wc_Sha256Free(&loader->sha);
+    }
+    loader->state = CRED_STATE_ERROR;
+    loader->error = -1;
+
+    return -1;
+}
+
+static int CredLoaderBeginSecret(CredLoader* loader)
+{
+    loader->secretSz = 0;
+    loader->quadSz = 0;
+
+    return wc_InitSha256(&loader->sha);
+}
+
+static int CredLoaderAddUsername(CredLoader* loader, byte c)
+{
+    if (loader->usernameSz >= CRED_USERNAME_MAX_SZ) {
+        return CredLoaderFail(loader, "user name too long");
+    }
+    loader->username[loader->usernameSz++] = c;
+
+    return 0;
+}
+
+/* decode one base64 quantum into the key hash */
+static int CredLoaderDecodeQuad(CredLoader* loader)
+{
+    byte decoded[3];
+    word32 decodedSz = sizeof(decoded);
+
+    if (Base64_Decode(loader->quad, sizeof(loader->quad),
+                      decoded, &decodedSz) != 0) {
+        return -1;
+    }
+    loader->quadSz = 0;
+    loader->secretSz += decodedSz;
+
+    return wc_Sha256Update(&loader->sha, decoded, decodedSz);
+}
+
+/* the end of a password or key line: add the finished entry */
+static int CredLoaderEndLine(CredLoader* loader)
+{
+    CredEntry entry;
+    int ret;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.type = loader->type;
+    entry.usernameSz = loader->usernameSz;
+    memcpy(entry.username, loader->username, loader->usernameSz);
+
+    ret = CredDigestFinal(&loader->sha, loader->secretSz, entry.digest);
+    if (ret == 0)
+        ret = CredStoreInsert(loader->store, &entry);
+    memset(&entry, 0, sizeof(entry));
+
+    loader->state = CRED_STATE_LINE;
+    loader->usernameSz = 0;
+    loader->secretSz = 0;
+
+    if (ret != 0) {
+        loader->state = CRED_STATE_ERROR;
+        loader->error = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int CredLoaderInit(CredLoader* loader, CredStore* store, byte type)
+{
+    if (loader == NULL || store == NULL || store->entries == NULL ||
+        (type != WOLFSSH_USERAUTH_PASSWORD &&
+         type != WOLFSSH_USERAUTH_PUBLICKEY)) {
+        return -1;
+    }
+
+    memset(loader, 0, sizeof(CredLoader));
+    loader->store = store;
+    loader->type = type;
+    loader->lineNo = 1;
+    loader->state = CRED_STATE_LINE;
+
+    return 0;
+}
+
+int CredLoaderUpdate(CredLoader* loader, const byte* data, word32 dataSz)
+{
+    word32 i;
+
+    if (loader == NULL || (data == NULL && dataSz > 0))
+        return -1;
+
+    for (i = 0; i < dataSz && loader->state != CRED_STATE_ERROR; i++) {
+        byte c = data[i];
+        int blank = (c == ' ' || c == '\t');
+
+        /* CRLF files are accepted as is */
+        if (c == '\r')
+            continue;
+
+        switch (loader->state) {
+
+        case CRED_STATE_LINE:
+            if (c == '\n' || blank)
+                break;
+            if (c == '#') {
+                loader->state = CRED_STATE_COMMENT;
+                break;
+            }
+            loader->usernameSz = 0;
+            if (loader->type == WOLFSSH_USERAUTH_PASSWORD) {
+                loader->state = CRED_STATE_USER;
+                if (c == ':') {
+                    loader->state = CRED_STATE_PASSWORD;
+                    if (CredLoaderBeginSecret(loader) != 0)
+                        return CredLoaderFail(loader, "hash error");
+                }
+                else if (CredLoaderAddUsername(loader, c) != 0) {
+                    return -1;
+                }
+            }
+            else {
+                loader->state = CRED_STATE_KEY_TYPE;
+            }
+            break;
+
+        case CRED_STATE_COMMENT:
+            if (c == '\n')
+                loader->state = CRED_STATE_LINE;
+            break;
+
+        case CRED_STATE_USER:
+            if (c == '\n')
+                return CredLoaderFail(loader, "missing ':'");
+            if (c == ':') {
+                loader->state = CRED_STATE_PASSWORD;
+                if (CredLoaderBeginSecret(loader) != 0)
+                    return CredLoaderFail(loader, "hash error");
+            }
+            else if (CredLoaderAddUsername(loader, c) != 0) {
+                return -1;
+            }
+            break;
+
+        case CRED_STATE_PASSWORD:
+            if (c == '\n') {
+                if (CredLoaderEndLine(loader) != 0)
+                    return CredLoaderFail(loader, "could not add user");
+                break;
+            }
+            loader->secretSz++;
+            if (wc_Sha256Update(&loader->sha, &c, 1) != 0)
+                return CredLoaderFail(loader, "hash error");
+            break;
+
+        case CRED_STATE_KEY_TYPE:
+            if (c == '\n')
+                return CredLoaderFail(loader, "missing key");
+            if (blank)
+                loader->state = CRED_STATE_KEY_SEP;
+            break;
+
+        case CRED_STATE_KEY_SEP:
+            if (c == '\n')
+                return CredLoaderFail(loader, "missing key");
+            if (blank)
+                break;
+            loader->state = CRED_STATE_KEY;
+            if (CredLoaderBeginSecret(loader) != 0)
+                return CredLoaderFail(loader, "hash error");
+            /* fall through */
+
+        case CRED_STATE_KEY:
+            if (c == '\n')
+                return CredLoaderFail(loader, "missing user name");
+            if (blank) {
+                if (loader->quadSz != 0 || loader->secretSz == 0)
+                    return CredLoaderFail(loader, "bad key length");
+                loader->state = CRED_STATE_NAME_SEP;
+                break;
+            }
+            loader->quad[loader->quadSz++] = c;
+            if (loader->quadSz == sizeof(loader->quad) &&
+                CredLoaderDecodeQuad(loader) != 0) {
+                return CredLoaderFail(loader, "bad base64 key");
+            }
+            break;
+
+        case CRED_STATE_NAME_SEP:
+            if (c == '\n')
+                return CredLoaderFail(loader, "missing user name");
+            if (blank)
+                break;
+            loader->state = CRED_STATE_NAME;
+            /* fall through */
+
+        case CRED_STATE_NAME:
+            if (c == '\n') {
+                if (CredLoaderEndLine(loader) != 0)
+                    return CredLoaderFail(loader, "could not add key");
+                break;
+            }
+            if (CredLoaderAddUsername(loader, c) != 0)
+                return -1;
+            break;
+
+        default:
+            break;
+        }
+
+        if (c == '\n')
+            loader->lineNo++;
+    }
+
+    return loader->error;
+}
+
+int CredLoaderFinal(CredLoader* loader)
+{
+    if (loader == NULL)
+        return -1;
+
+    switch (loader->state) {
+        case CRED_STATE_PASSWORD:
+        case CRED_STATE_NAME:
+            /* the last line had no newline */
+            return CredLoaderUpdate(loader, (const byte*)"\n", 1);
+
+        case CRED_STATE_LINE:
+        case CRED_STATE_COMMENT:
+            return loader->error;
+
+        case CRED_STATE_ERROR:
+            return -1;
+
+        default:
+            return CredLoaderFail(loader, "incomplete line");
+    }
+}
+
+int CredStoreCheck(const CredStore* store, byte type,
+                   const byte* username, word32 usernameSz,
+                   const byte* p, word32 pSz)
+{
+    byte name[CRED_USERNAME_MAX_SZ];
+    byte digest[WC_SHA256_DIGEST_SIZE];
+    byte nameSz = (byte)usernameSz;
+    byte userFound = 0, typeFound = 0, matched = 0;
+    word32 i;
+
+    if (store == NULL || store->entries == NULL || username == NULL ||
+        p == NULL) {
+        return WOLFSSH_USERAUTH_FAILURE;
+    }
+
+    /* longer names can never match, as stored names are at most this */
+    if (usernameSz > CRED_USERNAME_MAX_SZ)
+        return WOLFSSH_USERAUTH_INVALID_USER;
+
+    memset(name, 0, sizeof(name));
+    memcpy(name, username, usernameSz);
+
+    if (CredDigest(p, pSz, digest) != 0)
+        return WOLFSSH_USERAUTH_FAILURE;
+
+    /*
+     * All entries for one user sit in the same probe run, which ends at
+     * the first empty slot. Every entry in the run is compared in full,
+     * with no early exit, so the time taken does not show which part of
+     * a name or digest matched.
+     */
+    i = CredHash(name, usernameSz) & store->mask;
+    while (store->entries[i].type != 0) {
+        const CredEntry* entry = &store->entries[i];
+        byte sameUser, sameType;
+
+        sameUser = CredConstantCompare(entry->username, name, sizeof(name))
+                 & CredConstantCompare(&entry->usernameSz, &nameSz, 1);
+        sameType = sameUser & CredConstantCompare(&entry->type, &type, 1);
+
+        userFound |= sameUser;
+        typeFound |= sameType;
+        matched   |= sameType & CredConstantCompare(entry->digest, digest,
+                                                    sizeof(digest));
+
+        i = (i + 1) & store->mask;
+    }
+
+    memset(digest, 0, sizeof(digest));
+
+    if (matched)
+        return WOLFSSH_USERAUTH_SUCCESS;
+    if (typeFound)
+        return (type == WOLFSSH_USERAUTH_PASSWORD ?
+                WOLFSSH_USERAUTH_INVALID_PASSWORD :
+                WOLFSSH_USERAUTH_INVALID_PUBLICKEY);
+    if (userFound)
+        return WOLFSSH_USERAUTH_INVALID_AUTHTYPE;
+
+    return WOLFSSH_USERAUTH_INVALID_USER;
+}
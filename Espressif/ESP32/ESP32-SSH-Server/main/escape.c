@@ -0,0 +1,109 @@
+/* escape.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "escape.h"
+
+#include <string.h>
+
+#define ESCAPE_IS_EOL(c) (((c) == '\r') || ((c) == '\n'))
+
+void escape_init(escape_t* esc, uint8_t escapeChar)
+{
+    esc->escapeChar = escapeChar;
+    esc->lineStart = 1;
+    esc->pending = 0;
+}
+
+/* the command for the byte after the escape character, if any */
+static int escape_cmd(uint8_t c)
+{
+    switch (c) {
+        case '.':
+            return ESCAPE_CMD_DISCONNECT;
+        case 'R':
+            return ESCAPE_CMD_REKEY;
+        case '#':
+            return ESCAPE_CMD_STATS;
+        case '?':
+            return ESCAPE_CMD_HELP;
+        default:
+            return ESCAPE_CMD_NONE;
+    }
+}
+
+size_t escape_next(escape_t* esc, const uint8_t* in, size_t sz,
+                   const uint8_t** out, size_t* outSz, int* cmd)
+{
+    const uint8_t* hit;
+    size_t run;
+
+    *out = in;
+    *outSz = 0;
+    *cmd = ESCAPE_CMD_NONE;
+
+    if (sz == 0) {
+        return 0;
+    }
+
+    if (esc->pending) {
+        esc->pending = 0;
+
+        *cmd = escape_cmd(in[0]);
+        if (*cmd != ESCAPE_CMD_NONE) {
+            /* still at the start of a line, so escapes can follow */
+            return 1;
+        }
+
+        /* not a command: pass the escape character on, and for ~~ that is
+         * all; otherwise the byte after it follows in the next step */
+        *out = &esc->escapeChar;
+        *outSz = 1;
+        esc->lineStart = 0;
+        return (in[0] == esc->escapeChar) ? 1 : 0;
+    }
+
+    if (esc->escapeChar != 0) {
+        if (esc->lineStart && (in[0] == esc->escapeChar)) {
+            esc->pending = 1;
+            return 1;
+        }
+
+        /* pass everything up to an escape character that starts a line */
+        run = 1;
+        while (run < sz) {
+            hit = memchr(in + run, esc->escapeChar, sz - run);
+            if (hit == NULL) {
+                run = sz;
+                break;
+            }
+            run = (size_t)(hit - in);
+            if (ESCAPE_IS_EOL(in[run - 1])) {
+                break;
+            }
+            run++;
+        }
+    }
+    else {
+        run = sz;
+    }
+
+    *outSz = run;
+    esc->lineStart = ESCAPE_IS_EOL(in[run - 1]);
+    return run;
+}
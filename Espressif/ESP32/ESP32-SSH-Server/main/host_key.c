@@ -0,0 +1,244 @@
+/* host_key.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "host_key.h"
+
+#include <wolfssl/wolfcrypt/asn_public.h>
+#include <wolfssl/wolfcrypt/random.h>
+#ifdef HAVE_ECC
+    #include <wolfssl/wolfcrypt/ecc.h>
+#endif
+#ifndef NO_RSA
+    #include <wolfssl/wolfcrypt/rsa.h>
+#endif
+
+#ifdef NO_FILESYSTEM
+    #include <wolfssh/certs_test.h>
+#else
+    #include <stdio.h>
+#endif
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+static const char* TAG = "host_key";
+
+static byte hostKeyDer[HOST_KEY_MAX_SZ];
+static word32 hostKeyDerSz = 0;
+
+/* ECC unless there is no ECC or RSA is asked for; see host_key.h */
+#if defined(NO_RSA) || \
+    (defined(HAVE_ECC) && !defined(SSH_SERVER_HOST_KEY_RSA))
+    static const byte hostKeyIsEcc = 1;
+#else
+    static const byte hostKeyIsEcc = 0;
+#endif
+
+#ifndef NO_FILESYSTEM
+static int load_file(const char* fileName, byte* buf, word32 bufSz)
+{
+    FILE* file;
+    word32 fileSz;
+    word32 readSz;
+
+    if (fileName == NULL) return 0;
+
+    if (WFOPEN(&file, fileName, "rb") != 0)
+        return 0;
+    fseek(file, 0, SEEK_END);
+    fileSz = (word32)ftell(file);
+    rewind(file);
+
+    if (fileSz > bufSz) {
+        fclose(file);
+        return 0;
+    }
+
+    readSz = (word32)fread(buf, 1, fileSz, file);
+    if (readSz < fileSz) {
+        fclose(file);
+        return 0;
+    }
+
+    fclose(file);
+
+    return fileSz;
+}
+#endif /* !NO_FILESYSTEM */
+
+/* returns buffer size on success */
+static int load_key(byte isEcc, byte* buf, word32 bufSz)
+{
+    word32 sz = 0;
+
+#ifndef NO_FILESYSTEM
+    const char* bufName;
+    bufName = isEcc ? "./keys/server-key-ecc.der" :
+                       "./keys/server-key-rsa.der";
+    sz = load_file(bufName, buf, bufSz);
+#else
+    /* using buffers instead */
+    if (isEcc) {
+    #ifdef DEMO_SERVER_384
+        if ((word32)sizeof_ecc_key_der_384 > bufSz) {
+            return 0;
+        }
+        WMEMCPY(buf, ecc_key_der_384, sizeof_ecc_key_der_384);
+        sz = sizeof_ecc_key_der_384;
+    #else
+        if ((word32)sizeof_ecc_key_der_256 > bufSz) {
+            return 0;
+        }
+        WMEMCPY(buf, ecc_key_der_256, sizeof_ecc_key_der_256);
+        sz = sizeof_ecc_key_der_256;
+    #endif
+    }
+    else {
+        if ((word32)sizeof_rsa_key_der_2048 > bufSz) {
+            return 0;
+        }
+        WMEMCPY(buf, rsa_key_der_2048, sizeof_rsa_key_der_2048);
+        sz = sizeof_rsa_key_der_2048;
+    }
+#endif
+
+    return sz;
+}
+
+#ifdef HAVE_ECC
+/* Decode the cached key, and with FP_ECC sign a dummy digest twice so
+ * the shared fixed-point table for its curve is built now; see
+ * host_key.h. */
+static int HostKeyCheckEcc(void)
+{
+    ecc_key key;
+    word32 idx = 0;
+    int ret;
+
+    ret = wc_ecc_init(&key);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = wc_EccPrivateKeyDecode(hostKeyDer, &idx, &key, hostKeyDerSz);
+
+#ifdef FP_ECC
+    if (ret == 0) {
+        WC_RNG rng;
+        byte digest[32];
+        byte sig[ECC_MAX_SIG_SIZE];
+        word32 sigSz;
+        int64_t start = esp_timer_get_time();
+        int i;
+
+        XMEMSET(digest, 0x5a, sizeof(digest));
+        ret = wc_InitRng(&rng);
+        if (ret == 0) {
+            for (i = 0; ret == 0 && i < 2; i++) {
+                sigSz = sizeof(sig);
+                ret = wc_ecc_sign_hash(digest, sizeof(digest), sig, &sigSz,
+                                       &rng, &key);
+            }
+            wc_FreeRng(&rng);
+        }
+        if (ret == 0) {
+            ESP_LOGI(TAG, "Fixed-point ECC table ready in %lld ms.",
+                     (esp_timer_get_time() - start) / 1000);
+        }
+    }
+#endif
+
+    wc_ecc_free(&key);
+    return ret;
+}
+#endif /* HAVE_ECC */
+
+#ifndef NO_RSA
+static int HostKeyCheckRsa(void)
+{
+    RsaKey key;
+    word32 idx = 0;
+    int ret;
+
+    ret = wc_InitRsaKey(&key, NULL);
+    if (ret == 0) {
+        ret = wc_RsaPrivateKeyDecode(hostKeyDer, &idx, &key, hostKeyDerSz);
+        wc_FreeRsaKey(&key);
+    }
+    return ret;
+}
+#endif /* !NO_RSA */
+
+int HostKeyInit(void)
+{
+    int ret = -1;
+
+    if (hostKeyDerSz != 0) {
+        return 0;
+    }
+
+    hostKeyDerSz = (word32)load_key(hostKeyIsEcc, hostKeyDer,
+                                    sizeof(hostKeyDer));
+    if (hostKeyDerSz == 0) {
+        ESP_LOGE(TAG, "Couldn't load key.");
+        return -1;
+    }
+
+#ifdef HAVE_ECC
+    if (hostKeyIsEcc) {
+        ret = HostKeyCheckEcc();
+    }
+#endif
+#ifndef NO_RSA
+    if (!hostKeyIsEcc) {
+        ret = HostKeyCheckRsa();
+    }
+#endif
+
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Host key is not usable: %d", ret);
+        XMEMSET(hostKeyDer, 0, sizeof(hostKeyDer));
+        hostKeyDerSz = 0;
+        return -1;
+    }
+
+    ESP_LOGI(TAG, "Loaded %s host key, %u bytes.",
+             hostKeyIsEcc ? "ECC" : "RSA", (unsigned)hostKeyDerSz);
+    return 0;
+}
+
+int HostKeyIsEcc(void)
+{
+    return hostKeyIsEcc;
+}
+
+int HostKeyUse(WOLFSSH_CTX* ctx)
+{
+    if (HostKeyInit() != 0) {
+        return -1;
+    }
+
+    if (wolfSSH_CTX_UsePrivateKey_buffer(ctx, hostKeyDer, hostKeyDerSz,
+                                         WOLFSSH_FORMAT_ASN1) < 0) {
+        ESP_LOGE(TAG, "Couldn't use key buffer.");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,90 @@
+/* coalesce.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _COALESCE_H_
+#define _COALESCE_H_
+
+/* Note this header has no RTOS dependencies so that the policy can also be
+ * compiled on a host for testing. Times are in microseconds, from any
+ * monotonic clock such as esp_timer_get_time(). */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest prompt pattern that can be matched */
+#define COALESCE_TAIL_SZ 16
+
+/*
+ * Flush policy for output batched on its way to an SSH client, so a device
+ * that writes a few bytes at a time does not cost a full SSH packet each.
+ *
+ * Pending data is sent at once when:
+ *   - it arrived after the output had been quiet for delayUs, such as the
+ *     echo of a key press,
+ *   - it holds a newline (if newline is set) or ends with a prompt,
+ *   - maxSz bytes are pending, or
+ *   - the oldest pending byte has waited delayUs.
+ * A delayUs of zero sends everything at once.
+ */
+typedef struct coalesce_t {
+    /* policy */
+    size_t maxSz;
+    int64_t delayUs;
+    int newline;
+    const char* const* prompts; /* NULL terminated, or NULL for none */
+
+    /* state */
+    size_t scanned;  /* pending bytes already seen by coalesce_scan */
+    int64_t firstUs; /* when the oldest pending byte was seen */
+    int64_t lastSendUs;
+    int flush;       /* send everything pending without waiting */
+    uint8_t tail[COALESCE_TAIL_SZ]; /* last bytes seen, for prompts */
+    size_t tailSz;
+
+    /* totals, for tuning */
+    uint32_t sends;
+    uint32_t bytes;
+} coalesce_t;
+
+void coalesce_init(coalesce_t* c, size_t maxSz, int64_t delayUs, int newline,
+                   const char* const* prompts);
+
+/* forget pending data and totals, for a new session */
+void coalesce_reset(coalesce_t* c);
+
+/* Look at sz newly pending bytes, those after the c->scanned already seen.
+ * Pending data may come in several pieces, as from a ring. */
+void coalesce_scan(coalesce_t* c, const uint8_t* data, size_t sz,
+                   int64_t now);
+
+/* With pending bytes waiting, returns 0 to send them now, otherwise how
+ * long to wait before asking again. */
+int64_t coalesce_wait(const coalesce_t* c, size_t pending, int64_t now);
+
+/* sz bytes were sent in one packet, leaving remaining pending */
+void coalesce_sent(coalesce_t* c, size_t sz, size_t remaining, int64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _COALESCE_H_ */
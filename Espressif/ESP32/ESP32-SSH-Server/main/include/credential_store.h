@@ -0,0 +1,120 @@
+/* credential_store.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _CREDENTIAL_STORE_H_
+#define _CREDENTIAL_STORE_H_
+
+/* make sure this appears before any other wolfSSL headers */
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssl/wolfcrypt/sha256.h>
+
+#include <wolfssh/ssh.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* longest user name; longer names are refused when added or loaded */
+#define CRED_USERNAME_MAX_SZ 32
+
+/*
+ * One password or public key for one user. Only the SHA-256 of the
+ * length-prefixed secret is kept. A user may have several entries, e.g.
+ * a password and more than one key.
+ */
+typedef struct CredEntry {
+    byte type;       /* WOLFSSH_USERAUTH_PASSWORD or _PUBLICKEY; 0 = empty */
+    byte usernameSz;
+    byte username[CRED_USERNAME_MAX_SZ]; /* zero padded */
+    byte digest[WC_SHA256_DIGEST_SIZE];
+} CredEntry;
+
+/*
+ * Open-addressing (linear probe) hash table of CredEntry, keyed by user
+ * name, in a single contiguous allocation. Built once at startup with
+ * CredStoreAdd, then only read by wsUserAuth from any session task.
+ */
+typedef struct CredStore {
+    CredEntry* entries;
+    word32 mask;  /* capacity - 1; capacity is a power of two */
+    word32 count;
+} CredStore;
+
+/* size the table for about expected entries; it grows if needed.
+ * Returns 0 on success. */
+int CredStoreInit(CredStore* store, word32 expected);
+
+/* wipe and release the table */
+void CredStoreFree(CredStore* store);
+
+/* hash p and add it for username. Returns 0 on success. */
+int CredStoreAdd(CredStore* store, byte type,
+                 const byte* username, word32 usernameSz,
+                 const byte* p, word32 pSz);
+
+/*
+ * Streaming loader: parses a credentials file, or a flash blob, a chunk
+ * at a time and adds each line to a CredStore as it goes, so neither a
+ * copy of the whole file nor of a decoded key is ever needed.
+ *
+ * For WOLFSSH_USERAUTH_PASSWORD, each line is
+ *     username:password
+ * For WOLFSSH_USERAUTH_PUBLICKEY (authorized_keys style), each line is
+ *     ssh-rsa AAAAB3BASE64ENCODEDPUBLICKEYBLOB username
+ *
+ * Blank lines and lines starting with '#' are skipped. The key blob is
+ * base64 decoded four characters at a time straight into the hash, so
+ * keys of any size are accepted.
+ */
+typedef struct CredLoader {
+    CredStore* store;
+    wc_Sha256 sha;
+    word32 secretSz;   /* bytes hashed so far for this line */
+    word32 lineNo;
+    int    error;
+    byte   type;
+    byte   state;
+    byte   usernameSz;
+    byte   quadSz;
+    byte   quad[4];    /* base64 characters waiting to be decoded */
+    byte   username[CRED_USERNAME_MAX_SZ];
+} CredLoader;
+
+/* returns 0 on success */
+int CredLoaderInit(CredLoader* loader, CredStore* store, byte type);
+
+/* parse the next dataSz bytes; lines may span calls. Returns 0 on
+ * success, or -1 once any line was malformed. */
+int CredLoaderUpdate(CredLoader* loader, const byte* data, word32 dataSz);
+
+/* finish a last line without a newline. Returns 0 on success. */
+int CredLoaderFinal(CredLoader* loader);
+
+/* Check a presented password or public key. Returns one of
+ * WOLFSSH_USERAUTH_SUCCESS, _INVALID_USER, _INVALID_AUTHTYPE,
+ * _INVALID_PASSWORD or _INVALID_PUBLICKEY. */
+int CredStoreCheck(const CredStore* store, byte type,
+                   const byte* username, word32 usernameSz,
+                   const byte* p, word32 pSz);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CREDENTIAL_STORE_H_ */
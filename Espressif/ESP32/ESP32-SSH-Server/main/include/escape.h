@@ -0,0 +1,77 @@
+/* escape.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ESCAPE_H_
+#define _ESCAPE_H_
+
+/* Note this header has no RTOS dependencies so that the scanner can also
+ * be compiled on a host for testing. */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * OpenSSH style escape sequences in data from an SSH client. The escape
+ * character is only recognised as the first byte of a line, that is at the
+ * start of the session or after a CR or LF, and the byte after it is the
+ * command:
+ *
+ *     ~.  disconnect          ~R  rekey
+ *     ~#  session statistics  ~?  list these
+ *     ~~  send one ~
+ *
+ * Any other byte after the escape character is passed on along with it.
+ * Everything else passes through untouched, binary data included. The
+ * search is for the escape character alone, with memchr, so ordinary data
+ * is scanned a word at a time or faster.
+ */
+enum {
+    ESCAPE_CMD_NONE = 0,
+    ESCAPE_CMD_DISCONNECT,
+    ESCAPE_CMD_REKEY,
+    ESCAPE_CMD_STATS,
+    ESCAPE_CMD_HELP
+};
+
+typedef struct escape_t {
+    uint8_t escapeChar; /* 0 turns escapes off */
+    uint8_t lineStart;  /* the next byte starts a line */
+    uint8_t pending;    /* an escape character was held back */
+} escape_t;
+
+void escape_init(escape_t* esc, uint8_t escapeChar);
+
+/*
+ * Take the next step over sz bytes of client data at in. Sets *out and
+ * *outSz to data to pass on, either a run of in or a held back escape
+ * character, and *cmd to any command completed. Returns the number of
+ * bytes of in used, which can be zero when only *out is set; call again
+ * with the rest until it is all used.
+ */
+size_t escape_next(escape_t* esc, const uint8_t* in, size_t sz,
+                   const uint8_t** out, size_t* outSz, int* cmd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ESCAPE_H_ */
@@ -0,0 +1,68 @@
+/* host_key.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _HOST_KEY_H_
+#define _HOST_KEY_H_
+
+/* make sure this appears before any other wolfSSL headers */
+#include <wolfssl/wolfcrypt/settings.h>
+
+#include <wolfssh/ssh.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The host key is ECC (P-256, or P-384 with DEMO_SERVER_384) when
+ * wolfCrypt has ECC. Define SSH_SERVER_HOST_KEY_RSA to use the RSA 2048
+ * key instead; it is still loaded and checked once, but gets nothing
+ * from FP_ECC, as only ECDH key exchanges use the curve tables then. */
+/* #define SSH_SERVER_HOST_KEY_RSA */
+
+/* largest DER host key kept in the cache */
+#ifndef HOST_KEY_MAX_SZ
+    #define HOST_KEY_MAX_SZ 1200
+#endif
+
+/*
+ * The server host key is loaded and checked once, at boot, rather than
+ * each time a listener is set up. For an ECC key built with FP_ECC, two
+ * signatures are also made so the fixed-point table for the curve base
+ * point is ready before the first client connects; every later host-key
+ * signature and ephemeral ECDH key in any session then uses it. Two,
+ * because wolfCrypt only builds the table the second time a base point
+ * is used.
+ *
+ * HostKeyInit may be called more than once; only the first call works.
+ * Returns 0 on success.
+ */
+int HostKeyInit(void);
+
+/* non-zero when the cached host key is ECC */
+int HostKeyIsEcc(void);
+
+/* give the cached host key to ctx; calls HostKeyInit if needed.
+ * Returns 0 on success. */
+int HostKeyUse(WOLFSSH_CTX* ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _HOST_KEY_H_ */
@@ -0,0 +1,76 @@
+/* kex_pool.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _KEX_POOL_H_
+#define _KEX_POOL_H_
+
+/* make sure this appears before any other wolfSSL headers */
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* stack for the background task; a key generation needs about as much
+ * as the host key check that runs on the main task at boot */
+#ifndef KEX_POOL_STACK_SIZE
+    #define KEX_POOL_STACK_SIZE (6 * 1024)
+#endif
+
+/* wait after a key exchange before refilling, so the refill does not
+ * compete with the rest of that handshake */
+#ifndef KEX_POOL_SETTLE_MS
+    #define KEX_POOL_SETTLE_MS 1000
+#endif
+
+/*
+ * wolfSSH makes each ephemeral ECDH key itself, inside wolfSSH_accept and
+ * again on every rekey, and has no way to be handed one made earlier.
+ * Most of the cost of such a key is the multiply of the curve base point,
+ * and with FP_ECC that is what can be done ahead: a task at idle priority
+ * makes throwaway keys on every ECDH curve this build offers, so each
+ * curve has its fixed-point table before a client needs it. The client's
+ * public point uses the same cache and can push a table out, so the task
+ * refills after each key exchange. Without FP_ECC there is nothing to
+ * keep, and curve25519 and DH have no such table: when wolfSSL is built
+ * with curve25519, curve25519-sha256 is the key exchange wolfSSH and
+ * OpenSSH prefer, and the pool only helps clients that settle on an
+ * ecdh-sha2-nistp one. With SINGLE_THREADED the cache has no mutex, so
+ * the pool is compiled out. That is the default build, with
+ * CONFIG_SSH_SERVER_MAX_SESSIONS of 1; KexPoolInit logs a warning there
+ * when FP_ECC is on, as the tables are then built by the first handshake
+ * that needs them.
+ *
+ * KexPoolInit starts the task, once; call it after HostKeyInit. Returns 0
+ * on success, including when there is nothing to do.
+ */
+int KexPoolInit(void);
+
+/* A key exchange has just finished on ssh, the first or a rekey, as
+ * reported by the wolfSSH keying completion callback; refill once it
+ * settles, if ssh negotiated an ECDH curve. Safe to call from any task,
+ * and does nothing before KexPoolInit. */
+void KexPoolRefill(WOLFSSH* ssh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _KEX_POOL_H_ */
@@ -0,0 +1,92 @@
+/* ring_buffer.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _RING_BUFFER_H_
+#define _RING_BUFFER_H_
+
+/* Note this header has no RTOS dependencies so that the ring can also be
+ * compiled on a host for testing. */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Single-producer, single-consumer lock-free byte ring.
+ *
+ * Exactly one task may call the producer function (ring_buffer_write) and
+ * exactly one task may call the consumer functions (ring_buffer_read,
+ * ring_buffer_peek, ring_buffer_consume, ring_buffer_discard).
+ *
+ * The head index is only ever written by the producer, the tail index only
+ * by the consumer. Both run freely and are masked on access, so the
+ * capacity must be a power of two.
+ */
+typedef struct ring_buffer_t {
+    uint8_t*      data;
+    size_t        mask; /* capacity - 1 */
+    atomic_size_t head; /* next write position; owned by the producer */
+    atomic_size_t tail; /* next read position; owned by the consumer */
+} ring_buffer_t;
+
+/* static initializer, for rings that must be usable before any task runs */
+#define RING_BUFFER_INIT(storage, capacity) \
+    { (uint8_t*)(storage), (size_t)(capacity) - 1, 0, 0 }
+
+/* returns zero on success, non-zero when capacity is not a power of two */
+int ring_buffer_init(ring_buffer_t* rb, uint8_t* storage, size_t capacity);
+
+size_t ring_buffer_capacity(const ring_buffer_t* rb);
+
+/* Number of bytes waiting. Exact for the consumer; for the producer the
+ * value can only grow stale downward as the consumer drains. */
+size_t ring_buffer_used(ring_buffer_t* rb);
+
+/* Number of bytes that can be written. Exact for the producer. */
+size_t ring_buffer_free(ring_buffer_t* rb);
+
+/* Producer: append up to sz bytes; returns the number actually written. */
+size_t ring_buffer_write(ring_buffer_t* rb, const uint8_t* data, size_t sz);
+
+/* Consumer: copy out up to sz bytes; returns the number actually read. */
+size_t ring_buffer_read(ring_buffer_t* rb, uint8_t* data, size_t sz);
+
+/* Consumer: point *data at the oldest contiguous readable region and
+ * return its length, without copying. Follow with ring_buffer_consume. */
+size_t ring_buffer_peek(ring_buffer_t* rb, const uint8_t** data);
+
+/* Consumer: as ring_buffer_peek, for the region starting skip bytes past
+ * the oldest; zero when fewer than skip bytes are waiting. */
+size_t ring_buffer_peek_at(ring_buffer_t* rb, size_t skip,
+                           const uint8_t** data);
+
+/* Consumer: release sz bytes previously returned by ring_buffer_peek. */
+void ring_buffer_consume(ring_buffer_t* rb, size_t sz);
+
+/* Consumer: drop everything currently waiting. */
+void ring_buffer_discard(ring_buffer_t* rb);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RING_BUFFER_H_ */
@@ -0,0 +1,66 @@
+/* session_pool.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SESSION_POOL_H_
+#define _SESSION_POOL_H_
+
+#include <freertos/FreeRTOS.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The session pool: SSH_SERVER_MAX_SESSIONS tasks, each with its own
+ * stack, all allocated once so heap use does not grow with the number of
+ * clients. A task sleeps until it is handed a client, runs it to the end,
+ * and then puts its slot back on the free list.
+ *
+ * Free slots wait in FIFO order. server_test takes one before each
+ * accept, so clients are handed to sessions in the order they connect;
+ * any beyond the cap wait in the listen backlog.
+ */
+
+/* runs one client to the end, on slot's task */
+typedef void (*SessionPoolRun)(int slot, void* arg);
+
+/* Create the tasks, once, each calling run(slot, arg) for every client it
+ * is handed. Returns 0 on success, including when already running. */
+int SessionPoolInit(SessionPoolRun run, void* arg);
+
+/* Wait up to ticks for a free slot, portMAX_DELAY for as long as it
+ * takes. Returns the slot, or -1. */
+int SessionPoolTake(TickType_t ticks);
+
+/* put back a slot taken for a client that never came, unused */
+void SessionPoolGive(int slot);
+
+/* wake slot's task to run the client now set up for it; the slot is free
+ * again once run returns */
+void SessionPoolStart(int slot);
+
+/* the number of slots free right now */
+int SessionPoolFree(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _SESSION_POOL_H_ */
@@ -47,15 +47,4 @@
 /* the main SSH Server demo*/
 void server_test(void *arg);
 
-/* External buffer functions used between RTOS tasks. (typically the UART)
- * TODO: Implement interrupts rather than polling */
-volatile char* __attribute__((optimize("O0"))) ExternalTransmitBuffer(void);
-volatile char* __attribute__((optimize("O0"))) ExternalReceiveBuffer(void);
-
-int ExternalTransmitBufferSz(void);
-int ExternalReceiveBufferSz(void);
-
-int Set_ExternalTransmitBufferSz(int n);
-int Set_ExternalReceiveBufferSz(int n);
-
 #endif /* _SSH_SERVER_H_ */
@@ -83,10 +83,12 @@
     /* reminder GPIO 34 to 39 are input only */
     #define TXD_PIN (GPIO_NUM_26)
     #define RXD_PIN (GPIO_NUM_36)
+    /* no RTS_PIN or CTS_PIN; define both here for SSH_UART_FLOW_CTRL */
 #elif defined (ULX3S)
     /* reminder GPIO 34 to 39 are input only */
     #define TXD_PIN (GPIO_NUM_32)
     #define RXD_PIN (GPIO_NUM_33)
+    /* no RTS_PIN or CTS_PIN; define both here for SSH_UART_FLOW_CTRL */
 #elif defined (SSH_HUZZAH_ESP8266)
     #define EX_UART_NUM UART_NUM_0
 #elif defined(CONFIG_IDF_TARGET_ESP8266)
@@ -103,8 +105,17 @@
     #ifndef GPIO_NUM_3
         #define GPIO_NUM_3 3
     #endif
+    #ifndef GPIO_NUM_4
+        #define GPIO_NUM_4 4
+    #endif
+    #ifndef GPIO_NUM_5
+        #define GPIO_NUM_5 5
+    #endif
     #define RXD_PIN (GPIO_NUM_1)
     #define TXD_PIN (GPIO_NUM_3)
+    /* used only with SSH_UART_FLOW_CTRL */
+    #define RTS_PIN (GPIO_NUM_4)
+    #define CTS_PIN (GPIO_NUM_5)
 #else
     #ifndef GPIO_NUM_17
         #define GPIO_NUM_17 17
@@ -112,8 +123,17 @@
     #ifndef GPIO_NUM_16
         #define GPIO_NUM_16 16
     #endif
+    #ifndef GPIO_NUM_18
+        #define GPIO_NUM_18 18
+    #endif
+    #ifndef GPIO_NUM_19
+        #define GPIO_NUM_19 19
+    #endif
     #define RXD_PIN (GPIO_NUM_16)
     #define TXD_PIN (GPIO_NUM_17)
+    /* used only with SSH_UART_FLOW_CTRL, as in the ESP-IDF uart_echo */
+    #define RTS_PIN (GPIO_NUM_18)
+    #define CTS_PIN (GPIO_NUM_19)
 #endif
 
 /* Optionally disable the entire UART component: */
@@ -150,6 +170,129 @@
 #endif
 #define SCRATCH_BUFFER_SZ 1200
 
+/* server_worker sleeps in select() until there is traffic in either
+ * direction; this is only the upper bound, for housekeeping. */
+#ifndef SSH_SERVER_IDLE_TIMEOUT_MS
+    #define SSH_SERVER_IDLE_TIMEOUT_MS 1000
+#endif
+
+/* Flow control. Data from an SSH client is only read from wolfSSH as the
+ * UART buffer has room for it, and wolfSSH only grants the client more
+ * channel window as it is read, so a slow UART holds the client back with
+ * no data lost. The window is what the UART sends in SSH_FLOW_WINDOW_MS
+ * at BAUD_RATE (10 bits a byte), within SSH_FLOW_WINDOW_MIN and
+ * SSH_FLOW_WINDOW_MAX. A client whose round trip is shorter than that
+ * keeps the UART at line rate, and no key press, such as a Ctrl-C, waits
+ * longer than that behind a paste. The round trip itself isn't known to
+ * the server, so this budget stands in for it. Set SSH_FLOW_WINDOW_SZ to
+ * choose the window directly. */
+#ifndef SSH_FLOW_WINDOW_MS
+    #define SSH_FLOW_WINDOW_MS 200
+#endif
+#ifndef SSH_FLOW_WINDOW_MIN
+    #define SSH_FLOW_WINDOW_MIN 2048
+#endif
+#ifndef SSH_FLOW_WINDOW_MAX
+    #define SSH_FLOW_WINDOW_MAX 16384
+#endif
+#define SSH_FLOW_WINDOW_LINE(baud) \
+    ((baud) / 10 * SSH_FLOW_WINDOW_MS / 1000)
+#define SSH_FLOW_WINDOW_FOR(baud) \
+    ((SSH_FLOW_WINDOW_LINE(baud) < SSH_FLOW_WINDOW_MIN) ? \
+        SSH_FLOW_WINDOW_MIN : \
+     (SSH_FLOW_WINDOW_LINE(baud) > SSH_FLOW_WINDOW_MAX) ? \
+        SSH_FLOW_WINDOW_MAX : SSH_FLOW_WINDOW_LINE(baud))
+#ifndef SSH_FLOW_WINDOW_SZ
+    #define SSH_FLOW_WINDOW_SZ SSH_FLOW_WINDOW_FOR(BAUD_RATE)
+#endif
+
+/* UART hardware flow control: 0 off, 1 RTS/CTS on RTS_PIN and CTS_PIN,
+ * set with TXD_PIN and RXD_PIN above. With CTS, a device that can't keep
+ * up holds off uart_tx_task, and that in turn holds off the SSH client as
+ * above. */
+#ifndef SSH_UART_FLOW_CTRL
+    #define SSH_UART_FLOW_CTRL 0
+#endif
+
+/* Escape character for OpenSSH style commands typed at the start of a
+ * line: ~. disconnects, ~R rekeys, ~# shows statistics, ~? lists them. An
+ * OpenSSH client acts on ~ itself, so type ~~ there to reach the server,
+ * or choose another character. 0 turns escapes off; all other bytes,
+ * Ctrl-C included, always go to the UART. */
+#ifndef SSH_SERVER_ESCAPE_CHAR
+    #define SSH_SERVER_ESCAPE_CHAR '~'
+#endif
+
+/* UART output is batched into fuller SSH packets, see coalesce.h. It is
+ * sent once SSH_COALESCE_MAX_SZ bytes are waiting, or the oldest has
+ * waited SSH_COALESCE_DELAY_US; at once after a quiet spell (such as an
+ * echoed key press), on a newline when SSH_COALESCE_NEWLINE is set, or
+ * when it ends with one of SSH_COALESCE_PROMPTS. A delay of 0 turns
+ * batching off. */
+#ifndef SSH_COALESCE_MAX_SZ
+    #define SSH_COALESCE_MAX_SZ 1024
+#endif
+#ifndef SSH_COALESCE_DELAY_US
+    #define SSH_COALESCE_DELAY_US 5000
+#endif
+#ifndef SSH_COALESCE_NEWLINE
+    #define SSH_COALESCE_NEWLINE 1
+#endif
+/* ": " is not a prompt here: every ESP-IDF log line has one after its
+ * tag. A "Password: " waits out the delay instead. */
+#ifndef SSH_COALESCE_PROMPTS
+    #define SSH_COALESCE_PROMPTS { "$ ", "# ", "> ", NULL }
+#endif
+
+/* The listening socket, SSH CTX and credentials are kept between clients;
+ * this is only the wait before trying again if setting them up fails. */
+#ifndef SSH_SERVER_RETRY_MS
+    #define SSH_SERVER_RETRY_MS 1000
+#endif
+
+/* Number of concurrent SSH sessions. Each one has its own pre-created task,
+ * stack and buffers, all allocated once; further clients wait in the listen
+ * backlog until a session ends. Set it in menuconfig, as wolfSSL is only
+ * built without SINGLE_THREADED when it is more than 1. */
+#ifndef SSH_SERVER_MAX_SESSIONS
+    #ifdef CONFIG_SSH_SERVER_MAX_SESSIONS
+        #define SSH_SERVER_MAX_SESSIONS CONFIG_SSH_SERVER_MAX_SESSIONS
+    #else
+        #define SSH_SERVER_MAX_SESSIONS 1
+    #endif
+#endif
+
+/* stack for each session task; see SERVER_SESSION_STACK_SIZE in main.h */
+#ifndef SSH_SESSION_STACK_SIZE
+    #define SSH_SESSION_STACK_SIZE (23 * 1024)
+#endif
+
+/* priority of the UART, listener and session tasks. One above idle, so
+ * the kex_pool task, which stays at idle, only runs when none of these
+ * has work to do. */
+#ifndef SSH_SERVER_TASK_PRIORITY
+    #define SSH_SERVER_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
+/* Translation of data from SSH clients on its way to the UART, see
+ * uart_map.h. Newline: 0 as is, 1 CR to CR LF, 2 LF to CR LF, 3 LF to CR.
+ * DEL: non-zero sends a real backspace instead of 0x7F. Other control
+ * bytes, apart from TAB, LF, CR, BS and ESC: 0 as is, 1 dropped,
+ * 2 sent as "^G" style text. */
+#ifndef SSH_UART_MAP_NEWLINE
+    #define SSH_UART_MAP_NEWLINE 0
+#endif
+#ifndef SSH_UART_MAP_DEL
+    #define SSH_UART_MAP_DEL 1
+#endif
+#ifndef SSH_UART_MAP_CTRL
+    #define SSH_UART_MAP_CTRL 0
+#endif
+
+#if SSH_SERVER_MAX_SESSIONS < 1
+    #error "SSH_SERVER_MAX_SESSIONS must be at least 1"
+#endif
+
 #ifdef  WOLFSSH_SERVER_IS_AP
     #ifdef WOLFSSH_SERVER_IS_STA
         #error "Concurrent WOLFSSH_SERVER_IS_AP and WOLFSSH_SERVER_IS_STA"
@@ -179,4 +322,8 @@ int ssh_server_config_init(void);
     #endif
 #endif
 
+#if SSH_UART_FLOW_CTRL && (!defined(RTS_PIN) || !defined(CTS_PIN))
+    #error "SSH_UART_FLOW_CTRL needs RTS_PIN and CTS_PIN"
+#endif
+
 #endif /* _SSH_SERVER_CONFIG_H_ */
@@ -21,26 +21,105 @@
 #define _TX_RX_BUFFER_H_
 
 #include <freertos/FreeRTOS.h>
-#include <freertos/semphr.h>
+#include <freertos/task.h>
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 
-/* TODO do these really need to be so big? probably not */
 /* Sizes for shared transmit and receive buffers, for
- * both external (typically UART) and SSH data streams */
+ * both external (typically UART) and SSH data streams.
+ * These are lock-free rings; sizes must be a power of two.
+ * There is one pair per SSH session, see SSH_SERVER_MAX_SESSIONS. */
 #define EXT_RX_BUF_MAX_SZ 2048
 #define EXT_TX_BUF_MAX_SZ 2048
 
+#if (EXT_RX_BUF_MAX_SZ & (EXT_RX_BUF_MAX_SZ - 1)) != 0
+    #error "EXT_RX_BUF_MAX_SZ must be a power of two"
+#endif
+#if (EXT_TX_BUF_MAX_SZ & (EXT_TX_BUF_MAX_SZ - 1)) != 0
+    #error "EXT_TX_BUF_MAX_SZ must be a power of two"
+#endif
+
 typedef uint8_t byte;
 
-int init_tx_rx_buffer(byte TxPin, byte RxPin);
+/*
+ * Each SSH session slot [session] has its own pair of buffers.
+ *
+ * The "Transmit" buffer carries data from the external device (UART) out
+ * to the SSH client: uart_rx_task is the only producer, and copies the
+ * same data to every attached session. That session's server_worker is
+ * the only consumer.
+ *
+ * The "Receive" buffer carries data from the SSH client to the external
+ * device: the session's server_worker is the only producer, uart_tx_task
+ * the only consumer of all of them.
+ *
+ * Each function below must only be called from the side noted.
+ */
+
+/* once at startup, before any task: create the Transmit data eventfds */
+int init_tx_rx_buffer_events(void);
+
+/* consumer (server_worker): attach [session] to the UART, reset its
+ * Transmit buffer and queue the welcome message */
+int init_tx_rx_buffer(int session, byte TxPin, byte RxPin);
+
+/* consumer (server_worker): detach [session]; UART data is no longer
+ * copied to it */
+void close_tx_rx_buffer(int session);
+
+/* producer (uart_rx_task): append to every attached session. Returns the
+ * number of bytes accepted by all of them. */
+int Set_ExternalTransmitBuffer(const byte *FromData, int sz);
+
+/* consumer (server_worker): bytes waiting to go to SSH */
+int ExternalTransmitBufferSz(int session);
+
+/* consumer (server_worker): an eventfd that becomes readable each time
+ * Set_ExternalTransmitBuffer adds data, or Receive space asked for with
+ * ExternalReceiveBuffer_WantSpace frees up, for use with select().
+ * Returns -1 before init_tx_rx_buffer_events. Clear it with
+ * ExternalTransmitBuffer_ClearEvent once reported readable. */
+int ExternalTransmitBuffer_EventFd(int session);
+void ExternalTransmitBuffer_ClearEvent(int session);
+
+/* consumer (server_worker): point *ToData at the oldest contiguous
+ * pending data without copying; returns its size. Release with
+ * Consume_ExternalTransmitBuffer once it has been sent. */
+int Get_ExternalTransmitBuffer(int session, byte **ToData);
+void Consume_ExternalTransmitBuffer(int session, int sz);
+
+/* consumer (server_worker): as Get_ExternalTransmitBuffer, for the data
+ * starting skip bytes past the oldest; zero when there is no more */
+int Peek_ExternalTransmitBuffer(int session, int skip, const byte **ToData);
+
+/* producer (server_worker): append, returns the number of bytes accepted */
+int Set_ExternalReceiveBuffer(int session, const byte *FromData, int sz);
+
+/* producer (server_worker): bytes Set_ExternalReceiveBuffer can take now.
+ * Reading no more than this from SSH is what holds the client back. */
+int ExternalReceiveBufferFree(int session);
 
-int Get_ExternalTransmitBuffer(byte **ToData);
+/* producer (server_worker): signal the session eventfd once uart_tx_task
+ * has drained the Receive buffer to half full or less. Check
+ * ExternalReceiveBufferFree again after asking, as the space may already
+ * be there. */
+void ExternalReceiveBuffer_WantSpace(int session);
 
-int Set_ExternalTransmitBuffer(byte *FromData, int sz);
+/* consumer (uart_tx_task): register the task to notify (with
+ * xTaskNotifyGive) each time Set_ExternalReceiveBuffer adds data */
+void ExternalReceiveBuffer_SetNotifyTask(TaskHandle_t task);
 
-int Set_ExternalReceiveBuffer(byte *FromData, int sz);
+/* consumer (uart_tx_task): bytes waiting to go to the UART, all sessions */
+int ExternalReceiveBufferSz(void);
 
-bool ExternalReceiveBuffer_IsChar(char charValue);
+/* consumer (uart_tx_task): point *ToData at the oldest contiguous pending
+ * data of one session, taking sessions in turn, without copying; returns
+ * its size, zero when there is none. Data that wraps around the end of a
+ * ring comes as a second region from the same session. Release with
+ * Consume_ExternalReceiveBuffer before the next call. */
+int Peek_ExternalReceiveBuffer(const byte **ToData);
+void Consume_ExternalReceiveBuffer(int sz);
 
 #endif /* _TX_RX_BUFFER_H_ */
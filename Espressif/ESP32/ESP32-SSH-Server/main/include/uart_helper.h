@@ -27,6 +27,38 @@
 #include <driver/uart.h>
 #include <driver/gpio.h>
 
+/* UART driver Rx ring size, in bytes */
+#ifndef UART_RX_DRIVER_BUF_SZ
+    #define UART_RX_DRIVER_BUF_SZ 2048
+#endif
+
+/* Depth of the UART driver event queue that uart_rx_task waits on */
+#ifndef UART_EVENT_QUEUE_SZ
+    #define UART_EVENT_QUEUE_SZ 20
+#endif
+
+/* Post a UART_DATA event once this many bytes sit in the Rx FIFO... */
+#ifndef UART_RX_FULL_THRESHOLD
+    #define UART_RX_FULL_THRESHOLD 64
+#endif
+
+/* ...or once the Rx line has been idle this many symbol times */
+#ifndef UART_RX_TIMEOUT_SYMBOLS
+    #define UART_RX_TIMEOUT_SYMBOLS 3
+#endif
+
+/* uart_tx_task sends SSH client data and frees it from the ring in
+ * pieces of at most this, so the session refills the ring while the rest
+ * is on the wire rather than after it has all gone */
+#ifndef UART_TX_PIECE_SZ
+    #define UART_TX_PIECE_SZ (EXT_RX_BUF_MAX_SZ / 4)
+#endif
+
+/* with SSH_UART_FLOW_CTRL, RTS is released at this Rx FIFO level */
+#ifndef UART_RX_FLOW_CTRL_THRESH
+    #define UART_RX_FLOW_CTRL_THRESH 100
+#endif
+
 void init_UART(void);
 
 void uart_send_welcome(void);
@@ -37,4 +69,8 @@ void uart_rx_task(void *arg);
 
 int sendData(const char* logName, const char* data);
 
+/* write sz bytes to the UART in one driver call; data may hold any byte
+ * value, including 0x00. Returns the number of bytes written. */
+int sendDataSz(const char* logName, const uint8_t* data, int sz);
+
 #endif /* _UART_HELPER_H_ */
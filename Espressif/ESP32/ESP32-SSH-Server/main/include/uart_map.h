@@ -0,0 +1,82 @@
+/* uart_map.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _UART_MAP_H_
+#define _UART_MAP_H_
+
+/* Note this header has no RTOS dependencies so that the map can also be
+ * compiled on a host for testing. */
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Byte translation for data on its way from the SSH client to the UART.
+ *
+ * Every input byte has an entry giving zero, one or two output bytes, so a
+ * byte can be dropped, replaced, or expanded (CR to CR LF, or a control
+ * byte to "^C" style text). Runs of bytes that are passed through as they
+ * are, the usual case, are found a word at a time and copied whole.
+ */
+typedef struct uart_map_t {
+    uint8_t out[256][2];
+    uint8_t len[256];  /* output bytes for each input byte, 0 to drop */
+    uint8_t ctrlOnly;  /* only bytes below 0x20 and DEL are changed */
+} uart_map_t;
+
+/* values for uart_map_config newline */
+#define UART_MAP_NL_KEEP    0 /* as is */
+#define UART_MAP_NL_CR_CRLF 1 /* CR becomes CR LF */
+#define UART_MAP_NL_LF_CRLF 2 /* LF becomes CR LF */
+#define UART_MAP_NL_LF_CR   3 /* LF becomes CR */
+
+/* values for uart_map_config ctrl, for control bytes other than
+ * TAB, LF, CR, BS and ESC */
+#define UART_MAP_CTRL_KEEP   0 /* as is */
+#define UART_MAP_CTRL_DROP   1 /* removed */
+#define UART_MAP_CTRL_ESCAPE 2 /* sent as "^" and a letter, e.g. "^G" */
+
+/* every byte maps to itself */
+void uart_map_init(uart_map_t* map);
+
+/* map byte in to outSz (0 to 2) bytes at out; returns non-zero on error */
+int uart_map_set(uart_map_t* map, uint8_t in, const uint8_t* out,
+                 size_t outSz);
+
+/* build the map from the rules above; del non-zero turns DEL into BS.
+ * Returns non-zero for an unknown rule. */
+int uart_map_config(uart_map_t* map, int newline, int del, int ctrl);
+
+/* length of the leading run of in that the map passes through unchanged */
+size_t uart_map_span(const uart_map_t* map, const uint8_t* in, size_t sz);
+
+/* Translate in to out in one pass, stopping when out is full. Returns the
+ * number of bytes written to out and sets *used to the number of input
+ * bytes taken. */
+size_t uart_map_apply(const uart_map_t* map, const uint8_t* in, size_t inSz,
+                      uint8_t* out, size_t outSz, size_t* used);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _UART_MAP_H_ */
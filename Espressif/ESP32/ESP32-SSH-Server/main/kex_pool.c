@@ -0,0 +1,188 @@
+/* kex_pool.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "kex_pool.h"
+
+#include <wolfssl/wolfcrypt/random.h>
+#ifdef HAVE_ECC
+    #include <wolfssl/wolfcrypt/ecc.h>
+#endif
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+#include <esp_timer.h>
+
+#include <string.h>
+
+#if defined(HAVE_ECC) && defined(FP_ECC) && !defined(SINGLE_THREADED)
+
+static const char* TAG = "kex_pool";
+
+/* the ECDH key exchange curves wolfSSH offers in this build */
+static const int kexPoolCurve[] = {
+#ifndef WOLFSSH_NO_ECDH_SHA2_NISTP256
+    ECC_SECP256R1,
+#endif
+#if defined(HAVE_ECC384) && !defined(WOLFSSH_NO_ECDH_SHA2_NISTP384)
+    ECC_SECP384R1,
+#endif
+#if defined(HAVE_ECC521) && !defined(WOLFSSH_NO_ECDH_SHA2_NISTP521)
+    ECC_SECP521R1,
+#endif
+    ECC_CURVE_INVALID
+};
+
+static StaticTask_t kexPoolTaskBuffer;
+static StackType_t  kexPoolStack[KEX_POOL_STACK_SIZE];
+static TaskHandle_t kexPoolTask = NULL;
+static WC_RNG       kexPoolRng;
+
+/* Make two throwaway keys on curveId, timing each into us[]; two, as
+ * explained in host_key.h. */
+static int kex_pool_fill(int curveId, int64_t* us)
+{
+    ecc_key key;
+    int keySz = wc_ecc_get_curve_size_from_id(curveId);
+    int ret = 0;
+    int i;
+
+    for (i = 0; ret == 0 && i < 2; i++) {
+        int64_t start = esp_timer_get_time();
+
+        ret = wc_ecc_init(&key);
+        if (ret == 0) {
+            ret = wc_ecc_make_key_ex(&kexPoolRng, keySz, &key, curveId);
+            wc_ecc_free(&key);
+        }
+        us[i] = esp_timer_get_time() - start;
+    }
+
+    return ret;
+}
+
+static void kex_pool_refill(int first)
+{
+    int64_t us[2];
+    int i;
+    int ret;
+
+    for (i = 0; kexPoolCurve[i] != ECC_CURVE_INVALID; i++) {
+        const char* name = wc_ecc_get_name(kexPoolCurve[i]);
+
+        ret = kex_pool_fill(kexPoolCurve[i], us);
+        if (ret != 0) {
+            ESP_LOGE(TAG, "Couldn't make a %s key: %d", name, ret);
+        }
+        else if (first) {
+            ESP_LOGI(TAG, "%s ephemeral key in %lld ms, then %lld ms "
+                          "with its table.",
+                          name, us[0] / 1000, us[1] / 1000);
+        }
+        else {
+            ESP_LOGD(TAG, "%s refilled in %lld ms.",
+                          name, (us[0] + us[1]) / 1000);
+        }
+
+        /* only the idle task shares this priority */
+        taskYIELD();
+    }
+}
+
+static void kex_pool_task(void* arg)
+{
+    int first = 1;
+
+    for (;;) {
+        kex_pool_refill(first);
+        first = 0;
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        /* let the key exchange that asked for this finish, and take any
+         * other requests made meanwhile along with it */
+        vTaskDelay(pdMS_TO_TICKS(KEX_POOL_SETTLE_MS));
+        ulTaskNotifyTake(pdTRUE, 0);
+    }
+}
+
+int KexPoolInit(void)
+{
+    int ret;
+
+    if (kexPoolTask != NULL || kexPoolCurve[0] == ECC_CURVE_INVALID) {
+        return 0;
+    }
+
+    ret = wc_InitRng(&kexPoolRng);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "Couldn't init RNG: %d", ret);
+        return ret;
+    }
+
+    kexPoolTask = xTaskCreateStatic(kex_pool_task, "kex_pool",
+                                    KEX_POOL_STACK_SIZE, NULL,
+                                    tskIDLE_PRIORITY, kexPoolStack,
+                                    &kexPoolTaskBuffer);
+    if (kexPoolTask == NULL) {
+        ESP_LOGE(TAG, "Couldn't create task.");
+        wc_FreeRng(&kexPoolRng);
+        return -1;
+    }
+
+    return 0;
+}
+
+void KexPoolRefill(WOLFSSH* ssh)
+{
+    char kex[32];
+
+    if (kexPoolTask == NULL || ssh == NULL) {
+        return;
+    }
+
+    /* curve25519 and DH never touch the fixed-point cache */
+    if (wolfSSH_GetText(ssh, WOLFSSH_TEXT_KEX_ALGO, kex, sizeof(kex)) == 0
+            || strncmp(kex, "ecdh-sha2-nistp", 15) != 0) {
+        return;
+    }
+
+    xTaskNotifyGive(kexPoolTask);
+}
+
+#else
+
+int KexPoolInit(void)
+{
+#if defined(HAVE_ECC) && defined(FP_ECC)
+    /* only SINGLE_THREADED gets here with FP_ECC */
+    ESP_LOGW("kex_pool", "Not started in a SINGLE_THREADED build; set "
+                         "SSH_SERVER_MAX_SESSIONS above 1 to keep the ECDH "
+                         "tables warm.");
+#endif
+    return 0;
+}
+
+void KexPoolRefill(WOLFSSH* ssh)
+{
+    (void)ssh;
+}
+
+#endif /* HAVE_ECC && FP_ECC && !SINGLE_THREADED */
@@ -68,6 +68,9 @@
 #endif
 
 #include "ssh_server.h"
+#include "tx_rx_buffer.h"
+#include "host_key.h"
+#include "kex_pool.h"
 
 /* logging
  *
@@ -85,15 +88,19 @@
 
 static const char *TAG = "SSH Server main";
 
-/* 10 seconds, used for heartbeat message in thread */
+/* 60 seconds, used for heartbeat message in thread */
 static TickType_t DelayTicks = (60000 / portTICK_PERIOD_MS);
 
 
 void server_session(void* args)
 {
+    TickType_t RetryTicks = (SSH_SERVER_RETRY_MS / portTICK_PERIOD_MS);
+
     while (1) {
+        /* server_test keeps its socket and CTX, and accepts clients
+         * forever; it only returns if that setup fails */
         server_test(args);
-        vTaskDelay(DelayTicks ? DelayTicks : 1); /* Minimum delay = 1 tick */
+        vTaskDelay(RetryTicks ? RetryTicks : 1); /* Minimum delay = 1 tick */
 
 #ifdef DEBUG_WDT
         /* if we get panic faults, perhaps the watchdog needs attention? */
@@ -192,6 +199,10 @@ int init(void)
     init_UART();
 #endif
 
+    /* per-session buffers; lets server_worker wake on UART data as well as
+     * on its socket */
+    init_tx_rx_buffer_events();
+
     /*
      * here we have one of three options:
      *
@@ -259,6 +270,19 @@ int init(void)
 
     ret = wolfSSH_Init();
 
+    /* parse the host key, and build any ECC tables, before the first
+     * client rather than during its handshake */
+    if (ret == WS_SUCCESS) {
+        if (HostKeyInit() != 0) {
+            ESP_LOGE(TAG, "Host key init failed; will retry at listen.");
+        }
+
+        /* and the tables for the key exchange curves, in the background */
+        if (KexPoolInit() != 0) {
+            ESP_LOGE(TAG, "Key exchange pool init failed.");
+        }
+    }
+
     return ret;
 }
 
@@ -325,6 +349,8 @@ void app_main(void)
 #ifdef ESP_ENABLE_WOLFSSH
     ESP_LOGI(TAG, "SSH DEFAULT_WINDOW_SZ:     %d bytes",
                    DEFAULT_WINDOW_SZ);
+    ESP_LOGI(TAG, "SSH channel window:        %d bytes",
+                   SSH_FLOW_WINDOW_SZ);
 #else
     #error "ESP_ENABLE_WOLFSSH ust be enabled for this project"
 #endif
@@ -337,24 +363,25 @@ void app_main(void)
      * See https://docs.espressif.com/projects/esp-idf/en/latest/esp32/api-reference/system/freertos.html#esp-idf-freertos-applications
      * Unlike Vanilla FreeRTOS, users must not call vTaskStartScheduler();
      *
-     * All of the tasks are at the same, highest idle priority, so they will
-     * all get equal attentiom when priority was set to
+     * All of the tasks are at the same priority, just above idle, so they
+     * will all get equal attention; the kex_pool task stays below them.
+     * When priority was set to
      *   configMAX_PRIORITIES - [1,2,3]
      * there was an odd WDT timeout warning.
      */
 #ifndef DISABLE_SSH_UART
     xTaskCreate(uart_rx_task, "uart_rx_task",
                 UART_RX_TASK_STACK_SIZE, NULL,
-                tskIDLE_PRIORITY, NULL);
+                SSH_SERVER_TASK_PRIORITY, NULL);
 
     xTaskCreate(uart_tx_task, "uart_tx_task",
                 UART_TX_TASK_STACK_SIZE, NULL,
-                tskIDLE_PRIORITY, NULL);
+                SSH_SERVER_TASK_PRIORITY, NULL);
 #endif
 
     xTaskCreate(server_session, "server_session",
                 SERVER_SESSION_STACK_SIZE, NULL,
-                tskIDLE_PRIORITY, NULL);
+                SSH_SERVER_TASK_PRIORITY, NULL);
 
 #ifndef NO_EXAMPLE_HEARTBEAT
     for (;;) {
@@ -0,0 +1,154 @@
+/* ring_buffer.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "ring_buffer.h"
+
+#include <string.h>
+
+/*
+ * Memory ordering:
+ *
+ * The producer fills the data area, then publishes the new head with
+ * release semantics. The consumer loads head with acquire semantics before
+ * touching the data, so it never sees bytes that were not yet copied.
+ * The same pairing on tail guarantees the producer never overwrites bytes
+ * the consumer is still reading.
+ */
+
+int ring_buffer_init(ring_buffer_t* rb, uint8_t* storage, size_t capacity)
+{
+    if (rb == NULL || storage == NULL || capacity == 0 ||
+        (capacity & (capacity - 1)) != 0) {
+        return 1;
+    }
+
+    rb->data = storage;
+    rb->mask = capacity - 1;
+    atomic_init(&rb->head, 0);
+    atomic_init(&rb->tail, 0);
+
+    return 0;
+}
+
+size_t ring_buffer_capacity(const ring_buffer_t* rb)
+{
+    return rb->mask + 1;
+}
+
+size_t ring_buffer_used(ring_buffer_t* rb)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+
+    return head - tail;
+}
+
+size_t ring_buffer_free(ring_buffer_t* rb)
+{
+    return ring_buffer_capacity(rb) - ring_buffer_used(rb);
+}
+
+size_t ring_buffer_write(ring_buffer_t* rb, const uint8_t* data, size_t sz)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_acquire);
+    size_t space = ring_buffer_capacity(rb) - (head - tail);
+    size_t offset = head & rb->mask;
+    size_t first;
+
+    if (sz > space) {
+        sz = space;
+    }
+    if (sz == 0) {
+        return 0;
+    }
+
+    /* copy up to the physical end of the storage, then wrap to the start */
+    first = ring_buffer_capacity(rb) - offset;
+    if (first > sz) {
+        first = sz;
+    }
+    memcpy(rb->data + offset, data, first);
+    memcpy(rb->data, data + first, sz - first);
+
+    atomic_store_explicit(&rb->head, head + sz, memory_order_release);
+
+    return sz;
+}
+
+size_t ring_buffer_peek(ring_buffer_t* rb, const uint8_t** data)
+{
+    return ring_buffer_peek_at(rb, 0, data);
+}
+
+size_t ring_buffer_peek_at(ring_buffer_t* rb, size_t skip,
+                           const uint8_t** data)
+{
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+    size_t used = head - tail;
+    size_t offset = (tail + skip) & rb->mask;
+    size_t contiguous = ring_buffer_capacity(rb) - offset;
+
+    *data = rb->data + offset;
+
+    if (skip >= used) {
+        return 0;
+    }
+    used -= skip;
+
+    return (used < contiguous) ? used : contiguous;
+}
+
+void ring_buffer_consume(ring_buffer_t* rb, size_t sz)
+{
+    size_t tail = atomic_load_explicit(&rb->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&rb->tail, tail + sz, memory_order_release);
+}
+
+size_t ring_buffer_read(ring_buffer_t* rb, uint8_t* data, size_t sz)
+{
+    size_t total = 0;
+
+    /* at most two passes: up to the end of storage, then after the wrap */
+    while (total < sz) {
+        const uint8_t* region;
+        size_t n = ring_buffer_peek(rb, &region);
+
+        if (n == 0) {
+            break;
+        }
+        if (n > sz - total) {
+            n = sz - total;
+        }
+        memcpy(data + total, region, n);
+        ring_buffer_consume(rb, n);
+        total += n;
+    }
+
+    return total;
+}
+
+void ring_buffer_discard(ring_buffer_t* rb)
+{
+    size_t head = atomic_load_explicit(&rb->head, memory_order_acquire);
+
+    atomic_store_explicit(&rb->tail, head, memory_order_release);
+}
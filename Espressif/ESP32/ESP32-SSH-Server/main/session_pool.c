@@ -0,0 +1,148 @@
+/* session_pool.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "session_pool.h"
+#include "ssh_server_config.h"
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+
+#include <esp_log.h>
+
+#include <stdio.h>
+
+static const char* TAG = "session_pool";
+
+typedef struct {
+    int slot;
+    TaskHandle_t task;
+} session_pool_slot_t;
+
+static session_pool_slot_t sessionSlot[SSH_SERVER_MAX_SESSIONS];
+static StaticTask_t  sessionTaskBuffer[SSH_SERVER_MAX_SESSIONS];
+static StackType_t   sessionStack[SSH_SERVER_MAX_SESSIONS]
+                                 [SSH_SESSION_STACK_SIZE];
+static StaticQueue_t sessionFreeSlotsBuffer;
+static uint8_t       sessionFreeSlotsStorage[SSH_SERVER_MAX_SESSIONS
+                                             * sizeof(int)];
+static QueueHandle_t sessionFreeSlots = NULL;
+
+static SessionPoolRun sessionRun = NULL;
+static void*          sessionRunArg = NULL;
+
+static void session_pool_task(void* arg)
+{
+    session_pool_slot_t* s = (session_pool_slot_t*)arg;
+
+    /* this RTOS task will never exit */
+    while (1) {
+        /* sleep until server_test hands over an accepted client */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        sessionRun(s->slot, sessionRunArg);
+
+#ifdef INCLUDE_uxTaskGetStackHighWaterMark
+        ESP_LOGI(TAG, "Session %d stack HWM: %d bytes", s->slot,
+                      uxTaskGetStackHighWaterMark(NULL));
+#endif
+
+        xQueueSend(sessionFreeSlots, &s->slot, portMAX_DELAY);
+    }
+}
+
+int SessionPoolInit(SessionPoolRun run, void* arg)
+{
+    int i;
+
+    if (sessionFreeSlots != NULL) {
+        /* already running from a prior server_test */
+        return 0;
+    }
+    if (run == NULL) {
+        return -1;
+    }
+    sessionRun = run;
+    sessionRunArg = arg;
+
+    sessionFreeSlots = xQueueCreateStatic(SSH_SERVER_MAX_SESSIONS,
+                                          sizeof(int),
+                                          sessionFreeSlotsStorage,
+                                          &sessionFreeSlotsBuffer);
+    if (sessionFreeSlots == NULL) {
+        ESP_LOGE(TAG, "Couldn't create session pool queue.");
+        return -1;
+    }
+
+    for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+        session_pool_slot_t* s = &sessionSlot[i];
+        char name[configMAX_TASK_NAME_LEN];
+
+        s->slot = i;
+        snprintf(name, sizeof(name), "ssh_session_%d", i);
+        s->task = xTaskCreateStatic(session_pool_task, name,
+                                    SSH_SESSION_STACK_SIZE, s,
+                                    SSH_SERVER_TASK_PRIORITY,
+                                    sessionStack[i], &sessionTaskBuffer[i]);
+        if (s->task == NULL) {
+            ESP_LOGE(TAG, "Couldn't create session task %d.", i);
+            return -1;
+        }
+
+        xQueueSend(sessionFreeSlots, &i, 0);
+    }
+
+    ESP_LOGI(TAG, "Session pool ready: %d sessions, %d byte stacks.",
+                  SSH_SERVER_MAX_SESSIONS, SSH_SESSION_STACK_SIZE);
+    return 0;
+}
+
+int SessionPoolTake(TickType_t ticks)
+{
+    int slot = -1;
+
+    if (sessionFreeSlots == NULL ||
+        xQueueReceive(sessionFreeSlots, &slot, ticks) != pdTRUE) {
+        return -1;
+    }
+    return slot;
+}
+
+void SessionPoolGive(int slot)
+{
+    if (sessionFreeSlots != NULL &&
+        slot >= 0 && slot < SSH_SERVER_MAX_SESSIONS) {
+        xQueueSend(sessionFreeSlots, &slot, 0);
+    }
+}
+
+void SessionPoolStart(int slot)
+{
+    if (slot >= 0 && slot < SSH_SERVER_MAX_SESSIONS &&
+        sessionSlot[slot].task != NULL) {
+        xTaskNotifyGive(sessionSlot[slot].task);
+    }
+}
+
+int SessionPoolFree(void)
+{
+    return (sessionFreeSlots != NULL) ?
+           (int)uxQueueMessagesWaiting(sessionFreeSlots) : 0;
+}
@@ -45,16 +45,30 @@
 
 /* Espressif */
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
+
+#include <errno.h>
 
 /* Project */
 #include "ssh_server_config.h"
 #include "ssh_server.h"
 #include "tx_rx_buffer.h"
+#include "credential_store.h"
+#include "host_key.h"
+#include "coalesce.h"
+#include "escape.h"
+#include "kex_pool.h"
+#include "session_pool.h"
+
+#if defined(SINGLE_THREADED) && (SSH_SERVER_MAX_SESSIONS > 1)
+    #error "SSH_SERVER_MAX_SESSIONS > 1 needs wolfSSL without SINGLE_THREADED"
+#endif
 
-
-/* note our actual buffer is used by RTOS threads, and eventually interrupts */
-static volatile byte sshStreamTransmitBufferArray[EXT_TX_BUF_MAX_SZ];
-static volatile byte sshStreamReceiveBufferArray[EXT_RX_BUF_MAX_SZ];
+#if SSH_COALESCE_MAX_SZ > EXT_TX_BUF_MAX_SZ / 2
+    #error "SSH_COALESCE_MAX_SZ must leave room in the Transmit ring"
+#endif
 
 static const char* TAG = "ssh_server";
 
@@ -89,6 +103,9 @@ static const char samplePublicKeyRsaBuffer[] =
     "biE57dK6BrH5iZwVLTQKux31uCJLPhiktI3iLbdlGZEctJkTasfVSsUizwVIyRjhVKmbdI"
     "RGwkU38D043AR1h0mUoGCPIKuqcFMf gretel\n";
 
+/* output that ends with one of these is sent at once, see coalesce.h */
+static const char* const sshCoalescePrompts[] = SSH_COALESCE_PROMPTS;
+
 /* #define SSH_SERVER_PROFILE */
 
 #ifdef SSH_SERVER_PROFILE
@@ -96,60 +113,30 @@ static const char samplePublicKeyRsaBuffer[] =
     static int MaxSeenTxSize = 0;
 #endif
 
-/* Show HW lockdepth. Oddities here are often a symptom of stack overflow. */
-#if !defined(NO_WOLFSSL_ESP32_CRYPT_HASH) && \
-     defined(WOLFSSL_ESP32_HW_LOCK_DEBUG)
-    #define SSH_SERVER_DEBUG_LOCKDEPTH
-#endif
-/* Map user names to passwords */
-/* Use arrays for username and p. The password or public key can
- * be hashed and the hash stored here. Then I won't need the type. */
-typedef struct PwMap {
-    byte type;
-    byte username[32];
-    word32 usernameSz;
-    byte p[WC_SHA256_DIGEST_SIZE];
-    struct PwMap* next;
-} PwMap;
-
-
-typedef struct PwMapList {
-    PwMap* head;
-} PwMapList;
-
-
 typedef struct {
     WOLFSSH* ssh;
     int fd;
     word32 id;
     char nonBlock;
-} thread_ctx_t;
 
+    /* session pool slot; also selects the external buffers to use */
+    int slot;
+    int64_t acceptTime; /* esp_timer_get_time() when the client connected */
 
-/* find a byte character [str] of length [bufSz] within [buf];
- * returns byte position if found, otherwise zero
- */
-static byte find_char(const byte* str, const byte* buf, word32 bufSz)
-{
-    int ret = 0;
-    const byte* cur;
-    while (bufSz && (ret == 0) && (ret < 255)) {
-        cur = str;
-        while (*cur != '\0') {
-            if (*cur == *buf) {
-                ret = *cur;
-            }
-            cur++;
-        }
-        buf++;
-        bufSz--;
-    }
-    if (ret == 255) {
-        ESP_LOGE(TAG, "find_char not found in 254 chars");
-    }
+    /* when to send UART data waiting in the external transmit ring */
+    coalesce_t coalesce;
 
-    return ret;
-}
+    /* escape sequences, such as ~. to disconnect, in client data */
+    escape_t escape;
+
+    /* client data is being left with wolfSSH, and so the client held to
+     * its window, until the UART drains enough to take it */
+    int rxHeld;
+
+    /* Local landing area for wolfSSH_stream_read. Data going the other way
+     * (UART to SSH) is sent directly from the external transmit ring. */
+    byte rxBuf[EXT_RX_BUF_MAX_SZ];
+} thread_ctx_t;
 
 
 static int dump_stats(thread_ctx_t* ctx)
@@ -231,15 +218,334 @@ static int NonBlockSSH_accept(WOLFSSH* ssh)
 
 
 /*
- * server_worker is the main thread for a given SSH connection
+ * Send everything waiting in the external transmit buffer (typically from
+ * the UART) to the SSH client, straight out of the ring; no copy.
+ *
+ * Sets *wantWrite when the socket could not take it all, so the caller
+ * can wait for it to become writable. Returns 1 when the session should
+ * stop, otherwise 0.
+ */
+static int server_worker_send_external(thread_ctx_t* threadCtx,
+                                       int* wantWrite)
+{
+    byte* sshStreamTransmitBuffer = NULL;
+    int thisSize;
+    int sentSz;
+
+    *wantWrite = 0;
+
+    /* At most two passes are needed per drain: up to the end of the ring
+     * storage, then again after the wrap. Only this thread consumes from
+     * that ring, so the data pointed to will not change underneath us. */
+    while ((thisSize = Get_ExternalTransmitBuffer(threadCtx->slot,
+                           &sshStreamTransmitBuffer)) > 0) {
+        ESP_LOGV(TAG,"Tx UART!");
+        sentSz = wolfSSH_stream_send(threadCtx->ssh,
+                                     sshStreamTransmitBuffer,
+                                     thisSize);
+        if (sentSz > 0) {
+            Consume_ExternalTransmitBuffer(threadCtx->slot, sentSz);
+            coalesce_sent(&threadCtx->coalesce, (size_t)sentSz,
+                          (size_t)ExternalTransmitBufferSz(threadCtx->slot),
+                          esp_timer_get_time());
+        }
+        else {
+            sentSz = wolfSSH_get_error(threadCtx->ssh);
+            if (sentSz == WS_WANT_WRITE) {
+                *wantWrite = 1;
+            }
+            else if (sentSz != WS_WANT_READ && sentSz != WS_REKEYING) {
+                ESP_LOGE(TAG, "wolfSSH_stream_send error!");
+                return 1;
+            }
+            /* leave the data in the ring and try again later */
+            break;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Pass UART data that arrived since the last look to the coalescer, then
+ * send what is waiting if it says so. Otherwise *waitUs is set to how
+ * long the data may still wait. Returns 1 when the session should stop.
+ */
+static int server_worker_flush_external(thread_ctx_t* threadCtx,
+                                        int* wantWrite, int64_t* waitUs)
+{
+    coalesce_t* co = &threadCtx->coalesce;
+    const byte* data = NULL;
+    int64_t now = esp_timer_get_time();
+    int pending;
+    int sz;
+
+    *waitUs = 0;
+
+    /* the new data is in at most two pieces, either side of the wrap */
+    while ((sz = Peek_ExternalTransmitBuffer(threadCtx->slot,
+                                             (int)co->scanned, &data)) > 0) {
+        coalesce_scan(co, data, (size_t)sz, now);
+    }
+
+    pending = ExternalTransmitBufferSz(threadCtx->slot);
+    if (pending <= 0) {
+        *wantWrite = 0;
+        return 0;
+    }
+
+    *waitUs = coalesce_wait(co, (size_t)pending, now);
+    if (*waitUs > 0) {
+        *wantWrite = 0;
+        return 0;
+    }
+
+    return server_worker_send_external(threadCtx, wantWrite);
+}
+
+/*
+ * Pass data from the SSH client on to the external receive buffer
+ * (typically for the UART), less any escape sequences, which are acted on
+ * here. Returns 1 when the session should stop, otherwise 0.
+ */
+static int server_worker_escape(thread_ctx_t* threadCtx,
+                                const byte* buf, int sz)
+{
+    static const char help[] =
+        "\r\nSupported escape sequences:\r\n"
+        "  ~.  - disconnect\r\n"
+        "  ~R  - request rekey\r\n"
+        "  ~#  - session statistics\r\n"
+        "  ~?  - this message\r\n"
+        "  ~~  - send the escape character\r\n"
+        "(Escapes are only recognized immediately after newline.)\r\n";
+    size_t done = 0;
+    int stop = 0;
+
+    while ((done < (size_t)sz) && !stop) {
+        const byte* out = NULL;
+        size_t outSz = 0;
+        int cmd = ESCAPE_CMD_NONE;
+
+        done += escape_next(&threadCtx->escape, buf + done,
+                            (size_t)sz - done, &out, &outSz, &cmd);
+
+        /* Any prior data not yet sent to the UART is kept; this appends
+         * after it. */
+        if (outSz > 0 &&
+            Set_ExternalReceiveBuffer(threadCtx->slot, out,
+                                      (int)outSz) != (int)outSz) {
+            /* server_worker_read_ssh only reads what fits, so this is
+             * data lost, not a UART that is busy */
+            ESP_LOGE(TAG, "Session %d: UART buffer overrun.",
+                     threadCtx->slot);
+            stop = 1;
+            break;
+        }
+
+        switch (cmd) {
+
+        case ESCAPE_CMD_DISCONNECT:
+            ESP_LOGI(TAG, "Session %d: escape disconnect.", threadCtx->slot);
+            stop = 1;
+            break;
+
+        case ESCAPE_CMD_REKEY:
+            /* the kex pool refills once it completes, server_keying_done */
+            if (wolfSSH_TriggerKeyExchange(threadCtx->ssh) != WS_SUCCESS) {
+                stop = 1;
+            }
+            break;
+
+        case ESCAPE_CMD_STATS:
+            if (dump_stats(threadCtx) <= 0) {
+                stop = 1;
+            }
+            break;
+
+        case ESCAPE_CMD_HELP:
+            if (wolfSSH_stream_send(threadCtx->ssh, (byte*)help,
+                                    sizeof(help) - 1) <= 0) {
+                stop = 1;
+            }
+            break;
+        }
+    }
+
+    return stop;
+}
+
+/*
+ * How much client data can be read now: what fits in the landing area and
+ * in the external receive buffer, less one byte for an escape character
+ * that server_worker_escape may have held back.
+ */
+static int server_worker_rx_room(thread_ctx_t* threadCtx, int backlogSz)
+{
+    int room = (int)sizeof(threadCtx->rxBuf) - backlogSz - 1;
+    int ringFree = ExternalReceiveBufferFree(threadCtx->slot) - 1;
+
+    return (ringFree < room) ? ringFree : room;
+}
+
+/*
+ * While client data is held back, still let wolfSSH process what arrives
+ * on the socket, such as window adjusts for the data we send, and channel
+ * data within the window already granted. No channel data is taken, so
+ * no more window is granted. Returns 1 when the session should stop.
+ */
+static int server_worker_poll_ssh(thread_ctx_t* threadCtx)
+{
+    int ret = wolfSSH_worker(threadCtx->ssh, NULL);
+
+    if (ret < 0) {
+        ret = wolfSSH_get_error(threadCtx->ssh);
+    }
+
+    switch (ret) {
+        case WS_SUCCESS:
+        case WS_CHAN_RXD:
+        case WS_WANT_READ:
+        case WS_WANT_WRITE:
+        case WS_REKEYING:
+        case WS_WINDOW_FULL:
+            return 0;
+        default:
+            ESP_LOGE(TAG, "wolfSSH_worker error %d", ret);
+            return 1;
+    }
+}
+
+/*
+ * Read everything wolfSSH has for us, after the socket was reported
+ * readable, and pass it on to the external receive buffer (typically for
+ * the UART). Only as much is read as that buffer has room for: wolfSSH
+ * grants the client more channel window only as data is read, so a slow
+ * UART holds the client back rather than losing data. When out of room,
+ * threadCtx->rxHeld is set and the session eventfd is signalled once the
+ * UART has drained. Returns 1 when the session should stop, otherwise 0.
+ */
+static int server_worker_read_ssh(thread_ctx_t* threadCtx, int* backlogSz)
+{
+    byte* this_rx_buf = threadCtx->rxBuf;
+    int rxSz, txSz, txSum;
+    int room;
+    int stop = 0;
+
+    while (!stop) {
+        room = server_worker_rx_room(threadCtx, *backlogSz);
+        if (room <= 0) {
+            /* ask, then look again, so a drain in between is not missed */
+            ExternalReceiveBuffer_WantSpace(threadCtx->slot);
+            room = server_worker_rx_room(threadCtx, *backlogSz);
+            if (room <= 0) {
+                threadCtx->rxHeld = 1;
+                break;
+            }
+        }
+
+        /* when polling, debugging can be verbose, turn it off */
+        #ifdef DEBUG_WOLFSSH
+            ESP_LOGV(TAG, "wolfSSH debugging off.");
+            wolfSSH_Debugging_OFF();
+        #endif
+
+        /* The socket is non-blocking; this returns WS_WANT_READ once
+         * everything already received has been processed. */
+        rxSz = wolfSSH_stream_read(threadCtx->ssh,
+                                   this_rx_buf + *backlogSz, room);
+
+        /* turn debugging back on */
+        #ifdef DEBUG_WOLFSSH
+            ESP_LOGV(TAG, "wolfSSH debugging on.");
+            wolfSSH_Debugging_ON();
+        #endif
+
+        if (rxSz <= 0) {
+            rxSz = wolfSSH_get_error(threadCtx->ssh);
+            if (rxSz == WS_WANT_READ || rxSz == WS_WANT_WRITE) {
+                /* nothing more for now */
+                threadCtx->rxHeld = 0;
+                break;
+            }
+
+            /*  any other value is an error, or the peer closed */
+            ESP_LOGE(TAG, "wolfSSH_stream_read error!");
+            stop = 1;
+            break;
+        }
+
+#if defined(DISABLE_SSH_UART)
+        this_rx_buf[rxSz] = 0;
+        /* printf is not ideal for embedded, but here for demo
+         * output only. setvbuf should have been set to flush
+         * output immediately:*/
+        printf("%s", this_rx_buf);
+        continue;
+#else
+        ESP_LOGV(TAG, "Received %d bytes from client.", rxSz);
+#endif
+
+        /* Append external data, for something such as
+         * UART forwarding, and act on any escape sequence.
+         */
+        stop = server_worker_escape(threadCtx, this_rx_buf + *backlogSz,
+                                    rxSz);
+
+        *backlogSz += rxSz;
+        txSum = 0;
+        txSz = 0;
+
+        while (*backlogSz != txSum && txSz >= 0 && !stop) {
+            /* we typically do NOT want to re-echo TTY data
+             * but it can be configured to do so by setting
+             * SSH_SERVER_ECHO to a value of 1
+             **/
+            if (SSH_SERVER_ECHO == 1) {
+                /* reminder we moved data from external buffer
+                 * to our local buf, and this is ECHO
+                 */
+                txSz = wolfSSH_stream_send(threadCtx->ssh,
+                                           this_rx_buf + txSum,
+                                           *backlogSz - txSum);
+            }
+            else {
+                txSz = *backlogSz - txSum;
+            }
+
+            if (txSz > 0) {
+                txSum += txSz;
+            }
+            else if (txSz != WS_REKEYING) {
+                stop = 1;
+            }
+
+            #ifdef SSH_SERVER_WDT_RESET
+            {
+                esp_task_wdt_reset();
+            }
+            #endif
+        } /* while */
+
+        if (txSum < *backlogSz) {
+            memmove(this_rx_buf,
+                    this_rx_buf + txSum,
+                    *backlogSz - txSum);
+        }
+        *backlogSz -= txSum;
+    }
+
+    return stop;
+}
+
+/*
+ * server_worker runs a given SSH connection, in its session pool task
  */
 static THREAD_RETURN WOLFSSH_THREAD server_worker(void* vArgs)
 {
     int ret;
 
-    /* we'll create a local instance of threadCtx since it will be
-     * handed off to potentially multiple separate threads
-     */
+    /* each session pool slot has its own threadCtx */
     thread_ctx_t* threadCtx = (thread_ctx_t*)vArgs;
 
 #if defined(WOLFSSH_SCP) && defined(NO_FILESYSTEM)
@@ -269,252 +575,115 @@ static THREAD_RETURN WOLFSSH_THREAD server_worker(void* vArgs)
         ret = NonBlockSSH_accept(threadCtx->ssh);
 
     if (ret == WS_SUCCESS) {
-        byte* this_rx_buf = NULL;
-
-        int backlogSz = 0, rxSz, txSz, stop = 0, txSum;
+        int backlogSz = 0, stop = 0, wantWrite = 0;
+        int64_t waitUs = 0;
+        int sshFd = threadCtx->fd;
+        int extFd = ExternalTransmitBuffer_EventFd(threadCtx->slot);
+
+        init_tx_rx_buffer(threadCtx->slot, TXD_PIN, RXD_PIN);
+        coalesce_reset(&threadCtx->coalesce);
+        escape_init(&threadCtx->escape, SSH_SERVER_ESCAPE_CHAR);
+        threadCtx->rxHeld = 0;
+
+        /* The loop below waits in select(), so reads must never block. */
+        if (!threadCtx->nonBlock) {
+            tcp_set_nonblocking(&sshFd);
+        }
 
-        init_tx_rx_buffer(TXD_PIN, RXD_PIN);
+        /* the welcome message is already waiting to be sent */
+        stop = server_worker_send_external(threadCtx, &wantWrite);
+        ESP_LOGI(TAG, "Session %d ready %lld ms after accept.",
+                      threadCtx->slot,
+                      (esp_timer_get_time() - threadCtx->acceptTime) / 1000);
 
         /*
          * we'll stay in this loop then entire time this worker thread has
-         * a valid SSH connection open
+         * a valid SSH connection open. Each pass sleeps until either the
+         * SSH socket is readable (or writable, if output is backed up), or
+         * the UART side signals new data, so an idle session costs nothing.
          */
-        do {
-            /* int show_msg = 0;
-             * TODO optionally disable echo of text to USB port */
-            int has_err = 0;
-            this_rx_buf = (byte*)&sshStreamReceiveBufferArray;
-            vTaskDelay(10);
-
-            if (!stop) {
-                do {
-                    int error = 0;
-                    socklen_t len = sizeof(error);
-                    int retval = getsockopt(threadCtx->fd,
-                                           SOL_SOCKET, SO_ERROR, &error, &len);
-
-                    if (retval != 0) {
-                        /* if we can't even call getsockopt, give up */
-                        stop = 1;
-                        ESP_LOGE(TAG,"ERROR: getsockopt "
-                                     "unable to query socket fd!");
-                    }
-                    if (error != 0) {
-                        /* socket has a non zero error status */
-                        ESP_LOGE(TAG,"ERROR: getsockopt "
-                                     "returned error socket fd!");
-                        stop = 1;
-                    }
-
-                    /* when polling, debugging can be verbose, turn it off */
-                    #ifdef DEBUG_WOLFSSH
-                        ESP_LOGV(TAG, "wolfSSH debugging off.");
-                        wolfSSH_Debugging_OFF();
-                    #endif
-
-                    /* this is a blocking call, awaiting an SSH keypress
-                     * unless nonBlock = 1 (normally we are NOT blocking) */
-                    rxSz = wolfSSH_stream_read(threadCtx->ssh,
-                                               this_rx_buf + backlogSz,
-                                               EXAMPLE_BUFFER_SZ);
-
-                    if (rxSz <= 0) {
-                        rxSz = wolfSSH_get_error(threadCtx->ssh);
-                        if (rxSz == WS_WANT_READ || rxSz == WS_WANT_WRITE)
-                        {
-                            /* WS_WANT_READ or WS_WANT_WRITE but no data yet */
-                            rxSz = 0;
-                        }
-                        else
-                        {
-                            /*  any other negative value is an error */
-                            has_err = 1;
-                            ESP_LOGE(TAG, "wolfSSH_stream_read error!");
-                        }
-                    }
-                    else {
-#if defined(DISABLE_SSH_UART)
-                        this_rx_buf[rxSz] = 0;
-                        rxSz = 0;
-                        /* printf is not ideal for embedded, but here for demo
-                         * output only. setvbuf should have been set to flush
-                         * output immediately:*/
-                        printf("%s", this_rx_buf);
-#else
-                        ESP_LOGI(TAG, "Received %d bytes from client.", rxSz);
-#endif
-                    }
-
-
-                    /* turn debugging back on */
-                    #ifdef DEBUG_WOLFSSH
-                        ESP_LOGV(TAG, "wolfSSH debugging on.");
-                        wolfSSH_Debugging_ON();
-                    #endif
-
-                    taskYIELD();
-                    #ifdef SSH_SERVER_WDT_RESET
-                    {
-                        esp_task_wdt_reset();
-                    }
-                    #endif
-
-                } while ((WOLFSSL_NONBLOCK == 0) /* We'll wait only when
-                                                  * not using non-blocking
-                                                  * socket. */
-                         &&
-                         (rxSz == WS_WANT_READ || rxSz == WS_WANT_WRITE));
-
-                /*
-                 * if there's data in the external transmit buffer, typically
-                 * from UART, we'll send that to the SSH client.
-                 */
-                if (ExternalTransmitBufferSz() > 0) {
-                    ESP_LOGI(TAG,"Tx UART!");
-
-                    /* our actual transit buffer array is not on the local
-                     * stack to minimize RTOS requirements; we'll setup a
-                     * pointer to it.
-                     *
-                     * Note this is a *different* buffer from the
-                     * external (UART) which may change during RTOS threads,
-                     * and future interrupt code.
-                     * */
-                    byte* sshStreamTransmitBuffer =
-                          (byte*)(&sshStreamTransmitBufferArray);
-
-                    /* We'll get a copy of the buffer and
-                     * set _ExternalTransmitBufferSz to zero
-                     *
-                     * Note this is thread safe, getting both data and size.
-                     */
-                    int thisSize = Get_ExternalTransmitBuffer(
-                                       &sshStreamTransmitBuffer
-                                   );
-
-                    if (sshStreamTransmitBuffer == NULL) {
-                        /* TODO this is an error as the buffer should never
-                         * be null if the size was larger than zero */
-                        stop = 1;
-                    }
-                    else {
-                        /* note thisSize will not have changed from any other
-                         *  thread, since we have a copy and fixed size */
-                        wolfSSH_stream_send(threadCtx->ssh,
-                                            sshStreamTransmitBuffer,
-                                            thisSize);
-                    }
-                } /* ExternalTransmitBufferSz() > 0 */
-
-                /*
-                 * If we received any data from the SSH client,
-                 * we'll store it in the External Received Buffer
-                 * for later sending to the UART.
-                 *
-                 * Reminder negative values for WS_WANT_READ || WS_WANT_WRITE
-                 */
-                if (rxSz > 0) {
-                    /* Append external data, for something such as
-                     * UART forwarding.
-                     *
-                     * Note any prior data saved in the buffer
-                     * was _ExternalReceiveBufferSz.
-                     *
-                     * Here we perform the thread-safe equivalent of:
-                     *
-                        memcpy(
-                            &_ExternalReceiveBuffer[_ExternalReceiveBufferSz],
-                            buf,
-                            rxSz);
-                        _ExternalReceiveBufferSz = rxSz;
-                     */
-                    Set_ExternalReceiveBuffer(this_rx_buf, rxSz);
-
-                    backlogSz += rxSz;
-                    txSum = 0;
-                    txSz = 0;
-
-                    while (backlogSz != txSum && txSz >= 0 && !stop) {
-                        /* we typically do NOT want to re-echo TTY data
-                         * but it can be configured to do so by setting
-                         * SSH_SERVER_ECHO to a value of 1
-                         **/
-                        if (SSH_SERVER_ECHO == 1) {
-                            /* reminder we moved data from external buffer
-                             * to our local buf, and this is ECHO
-                             */
-                            txSz = wolfSSH_stream_send(threadCtx->ssh,
-                                                       this_rx_buf + txSum,
-                                                       backlogSz - txSum);
-                        }
-                        else {
-                            txSz = backlogSz - txSum;
-                        }
-
-                        if (txSz > 0) {
-                            byte c;
-                            const byte matches[] = { 0x03, 0x05, 0x06, 0x00 };
-
-                            c = find_char(matches, this_rx_buf + txSum, txSz);
-
-                            switch (c) {
-
-                            case 0x03:
-                                stop = 1;
-                                break;
-
-                            case 0x06:
-                                if (wolfSSH_TriggerKeyExchange(threadCtx->ssh)
-                                        != WS_SUCCESS) {
-                                    stop = 1;
-                                }
-                                break;
-
-                            case 0x05:
-                                if (dump_stats(threadCtx) <= 0) {
-                                    stop = 1;
-                                }
-                                break;
-                            }
-
-                            txSum += txSz;
-                        }
-                        else if (txSz != WS_REKEYING) {
-                            stop = 1;
-                        }
-
-                        taskYIELD();
-                        #ifdef SSH_SERVER_WDT_RESET
-                        {
-                            esp_task_wdt_reset();
-                        }
-                        #endif
-                    } /* while */
-
-                    if (txSum < backlogSz) {
-                        memmove(this_rx_buf,
-                                this_rx_buf + txSum,
-                                backlogSz - txSum);
-                    }
-                    backlogSz -= txSum;
+        while (!stop) {
+            fd_set readFds;
+            fd_set writeFds;
+            struct timeval timeout;
+            int maxFd = sshFd;
+            int selectRet;
+            int readable;
+
+            FD_ZERO(&readFds);
+            FD_ZERO(&writeFds);
+            FD_SET(sshFd, &readFds);
+            if (wantWrite) {
+                FD_SET(sshFd, &writeFds);
+            }
+            if (extFd >= 0) {
+                FD_SET(extFd, &readFds);
+                if (extFd > maxFd) {
+                    maxFd = extFd;
                 }
-                else {
-                    /* we might have negative values for non-blocking Rx
-                     * during WS_WANT_READ || WS_WANT_WRITE */
-                    if (has_err == 1)
-                    {
-                        stop = 1;
-                    }
+            }
+
+            /* wake in time to send held back UART data */
+            if ((waitUs > 0) &&
+                (waitUs < (int64_t)SSH_SERVER_IDLE_TIMEOUT_MS * 1000)) {
+                timeout.tv_sec  = (long)(waitUs / 1000000);
+                timeout.tv_usec = (long)(waitUs % 1000000);
+            }
+            else {
+                timeout.tv_sec  =  SSH_SERVER_IDLE_TIMEOUT_MS / 1000;
+                timeout.tv_usec = (SSH_SERVER_IDLE_TIMEOUT_MS % 1000) * 1000;
+            }
+
+            selectRet = select(maxFd + 1, &readFds, &writeFds, NULL, &timeout);
+            if (selectRet < 0) {
+                if (errno == EINTR) {
+                    continue;
                 }
+                ESP_LOGE(TAG, "ERROR: select failed on socket fd!");
+                stop = 1;
+                break;
             }
 
-        #ifdef DEBUG_WDT
-            /* if we get panic faults, perhaps the watchdog needs attention? */
-            taskYIELD();
-            vTaskDelay(pdMS_TO_TICKS(10));
-            esp_task_wdt_reset();
-        #endif
-        } while (!stop);
+            if ((extFd >= 0) && FD_ISSET(extFd, &readFds)) {
+                /* only clears the signal; the data is in the ring */
+                ExternalTransmitBuffer_ClearEvent(threadCtx->slot);
+            }
+
+            /* also try held back data, as the wake may be UART room */
+            readable = FD_ISSET(sshFd, &readFds);
+            if (readable || threadCtx->rxHeld) {
+                stop = server_worker_read_ssh(threadCtx, &backlogSz);
+            }
+            if (!stop && readable && threadCtx->rxHeld) {
+                stop = server_worker_poll_ssh(threadCtx);
+            }
+
+            /*
+             * if there's data in the external transmit buffer, typically
+             * from UART, we'll send that to the SSH client once the
+             * coalescer says it has waited long enough. This is also
+             * retried after socket activity, as a rekey or a full socket
+             * may have held it back.
+             */
+            if (!stop) {
+                stop = server_worker_flush_external(threadCtx, &wantWrite,
+                                                    &waitUs);
+            }
+            else {
+                wantWrite = 0;
+            }
+
+            #ifdef SSH_SERVER_WDT_RESET
+            {
+                esp_task_wdt_reset();
+            }
+            #endif
+        } /* while (!stop) */
+
+        ESP_LOGI(TAG, "Session %d sent %u UART bytes in %u packets.",
+                      threadCtx->slot, (unsigned)threadCtx->coalesce.bytes,
+                      (unsigned)threadCtx->coalesce.sends);
+        close_tx_rx_buffer(threadCtx->slot);
     } /* if (ret == WS_SUCCESS) */
 
     else if (ret == WS_SCP_COMPLETE) {
@@ -546,183 +715,72 @@ static THREAD_RETURN WOLFSSH_THREAD server_worker(void* vArgs)
     if (threadCtx->fd != SOCKET_INVALID) {
         ESP_LOGI(TAG,"Close sockfd socket");
         close(threadCtx->fd);
+        threadCtx->fd = SOCKET_INVALID;
     }
 
+    /* wolfSSH has no way to reset a session object for reuse; it is
+     * created per connection by server_test and released here. */
     wolfSSH_free(threadCtx->ssh);
-    free(threadCtx);
+    threadCtx->ssh = NULL;
 
     return 0;
 }
 
-#ifndef NO_FILESYSTEM
-static int load_file(const char* fileName, byte* buf, word32 bufSz)
-{
-    FILE* file;
-    word32 fileSz;
-    word32 readSz;
-
-    if (fileName == NULL) return 0;
-
-    if (WFOPEN(&file, fileName, "rb") != 0)
-        return 0;
-    fseek(file, 0, SEEK_END);
-    fileSz = (word32)ftell(file);
-    rewind(file);
-
-    if (fileSz > bufSz) {
-        fclose(file);
-        return 0;
-    }
-
-    readSz = (word32)fread(buf, 1, fileSz, file);
-    if (readSz < fileSz) {
-        fclose(file);
-        return 0;
-    }
-
-    fclose(file);
-
-    return fileSz;
-}
-#endif /* !NO_FILESYSTEM */
-
-
-
-/* returns buffer size on success */
-static int load_key(byte isEcc, byte* buf, word32 bufSz)
-{
-    word32 sz = 0;
-
-#ifndef NO_FILESYSTEM
-    const char* bufName;
-    bufName = isEcc ? "./keys/server-key-ecc.der" :
-                       "./keys/server-key-rsa.der";
-    sz = load_file(bufName, buf, bufSz);
-#else
-    /* using buffers instead */
-    if (isEcc) {
-        if ((word32)sizeof_ecc_key_der_256 > bufSz) {
-            return 0;
-        }
-    #ifdef DEMO_SERVER_384
-        WMEMCPY(buf, ecc_key_der_384, sizeof_ecc_key_der_384);
-        sz = sizeof_ecc_key_der_384;
-    #else
-        WMEMCPY(buf, ecc_key_der_256, sizeof_ecc_key_der_256);
-        sz = sizeof_ecc_key_der_256;
-    #endif
-
-    }
-    else {
-        if ((word32)sizeof_rsa_key_der_2048 > bufSz) {
-            return 0;
-        }
-        WMEMCPY(buf, rsa_key_der_2048, sizeof_rsa_key_der_2048);
-        sz = sizeof_rsa_key_der_2048;
-    }
-#endif
-
-    return sz;
-}
-
+/* Each session pool slot has its own thread_ctx_t, including its stream
+ * buffer, allocated once along with the pool, session_pool.h. */
+static thread_ctx_t sessionCtx[SSH_SERVER_MAX_SESSIONS];
 
-/* our own little c word32 to array */
-static WC_INLINE void c32toa(word32 u32, byte* c)
+/* runs one accepted client on its session pool task */
+static void server_session_run(int slot, void* arg)
 {
-    c[0] = (u32 >> 24) & 0xff;
-    c[1] = (u32 >> 16) & 0xff;
-    c[2] = (u32 >>  8) & 0xff;
-    c[3] =  u32 & 0xff;
+    thread_ctx_t* threadCtx = &sessionCtx[slot];
+
+    (void)arg;
+    ESP_LOGI(TAG,"server_worker %d started.", slot);
+    server_worker(threadCtx);
+    ESP_LOGI(TAG,"server_worker %d completed.", slot);
+    ESP_LOGI(TAG, "Minimum free heap so far: %lu bytes",
+                  (unsigned long)esp_get_minimum_free_heap_size());
 }
 
-static PwMap* PwMapNew(PwMapList* list,
-                       byte type,
-                       const byte* username,
-                       word32 usernameSz,
-                       const byte* p,
-                       word32 pSz) {
-    PwMap* map = NULL;
-
-    map = (PwMap*)malloc(sizeof(PwMap));
-    if (map != NULL) {
-        wc_Sha256 sha = { };
-        byte flatSz[4];
-        int fsz = 0;
-
-        map->type = type;
-        if (usernameSz >= sizeof(map->username))
-            usernameSz = sizeof(map->username) - 1;
-        memcpy(map->username, username, usernameSz + 1);
-        map->username[usernameSz] = 0;
-        map->usernameSz = usernameSz;
-
-        ESP_LOGI(TAG, "map->username = %s", map->username);
-
-        wc_InitSha256(&sha);
-        c32toa(pSz, flatSz);
-
-        fsz = sizeof(flatSz);
-
-    #ifdef DEBUG_WOLFSSH
-        ESP_LOGI(TAG, "map->username = %s", map->username);
-        ESP_LOGI(TAG, "SHA256 flatSz: 0x%02x%02x%02x%02x; size = %d",
-                      flatSz[0], flatSz[1], flatSz[2], flatSz[3], fsz);
-        ESP_LOGI(TAG, "SHA256 sample password: '%s': size = %d bytes", p, pSz);
-    #endif
-    #if defined(SSH_SERVER_DEBUG_LOCKDEPTH)
-        ESP_LOGW(TAG, "PwMapNew sha256 final ctx->lockDepth = %d",
-                       (&sha.ctx)->lockDepth);
-        ESP_LOGW(TAG, "calling wc_Sha256Update(1) ctx->lockDepth = %d",
-                       (&sha.ctx)->lockDepth);
-    #endif
-        wc_Sha256Update((wc_Sha256*)&sha, flatSz, fsz);
-    #if defined(SSH_SERVER_DEBUG_LOCKDEPTH) && \
-       !defined(NO_WOLFSSL_ESP32_CRYPT_HASH_SHA256)
-        ESP_LOGW(TAG, "calling wc_Sha256Update(2) ctx->lockDepth = %d",
-                      (&sha.ctx)->lockDepth);
-    #endif
-        wc_Sha256Update((wc_Sha256*)&sha, p, pSz);
-    #if defined(SSH_SERVER_DEBUG_LOCKDEPTH) && \
-       !defined(NO_WOLFSSL_ESP32_CRYPT_HASH_SHA256)
-
-        ESP_LOGW(TAG, "calling wc_Sha256Final ctx->lockDepth = %d",
-                      (&sha.ctx)->lockDepth);
-    #endif
-        wc_Sha256Final((wc_Sha256*)&sha, (byte*)map->p);
-
-        map->next = list->head;
-        list->head = map;
-    }
-
-    return map;
-}
-
-static void PwMapListDelete(PwMapList* list)
+/* set up the session contexts and start the pool, once; returns zero on
+ * success */
+static int server_session_init(void)
 {
-    if (list != NULL) {
-        PwMap* head = list->head;
-
-        while (head != NULL) {
-            PwMap* cur = head;
-            head = head->next;
-            memset(cur, 0, sizeof(PwMap));
-            free(cur);
+    static int ready = 0;
+    int i;
+
+    if (!ready) {
+        for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+            thread_ctx_t* threadCtx = &sessionCtx[i];
+
+            memset(threadCtx, 0, sizeof(thread_ctx_t));
+            threadCtx->fd = SOCKET_INVALID;
+            threadCtx->slot = i;
+            coalesce_init(&threadCtx->coalesce, SSH_COALESCE_MAX_SZ,
+                          SSH_COALESCE_DELAY_US, SSH_COALESCE_NEWLINE,
+                          sshCoalescePrompts);
         }
+        ready = 1;
     }
+
+    return SessionPoolInit(server_session_run, NULL);
 }
 
-static int LoadPasswordBuffer(byte* buf, word32 bufSz, PwMapList* list)
+/*
+ * Load a passwd style buffer into the credential store. Each line is in
+ * the format
+ *     username:password\n
+ * The buffer is parsed in place, without a copy; a file or flash blob can
+ * equally be fed a chunk at a time with CredLoaderUpdate.
+ */
+static int LoadPasswordBuffer(const byte* buf, word32 bufSz,
+                              CredStore* store)
 {
-    char* str = (char*)buf;
-    char* delimiter;
-    char* username;
-    char* password;
-
-    /* Each line of passwd.txt is in the format
-     *     username:password\n
-     * This function modifies the passed-in buffer. */
+    CredLoader loader;
+    int ret;
 
-    if (list == NULL)
+    if (store == NULL)
         return -1;
 
     if (buf == NULL || bufSz == 0) {
@@ -730,50 +788,30 @@ static int LoadPasswordBuffer(byte* buf, word32 bufSz, PwMapList* list)
         return 0;
     }
 
-    while (*str != 0) {
-        delimiter = strchr(str, ':');
-        if (delimiter == NULL) {
-            return -1;
-        }
-        username = str;
-        *delimiter = 0;
-        password = delimiter + 1;
-        str = strchr(password, '\n');
-        if (str == NULL) {
-            return -1;
-        }
-        *str = 0;
-        str++;
-        if (PwMapNew(list,
-                     WOLFSSH_USERAUTH_PASSWORD,
-                     (byte*)username,
-                     (word32)strlen(username),
-                     (byte*)password,
-                     (word32)strlen(password)) == NULL) {
-
-            return -1;
-        }
-    }
+    ret = CredLoaderInit(&loader, store, WOLFSSH_USERAUTH_PASSWORD);
+    if (ret == 0)
+        ret = CredLoaderUpdate(&loader, buf, bufSz);
+    if (ret == 0)
+        ret = CredLoaderFinal(&loader);
 
-    return 0;
+    return ret;
 }
 
 
-static int LoadPublicKeyBuffer(byte* buf, word32 bufSz, PwMapList* list)
+/*
+ * Load an authorized_keys style buffer into the credential store. Each
+ * line is in the format
+ *     ssh-rsa AAAB3BASE64ENCODEDPUBLICKEYBLOB username\n
+ * Keys are decoded and hashed as they are parsed, so there is no limit on
+ * their size and no decoded copy.
+ */
+static int LoadPublicKeyBuffer(const byte* buf, word32 bufSz,
+                               CredStore* store)
 {
-    char* str = (char*)buf;
-    char* delimiter;
-    byte* publicKey64;
-    word32 publicKey64Sz;
-    byte* username;
-    word32 usernameSz;
-    byte  publicKey[300];
-    word32 publicKeySz;
-
-    /* Each line of passwd.txt is in the format
-     *     ssh-rsa AAAB3BASE64ENCODEDPUBLICKEYBLOB username\n
-     * This function modifies the passed-in buffer. */
-    if (list == NULL)
+    CredLoader loader;
+    int ret;
+
+    if (store == NULL)
         return -1;
 
     if (buf == NULL || bufSz == 0) {
@@ -781,61 +819,19 @@ static int LoadPublicKeyBuffer(byte* buf, word32 bufSz, PwMapList* list)
         return 0;
     }
 
-    while (*str != 0) {
-        /* Skip the public key type. This example will always be ssh-rsa. */
-        delimiter = strchr(str, ' ');
-        if (delimiter == NULL) {
-            return -1;
-        }
-        str = delimiter + 1;
-        delimiter = strchr(str, ' ');
-        if (delimiter == NULL) {
-            return -1;
-        }
-        publicKey64 = (byte*)str;
-        *delimiter = 0;
-        publicKey64Sz = (word32)(delimiter - str);
-        str = delimiter + 1;
-        delimiter = strchr(str, '\n');
-        if (delimiter == NULL) {
-            return -1;
-        }
-        username = (byte*)str;
-        *delimiter = 0;
-        usernameSz = (word32)(delimiter - str);
-        str = delimiter + 1;
-        publicKeySz = sizeof(publicKey);
-
-        if (Base64_Decode(publicKey64,
-            publicKey64Sz,
-            publicKey,
-            &publicKeySz) != 0) {
-
-            return -1;
-        }
-
-        if (PwMapNew(list,
-            WOLFSSH_USERAUTH_PUBLICKEY,
-            username,
-            usernameSz,
-            publicKey,
-            publicKeySz) == NULL) {
+    ret = CredLoaderInit(&loader, store, WOLFSSH_USERAUTH_PUBLICKEY);
+    if (ret == 0)
+        ret = CredLoaderUpdate(&loader, buf, bufSz);
+    if (ret == 0)
+        ret = CredLoaderFinal(&loader);
 
-            return -1;
-        }
-    }
-
-    return 0;
+    return ret;
 }
 
 static int wsUserAuth(byte authType,
                       WS_UserAuthData* authData,
                       void* ctx)
 {
-    PwMapList* list;
-    PwMap* map;
-    byte authHash[WC_SHA256_DIGEST_SIZE];
-
     if (ctx == NULL) {
         ESP_LOGE(TAG,"wsUserAuth: ctx not set");
         return WOLFSSH_USERAUTH_FAILURE;
@@ -847,85 +843,26 @@ static int wsUserAuth(byte authType,
         return WOLFSSH_USERAUTH_FAILURE;
     }
 
-    /* Hash the password or public key with its length. */
-    {
-        wc_Sha256 sha;
-        byte flatSz[4];
-        wc_InitSha256(&sha);
-        if (authType == WOLFSSH_USERAUTH_PASSWORD) {
-            c32toa(authData->sf.password.passwordSz, flatSz);
-            wc_Sha256Update(&sha, flatSz, sizeof(flatSz));
-            wc_Sha256Update(&sha,
-                authData->sf.password.password,
-                authData->sf.password.passwordSz);
-        }
-        else if (authType == WOLFSSH_USERAUTH_PUBLICKEY) {
-            c32toa(authData->sf.publicKey.publicKeySz, flatSz);
-            wc_Sha256Update(&sha, flatSz, sizeof(flatSz));
-            wc_Sha256Update(&sha,
-                authData->sf.publicKey.publicKey,
-                authData->sf.publicKey.publicKeySz);
-        }
-        wc_Sha256Final(&sha, authHash);
-    }
-
-    list = (PwMapList*)ctx;
-    map = list->head;
-
-    while (map != NULL) {
-        if (authData->usernameSz == map->usernameSz &&
-            memcmp(authData->username, map->username, map->usernameSz) == 0) {
-
-            if (authData->type == map->type) {
-                if (memcmp(map->p, authHash, WC_SHA256_DIGEST_SIZE) == 0) {
-                    return WOLFSSH_USERAUTH_SUCCESS;
-                }
-                else {
-                    return (authType == WOLFSSH_USERAUTH_PASSWORD ?
-                            WOLFSSH_USERAUTH_INVALID_PASSWORD :
-                            WOLFSSH_USERAUTH_INVALID_PUBLICKEY);
-                }
-            }
-            else {
-                return WOLFSSH_USERAUTH_INVALID_AUTHTYPE;
-            }
-        }
-        map = map->next;
+    /* one hash table lookup on the user name; the password or public key
+     * is hashed with its length and compared in constant time */
+    if (authData->type == WOLFSSH_USERAUTH_PASSWORD) {
+        return CredStoreCheck((CredStore*)ctx,
+                              WOLFSSH_USERAUTH_PASSWORD,
+                              authData->username,
+                              authData->usernameSz,
+                              authData->sf.password.password,
+                              authData->sf.password.passwordSz);
     }
-
-    return WOLFSSH_USERAUTH_INVALID_USER;
-}
-
-
-#ifdef WOLFSSH_TEST_THREADING
-
-typedef THREAD_RETURN WOLFSSH_THREAD THREAD_FUNC(void*);
-
-
-static WC_INLINE void ThreadDetach(THREAD_TYPE thread) {
-#ifdef SINGLE_THREADED
-    (void)thread;
-#elif defined(_POSIX_THREADS) && !defined(__MINGW32__)
-    pthread_detach(thread);
-#elif defined(WOLFSSL_TIRTOS)
-#if 0
-    while (1) {
-        if (Task_getMode(thread) == Task_Mode_TERMINATED) {
-            Task_sleep(5);
-            break;
-        }
-        Task_yield();
+    else {
+        return CredStoreCheck((CredStore*)ctx,
+                              WOLFSSH_USERAUTH_PUBLICKEY,
+                              authData->username,
+                              authData->usernameSz,
+                              authData->sf.publicKey.publicKey,
+                              authData->sf.publicKey.publicKeySz);
     }
-#endif
-#else
-    int res = CloseHandle((HANDLE)thread);
-    assert(res);
-    (void)res; /* Suppress un-used variable warning */
-#endif
 }
 
-#endif /* WOLFSSH_TEST_THREADING */
-
 
 /*
  * this my_IORecv callback is WIP and not currently used
@@ -966,40 +903,29 @@ static int my_IOSend(WOLFSSH* ssh, void* buff, word32 sz, void* ctx) {
 }
 */
 
-void server_test(void *arg)
+/*
+ * The server itself: the listening socket, WOLFSSH_CTX with its host key,
+ * and the credential store. These are set up by the first server_test and
+ * kept for the life of the device; only the WOLFSSH session object is made
+ * per connection, so the next client is accepted as soon as a session slot
+ * is free.
+ */
+static int          serverFd = SOCKET_INVALID;
+static WOLFSSH_CTX* serverCtx = NULL;
+static CredStore    serverCredStore;
+
+/* create, bind and listen on the server socket; returns zero on success */
+static int server_listen_init(void)
 {
     int DEFAULT_PORT = SSH_UART_PORT;
     int ret = WOLFSSL_SUCCESS; /* assume success until proven wrong */
-    int sockfd = 0; /* the socket that will carry our secure connection */
+    int sockfd = SOCKET_INVALID; /* the socket clients connect to */
     struct sockaddr_in servAddr;
     int                on;
 
-    static int mConnd = SOCKET_INVALID;
-
-    /* declare wolfSSL objects */
-    WOLFSSH_CTX *ctx = NULL; /* the wolfSSL context object*/
-
-    PwMapList pwMapList;
-
-    word32 defaultHighwater = EXAMPLE_HIGHWATER_MARK;
-    word32 threadCount = 0;
-    char multipleConnections = 0;
-    char useEcc = 0;
-
-#ifdef HAVE_SIGNAL
-    signal(SIGINT, sig_handler);
-#endif
-
-#ifdef DEBUG_WOLFSSL
-    wolfSSL_Debugging_ON();
-    ESP_LOGI(TAG,"Debug ON v0.2c");
-    /* TODO ShowCiphers(); */
-#endif /* DEBUG_WOLFSSL */
-
-#ifdef DEBUG_WOLFSSH
-    wolfSSH_Debugging_ON();
-    /* TODO ShowCiphers(); */
-#endif /* DEBUG_WOLFSSL */
+    if (serverFd != SOCKET_INVALID) {
+        return 0;
+    }
 
     /* Initialize the server address struct with zeros */
     memset(&servAddr, 0, sizeof(servAddr));
@@ -1311,121 +1237,217 @@ void server_test(void *arg)
         }
     }
 
-#ifdef NO_RSA
-    /* If wolfCrypt isn't built with RSA, force ECC on. */
-    useEcc = 1;
-    ESP_LOGI(TAG,"Found NO_RSA, setting useEcc = 1");
-#endif
+    if (ret != WOLFSSL_SUCCESS) {
+        if (sockfd >= 0) {
+            close(sockfd);
+        }
+        return -1;
+    }
+
+    serverFd = sockfd;
+    return 0;
+}
 
-    if (wolfSSH_Init() != WS_SUCCESS) {
-        ESP_LOGE(TAG,"Couldn't initialize wolfSSH.\n");
-        exit(EXIT_FAILURE);
+/* close the listening socket, so the next server_test makes a new one */
+static void server_listen_close(void)
+{
+    if (serverFd != SOCKET_INVALID) {
+        ESP_LOGI(TAG,"Close sockfd socket");
+        close(serverFd); /* Close the socket listening for clients   */
+        serverFd = SOCKET_INVALID;
     }
+}
 
-    ctx = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_SERVER, NULL);
-    if (ctx == NULL) {
-        ESP_LOGE(TAG,"Couldn't allocate SSH CTX data.\n");
-        exit(EXIT_FAILURE);
+static void server_ctx_free(void)
+{
+    CredStoreFree(&serverCredStore);
+    wolfSSH_CTX_free(serverCtx);
+    serverCtx = NULL;
+}
+
+/* wolfSSH calls this when a key exchange completes, the first and every
+ * rekey; the client's public point may have taken a table's place */
+static void server_keying_done(void* ctx)
+{
+    KexPoolRefill((WOLFSSH*)ctx);
+}
+
+/* the CTX with its host key, user auth and credentials, kept resident
+ * once made; returns zero on success */
+static int server_ctx_init(void)
+{
+    const char* bufName;
+    char useEcc;
+    int ret = 0;
+
+    if (serverCtx != NULL) {
+        return 0;
     }
 
+    /* the host key is normally already loaded at boot, see HostKeyInit */
+    useEcc = (char)HostKeyIsEcc();
 
-    memset(&pwMapList, 0, sizeof(pwMapList));
+    /* wolfSSH_Init was called once by app_main */
+    memset(&serverCredStore, 0, sizeof(serverCredStore));
+    serverCtx = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_SERVER, NULL);
+    if (serverCtx == NULL) {
+        ESP_LOGE(TAG,"Couldn't allocate SSH CTX data.\n");
+        ret = -1;
+    }
 
-    /* authorization is a callback, so assign it here: wsUserAuth */
-    wolfSSH_SetUserAuth(ctx, wsUserAuth);
+    /* sized for the sample users; it grows if more are added */
+    if (ret == 0 && CredStoreInit(&serverCredStore, 8) != 0) {
+        ESP_LOGE(TAG,"Couldn't allocate credential store.\n");
+        ret = -1;
+    }
 
-    /* set the login banner message as defined in ssh_server_config.h */
-    wolfSSH_CTX_SetBanner(ctx, SSH_SERVER_BANNER);
+    if (ret == 0) {
+        /* authorization is a callback, so assign it here: wsUserAuth */
+        wolfSSH_SetUserAuth(serverCtx, wsUserAuth);
 
-    {
-        const char* bufName;
-        byte buf[SCRATCH_BUFFER_SZ];
-        word32 bufSz;
-        int ret = 0;
+        /* set the login banner message as defined in ssh_server_config.h */
+        wolfSSH_CTX_SetBanner(serverCtx, SSH_SERVER_BANNER);
 
-        bufSz = load_key(useEcc, buf, SCRATCH_BUFFER_SZ);
-        if (bufSz == 0) {
-            ESP_LOGE(TAG, "Couldn't load key.\n");
-            exit(EXIT_FAILURE);
+        /* the window from the baud rate, ssh_server_config.h, so the
+         * client keeps the UART busy without queueing far ahead of it */
+        if (wolfSSH_CTX_SetWindowPacketSize(serverCtx, SSH_FLOW_WINDOW_SZ,
+                                            0) != WS_SUCCESS) {
+            ESP_LOGW(TAG,"Couldn't set window size; using default.");
         }
-        if (wolfSSH_CTX_UsePrivateKey_buffer(ctx,
-                                             buf,
-                                             bufSz,
-                                             WOLFSSH_FORMAT_ASN1) < 0) {
+
+        wolfSSH_SetKeyingCompletionCb(serverCtx, server_keying_done);
+
+        if (HostKeyUse(serverCtx) != 0) {
             ESP_LOGE(TAG,"Couldn't use key buffer.\n");
-            exit(EXIT_FAILURE);
+            ret = -1;
         }
+    }
 
-        bufSz = (word32)strlen(samplePasswordBuffer);
-        memcpy(buf, samplePasswordBuffer, bufSz);
-        buf[bufSz] = 0;
-        ret = LoadPasswordBuffer(buf, bufSz, &pwMapList);
+    if (ret == 0) {
+        /* the credential buffers are parsed in place; no scratch copy */
+        ret = LoadPasswordBuffer((const byte*)samplePasswordBuffer,
+                                 (word32)strlen(samplePasswordBuffer),
+                                 &serverCredStore);
         if (ret != 0) {
             ESP_LOGE(TAG, "Error: failed LoadPasswordBuffer %d", ret);
-            exit(EXIT_FAILURE);
         }
+    }
 
+    if (ret == 0) {
         bufName = useEcc ? samplePublicKeyEccBuffer :
                            samplePublicKeyRsaBuffer;
-        bufSz = (word32)strlen(bufName);
-        memcpy(buf, bufName, bufSz);
-        buf[bufSz] = 0;
-        LoadPublicKeyBuffer(buf, bufSz, &pwMapList);
+        ret = LoadPublicKeyBuffer((const byte*)bufName,
+                                  (word32)strlen(bufName),
+                                  &serverCredStore);
         if (ret != 0) {
-            ESP_LOGE(TAG, "Error: failed LoadPasswordBuffer %d", ret);
-            exit(EXIT_FAILURE);
+            ESP_LOGE(TAG, "Error: failed LoadPublicKeyBuffer %d", ret);
         }
     }
 
-    listen(sockfd, 5);
+    if (ret != 0) {
+        server_ctx_free();
+        return -1;
+    }
+
+    ESP_LOGI(TAG,"SSH CTX, host key and credentials ready.");
+    return 0;
+}
+
+/*
+ * Accept clients and hand each to a free session, forever. Returns only
+ * if the server can't be set up, or the listening socket fails; whatever
+ * was already set up is kept, and the caller just calls again.
+ */
+void server_test(void *arg)
+{
+    static word32 threadCount = 0;
+    word32 defaultHighwater = EXAMPLE_HIGHWATER_MARK;
+
+#ifdef HAVE_SIGNAL
+    signal(SIGINT, sig_handler);
+#endif
 
-    do {
+#ifdef DEBUG_WOLFSSL
+    wolfSSL_Debugging_ON();
+    ESP_LOGI(TAG,"Debug ON v0.2c");
+    /* TODO ShowCiphers(); */
+#endif /* DEBUG_WOLFSSL */
+
+#ifdef DEBUG_WOLFSSH
+    wolfSSH_Debugging_ON();
+    /* TODO ShowCiphers(); */
+#endif /* DEBUG_WOLFSSL */
+
+    if (server_session_init() != 0 ||
+        server_ctx_init() != 0 ||
+        server_listen_init() != 0) {
+        ESP_LOGE(TAG,"Server setup failed; will retry.");
+        return;
+    }
+
+    while (1) {
         int      clientFd = 0;
+        int      slot = 0;
         struct sockaddr_in clientAddr;
         socklen_t     clientAddrSz = sizeof(clientAddr);
-#ifndef SINGLE_THREADED
-        THREAD_TYPE   thread;
-        ESP_LOGI(TAG,"Did not find SINGLE_THREADED defined");
-#endif
         WOLFSSH*      ssh;
 
-        /* We'll create a new instance of threadCtx since it will be
-         * handed off to potentially multiple separate threads.
+        /* Each session pool slot has its own threadCtx, handed off to
+         * that slot's task once the client is accepted.
          */
         thread_ctx_t* threadCtx;
 
-        threadCtx = (thread_ctx_t*)malloc(sizeof(thread_ctx_t));
-        if (threadCtx == NULL) {
-            ESP_LOGE(TAG,"Couldn't allocate thread context data.\n");
-            exit(EXIT_FAILURE);
-        }
+        /* Wait for a free session before accepting; meanwhile further
+         * clients wait in the listen backlog. */
+        slot = SessionPoolTake(portMAX_DELAY);
+        threadCtx = &sessionCtx[slot];
 
         /*
          * optionally register some callbacks (these are not working)
-        wolfSSH_SetIORecv(ctx, my_IORecv);
-        wolfSSH_SetIOSend(ctx, my_IOSend);
+        wolfSSH_SetIORecv(serverCtx, my_IORecv);
+        wolfSSH_SetIOSend(serverCtx, my_IOSend);
          */
 
-        ssh = wolfSSH_new(ctx);
+        /* made before accept so the client isn't kept waiting for it */
+        ssh = wolfSSH_new(serverCtx);
         if (ssh == NULL) {
             ESP_LOGE(TAG,"Failed to create ssh object during wolfSSH_new.\n");
-            exit(EXIT_FAILURE);
+            SessionPoolGive(slot);
+            vTaskDelay(SSH_SERVER_RETRY_MS / portTICK_PERIOD_MS);
+            continue;
         }
-        wolfSSH_SetUserAuthCtx(ssh, &pwMapList);
+        wolfSSH_SetUserAuthCtx(ssh, &serverCredStore);
+        wolfSSH_SetKeyingCompletionCbCtx(ssh, (void*)ssh);
         /* Use the session object for its own highwater callback ctx */
         if (defaultHighwater > 0) {
             wolfSSH_SetHighwaterCtx(ssh, (void*)ssh);
             wolfSSH_SetHighwater(ssh, defaultHighwater);
         }
 
-        clientFd = accept(sockfd,
+        clientFd = accept(serverFd,
                           (struct sockaddr*)&clientAddr,
                           &clientAddrSz
                          );
 
-        if (clientFd == -1) {
-            ESP_LOGI(TAG,"ERROR: failed accept");
-            exit(EXIT_FAILURE);
+        if (clientFd < 0) {
+            int err = errno;
+
+            wolfSSH_free(ssh);
+            SessionPoolGive(slot);
+
+            /* a client that gave up, or a short lack of memory or sockets,
+             * only costs that one client */
+            if (err == ECONNABORTED || err == EINTR || err == EAGAIN ||
+                err == ENOMEM || err == ENOBUFS || err == ENFILE ||
+                err == EMFILE) {
+                ESP_LOGW(TAG,"accept failed, errno %d; continuing.", err);
+                vTaskDelay(10 / portTICK_PERIOD_MS);
+                continue;
+            }
+
+            ESP_LOGE(TAG,"ERROR: failed accept, errno %d", err);
+            server_listen_close();
+            return;
         }
 
         if (WOLFSSL_NONBLOCK)
@@ -1437,52 +1459,10 @@ void server_test(void *arg)
         threadCtx->fd = clientFd;
         threadCtx->id = threadCount++;
         threadCtx->nonBlock = WOLFSSL_NONBLOCK;
+        threadCtx->acceptTime = esp_timer_get_time();
 
-        ESP_LOGI(TAG,"server_worker started.");
-#ifndef SINGLE_THREADED
-    #ifdef WOLFSSH_TEST_THREADING
-        ThreadStart(server_worker, threadCtx, &thread);
-
-        if (multipleConnections)
-            ThreadDetach(thread);
-        else
-            ThreadJoin(thread);
-    #else
-        /* see "wolfssh/test.h" check user_settings.h */
-        #error "WOLFSSH_TEST_THREADING must be enabled unless SINGLE_THREADED"
-    #endif
-#else
-        server_worker(threadCtx);
-#endif /* SINGLE_THREADED */
-        ESP_LOGI(TAG,"server_worker completed.");
-        vTaskDelay(10);
-    } while (multipleConnections);
-    ESP_LOGI(TAG,"all servers exited.");
-
-    PwMapListDelete(&pwMapList);
-    wolfSSH_CTX_free(ctx);
-    if (wolfSSH_Cleanup() != WS_SUCCESS) {
-        ESP_LOGE(TAG,"Couldn't clean up wolfSSH.\n");
-        exit(EXIT_FAILURE);
-    }
-#if defined(HAVE_ECC) && defined(FP_ECC) && defined(HAVE_THREAD_LS)
-    wc_ecc_fp_free(); /* free per thread cache */
-#endif
-
-    ESP_LOGI(TAG,"server test done!");
-
-    /* Cleanup and return */
-
-    if (mConnd != SOCKET_INVALID) {
-        ESP_LOGI(TAG,"Close mConnd socket");
-        close(mConnd); /* Close the connection to the client   */
-        mConnd = SOCKET_INVALID;
+        ESP_LOGI(TAG,"Client %u handed to session %d.",
+                     (unsigned)threadCtx->id, slot);
+        SessionPoolStart(slot);
     }
-    if (sockfd != SOCKET_INVALID) {
-        ESP_LOGI(TAG,"Close sockfd socket");
-        close(sockfd); /* Close the socket listening for clients   */
-        sockfd = SOCKET_INVALID;
-    }
-
-    return;
 }
@@ -1,4 +1,4 @@
-/* uart_hlper.c
+/* tx_rx_buffer.c
  *
  * Copyright (C) 2014-2024 wolfSSL Inc.
  *
@@ -18,10 +18,15 @@
  * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "tx_rx_buffer.h"
-#include "int_to_string.h"
+#include "ring_buffer.h"
+#include "ssh_server_config.h"
 
 #include <esp_log.h>
-#include <task.h>
+#include <esp_vfs_eventfd.h>
+#include <freertos/task.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #ifdef DISABLE_SSH_UART
 
@@ -33,498 +38,513 @@
     #define SSH_GPIO_MESSAGE_TX "Tx GPIO "
     #define SSH_GPIO_MESSAGE_RX ", Rx GPIO "
     #define SSH_READY_MESSAGE   ".\r\n\r\n"                                 \
-                                "Press [Enter] to start. Ctrl-C to exit."   \
+                                "Press [Enter] to start. ~. to exit."       \
                                 "\r\n\r\n"
 #endif
 
 static const char *TAG = "tx_rx_buf";
 
+/* Shared external, non ssh buffers. typically the UART.
+ *
+ * These are single-producer, single-consumer lock-free rings; see the
+ * ownership notes in tx_rx_buffer.h. No semaphore is taken on any path.
+ * All of it is allocated here, once, for SSH_SERVER_MAX_SESSIONS. */
+typedef struct ext_session_buffer_t {
+    ring_buffer_t receive;
+    ring_buffer_t transmit;
+    byte receiveData[EXT_RX_BUF_MAX_SZ];
+    byte transmitData[EXT_TX_BUF_MAX_SZ];
+
+    /* set by the session (the transmit consumer) while connected; the
+     * UART side only copies data to attached sessions */
+    atomic_bool attached;
+
+    /* set by the session when it is holding SSH data back for lack of
+     * Receive space; uart_tx_task signals it once there is room */
+    atomic_bool receiveWantSpace;
+
+    /* eventfd signalled when data is added to the Transmit ring, so that
+     * server_worker can wait on it in the same select() as its socket */
+    int transmitEventFd;
+
+    /* The welcome message is sent ahead of any UART data. It is owned by
+     * the transmit consumer (server_worker), so it does not break the
+     * single producer rule for the transmit ring. */
+#ifndef DISABLE_SSH_UART
+    char preamble[sizeof(SSH_WELCOME_MESSAGE)
+                  + sizeof(SSH_GPIO_MESSAGE)
+                  + sizeof(SSH_GPIO_MESSAGE_TX)
+                  + sizeof(SSH_GPIO_MESSAGE_RX)
+                  + sizeof(SSH_READY_MESSAGE)
+                  + 8];
+#else
+    char preamble[1];
+#endif
+    int preambleSz;
+    int preambleIdx;
+} ext_session_buffer_t;
 
-/* TODO define size and check when assigning */
-/* Shared external, non ssh buffers. typically the UART */
-volatile static char  _ExternalReceiveBuffer[EXT_RX_BUF_MAX_SZ];
-volatile static char  _ExternalTransmitBuffer[EXT_TX_BUF_MAX_SZ];
-volatile static int _ExternalReceiveBufferSz = 0;
-volatile static int _ExternalTransmitBufferSz = 0;
+static ext_session_buffer_t _ExternalSessionBuffer[SSH_SERVER_MAX_SESSIONS];
 
+/* task waiting for data in any Receive ring; typically uart_tx_task,
+ * which sets it as it starts, possibly after a session has */
+static _Atomic(TaskHandle_t) _ExternalReceiveNotifyTask = NULL;
 
-static SemaphoreHandle_t _xExternalReceiveBuffer_Semaphore = NULL;
-static SemaphoreHandle_t _xExternalTransmitBuffer_Semaphore = NULL;
+/* next session uart_tx_task takes from, and how many regions in a row it
+ * has had; owned by that consumer */
+static int _ExternalReceiveNext = 0;
+static int _ExternalReceiveRegions = 0;
 
+#ifdef SSH_SERVER_PROFILE
+    static int MaxSeenRxSize = 0;
+    static int MaxSeenTxSize = 0;
+#endif
 
-/*
- * initialize the external buffer (typically a UART) Receive Semaphore.
- */
-int InitReceiveSemaphore(void)
+/* returns NULL for an out of range session index */
+static ext_session_buffer_t* ext_session_buffer(int session)
 {
-    int ret = ESP_OK;
-    if (_xExternalReceiveBuffer_Semaphore == NULL) {
-        ESP_LOGV(TAG, "Enter InitReceiveSemaphore.");
-
-        /* the case of recursive mutexes is interesting, so alert */
-    #ifdef configUSE_RECURSIVE_MUTEXES
-        /* see semphr.h */
-        ESP_LOGI(TAG,"InitSemaphore UART Rx "
-                     "configUSE_RECURSIVE_MUTEXES enabled");
-    #endif
-
-        _xExternalReceiveBuffer_Semaphore =  xSemaphoreCreateMutex();
-    #ifdef configUSE_RECURSIVE_MUTEXES
-        /* see semphr.h */
-        ESP_LOGV(TAG,"_xExternalReceiveBuffer_Semaphore complete");
-        #ifdef INCLUDE_uxTaskGetStackHighWaterMark
-            ESP_LOGV(TAG, "1 rx Stack HWM: %d\n",
-            uxTaskGetStackHighWaterMark(NULL));
-        #endif
-    #endif
-    }
-    else {
-        ESP_LOGV(TAG, "Rx _xExternalTransmitBuffer_Semaphore "
-                      "already initialized");
+    if ((session < 0) || (session >= SSH_SERVER_MAX_SESSIONS)) {
+        ESP_LOGE(TAG, "ERROR: bad session index %d", session);
+        return NULL;
     }
-    return ret;
+    return &_ExternalSessionBuffer[session];
 }
 
 /*
- * initialize the external buffer (typically a UART) Transmit Semaphore.
+ * Append data from the SSH client, to be sent to the external device.
+ * Returns the number of bytes accepted, which is less than sz when the
+ * buffer is full. Negative values are errors.
  */
-int InitTransmitSemaphore(void)
+int Set_ExternalReceiveBuffer(int session, const byte *FromData, int sz)
 {
-    int ret = ESP_OK;
-    if (_xExternalTransmitBuffer_Semaphore == NULL) {
-
-        /* the case of recursive mutexes is interesting, so alert */
-    #ifdef configUSE_RECURSIVE_MUTEXES
-        /* see semphr.h */
-        ESP_LOGI(TAG, "InitSemaphore Tx configUSE_RECURSIVE_MUTEXES enabled");
-    #endif
-    #ifdef INCLUDE_uxTaskGetStackHighWaterMark
-        ESP_LOGV(TAG, "Tx Stack HWM: %d\n", uxTaskGetStackHighWaterMark(NULL));
-    #endif
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+    TaskHandle_t notifyTask;
+    int ret;
 
-        _xExternalTransmitBuffer_Semaphore =  xSemaphoreCreateMutex();
+    if ((buf == NULL) || (FromData == NULL) || (sz < 0)) {
+        return -1;
+    }
 
-#ifdef configUSE_RECURSIVE_MUTEXES
-        /* see semphr.h */
-        ESP_LOGV(TAG, "_xExternalReceiveBuffer_Semaphore complete");
-    #endif
+    ret = (int)ring_buffer_write(&buf->receive, FromData, sz);
+    if (ret < sz) {
+        ESP_LOGW(TAG, "Warning: Set_ExternalReceiveBuffer full, "
+                      "dropped %d bytes.", sz - ret);
     }
-    else {
-        ESP_LOGV(TAG, "Tx _xExternalTransmitBuffer_Semaphore"
-                      "already initialized");
+    notifyTask = atomic_load_explicit(&_ExternalReceiveNotifyTask,
+                                      memory_order_acquire);
+    if ((ret > 0) && (notifyTask != NULL)) {
+        xTaskNotifyGive(notifyTask);
+    }
+
+#ifdef SSH_SERVER_PROFILE
+    if ((int)ring_buffer_used(&buf->receive) > MaxSeenRxSize) {
+        MaxSeenRxSize = (int)ring_buffer_used(&buf->receive);
     }
+#endif
     return ret;
 }
 
-/*
- * return true if the Rx buffer is exactly 1 char long and contains charValue
- */
-bool __attribute__((optimize("O0")))
-ExternalReceiveBuffer_IsChar(char charValue)
+/* wake the session's server_worker through its eventfd */
+static void ext_session_signal(ext_session_buffer_t* buf)
 {
-    bool ret = false; /* assume not a match unless proven otherwise */
-    char thisChar; /* typically looking at position 0, e.g. user typing */
-
-    InitReceiveSemaphore();
-    if (xSemaphoreTake(_xExternalReceiveBuffer_Semaphore,
-                       (TickType_t) 10) == pdTRUE) {
-
-        /* the entire thread-safety wrapper is for this code segment */
-        {
-            if (_ExternalReceiveBufferSz == 1)
-            {
-                thisChar =  _ExternalReceiveBuffer[0];
-                ret = (thisChar == charValue);
-           }
-        }
-        xSemaphoreGive(_xExternalReceiveBuffer_Semaphore);
+    uint64_t signal = 1;
+
+    if (buf->transmitEventFd < 0) {
+        return;
     }
-    else {
-        /* we could not get the semaphore to update the value!
-         * TODO how to handle this? */
-        ret = false;
+    if (write(buf->transmitEventFd, &signal, sizeof(signal))
+            != sizeof(signal)) {
+        ESP_LOGW(TAG, "Warning: session event failed");
     }
+}
 
-    return ret;
+/* space for more SSH client data; never more than the UART has drained */
+int ExternalReceiveBufferFree(int session)
+{
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+
+    return (buf == NULL) ? 0 : (int)ring_buffer_free(&buf->receive);
 }
 
-volatile char* __attribute__((optimize("O0"))) ExternalReceiveBuffer()
+/* ask for a signal once the Receive buffer is half empty */
+void ExternalReceiveBuffer_WantSpace(int session)
 {
-    return _ExternalReceiveBuffer;
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+
+    if (buf != NULL) {
+        atomic_store_explicit(&buf->receiveWantSpace, true,
+                              memory_order_seq_cst);
+        /* Order the flag store before the caller's second look at the
+         * ring, which uses acquire loads only. This pairs with the fence
+         * in Consume_ExternalReceiveBuffer: either that sees the flag, or
+         * this side sees the space it freed, never neither. */
+        atomic_thread_fence(memory_order_seq_cst);
+    }
 }
 
-volatile char* __attribute__((optimize("O0"))) ExternalTransmitBuffer()
+/* set the task to wake each time data is added to a Receive buffer */
+void ExternalReceiveBuffer_SetNotifyTask(TaskHandle_t task)
 {
-    return _ExternalTransmitBuffer;
+    atomic_store_explicit(&_ExternalReceiveNotifyTask, task,
+                          memory_order_release);
 }
 
-/* RTOS-safe positional value of current receive buffer position.
- * care should be take when using the number as more chars may have arrived!
- */
+/* number of bytes from SSH waiting to be sent to the external device */
 int ExternalReceiveBufferSz(void)
 {
     int ret = 0;
+    int i;
 
-    InitReceiveSemaphore();
-    if (xSemaphoreTake(_xExternalReceiveBuffer_Semaphore,
-                       (TickType_t) 10) == pdTRUE) {
-
-        /* the entire thread-safety wrapper is for this code statement */
-        {
-            ret = _ExternalReceiveBufferSz;
-        }
-        xSemaphoreGive(_xExternalReceiveBuffer_Semaphore);
-    }
-    else {
-        /* we could not get the semaphore to update the value!
-         * TODO how to handle this?  */
-        ret = 0;
+    for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+        ret += (int)ring_buffer_used(&_ExternalSessionBuffer[i].receive);
     }
 
-#ifdef SSH_SERVER_PROFILE
-    if (ret > MaxSeenRxSize) {
-        MaxSeenRxSize = ret;
-    }
-#endif
     return ret;
 }
 
-/* RTOS-safe positional value of current transmit buffer position.
- * care should be take when using the number as more chars may have been sent!
+/* move uart_tx_task on to the next session */
+static void ExternalReceiveBuffer_Next(void)
+{
+    _ExternalReceiveRegions = 0;
+    _ExternalReceiveNext++;
+    if (_ExternalReceiveNext >= SSH_SERVER_MAX_SESSIONS) {
+        _ExternalReceiveNext = 0;
+    }
+}
+
+/*
+ * Point *ToData at pending SSH client data, in place, and return its size;
+ * zero when no session has any. Sessions are taken in turn, everything a
+ * session has pending (at most two regions, when it wraps) before the
+ * next, so that one busy client cannot hold the UART. The data has no
+ * terminator and may hold any byte value. Negative values are errors.
  */
-int ExternalTransmitBufferSz(void)
+int Peek_ExternalReceiveBuffer(const byte **ToData)
 {
-    int ret;
+    const uint8_t* region = NULL;
+    int ret = 0;
+    int i;
 
-    InitTransmitSemaphore();
-    if (xSemaphoreTake(_xExternalTransmitBuffer_Semaphore,
-                      (TickType_t) 10) == pdTRUE) {
+    if (ToData == NULL) {
+        return -1;
+    }
 
-        /* the entire thread-safety wrapper is for this code statement */
-        {
-            ret = _ExternalTransmitBufferSz;
+    for (i = 0; (i < SSH_SERVER_MAX_SESSIONS) && (ret == 0); i++) {
+        ret = (int)ring_buffer_peek(
+                &_ExternalSessionBuffer[_ExternalReceiveNext].receive,
+                &region);
+        if (ret == 0) {
+            ExternalReceiveBuffer_Next();
         }
-
-        xSemaphoreGive(_xExternalTransmitBuffer_Semaphore);
     }
-    else {
-        /* we could not get the semaphore to update the value!
-         * TODO how to handle this? */
-        ret = 0;
+
+    *ToData = (const byte*)region;
+    return ret;
+}
+
+/* release sz bytes previously returned by Peek_ExternalReceiveBuffer */
+void Consume_ExternalReceiveBuffer(int sz)
+{
+    ext_session_buffer_t* buf = &_ExternalSessionBuffer[_ExternalReceiveNext];
+    ring_buffer_t* rb = &buf->receive;
+
+    if (sz <= 0) {
+        return;
     }
 
-#ifdef SSH_SERVER_PROFILE
-    if (ret > MaxSeenTxSize) {
-        MaxSeenTxSize = ret;
+    ring_buffer_consume(rb, sz);
+
+    /* Let a session waiting on the UART read from SSH again, and so grant
+     * its client more window. The fence keeps the release of the tail
+     * above from moving past the flag load, as in
+     * ExternalReceiveBuffer_WantSpace. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&buf->receiveWantSpace, memory_order_seq_cst)
+        && (ring_buffer_free(rb) >= ring_buffer_capacity(rb) / 2)) {
+        atomic_store_explicit(&buf->receiveWantSpace, false,
+                              memory_order_seq_cst);
+        ext_session_signal(buf);
     }
-#endif
 
-    return ret;
+    /* a session gets its wrapped region too, then it is the next turn */
+    _ExternalReceiveRegions++;
+    if ((ring_buffer_used(rb) == 0) || (_ExternalReceiveRegions >= 2)) {
+        ExternalReceiveBuffer_Next();
+    }
 }
 
 /*
- * returns zero if ExternalReceiveBufferSz successfully assigned
+ * Append data from the external device, to be sent to every attached SSH
+ * client. Returns the number of bytes accepted by all of them, which is
+ * less than sz when any one buffer is full. Negative values are errors.
  */
-int Set_ExternalReceiveBufferSz(int n)
+int Set_ExternalTransmitBuffer(const byte *FromData, int sz)
 {
-    int ret = 0; /* we assume success unless proven otherwise */
+    int ret = sz;
+    int i;
 
-    InitReceiveSemaphore();
-    if ((n >= 0) && (n < EXT_RX_BUF_MAX_SZ - 1)) {
-        /* only assign valid buffer sizes */
-        if (xSemaphoreTake(_xExternalReceiveBuffer_Semaphore,
-            (TickType_t) 10) == pdTRUE) {
+    if ((FromData == NULL) || (sz < 0)) {
+        return -1;
+    }
 
-            /* the entire thread-safety wrapper is for this code statement */
-            {
-                _ExternalReceiveBufferSz = n;
+    for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+        ext_session_buffer_t* buf = &_ExternalSessionBuffer[i];
+        int thisSz;
 
-                /* ensure the next char is zero, in case the stuffer of data
-                 * does not do it */
-                _ExternalReceiveBuffer[n + 1] = 0;
-            }
+        if (!atomic_load_explicit(&buf->attached, memory_order_acquire)) {
+            continue;
+        }
 
-            xSemaphoreGive(_xExternalReceiveBuffer_Semaphore);
+        thisSz = (int)ring_buffer_write(&buf->transmit, FromData, sz);
+        if (thisSz < sz) {
+            ESP_LOGW(TAG, "Warning: Set_ExternalTransmitBuffer %d full, "
+                          "dropped %d bytes.", i, sz - thisSz);
         }
-        else {
-            /* we could not get the semaphore to update the value! */
-            ret = 1;
+        if (thisSz < ret) {
+            ret = thisSz;
         }
+        if (thisSz > 0) {
+            ext_session_signal(buf);
+        }
+
+#ifdef SSH_SERVER_PROFILE
+        if ((int)ring_buffer_used(&buf->transmit) > MaxSeenTxSize) {
+            MaxSeenTxSize = (int)ring_buffer_used(&buf->transmit);
+        }
+#endif
     }
-    else {
-        /* the new length must be between zero and maximum length! */
-        ret = 1;
-    }
+
     return ret;
 }
 
 /*
- * returns zero if ExternalTransmitBufferSz successfully assigned
+ * Set up the session buffers and create the eventfds used to announce new
+ * Transmit data. Call once at startup, before the UART and SSH tasks are
+ * created.
  */
-int Set_ExternalTransmitBufferSz(int n)
+int init_tx_rx_buffer_events(void)
 {
-    int ret = 0; /* we assume success unless proven otherwise */
+    esp_vfs_eventfd_config_t config = ESP_VFS_EVENTD_CONFIG_DEFAULT();
+    esp_err_t err;
+    int i;
+
+    for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+        ext_session_buffer_t* buf = &_ExternalSessionBuffer[i];
+
+        ring_buffer_init(&buf->receive, buf->receiveData,
+                         sizeof(buf->receiveData));
+        ring_buffer_init(&buf->transmit, buf->transmitData,
+                         sizeof(buf->transmitData));
+        atomic_init(&buf->attached, false);
+        atomic_init(&buf->receiveWantSpace, false);
+        buf->transmitEventFd = -1;
+        buf->preambleSz = 0;
+        buf->preambleIdx = 0;
+    }
 
-    InitTransmitSemaphore();
+    /* ESP_ERR_INVALID_STATE: already registered elsewhere, that's fine */
+    if (config.max_fds < SSH_SERVER_MAX_SESSIONS) {
+        config.max_fds = SSH_SERVER_MAX_SESSIONS;
+    }
+    err = esp_vfs_eventfd_register(&config);
+    if ((err != ESP_OK) && (err != ESP_ERR_INVALID_STATE)) {
+        ESP_LOGE(TAG, "ERROR: esp_vfs_eventfd_register failed %d", err);
+        return err;
+    }
 
-    /* we look at ByteExternalTransmitBufferSz + 1
-     * since we also append our own zero string termination
-     */
-    if ( (n < 0) || (n > EXT_TX_BUF_MAX_SZ + 1) ) {
-        /* New buffer size length must be between zero and maximum length! */
-        ret = 1;
+    for (i = 0; i < SSH_SERVER_MAX_SESSIONS; i++) {
+        _ExternalSessionBuffer[i].transmitEventFd = eventfd(0, 0);
+        if (_ExternalSessionBuffer[i].transmitEventFd < 0) {
+            ESP_LOGE(TAG, "ERROR: could not create transmit eventfd %d", i);
+            return ESP_FAIL;
+        }
     }
-    else {
-        /* only assign valid buffer sizes */
-        if (xSemaphoreTake(_xExternalTransmitBuffer_Semaphore,
-            (TickType_t) 10) == pdTRUE) {
 
-            /* the entire thread-safety wrapper is for this code statement */
-            {
-                _ExternalTransmitBufferSz = n;
+    return ESP_OK;
+}
 
-                /* ensure the next char is zero,
-                 * in case the stuffer of data does not do it */
-                _ExternalTransmitBuffer[n + 1] = 0;
-            }
+/* the eventfd to select() on for Transmit data; -1 if not initialized */
+int ExternalTransmitBuffer_EventFd(int session)
+{
+    ext_session_buffer_t* buf = ext_session_buffer(session);
 
-            xSemaphoreGive(_xExternalTransmitBuffer_Semaphore);
-        }
-        else {
-            /* we could not get the semaphore to update the value! */
-            ret = 1;
-        }
-    } /* valid value of n */
-    return ret;
+    return (buf == NULL) ? -1 : buf->transmitEventFd;
 }
 
-/* Set the length of the external (typiclly UART) Rx buffer */
-int Set_ExternalReceiveBuffer(byte *FromData, int sz)
+/* reset the Transmit eventfd after select() reported it readable */
+void ExternalTransmitBuffer_ClearEvent(int session)
 {
-    /* TODO this block has not yet been fully tested */
-    int ret = ESP_OK; /* we assume success unless proven otherwise */
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+    uint64_t signal = 0;
 
-    if ( (sz < 0) || (sz > EXT_RX_BUF_MAX_SZ) ) {
-        /* we'll only do a copy for valid sizes, otherwise return an error */
-        ret = 1;
-    }
-    else {
-        InitReceiveSemaphore();
-        if (xSemaphoreTake(_xExternalReceiveBuffer_Semaphore,
-            (TickType_t) 10) == pdTRUE) {
-
-            /* The entire thread-safety wrapper is for this code statement.
-             * in a multi-threaded environment, a different thread may be
-             * reading or writing from the data. We need to ensure it is
-             * static at the time of copy.
-             */
-            {
-                memcpy(
-                      (byte*)&_ExternalReceiveBuffer[_ExternalReceiveBufferSz],
-                      FromData,
-                      sz);
-
-                _ExternalReceiveBufferSz = sz;
-            } /* thread safe */
-
-            xSemaphoreGive(_xExternalReceiveBuffer_Semaphore);
-        }
-        else {
-            /* we could not get the semaphore to update the value!
-             * TODO how to handle this? Will this ever occur?
-             * If so, adjust wait time, above. */
-            ESP_LOGW(TAG, "Warning: Set_ExternalReceiveBuffer failed to "
-                          "take semaphore. Consisder wait time adjustment." );
-            ret = 1;
+    if ((buf != NULL) && (buf->transmitEventFd >= 0)) {
+        if (read(buf->transmitEventFd, &signal, sizeof(signal))
+                != sizeof(signal)) {
+            ESP_LOGV(TAG, "Transmit event already clear");
         }
     }
+}
 
-    return ret;
+/* number of bytes waiting to be sent to the SSH client */
+int ExternalTransmitBufferSz(int session)
+{
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+
+    if (buf == NULL) {
+        return 0;
+    }
+
+    return (buf->preambleSz - buf->preambleIdx)
+           + (int)ring_buffer_used(&buf->transmit);
 }
 
 /*
- * Thread safe populate ToData with the contents of _ExternalTransmitBuffer
- * returns the size of the data, negative values are errors.
+ * Point *ToData at the oldest contiguous data waiting for the SSH client
+ * and return its size; zero when there is nothing to send. The data stays
+ * in place until released with Consume_ExternalTransmitBuffer, so the
+ * caller can hand it straight to wolfSSH_stream_send without a copy.
  */
-int Get_ExternalTransmitBuffer(byte **ToData)
+int Get_ExternalTransmitBuffer(int session, byte **ToData)
 {
-    int ret = 0;
-    InitTransmitSemaphore();
-
-    if (xSemaphoreTake(_xExternalTransmitBuffer_Semaphore,
-        (TickType_t) 10) == pdTRUE) {
-
-        int thisSize = _ExternalTransmitBufferSz;
-        if (thisSize == 0) {
-            /* nothing to do */
-            ESP_LOGI(TAG,"Get_ExternalTransmitBuffer size is already zero");
-        }
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+    const uint8_t* region = NULL;
+    int ret;
 
-        else {
-            if (*ToData == NULL) {
-                /* we could not allocate memory, so fail */
-                ret = -1;
-                ESP_LOGI(TAG,"Get_ExternalTransmitBuffer *ToData == NULL");
-            }
-            else {
-                memcpy(*ToData,
-                       (byte*)_ExternalTransmitBuffer,
-                       thisSize
-                      );
-
-                _ExternalTransmitBufferSz = 0;
-                ret = thisSize;
-            }
-        }
-        xSemaphoreGive(_xExternalTransmitBuffer_Semaphore);
+    if ((buf == NULL) || (ToData == NULL)) {
+        return -1;
     }
-    else {
-        /* We could not get the semaphore to update the value!
-         * TODO how to handle this? Wait time adjust? */
-        ret = -1;
-        ESP_LOGE(TAG,"ERROR: Get_ExternalTransmitBuffer SemaphoreTake "
-                     "_xExternalTransmitBuffer_Semaphore failed.");
+
+    if (buf->preambleIdx < buf->preambleSz) {
+        *ToData = (byte*)&buf->preamble[buf->preambleIdx];
+        return buf->preambleSz - buf->preambleIdx;
     }
 
+    ret = (int)ring_buffer_peek(&buf->transmit, &region);
+    *ToData = (byte*)region;
+
     return ret;
 }
 
-
 /*
- * Thread safe populate FromData with the contents of _ExternalTransmitBuffer
- * returns the size of the data, negative values are errors.
+ * Point *ToData at waiting data skip bytes past the oldest, in place, and
+ * return the size of that contiguous region. Lets server_worker look over
+ * data as it arrives without taking it from the ring.
  */
-int Set_ExternalTransmitBuffer(byte *FromData, int sz)
+int Peek_ExternalTransmitBuffer(int session, int skip, const byte **ToData)
 {
-    int ret = 0;
-
-    /* here we need to call the thread-safe ExternalTransmitBufferSz() */
-    int thisNewSize = sz + ExternalTransmitBufferSz();
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+    const uint8_t* region = NULL;
+    int preambleSz;
+    int ret;
 
-    if ( (sz < 0) || (thisNewSize > EXT_TX_BUF_MAX_SZ) ) {
-        /* we'll only do a copy for valid sizes, otherwise return an error */
-        ret = -1;
+    if ((buf == NULL) || (ToData == NULL) || (skip < 0)) {
+        return -1;
     }
-    else {
-        InitTransmitSemaphore();
-        if (xSemaphoreTake(_xExternalTransmitBuffer_Semaphore,
-                           (TickType_t) 10) == pdTRUE) {
-
-            /* Trim any trailing zeros from existing data by
-             * adjusting our array pointer. */
-            int thisStart = _ExternalTransmitBufferSz;
-            while (thisStart > 0
-                   &&
-                   (_ExternalTransmitBuffer[thisStart - 1] == 0x0)) {
-                thisStart--;
-            }
-
-            /* Actual new size may be smaller than above
-             * if we trimmed some zeros. */
-            thisNewSize = thisStart + sz;
-
-            /* The entire thread-safety wrapper is for this code statement.
-             * In a multi-threaded environment, a different thread may be
-             * reading writing from the data. We need to ensure it is static
-             * at the time of copy.
-             */
-            {
-                memcpy((byte*)&_ExternalTransmitBuffer[thisStart],
-                    FromData,
-                    sz);
-
-                _ExternalTransmitBufferSz = thisNewSize;
-                ret = thisNewSize;
-            }
-            xSemaphoreGive(_xExternalTransmitBuffer_Semaphore);
-        }
-        else {
-            /* we could not get the semaphore to update the value!
-             * TODO how to handle this? */
-            ESP_LOGW(TAG, "xSemaphoreTake failed in "
-                          "Set_ExternalTransmitBuffer");
-            ret = -1;
-        }
+
+    preambleSz = buf->preambleSz - buf->preambleIdx;
+    if (skip < preambleSz) {
+        *ToData = (const byte*)&buf->preamble[buf->preambleIdx + skip];
+        return preambleSz - skip;
     }
 
+    ret = (int)ring_buffer_peek_at(&buf->transmit,
+                                   (size_t)(skip - preambleSz), &region);
+    *ToData = (const byte*)region;
+
     return ret;
 }
 
+/* release sz bytes previously returned by Get_ExternalTransmitBuffer */
+void Consume_ExternalTransmitBuffer(int session, int sz)
+{
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+
+    if ((buf == NULL) || (sz <= 0)) {
+        return;
+    }
+
+    if (buf->preambleIdx < buf->preambleSz) {
+        buf->preambleIdx += sz;
+        if (buf->preambleIdx >= buf->preambleSz) {
+            buf->preambleIdx = 0;
+            buf->preambleSz = 0;
+        }
+    }
+    else {
+        ring_buffer_consume(&buf->transmit, sz);
+    }
+}
 
 /*
- * Initialize external buffers and show welcome message.
+ * Attach a session to the external buffers and queue the welcome message.
  * TxPin and RxPin are for display purposes only.
+ *
+ * Called by the transmit consumer (server_worker) at the start of each
+ * session: stale UART output from before the connection is dropped.
+ * Pending data for the UART is left alone, as only its consumer
+ * (uart_tx_task) may discard it.
  */
-int  init_tx_rx_buffer(byte TxPin, byte RxPin)
+int init_tx_rx_buffer(int session, byte TxPin, byte RxPin)
 {
+    ext_session_buffer_t* buf = ext_session_buffer(session);
     int ret = 0;
 
-    char numStr[3] = { ' ', ' ', ' ' }; /* printable 2-digit GPIO numbers */
-
-    /* These inits need to be called only once,
-     * but can be repeatedly called as needed. */
-    InitReceiveSemaphore();
-    InitTransmitSemaphore();
-
-    /*
-     *  Init and stuff startup message in buffer.
-     */
-    Set_ExternalReceiveBufferSz(0);
-    Set_ExternalTransmitBufferSz(0);
-
-    /* Typically prints: "Welcome to wolfSSL ESP32 SSH UART Server!" */
-    Set_ExternalTransmitBuffer((byte*)SSH_WELCOME_MESSAGE,
-                               sizeof(SSH_WELCOME_MESSAGE)
-                              );
-
-    /* Typically prints "You are now connected to UART " */
-    Set_ExternalTransmitBuffer((byte*)SSH_GPIO_MESSAGE,
-                               sizeof(SSH_GPIO_MESSAGE)
-                              );
-
-    /* "Tx GPIO " */
-    Set_ExternalTransmitBuffer((byte*)SSH_GPIO_MESSAGE_TX,
-                               sizeof(SSH_GPIO_MESSAGE_TX)
-                              );
-
-    /* The number of the Tx pin, converted to a string.
-     *
-     * Note despite Clang IntelliSense detecting duplicate code,
-     * it is NOT a duplicate. This one compares TxPin,
-     * the next one compares RxPin. */
-    if (TxPin <= 0x40) {
-        int_to_dec((char*)&numStr, TxPin);
-        numStr[2] = 0;
-        Set_ExternalTransmitBuffer((byte*)&numStr, sizeof(numStr));
-    }
-    else {
-        ESP_LOGE(TAG,"ERROR: bad value for TxPin");
-        ret = 1;
+    if (buf == NULL) {
+        return 1;
     }
 
-    /* ", Rx GPIO " */
-    Set_ExternalTransmitBuffer((byte*)SSH_GPIO_MESSAGE_RX,
-                               sizeof(SSH_GPIO_MESSAGE_RX)
-                              );
+    ring_buffer_discard(&buf->transmit);
+    ExternalTransmitBuffer_ClearEvent(session);
+    buf->preambleIdx = 0;
+    buf->preambleSz = 0;
+    atomic_store_explicit(&buf->receiveWantSpace, false,
+                          memory_order_seq_cst);
 
-    /* the number of the Rx pin, converted to a string */
-    if (RxPin <= 0x40)
-    {
-        int_to_dec((char*)&numStr, RxPin);
-        numStr[2] = 0;
-        Set_ExternalTransmitBuffer((byte*)&numStr, sizeof(numStr));
+#ifndef DISABLE_SSH_UART
+    if ((TxPin > 0x40) || (RxPin > 0x40)) {
+        ESP_LOGE(TAG,"ERROR: bad value for TxPin or RxPin");
+        ret = 1;
     }
     else {
-        ESP_LOGE(TAG,"ERROR: bad value for RxPin");
-        ret = 1;
+        /* Typically prints:
+         *   "Welcome to wolfSSL ESP32 SSH UART Server!"
+         *   "You are now connected to UART Tx GPIO 17, Rx GPIO 16."
+         *   "Press [Enter] to start. ~. to exit" */
+        buf->preambleSz = snprintf(buf->preamble,
+                                   sizeof(buf->preamble),
+                                   "%s%s%s%d%s%d%s",
+                                   SSH_WELCOME_MESSAGE,
+                                   SSH_GPIO_MESSAGE,
+                                   SSH_GPIO_MESSAGE_TX, TxPin,
+                                   SSH_GPIO_MESSAGE_RX, RxPin,
+                                   SSH_READY_MESSAGE);
+        if (buf->preambleSz < 0) {
+            buf->preambleSz = 0;
+            ret = 1;
+        }
+        else if (buf->preambleSz >= (int)sizeof(buf->preamble)) {
+            buf->preambleSz = (int)sizeof(buf->preamble) - 1;
+        }
     }
+#else
+    (void)TxPin;
+    (void)RxPin;
+#endif
+
+    atomic_store_explicit(&buf->attached, true, memory_order_release);
 
-    /* typically "Press [Enter] to start. Ctrl-C to exit" */
-    Set_ExternalTransmitBuffer((byte*)SSH_READY_MESSAGE,
-                               sizeof(SSH_READY_MESSAGE)
-                              );
 #ifdef INCLUDE_uxTaskGetStackHighWaterMark
     ESP_LOGI(TAG, "Stack HWM: %d\n", uxTaskGetStackHighWaterMark(NULL));
 #endif
     return ret;
 }
+
+/* detach a session at the end of its connection */
+void close_tx_rx_buffer(int session)
+{
+    ext_session_buffer_t* buf = ext_session_buffer(session);
+
+    if (buf != NULL) {
+        atomic_store_explicit(&buf->attached, false, memory_order_release);
+    }
+}
@@ -31,28 +31,23 @@
 #include "tx_rx_buffer.h"
 #include "ssh_server_config.h"
 #include "ssh_server.h"
+#include "uart_map.h"
 
 #include <esp_task_wdt.h>
 #include <driver/uart.h>
 #include <driver/gpio.h>
 #include <esp_log.h>
 
-/* portTICK_PERIOD_MS is ( ( TickType_t ) 1000 / configTICK_RATE_HZ )
- * configTICK_RATE_HZ is CONFIG_FREERTOS_HZ
- * CONFIG_FREERTOS_HZ is 100
- **/
-#define UART_TICKS_TO_WAIT (20 / portTICK_PERIOD_MS)
-
 /*
- * see examples: https://github.com/espressif/esp-idf/blob/master/examples/peripherals/uart/uart_echo/main/uart_echo_example_main.c
+ * see examples: https://github.com/espressif/esp-idf/blob/master/examples/peripherals/uart/uart_events/main/uart_events_example_main.c
  */
 
 
-/* we are going to use a real backspace instead of 0x7f observed */
-const char backspace[1] = { (char)0x08 };
-static SemaphoreHandle_t xUART_Semaphore = NULL;
 static const char* TAG = "uart_helper";
 
+/* UART driver event queue, see UART_EVENT_QUEUE_SZ */
+static QueueHandle_t uart_event_queue = NULL;
+
 /*
  * startupMessage is the message before actually connecting to UART in
  * server task thread.
@@ -77,7 +72,12 @@ void init_UART(void)
         .data_bits = UART_DATA_8_BITS,
         .parity = UART_PARITY_DISABLE,
         .stop_bits = UART_STOP_BITS_1,
+    #if SSH_UART_FLOW_CTRL
+        .flow_ctrl = UART_HW_FLOWCTRL_CTS_RTS,
+        .rx_flow_ctrl_thresh = UART_RX_FLOW_CTRL_THRESH,
+    #else
         .flow_ctrl = UART_HW_FLOWCTRL_DISABLE,
+    #endif
     #if !defined(CONFIG_IDF_TARGET_ESP8266)
         .source_clk = UART_SCLK_DEFAULT,
     #endif
@@ -86,12 +86,28 @@ void init_UART(void)
     #if CONFIG_UART_ISR_IN_IRAM
         intr_alloc_flags = ESP_INTR_FLAG_IRAM;
     #endif
-    /* We won't use a buffer for sending UART_NUM_1 data. */
-    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_1, 2048, 0, 0,
-                                        NULL, intr_alloc_flags));
+    /* We won't use a buffer for sending UART_NUM_1 data.
+     * Received data is announced on uart_event_queue, so uart_rx_task
+     * only wakes when there is something to do. */
+    ESP_ERROR_CHECK(uart_driver_install(UART_NUM_1, UART_RX_DRIVER_BUF_SZ, 0,
+                                        UART_EVENT_QUEUE_SZ,
+                                        &uart_event_queue, intr_alloc_flags));
     ESP_ERROR_CHECK(uart_param_config(UART_NUM_1, &uart_config));
+#if SSH_UART_FLOW_CTRL
+    ESP_ERROR_CHECK(uart_set_pin(UART_NUM_1, TXD_PIN, RXD_PIN,
+                                 RTS_PIN, CTS_PIN));
+#else
     ESP_ERROR_CHECK(uart_set_pin(UART_NUM_1, TXD_PIN, RXD_PIN,
                                  UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+#endif
+
+    /* A UART_DATA event is posted when the Rx FIFO reaches the threshold,
+     * or when the line has been idle for the timeout; a single keystroke
+     * is therefore delivered after a few symbol times, not a tick. */
+    ESP_ERROR_CHECK(uart_set_rx_full_threshold(UART_NUM_1,
+                                               UART_RX_FULL_THRESHOLD));
+    ESP_ERROR_CHECK(uart_set_rx_timeout(UART_NUM_1,
+                                        UART_RX_TIMEOUT_SYMBOLS));
 #endif /* CONFIG_IDF_TARGET_ESP8266 */
     ESP_LOGI(TAG, "End init_UART.");
 }
@@ -109,16 +125,28 @@ void uart_send_welcome() {
  *  send character string at char* data to UART
  */
 int sendData(const char* logName, const char* data) {
-    const int len = strlen(data);
-
-    /* note we are always using UART_NUM_1 but the GPIO pins may vary */
-    const int txBytes = uart_write_bytes(UART_NUM_1, data, len);
+    const int txBytes = sendDataSz(logName, (const uint8_t*)data,
+                                   strlen(data));
 
     ESP_LOGI(logName, "Wrote %d bytes", txBytes);
 
     return txBytes;
 }
 
+/*
+ *  send sz bytes at data to UART, no terminator needed
+ */
+int sendDataSz(const char* logName, const uint8_t* data, int sz) {
+    /* note we are always using UART_NUM_1 but the GPIO pins may vary.
+     * With no driver Tx buffer this returns once all of it is in the
+     * FIFO, so a whole region goes in a single call. */
+    const int txBytes = uart_write_bytes(UART_NUM_1, data, sz);
+
+    ESP_LOGV(logName, "Wrote %d of %d bytes", txBytes, sz);
+
+    return txBytes;
+}
+
 /*
  *  if the external Receive Buffer has data (e.g. from SSH client)
  *  then send that data to the UART (ExternalReceiveBufferSz bytes)
@@ -130,50 +158,98 @@ void uart_tx_task(void *arg) {
     static const char *TX_TASK_TAG = "TX_TASK";
     esp_log_level_set(TX_TASK_TAG, ESP_LOG_INFO);
 
+    /* SSH to UART byte translation, and room for a translated region;
+     * expansion only ever needs more passes, not a bigger buffer */
+    static uart_map_t map;
+    static uint8_t mapped[EXT_RX_BUF_MAX_SZ];
+
+    if (uart_map_config(&map, SSH_UART_MAP_NEWLINE, SSH_UART_MAP_DEL,
+                        SSH_UART_MAP_CTRL) != 0) {
+        ESP_LOGE(TAG, "Unknown SSH_UART_MAP setting, using identity map.");
+        uart_map_init(&map);
+    }
+
+    /* The SSH side notifies this task whenever it adds data. */
+    ExternalReceiveBuffer_SetNotifyTask(xTaskGetCurrentTaskHandle());
+
     /* this RTOS task will never exit */
     while (1) {
-        vTaskDelay(10);
-
-        if (ExternalReceiveBufferSz() > 0)
+        const byte* data = NULL;
+        int dataSz;
+
+        /* Drain everything pending, then sleep until notified. A
+         * notification that arrives while draining stays pending, so
+         * the next take returns at once and nothing is missed. A region
+         * the map leaves alone, the usual case, goes to the driver
+         * straight from the ring, UART_TX_PIECE_SZ at a time. */
+        while ((dataSz = Peek_ExternalReceiveBuffer(&data)) > 0)
         {
-            ESP_LOGI(TAG,"UART Send Data");
+            size_t done = 0;
+
+            if (dataSz > UART_TX_PIECE_SZ) {
+                dataSz = UART_TX_PIECE_SZ;
+            }
+            ESP_LOGV(TAG, "UART Send Data %d", dataSz);
 
-            /* We don't want to send 0x7f as a backspace,
-             * we want a real backspace.
-             * TODO: optional character mapping */
-            if (ExternalReceiveBuffer_IsChar(0x7f)) {
-                sendData(TX_TASK_TAG, backspace);
+            if (uart_map_span(&map, data, (size_t)dataSz) ==
+                    (size_t)dataSz) {
+                sendDataSz(TX_TASK_TAG, data, dataSz);
+                done = (size_t)dataSz;
             }
-            else
-            {
-                sendData(TX_TASK_TAG, (char*)ExternalReceiveBuffer());
+
+            while (done < (size_t)dataSz) {
+                size_t used = 0;
+                size_t outSz = uart_map_apply(&map, data + done,
+                                              (size_t)dataSz - done,
+                                              mapped, sizeof(mapped),
+                                              &used);
+                if (outSz > 0) {
+                    sendDataSz(TX_TASK_TAG, mapped, (int)outSz);
+                }
+                done += used;
             }
 
-            /* Once we sent data, reset the pointer to zero to
-             * indicate empty queue. */
-            Set_ExternalReceiveBufferSz(0);
+            Consume_ExternalReceiveBuffer(dataSz);
         }
 
-        /* Yield. Let's not be greedy. */
-        taskYIELD();
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
     }
 }
 
 /*
- * reading and writing memory from different threads requires coordination.
- * we'll use exclusive mutex semaphores for this.
+ * Read everything the UART driver has buffered and append it to the
+ * External Transmit buffer. Returns the number of bytes moved.
  */
-void InitSemaphore()
+static int uart_rx_drain(uint8_t* data, int dataSz)
 {
-    if (xUART_Semaphore == NULL) {
-        xUART_Semaphore = xSemaphoreCreateMutex();
+    int total = 0;
+    size_t buffered = 0;
+
+    while (uart_get_buffered_data_len(UART_NUM_1, &buffered) == ESP_OK
+           && buffered > 0) {
+        int rxBytes;
+
+        if (buffered > (size_t)dataSz) {
+            buffered = (size_t)dataSz;
+        }
+
+        /* data is already in the driver buffer; never block here */
+        rxBytes = uart_read_bytes(UART_NUM_1, data, buffered, 0);
+        if (rxBytes <= 0) {
+            break;
+        }
+
+        /* this can be helpful during debug, but causes a bit of
+         * sluggish performance as it is not very RTOS friendly:
+
+         ESP_LOG_BUFFER_HEXDUMP(TAG, data, rxBytes, ESP_LOG_INFO);
+          */
+
+        Set_ExternalTransmitBuffer(data, rxBytes);
+        total += rxBytes;
     }
 
-#ifdef configUSE_RECURSIVE_MUTEXES
-    /* this may be interesting; see semphr.h */
-    ESP_LOGI(TAG,"InitSemaphore found UART "
-                 "configUSE_RECURSIVE_MUTEXES enabled");
-#endif
+    return total;
 }
 
 /*
@@ -181,12 +257,10 @@ void InitSemaphore()
  * buffer to SEND (typically out to the SSH client)
  */
 void uart_rx_task(void *arg) {
-    InitSemaphore();
-
-    /* TODO do we really want malloc? probably not.
-     * but in this thread, it only gets allocated once.
-     **/
-    uint8_t* data = (uint8_t*) malloc(EXT_RX_BUF_MAX_SZ + 1);
+    /* Only this task reads the UART, so one static landing area is enough */
+    static uint8_t data[EXT_TX_BUF_MAX_SZ];
+    uart_event_t event;
+    int rxBytes;
 
     /*
      * when we receive chars from UART, we'll send them out SSH
@@ -196,39 +270,49 @@ void uart_rx_task(void *arg) {
 
     ESP_LOGW(TAG, "-- Start RX_TASK");
 
-    /* TODO this should be interrupt driven, rather than polling */
-    while (1) {
-        /* note some examples have UART_TICKS_TO_WAIT = 1000,
-         * which results in very sluggish response.
-         * a known good value is (20 / portTICK_RATE_MS) */
-        vTaskDelay(10);
-        const int rxBytes = uart_read_bytes(UART_NUM_1,
-                                            data,
-                                            EXT_RX_BUF_MAX_SZ,
-                                            UART_TICKS_TO_WAIT);
-
-        if (rxBytes > 0) {
-            ESP_LOGI(TAG,"UART Rx Data!");
-            data[rxBytes] = 0;
-
-            ESP_LOGI(RX_TASK_TAG, "Read %d bytes:", rxBytes);
-
-            /* this can be helpful during debug, but causes a bit of
-             * sluggish performance as it is not very RTOS friendly:
-
-             ESP_LOGI(RX_TASK_TAG, "Read %d bytes: '%s'", rxBytes, data);
-             ESP_LOG_BUFFER_HEXDUMP(RX_TASK_TAG, data, rxBytes, ESP_LOG_INFO);
-
-              *
-              */
+    if (uart_event_queue == NULL) {
+        ESP_LOGE(TAG, "Error: UART event queue missing; call init_UART.");
+        vTaskDelete(NULL);
+        return;
+    }
 
-            Set_ExternalTransmitBuffer(data, rxBytes);
-        } /* (rxBytes > 0) */
+    /* this RTOS task sleeps until the UART driver posts an event */
+    while (1) {
+        if (xQueueReceive(uart_event_queue, &event, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
 
-        /* yield. let's not be greedy */
-        taskYIELD();
+        switch (event.type) {
+            case UART_DATA:
+            case UART_PATTERN_DET:
+                /* Rx FIFO threshold, idle timeout or pattern match; not
+                 * inside the log call, which compiles away below its
+                 * level */
+                rxBytes = uart_rx_drain(data, sizeof(data));
+                ESP_LOGV(RX_TASK_TAG, "Read %d bytes", rxBytes);
+                break;
+
+            case UART_FIFO_OVF:
+            case UART_BUFFER_FULL:
+                /* Keep what the driver holds, then start clean. Events
+                 * still queued for the flushed data are now stale. */
+                ESP_LOGW(RX_TASK_TAG, "UART Rx overflow (event %d)",
+                                      (int)event.type);
+                uart_rx_drain(data, sizeof(data));
+                uart_flush_input(UART_NUM_1);
+                xQueueReset(uart_event_queue);
+                break;
+
+            case UART_BREAK:
+            case UART_PARITY_ERR:
+            case UART_FRAME_ERR:
+                ESP_LOGW(RX_TASK_TAG, "UART Rx line error (event %d)",
+                                      (int)event.type);
+                break;
+
+            default:
+                ESP_LOGV(RX_TASK_TAG, "UART event %d", (int)event.type);
+                break;
+        }
     }
-
-    /* we never actually get here */
-    free(data);
 }
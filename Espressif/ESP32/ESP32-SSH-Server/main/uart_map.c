@@ -0,0 +1,210 @@
+/* uart_map.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "uart_map.h"
+
+#include <string.h>
+
+/* a word of bytes, each set to b */
+#define UART_MAP_ONES     ((size_t)-1 / 0xFF)
+#define UART_MAP_BYTES(b) (UART_MAP_ONES * (b))
+
+/* non-zero if any byte of x is below n (n at most 0x80) */
+#define UART_MAP_HAS_LESS(x, n) \
+    (((x) - UART_MAP_BYTES(n)) & ~(x) & UART_MAP_BYTES(0x80))
+
+/* non-zero if any byte of x is below 0x20 or is DEL. Bytes after one that
+ * really matches may also be flagged, so a hit is checked byte by byte. */
+#define UART_MAP_CTRL_IN(x) \
+    (UART_MAP_HAS_LESS((x), 0x20) | \
+     UART_MAP_HAS_LESS((x) ^ UART_MAP_BYTES(0x7F), 1))
+
+static int uart_map_is_identity(const uart_map_t* map, int b)
+{
+    return (map->len[b] == 1) && (map->out[b][0] == (uint8_t)b);
+}
+
+/* the word at a time scan is only valid while printable bytes, and those
+ * at 0x80 and above, pass through */
+static void uart_map_update(uart_map_t* map)
+{
+    int b;
+
+    map->ctrlOnly = 1;
+    for (b = 0x20; b < 0x100; b++) {
+        if ((b != 0x7F) && !uart_map_is_identity(map, b)) {
+            map->ctrlOnly = 0;
+            break;
+        }
+    }
+}
+
+void uart_map_init(uart_map_t* map)
+{
+    int b;
+
+    for (b = 0; b < 0x100; b++) {
+        map->out[b][0] = (uint8_t)b;
+        map->out[b][1] = 0;
+        map->len[b] = 1;
+    }
+    map->ctrlOnly = 1;
+}
+
+int uart_map_set(uart_map_t* map, uint8_t in, const uint8_t* out,
+                 size_t outSz)
+{
+    if ((map == NULL) || (outSz > 2) || ((out == NULL) && (outSz > 0))) {
+        return 1;
+    }
+
+    map->len[in] = (uint8_t)outSz;
+    map->out[in][0] = (outSz > 0) ? out[0] : 0;
+    map->out[in][1] = (outSz > 1) ? out[1] : 0;
+    uart_map_update(map);
+
+    return 0;
+}
+
+int uart_map_config(uart_map_t* map, int newline, int del, int ctrl)
+{
+    static const uint8_t crlf[] = { '\r', '\n' };
+    static const uint8_t cr[] = { '\r' };
+    static const uint8_t bs[] = { '\b' };
+    int ret = 0;
+    int b;
+
+    if (map == NULL) {
+        return 1;
+    }
+    uart_map_init(map);
+
+    for (b = 0; (b < 0x20) && (ret == 0); b++) {
+        if ((b == '\t') || (b == '\n') || (b == '\r') || (b == '\b') ||
+            (b == 0x1B)) {
+            continue;
+        }
+        if (ctrl == UART_MAP_CTRL_DROP) {
+            ret = uart_map_set(map, (uint8_t)b, NULL, 0);
+        }
+        else if (ctrl == UART_MAP_CTRL_ESCAPE) {
+            const uint8_t caret[] = { '^', (uint8_t)('@' + b) };
+            ret = uart_map_set(map, (uint8_t)b, caret, sizeof(caret));
+        }
+        else if (ctrl != UART_MAP_CTRL_KEEP) {
+            ret = 1;
+        }
+    }
+
+    switch (newline) {
+        case UART_MAP_NL_KEEP:
+            break;
+        case UART_MAP_NL_CR_CRLF:
+            ret |= uart_map_set(map, '\r', crlf, sizeof(crlf));
+            break;
+        case UART_MAP_NL_LF_CRLF:
+            ret |= uart_map_set(map, '\n', crlf, sizeof(crlf));
+            break;
+        case UART_MAP_NL_LF_CR:
+            ret |= uart_map_set(map, '\n', cr, sizeof(cr));
+            break;
+        default:
+            ret = 1;
+            break;
+    }
+
+    if (del) {
+        ret |= uart_map_set(map, 0x7F, bs, sizeof(bs));
+    }
+
+    return ret;
+}
+
+size_t uart_map_span(const uart_map_t* map, const uint8_t* in, size_t sz)
+{
+    size_t i = 0;
+
+    for (;;) {
+        if (map->ctrlOnly) {
+            /* skip whole words with no control byte or DEL in them */
+            while (i + sizeof(size_t) <= sz) {
+                size_t w;
+
+                memcpy(&w, in + i, sizeof(w));
+                if (UART_MAP_CTRL_IN(w) != 0) {
+                    break;
+                }
+                i += sizeof(size_t);
+            }
+        }
+
+        while ((i < sz) && uart_map_is_identity(map, in[i])) {
+            i++;
+            /* back to whole words after a control byte that passes */
+            if (map->ctrlOnly && (i % sizeof(size_t)) == 0) {
+                break;
+            }
+        }
+
+        if ((i == sz) || !uart_map_is_identity(map, in[i])) {
+            return i;
+        }
+    }
+}
+
+size_t uart_map_apply(const uart_map_t* map, const uint8_t* in, size_t inSz,
+                      uint8_t* out, size_t outSz, size_t* used)
+{
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i < inSz) {
+        size_t run = uart_map_span(map, in + i, inSz - i);
+        uint8_t b;
+
+        if (run > outSz - o) {
+            run = outSz - o;
+        }
+        memcpy(out + o, in + i, run);
+        i += run;
+        o += run;
+
+        if ((i == inSz) || (o == outSz)) {
+            break;
+        }
+
+        /* in[i] is changed by the map */
+        b = in[i];
+        if (map->len[b] > outSz - o) {
+            break;
+        }
+        if (map->len[b] > 0) {
+            out[o++] = map->out[b][0];
+        }
+        if (map->len[b] > 1) {
+            out[o++] = map->out[b][1];
+        }
+        i++;
+    }
+
+    if (used != NULL) {
+        *used = i;
+    }
+    return o;
+}
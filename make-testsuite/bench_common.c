@@ -0,0 +1,442 @@
+/* bench_common.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "bench_common.h"
+
+#include <wolfssl/wolfcrypt/memory.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+
+uint64_t BenchNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+uint64_t BenchCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    /* the generic timer; it counts at a fixed rate, not CPU cycles */
+    uint64_t v;
+
+    __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r" (v));
+    return v;
+#else
+    return 0;
+#endif
+}
+
+
+/* Each block carries its size in front so free and realloc can keep the
+ * in-use count. The header keeps max_align_t alignment. */
+#define BENCH_MEM_HDR_SZ 16
+
+static atomic_uint_fast64_t memAllocs;
+static atomic_uint_fast64_t memBytes;
+static atomic_uint_fast64_t memInUse;
+static atomic_uint_fast64_t memPeak;
+
+static void BenchMemTrack(size_t sz)
+{
+    uint_fast64_t inUse;
+    uint_fast64_t peak;
+
+    atomic_fetch_add(&memAllocs, 1);
+    atomic_fetch_add(&memBytes, sz);
+    inUse = atomic_fetch_add(&memInUse, sz) + sz;
+
+    peak = atomic_load(&memPeak);
+    while (inUse > peak &&
+            !atomic_compare_exchange_weak(&memPeak, &peak, inUse))
+        ;
+}
+
+static void* BenchMalloc(size_t sz)
+{
+    unsigned char* p = (unsigned char*)malloc(sz + BENCH_MEM_HDR_SZ);
+
+    if (p == NULL)
+        return NULL;
+    memcpy(p, &sz, sizeof(sz));
+    BenchMemTrack(sz);
+    return p + BENCH_MEM_HDR_SZ;
+}
+
+static void BenchFree(void* ptr)
+{
+    unsigned char* p;
+    size_t sz;
+
+    if (ptr == NULL)
+        return;
+    p = (unsigned char*)ptr - BENCH_MEM_HDR_SZ;
+    memcpy(&sz, p, sizeof(sz));
+    atomic_fetch_sub(&memInUse, sz);
+    free(p);
+}
+
+static void* BenchRealloc(void* ptr, size_t sz)
+{
+    unsigned char* p;
+    size_t oldSz = 0;
+
+    if (ptr == NULL)
+        return BenchMalloc(sz);
+
+    p = (unsigned char*)ptr - BENCH_MEM_HDR_SZ;
+    memcpy(&oldSz, p, sizeof(oldSz));
+    p = (unsigned char*)realloc(p, sz + BENCH_MEM_HDR_SZ);
+    if (p == NULL)
+        return NULL;
+    memcpy(p, &sz, sizeof(sz));
+    atomic_fetch_sub(&memInUse, oldSz);
+    BenchMemTrack(sz);
+    return p + BENCH_MEM_HDR_SZ;
+}
+
+int BenchMemInit(void)
+{
+    return wolfSSL_SetAllocators(BenchMalloc, BenchFree, BenchRealloc);
+}
+
+void BenchMemGet(BenchMem* mem)
+{
+    mem->allocs = atomic_load(&memAllocs);
+    mem->bytes = atomic_load(&memBytes);
+    mem->inUse = atomic_load(&memInUse);
+    mem->peak = atomic_load(&memPeak);
+}
+
+void BenchMemResetPeak(void)
+{
+    atomic_store(&memPeak, atomic_load(&memInUse));
+}
+
+
+int BenchAlgoSupported(const char* list)
+{
+    char name[64];
+    const char* end;
+    size_t sz;
+
+    while (list != NULL && *list != '\0') {
+        end = strchr(list, ',');
+        sz = (end != NULL) ? (size_t)(end - list) : strlen(list);
+        if (sz == 0 || sz >= sizeof(name))
+            return 0;
+        memcpy(name, list, sz);
+        name[sz] = '\0';
+        if (wolfSSH_CheckAlgoName(name) != WS_SUCCESS)
+            return 0;
+        list = (end != NULL) ? end + 1 : NULL;
+    }
+
+    return 1;
+}
+
+
+static int BenchSetAlgos(WOLFSSH_CTX* ctx, const BenchAlgos* algos)
+{
+    int ret = WS_SUCCESS;
+
+    if (algos->kex != NULL)
+        ret = wolfSSH_CTX_SetAlgoListKex(ctx, algos->kex);
+    if (ret == WS_SUCCESS && algos->key != NULL)
+        ret = wolfSSH_CTX_SetAlgoListKey(ctx, algos->key);
+    if (ret == WS_SUCCESS && algos->cipher != NULL)
+        ret = wolfSSH_CTX_SetAlgoListCipher(ctx, algos->cipher);
+    if (ret == WS_SUCCESS && algos->mac != NULL)
+        ret = wolfSSH_CTX_SetAlgoListMac(ctx, algos->mac);
+    if (ret == WS_SUCCESS && algos->window != 0)
+        ret = wolfSSH_CTX_SetWindowPacketSize(ctx, algos->window, 0);
+
+    return ret;
+}
+
+
+static int ServerUserAuth(byte authType, WS_UserAuthData* authData,
+                          void* ctx)
+{
+    (void)ctx;
+
+    if (authType != WOLFSSH_USERAUTH_PASSWORD)
+        return WOLFSSH_USERAUTH_FAILURE;
+
+    if (authData->usernameSz != sizeof(BENCH_USER) - 1 ||
+            memcmp(authData->username, BENCH_USER,
+                   authData->usernameSz) != 0)
+        return WOLFSSH_USERAUTH_INVALID_USER;
+
+    if (authData->sf.password.passwordSz != sizeof(BENCH_PASSWORD) - 1 ||
+            memcmp(authData->sf.password.password, BENCH_PASSWORD,
+                   authData->sf.password.passwordSz) != 0)
+        return WOLFSSH_USERAUTH_INVALID_PASSWORD;
+
+    return WOLFSSH_USERAUTH_SUCCESS;
+}
+
+
+static int ClientUserAuth(byte authType, WS_UserAuthData* authData,
+                          void* ctx)
+{
+    (void)ctx;
+
+    if (authType != WOLFSSH_USERAUTH_PASSWORD)
+        return WOLFSSH_USERAUTH_FAILURE;
+
+    authData->sf.password.password = (const byte*)BENCH_PASSWORD;
+    authData->sf.password.passwordSz = sizeof(BENCH_PASSWORD) - 1;
+    return WOLFSSH_USERAUTH_SUCCESS;
+}
+
+
+static int ClientPublicKeyCheck(const byte* pubKey, word32 pubKeySz,
+                                void* ctx)
+{
+    /* the server is in this process; accept its key */
+    (void)pubKey;
+    (void)pubKeySz;
+    (void)ctx;
+    return 0;
+}
+
+
+WOLFSSH_CTX* BenchServerCtx(const BenchAlgos* algos, const char* keyFile)
+{
+    WOLFSSH_CTX* ctx;
+    FILE* file;
+    byte* key = NULL;
+    long keySz = 0;
+    int ret = WS_FATAL_ERROR;
+
+    file = fopen(keyFile, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Couldn't open %s\n", keyFile);
+        return NULL;
+    }
+    if (fseek(file, 0, SEEK_END) == 0)
+        keySz = ftell(file);
+    rewind(file);
+    if (keySz > 0)
+        key = (byte*)malloc((size_t)keySz);
+    if (key != NULL && fread(key, 1, (size_t)keySz, file) != (size_t)keySz)
+        keySz = 0;
+    fclose(file);
+
+    ctx = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_SERVER, NULL);
+    if (ctx != NULL && key != NULL && keySz > 0) {
+        wolfSSH_SetUserAuth(ctx, ServerUserAuth);
+        ret = wolfSSH_CTX_UsePrivateKey_buffer(ctx, key, (word32)keySz,
+                                               WOLFSSH_FORMAT_ASN1);
+        if (ret == WS_SUCCESS)
+            ret = BenchSetAlgos(ctx, algos);
+    }
+    free(key);
+
+    if (ret != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up server with %s\n", keyFile);
+        wolfSSH_CTX_free(ctx);
+        ctx = NULL;
+    }
+
+    return ctx;
+}
+
+
+WOLFSSH_CTX* BenchClientCtx(const BenchAlgos* algos)
+{
+    WOLFSSH_CTX* ctx;
+
+    ctx = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_CLIENT, NULL);
+    if (ctx == NULL)
+        return NULL;
+
+    wolfSSH_SetUserAuth(ctx, ClientUserAuth);
+    wolfSSH_CTX_SetPublicKeyCheck(ctx, ClientPublicKeyCheck);
+    if (BenchSetAlgos(ctx, algos) != WS_SUCCESS) {
+        wolfSSH_CTX_free(ctx);
+        ctx = NULL;
+    }
+
+    return ctx;
+}
+
+
+static void* BenchAcceptThread(void* args)
+{
+    BenchConn* conn = (BenchConn*)args;
+
+    conn->serverRet = wolfSSH_accept(conn->server);
+    if (conn->serverRet != WS_SUCCESS) {
+        /* let a client stuck waiting on us see the close */
+        shutdown(conn->fds[0], SHUT_RDWR);
+    }
+
+    return NULL;
+}
+
+
+int BenchConnStart(BenchConn* conn, WOLFSSH_CTX* serverCtx,
+                   WOLFSSH_CTX* clientCtx)
+{
+    memset(conn, 0, sizeof(*conn));
+    conn->fds[0] = conn->fds[1] = -1;
+    conn->serverRet = WS_FATAL_ERROR;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, conn->fds) != 0)
+        return WS_FATAL_ERROR;
+
+    conn->server = wolfSSH_new(serverCtx);
+    conn->client = wolfSSH_new(clientCtx);
+    if (conn->server == NULL || conn->client == NULL)
+        return WS_MEMORY_E;
+
+    wolfSSH_set_fd(conn->server, conn->fds[0]);
+    wolfSSH_set_fd(conn->client, conn->fds[1]);
+    wolfSSH_SetUsername(conn->client, BENCH_USER);
+
+    if (pthread_create(&conn->thread, NULL, BenchAcceptThread, conn) != 0)
+        return WS_FATAL_ERROR;
+    conn->threadRunning = 1;
+
+    return WS_SUCCESS;
+}
+
+
+int BenchConnHandshake(BenchConn* conn)
+{
+    int ret;
+
+    ret = wolfSSH_connect(conn->client);
+    if (ret != WS_SUCCESS)
+        shutdown(conn->fds[1], SHUT_RDWR);
+
+    pthread_join(conn->thread, NULL);
+    conn->threadRunning = 0;
+
+    if (ret == WS_SUCCESS)
+        ret = conn->serverRet;
+
+    return ret;
+}
+
+
+static void* BenchRekeyThread(void* args)
+{
+    BenchConn* conn = (BenchConn*)args;
+    byte ch;
+
+    conn->serverRet = wolfSSH_stream_read(conn->server, &ch, 1);
+    if (conn->serverRet == 1)
+        conn->serverRet = WS_SUCCESS;
+    else
+        shutdown(conn->fds[0], SHUT_RDWR);
+
+    return NULL;
+}
+
+
+int BenchConnRekey(BenchConn* conn)
+{
+    byte ch = 'k';
+    int ret;
+
+    conn->serverRet = WS_FATAL_ERROR;
+    if (pthread_create(&conn->thread, NULL, BenchRekeyThread, conn) != 0)
+        return WS_FATAL_ERROR;
+    conn->threadRunning = 1;
+
+    /* channel data waits until the new keys are in use, so keep the
+     * client's side of the exchange going until the byte is sent */
+    ret = wolfSSH_TriggerKeyExchange(conn->client);
+    while (ret == WS_SUCCESS) {
+        ret = wolfSSH_stream_send(conn->client, &ch, 1);
+        if (ret == 1) {
+            ret = WS_SUCCESS;
+            break;
+        }
+        if (ret != WS_REKEYING && wolfSSH_get_error(conn->client)
+                != WS_REKEYING)
+            break;
+        ret = wolfSSH_worker(conn->client, NULL);
+        if (ret == WS_CHAN_RXD || ret == WS_REKEYING)
+            ret = WS_SUCCESS;
+    }
+    if (ret != WS_SUCCESS)
+        shutdown(conn->fds[1], SHUT_RDWR);
+
+    pthread_join(conn->thread, NULL);
+    conn->threadRunning = 0;
+
+    if (ret == WS_SUCCESS)
+        ret = conn->serverRet;
+
+    return ret;
+}
+
+
+void BenchConnFree(BenchConn* conn)
+{
+    if (conn->threadRunning) {
+        shutdown(conn->fds[0], SHUT_RDWR);
+        pthread_join(conn->thread, NULL);
+    }
+    wolfSSH_free(conn->client);
+    wolfSSH_free(conn->server);
+    if (conn->fds[0] >= 0)
+        close(conn->fds[0]);
+    if (conn->fds[1] >= 0)
+        close(conn->fds[1]);
+    memset(conn, 0, sizeof(*conn));
+    conn->fds[0] = conn->fds[1] = -1;
+}
+
+
+static int CompareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+double BenchPercentile(double* v, int n, int pct)
+{
+    if (n <= 0)
+        return 0.0;
+
+    qsort(v, (size_t)n, sizeof(*v), CompareDouble);
+    return v[((n - 1) * pct + 50) / 100];
+}
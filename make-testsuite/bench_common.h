@@ -0,0 +1,113 @@
+/* bench_common.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Helpers shared by the bench-* programs: clocks, an allocation counter
+ * hooked into wolfSSL's allocators, and an in-process server/client pair
+ * connected over a socketpair. */
+
+#ifndef _BENCH_COMMON_H_
+#define _BENCH_COMMON_H_
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(MATH_CHOICE_SP)
+    #define BENCH_MATH_NAME "sp"
+#elif defined(MATH_CHOICE_FAST)
+    #define BENCH_MATH_NAME "fast"
+#else
+    #define BENCH_MATH_NAME "normal"
+#endif
+
+#define BENCH_USER     "jill"
+#define BENCH_PASSWORD "upthehill"
+
+/* monotonic time in nanoseconds */
+uint64_t BenchNow(void);
+
+/* CPU cycle counter, or 0 where there isn't a usable one */
+uint64_t BenchCycles(void);
+
+/* Allocation totals, counted from the first BenchMemInit call. */
+typedef struct BenchMem {
+    uint64_t allocs;
+    uint64_t bytes;  /* total requested, not net */
+    uint64_t inUse;
+    uint64_t peak;   /* highest inUse since the last BenchMemResetPeak */
+} BenchMem;
+
+/* install the counting allocators; call before wolfSSH_Init */
+int  BenchMemInit(void);
+void BenchMemGet(BenchMem* mem);
+void BenchMemResetPeak(void);
+
+/* Algorithm choice for one side of a connection. Any NULL list keeps the
+ * library default. window of 0 keeps the default window size. */
+typedef struct BenchAlgos {
+    const char* kex;
+    const char* key;
+    const char* cipher;
+    const char* mac;
+    word32 window;
+} BenchAlgos;
+
+/* non-zero if every non-NULL name in the comma separated list is known
+ * to this build of wolfSSH */
+int BenchAlgoSupported(const char* list);
+
+/* Contexts with user auth, host key and algorithms set. keyFile is the
+ * DER host key, only needed for the server. NULL on failure. */
+WOLFSSH_CTX* BenchServerCtx(const BenchAlgos* algos, const char* keyFile);
+WOLFSSH_CTX* BenchClientCtx(const BenchAlgos* algos);
+
+/* One server and one client session over a socketpair. */
+typedef struct BenchConn {
+    WOLFSSH* server;
+    WOLFSSH* client;
+    int fds[2];
+    int serverRet;
+    int threadRunning;
+    pthread_t thread;
+} BenchConn;
+
+/* Create both sessions and run wolfSSH_accept in a new thread. Start
+ * the clock after this returns. */
+int BenchConnStart(BenchConn* conn, WOLFSSH_CTX* serverCtx,
+                   WOLFSSH_CTX* clientCtx);
+
+/* wolfSSH_connect on the calling thread, then wait for accept.
+ * Returns WS_SUCCESS when both sides are done. */
+int BenchConnHandshake(BenchConn* conn);
+
+/* After BenchConnHandshake, have the client start a new key exchange
+ * and send one byte of channel data, which the server can only read once
+ * the exchange is done. Returns WS_SUCCESS when the server has it. */
+int BenchConnRekey(BenchConn* conn);
+
+void BenchConnFree(BenchConn* conn);
+
+/* sort v and return its pct percentile */
+double BenchPercentile(double* v, int n, int pct);
+
+#endif /* _BENCH_COMMON_H_ */
@@ -0,0 +1,349 @@
+/* bench_cred_store.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the ESP32 server's credential store with the PwMap list that
+ * wsUserAuth walked before it, for 10, 1000 and 10000 users by default.
+ * The list is kept here as it was in ssh_server.c: one malloc'd node per
+ * user, searched from the head with memcmp.
+ *
+ * Both are filled with one password per user. Then the same random users
+ * log in through each, and unknown users try to. Each check hashes the
+ * password presented, as wsUserAuth does, so the time of a hash alone is
+ * printed too. For each it prints the mean nanoseconds per login and per
+ * unknown user, the bytes and allocations asked of the heap, and on glibc
+ * the heap in use, allocator overhead included.
+ *
+ *     ./bench-cred-store [-u users,...] [-n logins]
+ */
+
+#include "bench_common.h"
+#include "credential_store.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__GLIBC__) && \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    #include <malloc.h>
+    /* large blocks are mapped on their own, and counted apart */
+    #define BENCH_HEAP_IN_USE() \
+        ((long long)mallinfo2().uordblks + (long long)mallinfo2().hblkhd)
+#else
+    #define BENCH_HEAP_IN_USE() (-1LL)
+#endif
+
+#define BENCH_MAX_ROWS 8
+#define BENCH_NAME_SZ  16
+
+#define PW WOLFSSH_USERAUTH_PASSWORD
+
+/* the list, as wsUserAuth had it */
+typedef struct PwMap {
+    byte type;
+    byte username[32];
+    word32 usernameSz;
+    byte p[WC_SHA256_DIGEST_SIZE];
+    struct PwMap* next;
+} PwMap;
+
+typedef struct PwMapList {
+    PwMap* head;
+} PwMapList;
+
+typedef struct BenchHeap {
+    long long requested;
+    long long allocs;
+    long long inUse;  /* -1 where it can't be read */
+} BenchHeap;
+
+static char (*benchNames)[BENCH_NAME_SZ];
+static char (*benchPasswords)[BENCH_NAME_SZ];
+static word32* benchOrder;
+static int benchLogins = 100000;
+static volatile int benchSink;
+
+static void c32toa(word32 u32, byte* c)
+{
+    c[0] = (u32 >> 24) & 0xff;
+    c[1] = (u32 >> 16) & 0xff;
+    c[2] = (u32 >>  8) & 0xff;
+    c[3] =  u32 & 0xff;
+}
+
+static void BenchDigest(const byte* p, word32 pSz, byte* digest)
+{
+    wc_Sha256 sha;
+    byte flatSz[4];
+
+    wc_InitSha256(&sha);
+    c32toa(pSz, flatSz);
+    wc_Sha256Update(&sha, flatSz, sizeof(flatSz));
+    wc_Sha256Update(&sha, p, pSz);
+    wc_Sha256Final(&sha, digest);
+    wc_Sha256Free(&sha);
+}
+
+static PwMap* PwMapNew(PwMapList* list, byte type, const byte* username,
+                       word32 usernameSz, const byte* p, word32 pSz,
+                       BenchHeap* heap)
+{
+    PwMap* map = (PwMap*)malloc(sizeof(PwMap));
+
+    if (map != NULL) {
+        heap->requested += sizeof(PwMap);
+        heap->allocs++;
+        map->type = type;
+        if (usernameSz >= sizeof(map->username))
+            usernameSz = sizeof(map->username) - 1;
+        memcpy(map->username, username, usernameSz);
+        map->username[usernameSz] = 0;
+        map->usernameSz = usernameSz;
+        BenchDigest(p, pSz, map->p);
+        map->next = list->head;
+        list->head = map;
+    }
+    return map;
+}
+
+static void PwMapListDelete(PwMapList* list)
+{
+    PwMap* head = list->head;
+
+    while (head != NULL) {
+        PwMap* cur = head;
+
+        head = head->next;
+        memset(cur, 0, sizeof(PwMap));
+        free(cur);
+    }
+    list->head = NULL;
+}
+
+static int PwMapCheck(const PwMapList* list, byte type, const byte* username,
+                      word32 usernameSz, const byte* p, word32 pSz)
+{
+    byte authHash[WC_SHA256_DIGEST_SIZE];
+    const PwMap* map;
+
+    BenchDigest(p, pSz, authHash);
+    for (map = list->head; map != NULL; map = map->next) {
+        if (usernameSz == map->usernameSz &&
+            memcmp(username, map->username, map->usernameSz) == 0) {
+            if (type != map->type)
+                return WOLFSSH_USERAUTH_INVALID_AUTHTYPE;
+            if (memcmp(map->p, authHash, WC_SHA256_DIGEST_SIZE) == 0)
+                return WOLFSSH_USERAUTH_SUCCESS;
+            return WOLFSSH_USERAUTH_INVALID_PASSWORD;
+        }
+    }
+    return WOLFSSH_USERAUTH_INVALID_USER;
+}
+
+/* the logins, in a random order: a known user each, then an unknown one */
+static int BenchNames(int users)
+{
+    int k;
+
+    benchNames = calloc((size_t)users + 1, BENCH_NAME_SZ);
+    benchPasswords = calloc((size_t)users + 1, BENCH_NAME_SZ);
+    benchOrder = calloc((size_t)benchLogins, sizeof(word32));
+    if (benchNames == NULL || benchPasswords == NULL || benchOrder == NULL) {
+        return -1;
+    }
+    for (k = 0; k <= users; k++) {
+        snprintf(benchNames[k], BENCH_NAME_SZ, "user%05d", k);
+        snprintf(benchPasswords[k], BENCH_NAME_SZ, "pw%d", k * 7919);
+    }
+    srand(1);
+    for (k = 0; k < benchLogins; k++) {
+        benchOrder[k] = (word32)(rand() % users);
+    }
+    return 0;
+}
+
+static void BenchNamesFree(void)
+{
+    free(benchNames);
+    free(benchPasswords);
+    free(benchOrder);
+}
+
+#define BENCH_USER_ARGS(k) \
+    (const byte*)benchNames[k], (word32)strlen(benchNames[k]), \
+    (const byte*)benchPasswords[k], (word32)strlen(benchPasswords[k])
+
+/* mean ns of one check of user k, for k from benchOrder or the one past
+ * the end of the table */
+#define BENCH_TIME(result, known, check) \
+    do { \
+        uint64_t start = BenchNow(); \
+        int n; \
+        for (n = 0; n < benchLogins; n++) { \
+            int k = (known) ? (int)benchOrder[n] : users; \
+            benchSink += (check); \
+        } \
+        (result) = (double)(BenchNow() - start) / benchLogins; \
+    } while (0)
+
+static void BenchReport(const char* name, int users, double known,
+                        double unknown, const BenchHeap* heap)
+{
+    char inUse[24] = "-";
+
+    if (heap->inUse >= 0) {
+        snprintf(inUse, sizeof(inUse), "%lld", heap->inUse);
+    }
+    printf("%8d %-10s %10.0f %10.0f %12lld %8lld %12s\n", users, name,
+           known, unknown, heap->requested, heap->allocs, inUse);
+}
+
+static int BenchUsers(int users)
+{
+    BenchHeap listHeap = { 0, 0, -1 };
+    BenchHeap storeHeap = { 0, 0, -1 };
+    PwMapList list = { NULL };
+    CredStore store;
+    double known;
+    double unknown;
+    long long before;
+    int bad = 0;
+    int k;
+
+    if (BenchNames(users) != 0) {
+        fprintf(stderr, "out of memory\n");
+        BenchNamesFree();
+        return -1;
+    }
+
+    before = BENCH_HEAP_IN_USE();
+    for (k = 0; k < users && !bad; k++) {
+        bad = PwMapNew(&list, PW, BENCH_USER_ARGS(k), &listHeap) == NULL;
+    }
+    if (before >= 0) {
+        listHeap.inUse = BENCH_HEAP_IN_USE() - before;
+    }
+
+    /* sized for the users up front, as the server sizes it for its
+     * credentials */
+    before = BENCH_HEAP_IN_USE();
+    bad |= CredStoreInit(&store, (word32)users) != 0;
+    for (k = 0; k < users && !bad; k++) {
+        bad = CredStoreAdd(&store, PW, BENCH_USER_ARGS(k)) != 0;
+    }
+    if (!bad) {
+        storeHeap.requested = (long long)(store.mask + 1) * sizeof(CredEntry);
+        storeHeap.allocs = 1;
+        if (before >= 0) {
+            storeHeap.inUse = BENCH_HEAP_IN_USE() - before;
+        }
+    }
+
+    /* both must give the same answers */
+    for (k = 0; k <= users && !bad; k++) {
+        int want = (k < users) ? WOLFSSH_USERAUTH_SUCCESS :
+                                 WOLFSSH_USERAUTH_INVALID_USER;
+
+        bad = PwMapCheck(&list, PW, BENCH_USER_ARGS(k)) != want ||
+              CredStoreCheck(&store, PW, BENCH_USER_ARGS(k)) != want;
+    }
+    if (bad) {
+        fprintf(stderr, "%d users: couldn't fill or check\n", users);
+    }
+    else {
+        BENCH_TIME(known, 1, PwMapCheck(&list, PW, BENCH_USER_ARGS(k)));
+        BENCH_TIME(unknown, 0, PwMapCheck(&list, PW, BENCH_USER_ARGS(k)));
+        BenchReport("PwMap", users, known, unknown, &listHeap);
+        BENCH_TIME(known, 1, CredStoreCheck(&store, PW, BENCH_USER_ARGS(k)));
+        BENCH_TIME(unknown, 0, CredStoreCheck(&store, PW,
+                                              BENCH_USER_ARGS(k)));
+        BenchReport("CredStore", users, known, unknown, &storeHeap);
+    }
+
+    PwMapListDelete(&list);
+    CredStoreFree(&store);
+    BenchNamesFree();
+    return bad ? -1 : 0;
+}
+
+static int BenchParseList(const char* arg, int* list, int max)
+{
+    int count = 0;
+    char* end;
+
+    while (*arg != '\0' && count < max) {
+        long v = strtol(arg, &end, 0);
+
+        if (end == arg || v <= 0 || v > 99999) {
+            return -1;
+        }
+        list[count++] = (int)v;
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    int users[BENCH_MAX_ROWS] = { 10, 1000, 10000 };
+    int rows = 3;
+    byte digest[WC_SHA256_DIGEST_SIZE];
+    uint64_t start;
+    int bad = 0;
+    int opt;
+    int r;
+
+    while ((opt = getopt(argc, argv, "u:n:")) != -1) {
+        switch (opt) {
+            case 'u':
+                rows = BenchParseList(optarg, users, BENCH_MAX_ROWS);
+                bad |= rows <= 0;
+                break;
+            case 'n':
+                benchLogins = atoi(optarg);
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || benchLogins <= 0) {
+        fprintf(stderr, "usage: %s [-u users,... up to 99999] "
+                        "[-n logins]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    start = BenchNow();
+    for (r = 0; r < benchLogins; r++) {
+        BenchDigest((const byte*)"pw12345", 7, digest);
+        benchSink += digest[0];
+    }
+    printf("SHA-256 of a password alone: %.0f ns\n\n",
+           (double)(BenchNow() - start) / benchLogins);
+
+    printf("%8s %-10s %10s %10s %12s %8s %12s\n", "users", "store",
+           "login ns", "unknown ns", "heap bytes", "allocs", "heap in use");
+    for (r = 0; r < rows && !bad; r++) {
+        bad = BenchUsers(users[r]) != 0;
+    }
+
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
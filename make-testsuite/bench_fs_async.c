@@ -0,0 +1,560 @@
+/* bench_fs_async.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Serves READ requests at random offsets in a set of cold files opened
+ * through restricting-sftp, as a client with -q requests outstanding asks
+ * for them: each reply lets the client send one more. "sync" reads them
+ * one at a time with wPread in the order they arrive; "async" keeps them
+ * all in flight, handed to the kernel through an io_uring set up here.
+ * Both read the same requests, with the page cache of the files dropped
+ * first. For each it prints MB/s and the p50 and p99 time from a request
+ * arriving until its data is read. Linux 5.6 or later.
+ *
+ * wolfSSH's SFTP server waits for each filesystem call in turn, so the
+ * ring is not part of the filesystem layer; this shows what a server loop
+ * that keeps several requests in flight would gain. The files are opened
+ * read only through the layer, so it has nothing held back or cached that
+ * the reads would have to see.
+ *
+ *     ./bench-fs-async [-f files] [-s MB] [-r request] [-n reads]
+ *                      [-q outstanding] [-d dir]
+ */
+
+#include "bench_common.h"
+#include "myFilesystem.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* the most requests in flight */
+#define BENCH_RING_DEPTH 256
+
+typedef struct BenchReq {
+    int file;
+    word64 ofst;
+    uint64_t arrived;
+    byte* buf;
+} BenchReq;
+
+static char benchDir[256] = ".";
+static int benchFiles = 32;
+static word64 benchFileSz = 8 * 1024 * 1024;
+static word32 benchReqSz = 32768;
+static int benchReads = 4096;
+static int benchDepth = 64;
+
+static int* benchFd;
+static BenchReq* benchReq;
+static double* benchLat;
+
+/* a completed read */
+typedef struct BenchDone {
+    BenchReq* req;
+    int ret;    /* bytes read, or -errno */
+} BenchDone;
+
+static struct {
+    int fd;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    struct io_uring_sqe* sqes;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    struct io_uring_cqe* cqes;
+    void* sqRing;
+    size_t sqRingSz;
+    void* cqRing;       /* sqRing, if the kernel maps both together */
+    size_t cqRingSz;
+    size_t sqesSz;
+    unsigned queued;    /* in the submission ring, not yet submitted */
+} benchRing;
+
+
+static void BenchRingFree(void)
+{
+    if (benchRing.sqes != NULL) {
+        munmap(benchRing.sqes, benchRing.sqesSz);
+    }
+    if (benchRing.cqRing != NULL && benchRing.cqRing != benchRing.sqRing) {
+        munmap(benchRing.cqRing, benchRing.cqRingSz);
+    }
+    if (benchRing.sqRing != NULL) {
+        munmap(benchRing.sqRing, benchRing.sqRingSz);
+    }
+    if (benchRing.fd >= 0) {
+        close(benchRing.fd);
+    }
+    memset(&benchRing, 0, sizeof(benchRing));
+    benchRing.fd = -1;
+}
+
+
+static void* BenchRingMap(size_t sz, off_t what)
+{
+    void* map = mmap(NULL, sz, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, benchRing.fd, what);
+
+    return (map == MAP_FAILED) ? NULL : map;
+}
+
+
+/* a ring with room for depth reads; returns 0 on success */
+static int BenchRingInit(unsigned depth)
+{
+    struct io_uring_params p;
+    byte* sq;
+    byte* cq;
+
+    memset(&p, 0, sizeof(p));
+    benchRing.fd = (int)syscall(__NR_io_uring_setup, depth, &p);
+    if (benchRing.fd < 0) {
+        perror("io_uring_setup");
+        return -1;
+    }
+
+    benchRing.sqRingSz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    benchRing.cqRingSz = p.cq_off.cqes +
+            p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (benchRing.cqRingSz > benchRing.sqRingSz) {
+            benchRing.sqRingSz = benchRing.cqRingSz;
+        }
+        benchRing.cqRingSz = benchRing.sqRingSz;
+    }
+    benchRing.sqesSz = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    benchRing.sqRing = BenchRingMap(benchRing.sqRingSz, IORING_OFF_SQ_RING);
+    benchRing.cqRing = (p.features & IORING_FEAT_SINGLE_MMAP) ?
+            benchRing.sqRing :
+            BenchRingMap(benchRing.cqRingSz, IORING_OFF_CQ_RING);
+    benchRing.sqes = (struct io_uring_sqe*)BenchRingMap(benchRing.sqesSz,
+                                                        IORING_OFF_SQES);
+    if (benchRing.sqRing == NULL || benchRing.cqRing == NULL ||
+            benchRing.sqes == NULL) {
+        perror("mmap");
+        BenchRingFree();
+        return -1;
+    }
+
+    sq = (byte*)benchRing.sqRing;
+    cq = (byte*)benchRing.cqRing;
+    benchRing.sqTail = (unsigned*)(sq + p.sq_off.tail);
+    benchRing.sqMask = (unsigned*)(sq + p.sq_off.ring_mask);
+    benchRing.sqArray = (unsigned*)(sq + p.sq_off.array);
+    benchRing.cqHead = (unsigned*)(cq + p.cq_off.head);
+    benchRing.cqTail = (unsigned*)(cq + p.cq_off.tail);
+    benchRing.cqMask = (unsigned*)(cq + p.cq_off.ring_mask);
+    benchRing.cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+
+/* queue a read of req's block; there is always room, as no more than the
+ * ring's depth are in flight */
+static void BenchRingRead(BenchReq* req)
+{
+    unsigned tail = *benchRing.sqTail;
+    unsigned idx = tail & *benchRing.sqMask;
+    struct io_uring_sqe* sqe = &benchRing.sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = benchFd[req->file];
+    sqe->addr = (word64)(size_t)req->buf;
+    sqe->len = benchReqSz;
+    sqe->off = req->ofst;
+    sqe->user_data = (word64)(size_t)req;
+    benchRing.sqArray[idx] = idx;
+    __atomic_store_n(benchRing.sqTail, tail + 1, __ATOMIC_RELEASE);
+    benchRing.queued++;
+}
+
+
+/* submit what is queued, wait for at least one read to complete, and
+ * collect up to max of them; returns how many, or -1 */
+static int BenchRingReap(BenchDone* done, int max)
+{
+    unsigned head;
+    unsigned tail;
+    int count = 0;
+    int ret;
+
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, benchRing.fd,
+                           benchRing.queued, 1, IORING_ENTER_GETEVENTS,
+                           NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        perror("io_uring_enter");
+        return -1;
+    }
+    benchRing.queued -= (unsigned)ret;
+
+    head = *benchRing.cqHead;
+    tail = __atomic_load_n(benchRing.cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail && count < max) {
+        struct io_uring_cqe* cqe = &benchRing.cqes[head & *benchRing.cqMask];
+
+        done[count].req = (BenchReq*)(size_t)cqe->user_data;
+        done[count].ret = cqe->res;
+        count++;
+        head++;
+    }
+    __atomic_store_n(benchRing.cqHead, head, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+
+static void BenchPath(char* path, size_t sz, int file)
+{
+    snprintf(path, sz, "%s/bench-fs-async.%d", benchDir, file);
+}
+
+
+/* every request-sized block starts with its file and offset, so a read
+ * of the wrong place is caught */
+static void BenchTag(byte* block, int file, word64 ofst)
+{
+    word64 tag = ((word64)file << 48) | ofst;
+
+    memcpy(block, &tag, sizeof(tag));
+}
+
+
+static int BenchMakeFiles(void)
+{
+    byte* block = (byte*)malloc(benchReqSz);
+    char path[300];
+    word64 ofst;
+    word32 i;
+    int f;
+    int fd;
+
+    if (block == NULL) {
+        return -1;
+    }
+    for (i = 0; i < benchReqSz; i++) {
+        block[i] = (byte)(i * 7 + (i >> 8));
+    }
+
+    for (f = 0; f < benchFiles; f++) {
+        BenchPath(path, sizeof(path), f);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(path);
+            free(block);
+            return -1;
+        }
+        for (ofst = 0; ofst < benchFileSz; ofst += benchReqSz) {
+            BenchTag(block, f, ofst);
+            if (write(fd, block, benchReqSz) != (ssize_t)benchReqSz) {
+                perror(path);
+                close(fd);
+                free(block);
+                return -1;
+            }
+        }
+        fsync(fd);
+        close(fd);
+    }
+    free(block);
+    return 0;
+}
+
+
+/* drop the files from the page cache, so reads go to the media */
+static void BenchCool(void)
+{
+    int f;
+
+    for (f = 0; f < benchFiles; f++) {
+        (void)posix_fadvise(benchFd[f], 0, 0, POSIX_FADV_DONTNEED);
+    }
+}
+
+
+static int BenchCheck(const BenchReq* req, int ret)
+{
+    word64 tag;
+
+    memcpy(&tag, req->buf, sizeof(tag));
+    if (ret != (int)benchReqSz ||
+            tag != (((word64)req->file << 48) | req->ofst)) {
+        fprintf(stderr, "bad read of file %d at %llu: %d\n", req->file,
+                (unsigned long long)req->ofst, ret);
+        return -1;
+    }
+    return 0;
+}
+
+
+/* Read every request one at a time. Request k + depth arrives when
+ * request k is answered. */
+static double BenchSync(void)
+{
+    unsigned int ofst[2];
+    uint64_t start = BenchNow();
+    uint64_t now;
+    int k;
+    int ret;
+
+    for (k = 0; k < benchReads && k < benchDepth; k++) {
+        benchReq[k].arrived = start;
+    }
+    for (k = 0; k < benchReads; k++) {
+        BenchReq* req = &benchReq[k];
+
+        ofst[0] = (unsigned int)req->ofst;
+        ofst[1] = (unsigned int)(req->ofst >> 32);
+        ret = WPREAD(NULL, benchFd[req->file], req->buf, benchReqSz, ofst);
+        now = BenchNow();
+        if (BenchCheck(req, ret) != 0) {
+            return -1;
+        }
+        benchLat[k] = (double)(now - req->arrived) / 1e3;
+        if (k + benchDepth < benchReads) {
+            benchReq[k + benchDepth].arrived = now;
+        }
+    }
+    return (double)(BenchNow() - start) / 1e9;
+}
+
+
+static void BenchSubmit(int k, uint64_t now)
+{
+    benchReq[k].arrived = now;
+    BenchRingRead(&benchReq[k]);
+}
+
+
+/* Keep depth requests in flight. Each one answered lets the next
+ * arrive. */
+static double BenchAsync(void)
+{
+    BenchDone* done;
+    uint64_t start = BenchNow();
+    uint64_t now;
+    int next = 0;
+    int finished = 0;
+    int count;
+    int i;
+
+    done = (BenchDone*)malloc(sizeof(BenchDone) * (size_t)benchDepth);
+    if (done == NULL) {
+        return -1;
+    }
+    for (; next < benchReads && next < benchDepth; next++) {
+        BenchSubmit(next, start);
+    }
+
+    while (finished < benchReads) {
+        count = BenchRingReap(done, benchDepth);
+        if (count < 0) {
+            free(done);
+            return -1;
+        }
+        now = BenchNow();
+        for (i = 0; i < count; i++) {
+            BenchReq* req = done[i].req;
+
+            if (BenchCheck(req, done[i].ret) != 0) {
+                free(done);
+                return -1;
+            }
+            benchLat[finished++] = (double)(now - req->arrived) / 1e3;
+            if (next < benchReads) {
+                /* its buffer is free now, and the next request's may not
+                 * be if they complete out of order */
+                benchReq[next].buf = req->buf;
+                BenchSubmit(next++, now);
+            }
+        }
+    }
+    free(done);
+    return (double)(BenchNow() - start) / 1e9;
+}
+
+
+static int BenchCompare(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+
+    return (x > y) - (x < y);
+}
+
+
+static void BenchReport(const char* mode, double secs)
+{
+    qsort(benchLat, (size_t)benchReads, sizeof(double), BenchCompare);
+    printf("%-6s %10.1f %12.0f %12.0f\n", mode,
+           (double)benchReads * benchReqSz / secs / 1e6,
+           benchLat[benchReads / 2],
+           benchLat[(size_t)((double)benchReads * 0.99)]);
+}
+
+
+int main(int argc, char** argv)
+{
+    MY_FS_RULE rule = { "*", NULL, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    MY_FS_SESSION s;
+    word64 blocks;
+    char path[300];
+    double secs;
+    int bad = 0;
+    int opt;
+    int k;
+    int f;
+
+    while ((opt = getopt(argc, argv, "f:s:r:n:q:d:")) != -1) {
+        switch (opt) {
+            case 'f':
+                benchFiles = atoi(optarg);
+                break;
+            case 's':
+                benchFileSz = strtoull(optarg, NULL, 0) * 1024 * 1024;
+                break;
+            case 'r':
+                benchReqSz = (word32)strtoul(optarg, NULL, 0);
+                break;
+            case 'n':
+                benchReads = atoi(optarg);
+                break;
+            case 'q':
+                benchDepth = atoi(optarg);
+                break;
+            case 'd':
+                snprintf(benchDir, sizeof(benchDir), "%s", optarg);
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || benchFiles <= 0 || benchReqSz < sizeof(word64) ||
+            benchFileSz < benchReqSz || benchReads <= 0 ||
+            benchDepth <= 0 || benchDepth > BENCH_RING_DEPTH) {
+        fprintf(stderr, "usage: %s [-f files] [-s MB] [-r request] "
+                        "[-n reads]\n"
+                        "       [-q outstanding, at most %d] [-d dir]\n",
+                        argv[0], BENCH_RING_DEPTH);
+        return EXIT_FAILURE;
+    }
+
+    benchFd = (int*)calloc((size_t)benchFiles, sizeof(int));
+    benchReq = (BenchReq*)calloc((size_t)benchReads, sizeof(BenchReq));
+    benchLat = (double*)calloc((size_t)benchReads, sizeof(double));
+    if (benchFd == NULL || benchReq == NULL || benchLat == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    /* the same random requests for both, each with its own buffer */
+    blocks = benchFileSz / benchReqSz;
+    srand(1);
+    for (k = 0; k < benchReads; k++) {
+        benchReq[k].file = rand() % benchFiles;
+        benchReq[k].ofst = ((word64)rand() % blocks) * benchReqSz;
+    }
+    for (k = 0; k < benchReads && k < benchDepth; k++) {
+        benchReq[k].buf = (byte*)malloc(benchReqSz);
+        if (benchReq[k].buf == NULL) {
+            fprintf(stderr, "out of memory\n");
+            return EXIT_FAILURE;
+        }
+    }
+    /* one at a time, request k can reuse the buffer of request k - depth,
+     * which has been answered by the time k arrives */
+    for (; k < benchReads; k++) {
+        benchReq[k].buf = benchReq[k % benchDepth].buf;
+    }
+
+    if (BenchMakeFiles() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    wolfSSH_Init();
+    rule.prefix = benchDir;
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS ||
+            BenchRingInit((unsigned)benchDepth) != 0) {
+        fprintf(stderr, "Couldn't set up the filesystem session or ring\n");
+        return EXIT_FAILURE;
+    }
+    for (f = 0; f < benchFiles; f++) {
+        BenchPath(path, sizeof(path), f);
+        benchFd[f] = WOPEN(&s, path, O_RDONLY, 0);
+        if (benchFd[f] < 0) {
+            perror(path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("files: %d of %llu MB, reads: %d of %u bytes, outstanding: %d\n\n",
+           benchFiles, (unsigned long long)(benchFileSz >> 20), benchReads,
+           benchReqSz, benchDepth);
+    printf("%-6s %10s %12s %12s\n", "mode", "MB/s", "p50 us", "p99 us");
+
+    BenchCool();
+    secs = BenchSync();
+    if (secs < 0) {
+        bad = 1;
+    }
+    else {
+        BenchReport("sync", secs);
+    }
+
+    if (!bad) {
+        BenchCool();
+        secs = BenchAsync();
+        if (secs < 0) {
+            bad = 1;
+        }
+        else {
+            BenchReport("async", secs);
+        }
+    }
+
+    for (f = 0; f < benchFiles; f++) {
+        WCLOSE(&s, benchFd[f]);
+        BenchPath(path, sizeof(path), f);
+        unlink(path);
+    }
+    BenchRingFree();
+    wFsSessionFree(&s);
+    wolfSSH_Cleanup();
+    for (k = 0; k < benchReads && k < benchDepth; k++) {
+        free(benchReq[k].buf);
+    }
+    free(benchFd);
+    free(benchReq);
+    free(benchLat);
+
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
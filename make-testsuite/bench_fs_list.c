@@ -0,0 +1,239 @@
+/* bench_fs_list.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Lists a directory of -f files through restricting-sftp the way an SFTP
+ * session does: wolfSSH's READDIR reads the names a batch of -b at a time
+ * and stats each one for its attributes, then the client stats each name
+ * it was sent again, as file managers and sync tools do. Each listing is
+ * timed, and for -n listings it prints the p50 and p99 listing time, the
+ * time per name, and the wStat calls answered from the stat cache.
+ *
+ * The cache keeps the last MY_FS_STAT_CACHE_SZ results. Built as
+ * bench-fs-list with the default of 16, as bench-fs-list-nocache with it
+ * off, and as bench-fs-list-1k with 1024 entries, more than a batch.
+ *
+ *     ./bench-fs-list [-f files] [-b batch] [-n listings] [-d dir]
+ */
+
+#include "bench_common.h"
+#include "myFilesystem.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BENCH_NAME_SZ 256
+
+static char benchDir[256] = ".";
+static char benchList[300];
+static int benchFiles = 10000;
+static int benchBatch = 100;
+
+
+static int BenchMakeFiles(void)
+{
+    char path[sizeof(benchList) + BENCH_NAME_SZ];
+    int f;
+    int fd;
+
+    if (mkdir(benchList, 0755) != 0) {
+        perror(benchList);
+        return -1;
+    }
+    for (f = 0; f < benchFiles; f++) {
+        snprintf(path, sizeof(path), "%s/file-%05d", benchList, f);
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(path);
+            return -1;
+        }
+        close(fd);
+    }
+    return 0;
+}
+
+
+static void BenchRemoveFiles(void)
+{
+    char path[sizeof(benchList) + BENCH_NAME_SZ];
+    int f;
+
+    for (f = 0; f < benchFiles; f++) {
+        snprintf(path, sizeof(path), "%s/file-%05d", benchList, f);
+        unlink(path);
+    }
+    rmdir(benchList);
+}
+
+
+/* stat every name in the batch, as wolfSSH does for a READDIR reply and
+ * then the client does for each name in it */
+static int BenchStatBatch(char (*names)[BENCH_NAME_SZ], int count)
+{
+    char path[sizeof(benchList) + BENCH_NAME_SZ];
+    WSTAT_T st;
+    int pass;
+    int i;
+
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < count; i++) {
+            snprintf(path, sizeof(path), "%s/%s", benchList, names[i]);
+            if (wStat(path, &st) != 0) {
+                perror(path);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+
+/* one listing of the directory, returns the names seen or -1 */
+static int BenchListing(char (*names)[BENCH_NAME_SZ])
+{
+    WDIR dir;
+    struct dirent* d;
+    int seen = 0;
+    int count = 0;
+
+    if (wDirOpen(NULL, &dir, benchList) != 0) {
+        perror(benchList);
+        return -1;
+    }
+    while ((d = WREADDIR(NULL, &dir)) != NULL) {
+        snprintf(names[count++], BENCH_NAME_SZ, "%s", d->d_name);
+        if (count == benchBatch) {
+            if (BenchStatBatch(names, count) != 0) {
+                seen = -1;
+                break;
+            }
+            seen += count;
+            count = 0;
+        }
+    }
+    if (seen >= 0 && count > 0) {
+        if (BenchStatBatch(names, count) != 0) {
+            seen = -1;
+        }
+        else {
+            seen += count;
+        }
+    }
+    WCLOSEDIR(NULL, &dir);
+    return seen;
+}
+
+
+int main(int argc, char** argv)
+{
+    char (*names)[BENCH_NAME_SZ];
+    MY_FS_STATS stats;
+    double* lat;
+    double sum = 0;
+    int listings = 20;
+    int seen = 0;
+    int bad = 0;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "f:b:n:d:")) != -1) {
+        switch (opt) {
+            case 'f':
+                benchFiles = atoi(optarg);
+                break;
+            case 'b':
+                benchBatch = atoi(optarg);
+                break;
+            case 'n':
+                listings = atoi(optarg);
+                break;
+            case 'd':
+                snprintf(benchDir, sizeof(benchDir), "%s", optarg);
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || benchFiles <= 0 || benchFiles > 99999 || benchBatch <= 0 ||
+            listings <= 0) {
+        fprintf(stderr, "usage: %s [-f files, at most 99999] [-b batch] "
+                        "[-n listings] [-d dir]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    names = (char (*)[BENCH_NAME_SZ])malloc((size_t)benchBatch *
+            BENCH_NAME_SZ);
+    lat = (double*)malloc((size_t)listings * sizeof(double));
+    if (names == NULL || lat == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(benchList, sizeof(benchList), "%s/bench-fs-list.d", benchDir);
+    if (BenchMakeFiles() != 0) {
+        BenchRemoveFiles();
+        return EXIT_FAILURE;
+    }
+    /* "/file-00000" and the terminator */
+    if (strlen(benchList) + 12 > MY_FS_STAT_PATH_SZ) {
+        printf("paths are longer than MY_FS_STAT_PATH_SZ and are not "
+               "cached, use a shorter -d\n");
+    }
+
+    /* one listing to bring the directory into the kernel's caches */
+    wFsCacheFlush();
+    if (BenchListing(names) != benchFiles + 2) {
+        fprintf(stderr, "listing did not see every file\n");
+        bad = 1;
+    }
+    wFsStatsReset();
+    for (i = 0; !bad && i < listings; i++) {
+        uint64_t start = BenchNow();
+
+        seen = BenchListing(names);
+        lat[i] = (double)(BenchNow() - start) / 1e3;
+        sum += lat[i];
+        bad = seen != benchFiles + 2;
+    }
+    wFsStatsGet(&stats);
+
+    if (!bad) {
+        printf("files: %d, batch: %d, stat cache: %d entries\n\n",
+               benchFiles, benchBatch, MY_FS_STAT_CACHE_SZ);
+        printf("%12s %12s %12s %12s %12s\n", "p50 ms", "p99 ms",
+               "us/name", "stat hits", "stat misses");
+        printf("%12.2f %12.2f %12.3f %12lu %12lu\n",
+               BenchPercentile(lat, listings, 50) / 1e3,
+               BenchPercentile(lat, listings, 99) / 1e3,
+               sum / listings / seen,
+               stats.statHits / (unsigned long)listings,
+               stats.statMisses / (unsigned long)listings);
+    }
+
+    BenchRemoveFiles();
+    free(names);
+    free(lat);
+
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,476 @@
+/* bench_fs_read.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Downloads a large file through restricting-sftp's wPread the way
+ * wolfSSH's SFTP server does: each READ request is read into a buffer of
+ * its own, then copied into the output buffer to be encrypted. For each
+ * request size it reports MB/s, the reads and system calls made, and the
+ * bytes copied per byte downloaded. Built as bench-fs-read, over pread,
+ * as bench-fs-read-mmap, with MY_FS_MMAP, and as bench-fs-read-ra, with
+ * MY_FS_READ_AHEAD_SZ. bench-fs-read-mmap packs the reply from the mapping
+ * with wFsMapPeek, as a server that can take the bytes in place would.
+ * bench-fs-read-ra-advise adds MY_FS_ADVISE, so each block is read in the
+ * background while the one before it is used.
+ *
+ * -t and -m slow each media read down by a fixed latency in microseconds
+ * and a rate in MB/s, like an SD card. -w gives client window sizes; a
+ * client can only have a window of data requested at once, so each window
+ * takes at least the round trip time given with -l.
+ *
+ *     ./bench-fs-read [-s MB] [-r request,...] [-n passes] [-d dir]
+ *                     [-t us] [-m MB/s] [-w window,...] [-l us]
+ */
+
+#include "bench_common.h"
+#include "myFilesystem.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* system calls a download makes besides its reads and advice: open and
+ * close, with MY_FS_MMAP the fstat, mmap and munmap of the mapping, and
+ * with MY_FS_ADVISE the POSIX_FADV_SEQUENTIAL */
+#if defined(MY_FS_MMAP)
+    #define BENCH_FS_BACKEND    "mmap"
+    #define BENCH_FS_OPEN_CALLS 5
+#elif MY_FS_READ_AHEAD_SZ > 0 && defined(MY_FS_ADVISE)
+    #define BENCH_FS_BACKEND    "pread, read-ahead, advise"
+    #define BENCH_FS_OPEN_CALLS 3
+#elif MY_FS_READ_AHEAD_SZ > 0
+    #define BENCH_FS_BACKEND    "pread, read-ahead"
+    #define BENCH_FS_OPEN_CALLS 2
+#else
+    #define BENCH_FS_BACKEND    "pread"
+    #define BENCH_FS_OPEN_CALLS 2
+#endif
+
+#define BENCH_COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+#define BENCH_MAX_REQUESTS 16
+#define BENCH_MAX_WINDOWS  16
+
+/* OpenSSH's sftp asks for 32 KB at a time */
+static const word32 benchRequestDefault[] = { 4096, 32768, 262144 };
+
+/* room for an SSH packet header and MAC around a READ reply */
+#define BENCH_PACKET_EXTRA 64
+
+static char benchDir[256] = ".";
+static char benchPath[300];
+
+/* the media, as slow as -t and -m make it */
+static uint64_t benchMediaLatency; /* ns per read */
+static double   benchMediaRate;    /* bytes per ns, 0 for no limit */
+
+/* what the media reads did, and the buffer wPread was asked to fill */
+static word64 benchMediaBytes;
+static word64 benchDirectBytes;
+static const byte* benchReadBuf;
+/* bytes packed from the mapping without a copy into the READ buffer */
+static word64 benchMappedBytes;
+
+#ifdef MY_FS_ADVISE
+#define BENCH_ADV_MAX 64
+
+/* background reads the media was asked for, in order: each starts once
+ * the one before it is done, and ends at done */
+typedef struct BenchAdv {
+    word64 ofst;
+    word64 end;
+    uint64_t done;
+} BenchAdv;
+
+static BenchAdv benchAdv[BENCH_ADV_MAX];
+static int benchAdvCount;
+#endif
+
+
+static void BenchSleep(uint64_t ns)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    nanosleep(&ts, NULL);
+}
+
+
+/* myFilesystem.c reads the media through this, see MY_FS_PREAD */
+ssize_t BenchPread(int fd, void* buf, size_t sz, off_t ofst)
+{
+    uint64_t start = BenchNow();
+    uint64_t ns = benchMediaLatency;
+    ssize_t ret = pread(fd, buf, sz, ofst);
+#ifdef MY_FS_ADVISE
+    int i;
+
+    /* a read the media was asked for in the background only waits for
+     * that to finish */
+    for (i = 0; ret > 0 && i < benchAdvCount; i++) {
+        if ((word64)ofst >= benchAdv[i].ofst &&
+                (word64)ofst + (word64)ret <= benchAdv[i].end) {
+            benchMediaBytes += (word64)ret;
+            if ((const byte*)buf == benchReadBuf) {
+                benchDirectBytes += (word64)ret;
+            }
+            if (benchAdv[i].done > BenchNow()) {
+                BenchSleep(benchAdv[i].done - BenchNow());
+            }
+            return ret;
+        }
+    }
+#endif
+
+    if (ret > 0) {
+        benchMediaBytes += (word64)ret;
+        if ((const byte*)buf == benchReadBuf) {
+            benchDirectBytes += (word64)ret;
+        }
+        if (benchMediaRate > 0) {
+            ns += (uint64_t)((double)ret / benchMediaRate);
+        }
+    }
+    ns += start;
+    if (ns > BenchNow()) {
+        BenchSleep(ns - BenchNow());
+    }
+    return ret;
+}
+
+
+#ifdef MY_FS_ADVISE
+/* myFilesystem.c gives its advice through this, see MY_FS_FADVISE. A
+ * POSIX_FADV_WILLNEED queues a background read of the range on the media,
+ * which takes as long as a read of it would. */
+int BenchFadvise(int fd, off_t ofst, off_t len, int advice)
+{
+    uint64_t start = BenchNow();
+    BenchAdv* adv;
+    int i;
+
+    if (advice == POSIX_FADV_WILLNEED && len > 0) {
+        /* forget what is behind the new range once the list is full */
+        if (benchAdvCount == BENCH_ADV_MAX) {
+            for (i = 0; i < benchAdvCount &&
+                    benchAdv[i].end <= (word64)ofst; i++) {
+            }
+            memmove(benchAdv, benchAdv + i,
+                    (size_t)(benchAdvCount - i) * sizeof(BenchAdv));
+            benchAdvCount -= i;
+        }
+        if (benchAdvCount > 0 && benchAdv[benchAdvCount - 1].done > start) {
+            start = benchAdv[benchAdvCount - 1].done;
+        }
+        if (benchAdvCount < BENCH_ADV_MAX) {
+            adv = &benchAdv[benchAdvCount++];
+            adv->ofst = (word64)ofst;
+            adv->end = (word64)ofst + (word64)len;
+            adv->done = start + benchMediaLatency;
+            if (benchMediaRate > 0) {
+                adv->done += (uint64_t)((double)len / benchMediaRate);
+            }
+        }
+    }
+    return posix_fadvise(fd, ofst, len, advice);
+}
+#endif
+
+
+static int BenchMakeFile(word64 size)
+{
+    static byte block[1024 * 1024];
+    word64 done;
+    FILE* f;
+    word32 i;
+
+    for (i = 0; i < sizeof(block); i++) {
+        block[i] = (byte)(i * 7 + (i >> 8));
+    }
+
+    f = fopen(benchPath, "wb");
+    if (f == NULL) {
+        perror(benchPath);
+        return -1;
+    }
+    for (done = 0; done < size; done += sizeof(block)) {
+        size_t sz = (size - done < sizeof(block)) ?
+                (size_t)(size - done) : sizeof(block);
+
+        if (fwrite(block, 1, sz, f) != sz) {
+            perror(benchPath);
+            fclose(f);
+            return -1;
+        }
+    }
+    return fclose(f);
+}
+
+
+/* One download of the whole file in reqSz READ requests, with at most
+ * window bytes requested per round trip of rtt ns; a window of 0 has no
+ * limit. Returns the seconds it took, or a negative value on error.
+ * *copied gets the bytes copied on the way: by the media reads, by wPread
+ * when they were not made into the READ buffer, and into the output
+ * buffer. */
+static double BenchDownload(MY_FS_SESSION* s, word64 size, word32 reqSz,
+        word32 window, uint64_t rtt, byte* readBuf, byte* outBuf,
+        word64* copied)
+{
+    unsigned int ofst[2];
+    word64 pos = 0;
+    word64 returned = 0;
+    word64 inWindow = 0;
+    uint64_t start;
+    uint64_t windowStart;
+    int fd;
+    int ret;
+
+    fd = WOPEN(s, benchPath, O_RDONLY, 0);
+    if (fd < 0) {
+        perror(benchPath);
+        return -1;
+    }
+
+    benchReadBuf = readBuf;
+    benchMediaBytes = 0;
+    benchDirectBytes = 0;
+    benchMappedBytes = 0;
+#ifdef MY_FS_ADVISE
+    benchAdvCount = 0;
+#endif
+    start = windowStart = BenchNow();
+    while (pos < size) {
+        const byte* data = readBuf;
+
+        ofst[0] = (unsigned int)pos;
+        ofst[1] = (unsigned int)(pos >> 32);
+#ifdef MY_FS_MMAP
+        /* the mapped bytes go straight into the reply */
+        ret = wFsMapPeek(fd, reqSz, ofst, &data);
+        if (ret <= 0) {
+            data = readBuf;
+            ret = WPREAD(s, fd, readBuf, reqSz, ofst);
+        }
+        else {
+            benchMappedBytes += (word64)ret;
+        }
+#else
+        ret = WPREAD(s, fd, readBuf, reqSz, ofst);
+#endif
+        if (ret <= 0) {
+            fprintf(stderr, "read at %llu failed: %d\n",
+                    (unsigned long long)pos, ret);
+            WCLOSE(s, fd);
+            return -1;
+        }
+        returned += (word64)ret;
+        /* wolfSSH packing the reply to encrypt it */
+        memcpy(outBuf + BENCH_PACKET_EXTRA / 2, data, (size_t)ret);
+        pos += (word64)ret;
+
+        inWindow += (word64)reqSz;
+        if (window > 0 && inWindow >= window) {
+            uint64_t now = BenchNow();
+
+            if (now - windowStart < rtt) {
+                BenchSleep(rtt - (now - windowStart));
+            }
+            windowStart = BenchNow();
+            inWindow = 0;
+        }
+    }
+    WCLOSE(s, fd);
+
+    *copied = benchMediaBytes +
+            (returned - benchDirectBytes - benchMappedBytes) + returned;
+    return (double)(BenchNow() - start) / 1e9;
+}
+
+
+static int BenchParseList(const char* arg, word32* list, int max)
+{
+    int count = 0;
+    char* end;
+
+    while (*arg != '\0' && count < max) {
+        unsigned long v = strtoul(arg, &end, 0);
+
+        if (end == arg || v == 0) {
+            return -1;
+        }
+        list[count++] = (word32)v;
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+
+int main(int argc, char** argv)
+{
+    word32 request[BENCH_MAX_REQUESTS];
+    word32 window[BENCH_MAX_WINDOWS] = { 0 };
+    int requestCount = BENCH_COUNT(benchRequestDefault);
+    int windowCount = 1;
+    word64 size = 256 * 1024 * 1024;
+    uint64_t rtt = 1000000;
+    int passes = 3;
+    MY_FS_RULE rule = { "*", NULL, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    MY_FS_SESSION s;
+    int bad = 0;
+    int opt;
+    int i;
+    int w;
+    int p;
+
+    memcpy(request, benchRequestDefault, sizeof(benchRequestDefault));
+
+    while ((opt = getopt(argc, argv, "s:r:n:d:t:m:w:l:")) != -1) {
+        switch (opt) {
+            case 's':
+                size = strtoull(optarg, NULL, 0) * 1024 * 1024;
+                break;
+            case 'r':
+                requestCount = BenchParseList(optarg, request,
+                        BENCH_MAX_REQUESTS);
+                bad |= requestCount <= 0;
+                break;
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            case 'd':
+                snprintf(benchDir, sizeof(benchDir), "%s", optarg);
+                break;
+            case 't':
+                benchMediaLatency = strtoull(optarg, NULL, 0) * 1000;
+                break;
+            case 'm':
+                benchMediaRate = atof(optarg) * 1e6 / 1e9;
+                break;
+            case 'w':
+                windowCount = BenchParseList(optarg, window,
+                        BENCH_MAX_WINDOWS);
+                bad |= windowCount <= 0;
+                break;
+            case 'l':
+                rtt = strtoull(optarg, NULL, 0) * 1000;
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || size == 0 || passes <= 0) {
+        fprintf(stderr, "usage: %s [-s MB] [-r request,...] [-n passes] "
+                        "[-d dir]\n"
+                        "       [-t us] [-m MB/s] [-w window,...] [-l us]\n",
+                        argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    snprintf(benchPath, sizeof(benchPath), "%s/bench-fs-read.dat", benchDir);
+    rule.prefix = benchDir;
+    if (BenchMakeFile(size) != 0) {
+        return EXIT_FAILURE;
+    }
+
+    wolfSSH_Init();
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        unlink(benchPath);
+        return EXIT_FAILURE;
+    }
+
+    printf("backend: %s, file: %llu MB, passes: %d\n", BENCH_FS_BACKEND,
+           (unsigned long long)(size >> 20), passes);
+    if (benchMediaLatency > 0 || benchMediaRate > 0) {
+        printf("media: %llu us per read, %.1f MB/s\n",
+               (unsigned long long)(benchMediaLatency / 1000),
+               benchMediaRate * 1e3);
+    }
+    if (window[0] != 0) {
+        printf("round trip: %llu us\n", (unsigned long long)(rtt / 1000));
+    }
+    printf("\n%10s %10s %10s %12s %12s %12s %12s\n", "request", "window",
+           "MB/s", "media reads", "mapped reads", "syscalls/MB",
+           "copies/byte");
+
+    for (i = 0; !bad && i < requestCount; i++) {
+        byte* readBuf = (byte*)malloc(request[i]);
+        byte* outBuf = (byte*)malloc(request[i] + BENCH_PACKET_EXTRA);
+
+        if (readBuf == NULL || outBuf == NULL) {
+            fprintf(stderr, "out of memory\n");
+            bad = 1;
+        }
+
+        for (w = 0; !bad && w < windowCount; w++) {
+            MY_FS_STATS stats;
+            word64 copied = 0;
+            word64 total = 0;
+            double secs = 0;
+            double t;
+            char name[16];
+
+            /* one pass to bring the file into the page cache */
+            t = BenchDownload(&s, size, request[i], 0, 0, readBuf, outBuf,
+                    &copied);
+            wFsStatsReset();
+            for (p = 0; t >= 0 && p < passes; p++) {
+                t = BenchDownload(&s, size, request[i], window[w], rtt,
+                        readBuf, outBuf, &copied);
+                secs += t;
+                total += copied;
+            }
+            wFsStatsGet(&stats);
+            if (t < 0) {
+                bad = 1;
+                break;
+            }
+
+            if (window[w] == 0) {
+                snprintf(name, sizeof(name), "-");
+            }
+            else {
+                snprintf(name, sizeof(name), "%u", window[w]);
+            }
+            printf("%10u %10s %10.1f %12lu %12lu %12.2f %12.2f\n",
+                   request[i], name, (double)size * passes / secs / 1e6,
+                   stats.reads / (unsigned long)passes,
+                   stats.mapReads / (unsigned long)passes,
+                   (double)((stats.reads + stats.advises) /
+                            (unsigned long)passes + BENCH_FS_OPEN_CALLS) /
+                            (double)(size >> 20),
+                   (double)total / ((double)size * passes));
+        }
+        free(readBuf);
+        free(outBuf);
+    }
+
+    wFsSessionFree(&s);
+    wolfSSH_Cleanup();
+    unlink(benchPath);
+
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
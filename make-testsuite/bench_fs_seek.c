@@ -0,0 +1,299 @@
+/* bench_fs_seek.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Downloads a file through restricting-sftp's SYS_FS backend, over the
+ * SYS_FS stand-in in host/, as a client with -q READ requests outstanding
+ * asks for it: each reply lets the client send one more, and the server
+ * answers them in the order they arrive. SYS_FS has no positional read, so
+ * a request that does not start where the last one ended costs a seek as
+ * well as a read. -x gives percentages of requests the client sends out of
+ * order, each swapped with a later one still to be sent in its window,
+ * and there is a row for each. -t makes every SYS_FS call take that many
+ * microseconds, like an SD card's command overhead.
+ *
+ * For each it prints MB/s, the p50 and p99 time from a request arriving to
+ * its data being read, and the SYS_FS seeks and calls made per request,
+ * with the calls it would have made seeking before every read.
+ *
+ *     ./bench-fs-seek [-s MB] [-r request] [-q outstanding] [-x pct,...]
+ *                     [-t us] [-d dir]
+ */
+
+#include "bench_common.h"
+#include "host_sys_fs.h"
+#include "myFilesystem.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_MAX_ROWS 16
+
+static char benchDir[256] = ".";
+static char benchPath[300];
+static word64 benchFileSz = 64 * 1024 * 1024;
+static word32 benchReqSz = 32768;
+static int benchDepth = 64;
+
+static word32* benchOrder;
+static double* benchLat;
+static int benchReads;
+
+
+/* every request-sized block starts with its offset, so a read of the
+ * wrong place is caught */
+static int BenchMakeFile(void)
+{
+    byte* block = (byte*)malloc(benchReqSz);
+    word64 ofst;
+    word32 i;
+    int fd;
+
+    if (block == NULL) {
+        return -1;
+    }
+    for (i = 0; i < benchReqSz; i++) {
+        block[i] = (byte)(i * 7 + (i >> 8));
+    }
+    fd = open(benchPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(benchPath);
+        free(block);
+        return -1;
+    }
+    for (ofst = 0; ofst < benchFileSz; ofst += benchReqSz) {
+        memcpy(block, &ofst, sizeof(ofst));
+        if (write(fd, block, benchReqSz) != (ssize_t)benchReqSz) {
+            perror(benchPath);
+            close(fd);
+            free(block);
+            return -1;
+        }
+    }
+    close(fd);
+    free(block);
+    return 0;
+}
+
+
+/* the blocks in order, with pct percent swapped with a later one that is
+ * no more than the window ahead */
+static void BenchShuffle(int pct)
+{
+    int k;
+
+    for (k = 0; k < benchReads; k++) {
+        benchOrder[k] = (word32)k;
+    }
+    srand(1);
+    for (k = 0; k < benchReads - 1; k++) {
+        if (rand() % 100 < pct) {
+            int ahead = 1 + rand() % benchDepth;
+            int j = (k + ahead < benchReads) ? k + ahead : benchReads - 1;
+            word32 t = benchOrder[k];
+
+            benchOrder[k] = benchOrder[j];
+            benchOrder[j] = t;
+        }
+    }
+}
+
+
+/* Answer the requests one at a time, as they arrive. Returns the seconds
+ * it took, or a negative value on error. */
+static double BenchDownload(MY_FS_SESSION* s, byte* buf)
+{
+    uint64_t* arrived;
+    uint64_t start;
+    uint64_t now;
+    unsigned int ofst[2];
+    WFILE f = WBADFILE;
+    word64 tag;
+    int ret;
+    int k;
+
+    arrived = (uint64_t*)malloc(sizeof(uint64_t) * (size_t)benchReads);
+    if (arrived == NULL || wfopen(s, &f, benchPath,
+            SYS_FS_FILE_OPEN_READ) != 0) {
+        free(arrived);
+        return -1;
+    }
+
+    start = BenchNow();
+    for (k = 0; k < benchReads && k < benchDepth; k++) {
+        arrived[k] = start;
+    }
+    for (k = 0; k < benchReads; k++) {
+        word64 pos = (word64)benchOrder[k] * benchReqSz;
+
+        ofst[0] = (unsigned int)pos;
+        ofst[1] = (unsigned int)(pos >> 32);
+        ret = wPread(f, buf, benchReqSz, ofst);
+        now = BenchNow();
+        memcpy(&tag, buf, sizeof(tag));
+        if (ret != (int)benchReqSz || tag != pos) {
+            fprintf(stderr, "read at %llu failed: %d\n",
+                    (unsigned long long)pos, ret);
+            wFclose(&f);
+            free(arrived);
+            return -1;
+        }
+        benchLat[k] = (double)(now - arrived[k]) / 1e3;
+        if (k + benchDepth < benchReads) {
+            arrived[k + benchDepth] = now;
+        }
+    }
+    wFclose(&f);
+    free(arrived);
+    return (double)(BenchNow() - start) / 1e9;
+}
+
+
+static int BenchParseList(const char* arg, int* list, int max)
+{
+    int count = 0;
+    char* end;
+
+    while (*arg != '\0' && count < max) {
+        long v = strtol(arg, &end, 0);
+
+        if (end == arg || v < 0 || v > 100) {
+            return -1;
+        }
+        list[count++] = (int)v;
+        arg = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+
+int main(int argc, char** argv)
+{
+    MY_FS_RULE rule = { "*", NULL, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    MY_FS_SESSION s;
+    int pct[BENCH_MAX_ROWS] = { 0, 10 };
+    int rows = 2;
+    uint64_t latency = 0;
+    byte* buf;
+    int bad = 0;
+    int opt;
+    int r;
+
+    while ((opt = getopt(argc, argv, "s:r:q:x:t:d:")) != -1) {
+        switch (opt) {
+            case 's':
+                benchFileSz = strtoull(optarg, NULL, 0) * 1024 * 1024;
+                break;
+            case 'r':
+                benchReqSz = (word32)strtoul(optarg, NULL, 0);
+                break;
+            case 'q':
+                benchDepth = atoi(optarg);
+                break;
+            case 'x':
+                rows = BenchParseList(optarg, pct, BENCH_MAX_ROWS);
+                bad |= rows <= 0;
+                break;
+            case 't':
+                latency = strtoull(optarg, NULL, 0) * 1000;
+                break;
+            case 'd':
+                snprintf(benchDir, sizeof(benchDir), "%s", optarg);
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || benchReqSz < sizeof(word64) || benchFileSz < benchReqSz ||
+            benchFileSz > 0x7FFFFFFFUL || benchDepth <= 0) {
+        fprintf(stderr, "usage: %s [-s MB, under 2048] [-r request] "
+                        "[-q outstanding]\n"
+                        "       [-x pct,...] [-t us] [-d dir]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    benchReads = (int)(benchFileSz / benchReqSz);
+    benchOrder = (word32*)malloc(sizeof(word32) * (size_t)benchReads);
+    benchLat = (double*)malloc(sizeof(double) * (size_t)benchReads);
+    buf = (byte*)malloc(benchReqSz);
+    if (benchOrder == NULL || benchLat == NULL || buf == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+    snprintf(benchPath, sizeof(benchPath), "%s/bench-fs-seek.dat", benchDir);
+    if (BenchMakeFile() != 0) {
+        return EXIT_FAILURE;
+    }
+
+    wolfSSH_Init();
+    rule.prefix = benchDir;
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        unlink(benchPath);
+        return EXIT_FAILURE;
+    }
+    HostSysFsLatency(latency);
+
+    printf("file: %llu MB, reads: %d of %u bytes, outstanding: %d, "
+           "%llu us per call\n\n", (unsigned long long)(benchFileSz >> 20),
+           benchReads, benchReqSz, benchDepth,
+           (unsigned long long)(latency / 1000));
+    printf("%8s %10s %10s %10s %10s %10s %12s\n", "reorder", "MB/s",
+           "p50 us", "p99 us", "seeks/req", "calls/req", "w/o skip");
+
+    for (r = 0; !bad && r < rows; r++) {
+        MY_FS_STATS stats;
+        HostSysFsStats fs;
+        double secs;
+
+        BenchShuffle(pct[r]);
+        wFsStatsReset();
+        HostSysFsStatsReset();
+        secs = BenchDownload(&s, buf);
+        if (secs < 0) {
+            bad = 1;
+            break;
+        }
+        wFsStatsGet(&stats);
+        HostSysFsStatsGet(&fs);
+
+        printf("%7d%% %10.1f %10.0f %10.0f %10.3f %10.3f %12.3f\n", pct[r],
+               (double)benchFileSz / secs / 1e6,
+               BenchPercentile(benchLat, benchReads, 50),
+               BenchPercentile(benchLat, benchReads, 99),
+               (double)fs.seeks / benchReads,
+               (double)(fs.seeks + fs.reads) / benchReads,
+               (double)(stats.seeks + stats.seeksSkipped + stats.reads) /
+                       benchReads);
+    }
+
+    wFsSessionFree(&s);
+    wolfSSH_Cleanup();
+    unlink(benchPath);
+    free(benchOrder);
+    free(benchLat);
+    free(buf);
+
+    return bad ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,262 @@
+/* bench_handshake.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times complete connections, key exchange through password user auth and
+ * channel open, between a server and client in this process, for each
+ * key exchange and host key pair this build supports, then a rekey on
+ * each connection. With -c and FP_ECC, the fixed-point ECC tables are
+ * freed before each, to compare against the warm tables kept otherwise.
+ * With -k there is no host key cache: each connection gets a new server
+ * CTX with the key read from its DER file, after the tables are freed, as
+ * the ESP32 server's server_test did before host_key.c, and that setup is
+ * counted in the handshake time.
+ *
+ *     ./bench-handshake [-n iterations] [-w warmup] [-c] [-k]
+ */
+
+#include "bench_common.h"
+
+#ifdef FP_ECC
+    #include <wolfssl/wolfcrypt/ecc.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+static const char* benchKex[] = {
+    "ecdh-sha2-nistp256",
+    "ecdh-sha2-nistp384",
+    "ecdh-sha2-nistp521",
+    "curve25519-sha256",
+    "diffie-hellman-group14-sha256",
+    "diffie-hellman-group14-sha1",
+    "diffie-hellman-group-exchange-sha256",
+    "diffie-hellman-group1-sha1",
+};
+
+static const struct {
+    const char* name;
+    const char* file;
+} benchKey[] = {
+    { "ecdsa-sha2-nistp256", "keys/server-key-ecc.der" },
+    { "rsa-sha2-256",        "keys/server-key-rsa.der" },
+    { "ssh-rsa",             "keys/server-key-rsa.der" },
+};
+
+#define BENCH_COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+static int benchCold = 0;
+static int benchNoCache = 0;
+
+
+/* with -c, drop the fixed-point tables so the next step rebuilds them */
+static void BenchCool(void)
+{
+#ifdef FP_ECC
+    if (benchCold)
+        wc_ecc_fp_free();
+#endif
+}
+
+
+/* with -k, a new server CTX and host key for every connection, with none
+ * of the tables the last one built */
+static int BenchServerSetup(WOLFSSH_CTX** serverCtx, const BenchAlgos* algos,
+                            const char* keyFile)
+{
+    wolfSSH_CTX_free(*serverCtx);
+#ifdef FP_ECC
+    wc_ecc_fp_free();
+#endif
+    *serverCtx = BenchServerCtx(algos, keyFile);
+
+    return (*serverCtx != NULL) ? WS_SUCCESS : WS_FATAL_ERROR;
+}
+
+
+static int BenchOne(const char* kex, const char* key, const char* keyFile,
+                    int iterations, int warmup, double* lat, double* rekey)
+{
+    BenchAlgos algos = { kex, key, NULL, NULL, 0 };
+    WOLFSSH_CTX* serverCtx;
+    WOLFSSH_CTX* clientCtx;
+    BenchConn conn;
+    BenchMem before, after;
+    uint64_t start, setup, total = 0, peak = 0;
+    int i;
+    int ret = WS_SUCCESS;
+
+    serverCtx = BenchServerCtx(&algos, keyFile);
+    clientCtx = BenchClientCtx(&algos);
+    if (serverCtx == NULL || clientCtx == NULL)
+        ret = WS_FATAL_ERROR;
+
+    for (i = 0; ret == WS_SUCCESS && i < warmup; i++) {
+        ret = BenchConnStart(&conn, serverCtx, clientCtx);
+        if (ret == WS_SUCCESS)
+            ret = BenchConnHandshake(&conn);
+        BenchConnFree(&conn);
+    }
+
+    BenchMemGet(&before);
+    for (i = 0; ret == WS_SUCCESS && i < iterations; i++) {
+        BenchMem mem;
+
+        BenchMemResetPeak();
+        BenchMemGet(&mem);
+        setup = 0;
+        if (benchNoCache) {
+            start = BenchNow();
+            ret = BenchServerSetup(&serverCtx, &algos, keyFile);
+            setup = BenchNow() - start;
+        }
+        if (ret == WS_SUCCESS)
+            ret = BenchConnStart(&conn, serverCtx, clientCtx);
+        if (ret == WS_SUCCESS) {
+            BenchCool();
+            start = BenchNow();
+            ret = BenchConnHandshake(&conn);
+            start = BenchNow() - start + setup;
+            lat[i] = (double)start;
+            total += start;
+        }
+        if (ret == WS_SUCCESS) {
+            BenchCool();
+            start = BenchNow();
+            ret = BenchConnRekey(&conn);
+            rekey[i] = (double)(BenchNow() - start);
+        }
+        BenchConnFree(&conn);
+
+        BenchMemGet(&after);
+        if (after.peak - mem.inUse > peak)
+            peak = after.peak - mem.inUse;
+    }
+    BenchMemGet(&after);
+
+    if (ret == WS_SUCCESS) {
+        printf("%-36s %-20s %6d %9.1f %8.2f %8.2f %8.2f %8.2f "
+               "%10llu %7llu %9llu\n",
+               kex, key, iterations,
+               iterations / (total / 1e9),
+               BenchPercentile(lat, iterations, 50) / 1e6,
+               BenchPercentile(lat, iterations, 99) / 1e6,
+               BenchPercentile(rekey, iterations, 50) / 1e6,
+               BenchPercentile(rekey, iterations, 99) / 1e6,
+               (unsigned long long)((after.bytes - before.bytes)
+                                    / iterations),
+               (unsigned long long)((after.allocs - before.allocs)
+                                    / iterations),
+               (unsigned long long)peak);
+    }
+    else {
+        printf("%-36s %-20s failed %d\n", kex, key, ret);
+    }
+
+    wolfSSH_CTX_free(clientCtx);
+    wolfSSH_CTX_free(serverCtx);
+
+    return ret;
+}
+
+
+int main(int argc, char** argv)
+{
+    double* lat;
+    double* rekey;
+    int iterations = 50;
+    int warmup = 2;
+    int failures = 0;
+    int opt;
+    int k, h;
+
+    while ((opt = getopt(argc, argv, "n:w:ck")) != -1) {
+        switch (opt) {
+            case 'n':
+                iterations = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            case 'c':
+                benchCold = 1;
+                break;
+            case 'k':
+                benchNoCache = 1;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n iterations] [-w warmup] "
+                                "[-c] [-k]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (iterations < 1 || warmup < 0) {
+        fprintf(stderr, "iterations must be positive\n");
+        return EXIT_FAILURE;
+    }
+#ifndef FP_ECC
+    if (benchCold) {
+        fprintf(stderr, "-c needs FP_ECC, see user_settings.h\n");
+        return EXIT_FAILURE;
+    }
+#endif
+
+    lat = (double*)malloc(sizeof(*lat) * (size_t)iterations);
+    rekey = (double*)malloc(sizeof(*rekey) * (size_t)iterations);
+    if (lat == NULL || rekey == NULL ||
+            BenchMemInit() != 0 || wolfSSH_Init() != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't initialize.\n");
+        return EXIT_FAILURE;
+    }
+
+#ifdef FP_ECC
+    printf("math: %s, iterations: %d, fixed-point tables: %s, "
+           "host key cache: %s\n\n", BENCH_MATH_NAME, iterations,
+           (benchCold || benchNoCache) ? "cold" : "warm",
+           benchNoCache ? "off" : "on");
+#else
+    printf("math: %s, iterations: %d, host key cache: %s\n\n",
+           BENCH_MATH_NAME, iterations, benchNoCache ? "off" : "on");
+#endif
+    printf("%-36s %-20s %6s %9s %8s %8s %8s %8s %10s %7s %9s\n",
+           "kex", "host key", "n", "hs/s", "p50 ms", "p99 ms",
+           "rk50 ms", "rk99 ms", "bytes/hs", "allocs", "peak");
+
+    for (k = 0; k < BENCH_COUNT(benchKex); k++) {
+        if (!BenchAlgoSupported(benchKex[k]))
+            continue;
+        for (h = 0; h < BENCH_COUNT(benchKey); h++) {
+            if (!BenchAlgoSupported(benchKey[h].name))
+                continue;
+            if (access(benchKey[h].file, R_OK) != 0)
+                continue;
+            if (BenchOne(benchKex[k], benchKey[h].name, benchKey[h].file,
+                         iterations, warmup, lat, rekey) != WS_SUCCESS)
+                failures++;
+        }
+    }
+
+    wolfSSH_Cleanup();
+    free(rekey);
+    free(lat);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
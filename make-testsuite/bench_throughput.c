@@ -0,0 +1,297 @@
+/* bench_throughput.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Pushes a fixed volume of channel data from client to server with
+ * wolfSSH_stream_send/wolfSSH_stream_read, over a socketpair, for each
+ * cipher, MAC and window size this build supports. Results are CSV.
+ *
+ *     ./bench-throughput [-b bytes] [-c chunk] [-w window,...] [-o file]
+ */
+
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char* benchCipher[] = {
+    "aes128-gcm@openssh.com",
+    "aes256-gcm@openssh.com",
+    "aes128-ctr",
+    "aes192-ctr",
+    "aes256-ctr",
+    "aes128-cbc",
+    "aes256-cbc",
+};
+
+static const char* benchMac[] = {
+    "hmac-sha2-256",
+    "hmac-sha2-512",
+    "hmac-sha1",
+};
+
+#define BENCH_COUNT(a) (int)(sizeof(a) / sizeof((a)[0]))
+
+#define BENCH_MAX_WINDOWS 16
+
+static const word32 benchWindowDefault[] = { 16384, 131072, 1048576 };
+
+#define BENCH_KEY_FILE "keys/server-key-ecc.der"
+
+typedef struct BenchRead {
+    WOLFSSH* ssh;
+    byte* buf;
+    word32 bufSz;
+    uint64_t volume;
+    uint64_t received;
+    int ret;
+} BenchRead;
+
+
+static void* BenchReadThread(void* args)
+{
+    BenchRead* rd = (BenchRead*)args;
+    int ret = WS_SUCCESS;
+
+    while (rd->received < rd->volume) {
+        ret = wolfSSH_stream_read(rd->ssh, rd->buf, rd->bufSz);
+        if (ret <= 0)
+            break;
+        rd->received += (uint64_t)ret;
+        ret = WS_SUCCESS;
+    }
+    rd->ret = ret;
+
+    return NULL;
+}
+
+
+/* send volume bytes in chunk sized writes, waiting out a full peer
+ * window by letting the session process the window adjust */
+static int BenchSend(WOLFSSH* ssh, byte* buf, word32 chunk, uint64_t volume)
+{
+    uint64_t sent = 0;
+    word32 sz;
+    int ret;
+
+    while (sent < volume) {
+        sz = (volume - sent < chunk) ? (word32)(volume - sent) : chunk;
+        ret = wolfSSH_stream_send(ssh, buf, sz);
+        if (ret > 0) {
+            sent += (uint64_t)ret;
+            continue;
+        }
+        if (ret != WS_WINDOW_FULL && wolfSSH_get_error(ssh) != WS_WINDOW_FULL)
+            return ret;
+
+        ret = wolfSSH_worker(ssh, NULL);
+        if (ret != WS_SUCCESS && ret != WS_CHAN_RXD &&
+                ret != WS_WINDOW_FULL)
+            return ret;
+    }
+
+    return WS_SUCCESS;
+}
+
+
+static int BenchOne(FILE* out, const char* cipher, const char* mac,
+                    word32 window, uint64_t volume, word32 chunk)
+{
+    BenchAlgos algos = { NULL, NULL, cipher, mac, window };
+    WOLFSSH_CTX* serverCtx;
+    WOLFSSH_CTX* clientCtx;
+    BenchConn conn;
+    BenchRead rd;
+    pthread_t reader;
+    byte* sendBuf = NULL;
+    struct timespec cpu0, cpu1;
+    uint64_t start = 0, elapsed = 0, cycles = 0;
+    double cpuNs = 0.0;
+    int ret = WS_SUCCESS;
+
+    memset(&rd, 0, sizeof(rd));
+    memset(&conn, 0, sizeof(conn));
+    conn.fds[0] = conn.fds[1] = -1;
+
+    serverCtx = BenchServerCtx(&algos, BENCH_KEY_FILE);
+    clientCtx = BenchClientCtx(&algos);
+    sendBuf = (byte*)malloc(chunk);
+    rd.bufSz = chunk;
+    rd.buf = (byte*)malloc(rd.bufSz);
+    if (serverCtx == NULL || clientCtx == NULL ||
+            sendBuf == NULL || rd.buf == NULL)
+        ret = WS_MEMORY_E;
+
+    if (ret == WS_SUCCESS) {
+        memset(sendBuf, 0xa5, chunk);
+        ret = BenchConnStart(&conn, serverCtx, clientCtx);
+    }
+    if (ret == WS_SUCCESS)
+        ret = BenchConnHandshake(&conn);
+
+    if (ret == WS_SUCCESS) {
+        rd.ssh = conn.server;
+        rd.volume = volume;
+        if (pthread_create(&reader, NULL, BenchReadThread, &rd) != 0)
+            ret = WS_FATAL_ERROR;
+    }
+
+    if (ret == WS_SUCCESS) {
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu0);
+        cycles = BenchCycles();
+        start = BenchNow();
+
+        ret = BenchSend(conn.client, sendBuf, chunk, volume);
+        if (ret != WS_SUCCESS)
+            shutdown(conn.fds[1], SHUT_RDWR);
+        pthread_join(reader, NULL);
+
+        elapsed = BenchNow() - start;
+        cycles = BenchCycles() - cycles;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu1);
+        cpuNs = (cpu1.tv_sec - cpu0.tv_sec) * 1e9 +
+                (cpu1.tv_nsec - cpu0.tv_nsec);
+
+        if (ret == WS_SUCCESS)
+            ret = rd.ret;
+        if (ret == WS_SUCCESS && rd.received != volume)
+            ret = WS_FATAL_ERROR;
+    }
+
+    if (ret == WS_SUCCESS) {
+        fprintf(out, "%s,%s,%s,%u,%llu,%.6f,%.2f,%.2f,%.2f\n",
+                BENCH_MATH_NAME, cipher, mac != NULL ? mac : "aead",
+                window, (unsigned long long)volume, elapsed / 1e9,
+                (volume / 1e6) / (elapsed / 1e9),
+                (double)cycles / volume, cpuNs / volume);
+    }
+    else {
+        fprintf(stderr, "%s %s window %u failed %d\n",
+                cipher, mac != NULL ? mac : "aead", window, ret);
+    }
+
+    BenchConnFree(&conn);
+    wolfSSH_CTX_free(clientCtx);
+    wolfSSH_CTX_free(serverCtx);
+    free(rd.buf);
+    free(sendBuf);
+
+    return ret;
+}
+
+
+static int ParseWindows(char* list, word32* windows)
+{
+    char* tok;
+    int count = 0;
+
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+        if (count == BENCH_MAX_WINDOWS)
+            return -1;
+        windows[count] = (word32)strtoul(tok, NULL, 0);
+        if (windows[count] == 0)
+            return -1;
+        count++;
+    }
+
+    return count;
+}
+
+
+int main(int argc, char** argv)
+{
+    word32 windows[BENCH_MAX_WINDOWS];
+    int windowCount = BENCH_COUNT(benchWindowDefault);
+    uint64_t volume = 64ULL * 1024 * 1024;
+    word32 chunk = 16384;
+    FILE* out = stdout;
+    int failures = 0;
+    int opt;
+    int c, m, w;
+
+    memcpy(windows, benchWindowDefault, sizeof(benchWindowDefault));
+
+    while ((opt = getopt(argc, argv, "b:c:w:o:")) != -1) {
+        switch (opt) {
+            case 'b':
+                volume = strtoull(optarg, NULL, 0);
+                break;
+            case 'c':
+                chunk = (word32)strtoul(optarg, NULL, 0);
+                break;
+            case 'w':
+                windowCount = ParseWindows(optarg, windows);
+                break;
+            case 'o':
+                out = fopen(optarg, "w");
+                if (out == NULL) {
+                    perror(optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                windowCount = -1;
+                break;
+        }
+    }
+    if (volume == 0 || chunk == 0 || windowCount <= 0) {
+        fprintf(stderr, "usage: %s [-b bytes] [-c chunk] "
+                        "[-w window,...] [-o file]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (BenchMemInit() != 0 || wolfSSH_Init() != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't initialize.\n");
+        return EXIT_FAILURE;
+    }
+
+    fprintf(out, "math,cipher,mac,window,bytes,seconds,mb_per_s,"
+                 "cycles_per_byte,cpu_ns_per_byte\n");
+
+    for (c = 0; c < BENCH_COUNT(benchCipher); c++) {
+        int aead = strstr(benchCipher[c], "-gcm") != NULL;
+
+        if (!BenchAlgoSupported(benchCipher[c]))
+            continue;
+
+        /* the MAC is part of an AEAD cipher; run those once */
+        for (m = 0; m < (aead ? 1 : BENCH_COUNT(benchMac)); m++) {
+            const char* mac = aead ? NULL : benchMac[m];
+
+            if (mac != NULL && !BenchAlgoSupported(mac))
+                continue;
+            for (w = 0; w < windowCount; w++) {
+                if (BenchOne(out, benchCipher[c], mac, windows[w],
+                             volume, chunk) != WS_SUCCESS)
+                    failures++;
+                fflush(out);
+            }
+        }
+    }
+
+    wolfSSH_Cleanup();
+    if (out != stdout)
+        fclose(out);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
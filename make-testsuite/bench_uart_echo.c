@@ -0,0 +1,206 @@
+/* bench_uart_echo.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Times the echo of a key press through the ESP32 server's UART path. Its
+ * uart_helper.c, tx_rx_buffer.c and ring buffers run on the host, over
+ * the FreeRTOS and UART driver stand-ins in host/, with UART_NUM_1 on a
+ * pseudo terminal. A thread on the other end plays a device that echoes
+ * what it is sent, as a shell on a serial console does.
+ *
+ * Each key press goes in as server_worker puts client data in, with
+ * Set_ExternalReceiveBuffer, and the time runs until server_worker would
+ * have the echo: the session eventfd is readable in select() and the byte
+ * is in the Transmit ring. wolfSSH and the network are not in the path.
+ *
+ * -b paces the line at a baud rate: each byte takes 10 bit times each
+ * way, and a UART_DATA event for a lone byte waits for the Rx idle
+ * timeout, UART_RX_TIMEOUT_SYMBOLS, as on the board. The wire time alone
+ * is printed as the floor. -b 0 leaves only the task hand-offs.
+ *
+ *     ./bench-uart-echo [-n presses] [-b baud] [-g gap us]
+ */
+
+#include "bench_common.h"
+#include "host_uart.h"
+#include "ssh_server_config.h"
+#include "tx_rx_buffer.h"
+#include "uart_helper.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+static int benchDevice = -1;
+
+/* the device: send back whatever arrives, once it has had time to */
+static void* BenchEcho(void* arg)
+{
+    uint8_t buf[256];
+    ssize_t got;
+
+    (void)arg;
+    while ((got = read(benchDevice, buf, sizeof(buf))) > 0) {
+        if (HostUartByteNs() > 0) {
+            usleep((useconds_t)(HostUartByteNs() * (uint64_t)got / 1000));
+        }
+        if (write(benchDevice, buf, (size_t)got) != got) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Wait, as server_worker does, for the session eventfd, then take what
+ * the Transmit ring holds. Returns the bytes taken, or -1 after a second
+ * with nothing. */
+static int BenchWait(byte* out, int outSz)
+{
+    int evFd = ExternalTransmitBuffer_EventFd(0);
+    int got = 0;
+
+    while (got == 0) {
+        struct timeval timeout = { 1, 0 };
+        fd_set readFds;
+        byte* data;
+        int sz;
+
+        FD_ZERO(&readFds);
+        FD_SET(evFd, &readFds);
+        if (select(evFd + 1, &readFds, NULL, NULL, &timeout) <= 0) {
+            return -1;
+        }
+        ExternalTransmitBuffer_ClearEvent(0);
+        while ((sz = Get_ExternalTransmitBuffer(0, &data)) > 0) {
+            if (got + sz <= outSz) {
+                memcpy(out + got, data, (size_t)sz);
+            }
+            got += sz;
+            Consume_ExternalTransmitBuffer(0, sz);
+        }
+    }
+    return got;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t echo;
+    double* lat;
+    double sum = 0;
+    double floorUs;
+    int presses = 1000;
+    int baud = 115200;
+    int gapUs = 2000;
+    int bad = 0;
+    int lost = 0;
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "n:b:g:")) != -1) {
+        switch (opt) {
+            case 'n':
+                presses = atoi(optarg);
+                break;
+            case 'b':
+                baud = atoi(optarg);
+                break;
+            case 'g':
+                gapUs = atoi(optarg);
+                break;
+            default:
+                bad = 1;
+                break;
+        }
+    }
+    if (bad || presses <= 0 || baud < 0 || gapUs < 0) {
+        fprintf(stderr, "usage: %s [-n presses] [-b baud] [-g gap us]\n",
+                argv[0]);
+        return EXIT_FAILURE;
+    }
+    lat = (double*)calloc((size_t)presses, sizeof(double));
+    if (lat == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return EXIT_FAILURE;
+    }
+
+    benchDevice = HostUartOpen(baud);
+    if (benchDevice < 0) {
+        perror("HostUartOpen");
+        return EXIT_FAILURE;
+    }
+    if (init_tx_rx_buffer_events() != ESP_OK) {
+        fprintf(stderr, "Couldn't set up the session buffers\n");
+        return EXIT_FAILURE;
+    }
+    init_UART();
+    if (xTaskCreate(uart_tx_task, "uart_tx_task", 4096, NULL, 2,
+                    NULL) != pdPASS ||
+        xTaskCreate(uart_rx_task, "uart_rx_task", 4096, NULL, 2,
+                    NULL) != pdPASS ||
+        pthread_create(&echo, NULL, BenchEcho, NULL) != 0) {
+        fprintf(stderr, "Couldn't start the UART tasks\n");
+        return EXIT_FAILURE;
+    }
+
+    /* a session attaches, and takes its welcome message */
+    init_tx_rx_buffer(0, TXD_PIN, RXD_PIN);
+    while (ExternalTransmitBufferSz(0) > 0) {
+        byte* data;
+
+        Consume_ExternalTransmitBuffer(0, Get_ExternalTransmitBuffer(0,
+                                       &data));
+    }
+
+    for (i = 0; i < presses; i++) {
+        byte key = (byte)('a' + i % 26);
+        byte got[64];
+        uint64_t start = BenchNow();
+        int sz;
+
+        if (Set_ExternalReceiveBuffer(0, &key, 1) != 1) {
+            lost++;
+            continue;
+        }
+        sz = BenchWait(got, (int)sizeof(got));
+        lat[i] = (double)(BenchNow() - start) / 1e3;
+        if (sz != 1 || got[0] != key) {
+            lost++;
+        }
+        sum += lat[i];
+        usleep((useconds_t)gapUs);
+    }
+
+    /* out and back on the wire, and the idle timeout for a lone byte */
+    floorUs = (double)HostUartByteNs() * (2 + UART_RX_TIMEOUT_SYMBOLS) / 1e3;
+    printf("%-8s %8s %10s %10s %10s %10s %10s\n", "baud", "presses",
+           "mean us", "p50 us", "p99 us", "max us", "wire us");
+    printf("%-8d %8d %10.1f %10.1f %10.1f %10.1f %10.1f\n", baud, presses,
+           sum / presses, BenchPercentile(lat, presses, 50),
+           BenchPercentile(lat, presses, 99),
+           BenchPercentile(lat, presses, 100), floorUs);
+    if (lost > 0) {
+        printf("%d key presses not echoed\n", lost);
+    }
+
+    free(lat);
+    return (lost == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,102 @@
+/* fuzz_cred_loader.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* libFuzzer harness for the ESP32 server's streaming credential loader.
+ * The first byte of the input picks passwd or authorized_keys parsing and
+ * seeds the piece sizes; the rest is loaded whole into one store and in
+ * pieces of 1 to 64 bytes into another. Both must give the same result
+ * and the same table, with no entry of another type or a longer name than
+ * CRED_USERNAME_MAX_SZ. Build it with clang, and run it on a directory of
+ * sample files:
+ *
+ *     make fuzz-cred-loader
+ *     ./fuzz-cred-loader -max_len=4096 corpus/
+ */
+
+#include "credential_store.h"
+
+#include <esp_log.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int FuzzLoad(CredStore* store, byte type, const byte* data,
+                    word32 sz, unsigned int seed)
+{
+    CredLoader loader;
+    word32 i = 0;
+    int ret = CredLoaderInit(&loader, store, type);
+
+    while (ret == 0 && i < sz) {
+        word32 piece = (seed == 0) ? sz : 1 + (word32)rand_r(&seed) % 64;
+
+        if (piece > sz - i) {
+            piece = sz - i;
+        }
+        ret = CredLoaderUpdate(&loader, data + i, piece);
+        i += piece;
+    }
+    if (ret == 0) {
+        ret = CredLoaderFinal(&loader);
+    }
+    return ret;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    CredStore whole;
+    CredStore pieces;
+    byte type;
+    word32 sz;
+    word32 i;
+    int ret;
+
+    if (size < 1) {
+        return 0;
+    }
+    esp_log_level_set("cred_store", ESP_LOG_NONE);
+    type = (data[0] & 1) ? WOLFSSH_USERAUTH_PUBLICKEY :
+                           WOLFSSH_USERAUTH_PASSWORD;
+    sz = (word32)size - 1;
+
+    /* from the smallest table, so that it grows too */
+    if (CredStoreInit(&whole, 0) != 0 || CredStoreInit(&pieces, 0) != 0) {
+        abort();
+    }
+    ret = FuzzLoad(&whole, type, data + 1, sz, 0);
+    if (FuzzLoad(&pieces, type, data + 1, sz, 1U + data[0]) != ret ||
+        whole.count != pieces.count || whole.mask != pieces.mask ||
+        memcmp(whole.entries, pieces.entries,
+               (whole.mask + 1) * sizeof(CredEntry)) != 0) {
+        abort();
+    }
+    for (i = 0; i <= whole.mask; i++) {
+        const CredEntry* e = &whole.entries[i];
+
+        if (e->type != 0 && (e->type != type ||
+                             e->usernameSz > CRED_USERNAME_MAX_SZ)) {
+            abort();
+        }
+    }
+
+    CredStoreFree(&whole);
+    CredStoreFree(&pieces);
+    return 0;
+}
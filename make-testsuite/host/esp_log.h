@@ -0,0 +1,63 @@
+/* esp_log.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for the ESP-IDF log header, so that ESP32 server sources that
+ * only log can be built into the host tests. */
+
+#ifndef _HOST_ESP_LOG_H_
+#define _HOST_ESP_LOG_H_
+
+#include <stdio.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+/* one level for every tag, set by esp_log_level_set(); weak, so that each
+ * source that includes this shares it without a .c file to define it */
+__attribute__((weak)) esp_log_level_t hostLogLevel = ESP_LOG_INFO;
+
+#define ESP_LOGE(tag, fmt, ...) \
+    do { \
+        if (hostLogLevel >= ESP_LOG_ERROR) \
+            fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+#define ESP_LOGW(tag, fmt, ...) \
+    do { \
+        if (hostLogLevel >= ESP_LOG_WARN) \
+            fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__); \
+    } while (0)
+/* below the level: the arguments are not evaluated, as on the device, but
+ * still count as used */
+#define ESP_LOG_OFF(tag, fmt, ...) \
+    do { if (0) printf("%s" fmt, tag, ##__VA_ARGS__); } while (0)
+#define ESP_LOGI(tag, fmt, ...) ESP_LOG_OFF(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ESP_LOG_OFF(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGV(tag, fmt, ...) ESP_LOG_OFF(tag, fmt, ##__VA_ARGS__)
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buf, sz, level) ((void)(tag))
+
+#define esp_log_level_set(tag, level) ((void)(tag), hostLogLevel = (level))
+
+#endif /* _HOST_ESP_LOG_H_ */
@@ -0,0 +1,30 @@
+/* esp_task_wdt.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for the ESP-IDF task watchdog; there is none on the host. */
+
+#ifndef _HOST_ESP_TASK_WDT_H_
+#define _HOST_ESP_TASK_WDT_H_
+
+#include "esp_err.h"
+
+#define esp_task_wdt_reset() ESP_OK
+
+#endif /* _HOST_ESP_TASK_WDT_H_ */
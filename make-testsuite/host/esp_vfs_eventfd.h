@@ -0,0 +1,40 @@
+/* esp_vfs_eventfd.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for the ESP-IDF eventfd VFS: the host has eventfd itself. A
+ * read of the ESP-IDF one never blocks; it returns the count, even 0. */
+
+#ifndef _HOST_ESP_VFS_EVENTFD_H_
+#define _HOST_ESP_VFS_EVENTFD_H_
+
+#include <sys/eventfd.h>
+#include "esp_err.h"
+
+typedef struct {
+    size_t max_fds;
+} esp_vfs_eventfd_config_t;
+
+#define ESP_VFS_EVENTD_CONFIG_DEFAULT() { .max_fds = 5 }
+
+#define esp_vfs_eventfd_register(config) ((void)(config), ESP_OK)
+
+#define eventfd(count, flags) eventfd((count), (flags) | EFD_NONBLOCK)
+
+#endif /* _HOST_ESP_VFS_EVENTFD_H_ */
@@ -0,0 +1,52 @@
+/* FreeRTOS.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for the FreeRTOS types used by the ESP32 server, so that its
+ * tasks can run on the host as threads; see host_rtos.c. A tick is one
+ * millisecond. */
+
+#ifndef _HOST_FREERTOS_H_
+#define _HOST_FREERTOS_H_
+
+#include <stdint.h>
+
+typedef int           BaseType_t;
+typedef unsigned int  UBaseType_t;
+typedef uint32_t      TickType_t;
+typedef uint8_t       StackType_t;
+
+/* the host threads keep their own stacks; these only have to exist */
+typedef struct { int unused; } StaticTask_t;
+typedef struct { int unused; } StaticQueue_t;
+
+#define pdFALSE  0
+#define pdTRUE   1
+#define pdFAIL   pdFALSE
+#define pdPASS   pdTRUE
+#define errQUEUE_FULL  pdFAIL
+#define errQUEUE_EMPTY pdFAIL
+
+#define portMAX_DELAY        ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS   1
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(ms))
+#define tskIDLE_PRIORITY     0
+#define configMAX_TASK_NAME_LEN 16
+
+#endif /* _HOST_FREERTOS_H_ */
@@ -0,0 +1,39 @@
+/* queue.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for FreeRTOS queues, see host_rtos.c. */
+
+#ifndef _HOST_FREERTOS_QUEUE_H_
+#define _HOST_FREERTOS_QUEUE_H_
+
+#include "FreeRTOS.h"
+
+typedef struct HostQueue* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSz);
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSz,
+                                 uint8_t* storage, StaticQueue_t* buffer);
+void vQueueDelete(QueueHandle_t q);
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t q);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+
+#endif /* _HOST_FREERTOS_QUEUE_H_ */
@@ -0,0 +1,319 @@
+/* host_rtos.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* FreeRTOS tasks, task notifications and queues on POSIX threads, enough
+ * to run the ESP32 server's UART and session tasks in the host tests.
+ * Timeouts are in ticks of one millisecond. */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+struct HostTask {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify;
+    TaskFunction_t fn;
+    void* arg;
+};
+
+struct HostQueue {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t* items;
+    UBaseType_t length;
+    UBaseType_t itemSz;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static __thread struct HostTask* hostTaskSelf = NULL;
+
+/* a condition variable on the monotonic clock */
+static void HostCondInit(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* wait on cond until signalled or the deadline passes; a NULL deadline
+ * waits for ever. Returns 0 when signalled. */
+static int HostCondWait(pthread_cond_t* cond, pthread_mutex_t* lock,
+                        const struct timespec* deadline)
+{
+    if (deadline == NULL) {
+        return pthread_cond_wait(cond, lock);
+    }
+    return pthread_cond_timedwait(cond, lock, deadline);
+}
+
+/* the deadline ticks from now, or NULL for portMAX_DELAY */
+static const struct timespec* HostDeadline(TickType_t ticks,
+                                           struct timespec* ts)
+{
+    if (ticks == portMAX_DELAY) {
+        return NULL;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long)(ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+    return ts;
+}
+
+static struct HostTask* HostTaskNew(TaskFunction_t fn, void* arg)
+{
+    struct HostTask* task = (struct HostTask*)calloc(1, sizeof(*task));
+
+    if (task != NULL) {
+        pthread_mutex_init(&task->lock, NULL);
+        HostCondInit(&task->cond);
+        task->fn = fn;
+        task->arg = arg;
+    }
+    return task;
+}
+
+static void* HostTaskStart(void* arg)
+{
+    struct HostTask* task = (struct HostTask*)arg;
+
+    hostTaskSelf = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name,
+                       uint32_t stackDepth, void* arg, UBaseType_t prio,
+                       TaskHandle_t* handle)
+{
+    struct HostTask* task = HostTaskNew(fn, arg);
+
+    (void)name;
+    (void)stackDepth;
+    (void)prio;
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    if (pthread_create(&task->thread, NULL, HostTaskStart, task) != 0) {
+        free(task);
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char* name,
+                               uint32_t stackDepth, void* arg,
+                               UBaseType_t prio, StackType_t* stack,
+                               StaticTask_t* buffer)
+{
+    TaskHandle_t task = NULL;
+
+    (void)stack;
+    (void)buffer;
+    return (xTaskCreate(fn, name, stackDepth, arg, prio, &task) == pdPASS) ?
+           task : NULL;
+}
+
+/* only a task deleting itself, the one use in the server */
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == hostTaskSelf) {
+        pthread_exit(NULL);
+    }
+}
+
+/* a thread not made by xTaskCreate, such as main, becomes a task the
+ * first time it asks */
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (hostTaskSelf == NULL) {
+        hostTaskSelf = HostTaskNew(NULL, NULL);
+        if (hostTaskSelf == NULL) {
+            abort();
+        }
+        hostTaskSelf->thread = pthread_self();
+    }
+    return hostTaskSelf;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts;
+
+    ts.tv_sec = ticks / 1000;
+    ts.tv_nsec = (long)(ticks % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&task->lock);
+    task->notify++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks)
+{
+    struct HostTask* task = xTaskGetCurrentTaskHandle();
+    const struct timespec* deadline;
+    struct timespec ts;
+    uint32_t ret;
+
+    deadline = HostDeadline(ticks, &ts);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify == 0 && ticks != 0) {
+        if (HostCondWait(&task->cond, &task->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    ret = task->notify;
+    if (ret > 0) {
+        task->notify = clearOnExit ? 0 : ret - 1;
+    }
+    pthread_mutex_unlock(&task->lock);
+    return ret;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSz)
+{
+    struct HostQueue* q = (struct HostQueue*)calloc(1, sizeof(*q));
+
+    if (q == NULL) {
+        return NULL;
+    }
+    q->items = (uint8_t*)calloc(length, itemSz);
+    if (q->items == NULL) {
+        free(q);
+        return NULL;
+    }
+    pthread_mutex_init(&q->lock, NULL);
+    HostCondInit(&q->cond);
+    q->length = length;
+    q->itemSz = itemSz;
+    return q;
+}
+
+QueueHandle_t xQueueCreateStatic(UBaseType_t length, UBaseType_t itemSz,
+                                 uint8_t* storage, StaticQueue_t* buffer)
+{
+    (void)storage;
+    (void)buffer;
+    return xQueueCreate(length, itemSz);
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    if (q != NULL) {
+        pthread_mutex_destroy(&q->lock);
+        pthread_cond_destroy(&q->cond);
+        free(q->items);
+        free(q);
+    }
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks)
+{
+    const struct timespec* deadline;
+    struct timespec ts;
+    BaseType_t ret = errQUEUE_FULL;
+
+    deadline = HostDeadline(ticks, &ts);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->length && ticks != 0) {
+        if (HostCondWait(&q->cond, &q->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (q->count < q->length) {
+        memcpy(q->items + ((q->head + q->count) % q->length) * q->itemSz,
+               item, q->itemSz);
+        q->count++;
+        pthread_cond_broadcast(&q->cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks)
+{
+    const struct timespec* deadline;
+    struct timespec ts;
+    BaseType_t ret = errQUEUE_EMPTY;
+
+    deadline = HostDeadline(ticks, &ts);
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && ticks != 0) {
+        if (HostCondWait(&q->cond, &q->lock, deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (q->count > 0) {
+        memcpy(item, q->items + q->head * q->itemSz, q->itemSz);
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&q->cond);
+        ret = pdPASS;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->lock);
+    q->head = 0;
+    q->count = 0;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    UBaseType_t ret;
+
+    pthread_mutex_lock(&q->lock);
+    ret = q->count;
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
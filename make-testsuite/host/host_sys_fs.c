@@ -0,0 +1,377 @@
+/* host_sys_fs.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The MPLAB Harmony SYS_FS calls restricting-sftp makes, over POSIX on
+ * the host, so its SYS_FS build can be tested. A file handle is the file
+ * descriptor and keeps its own file pointer, as on the target, so a read
+ * or write goes where the last seek left it. Each call is counted by
+ * kind, and can be made to take a fixed time. */
+
+#include "host_sys_fs.h"
+#include "system/fs/sys_fs.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum {
+    HOST_FS_SEEK,
+    HOST_FS_READ,
+    HOST_FS_WRITE,
+    HOST_FS_OTHER
+} HostFsCall;
+
+static HostSysFsStats hostFsStats;
+static uint64_t hostFsLatency;
+static int hostFsError;
+
+
+static uint64_t HostFsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+/* count a call that started at start, and make it last the latency */
+static void HostFsDone(HostFsCall call, uint64_t start)
+{
+    uint64_t now;
+
+    switch (call) {
+        case HOST_FS_SEEK:
+            hostFsStats.seeks++;
+            break;
+        case HOST_FS_READ:
+            hostFsStats.reads++;
+            break;
+        case HOST_FS_WRITE:
+            hostFsStats.writes++;
+            break;
+        default:
+            hostFsStats.other++;
+            break;
+    }
+    if (errno != 0) {
+        hostFsError = errno;
+    }
+
+    while (hostFsLatency > 0 &&
+            (now = HostFsNow()) < start + hostFsLatency) {
+        uint64_t left = start + hostFsLatency - now;
+        struct timespec ts;
+
+        ts.tv_sec = (time_t)(left / 1000000000ULL);
+        ts.tv_nsec = (long)(left % 1000000000ULL);
+        nanosleep(&ts, NULL);
+    }
+}
+
+
+static SYS_FS_RESULT HostFsResult(int ret, HostFsCall call, uint64_t start)
+{
+    HostFsDone(call, start);
+    return (ret == 0) ? SYS_FS_RES_SUCCESS : SYS_FS_RES_FAILURE;
+}
+
+
+void HostSysFsLatency(uint64_t ns)
+{
+    hostFsLatency = ns;
+}
+
+
+void HostSysFsStatsGet(HostSysFsStats* stats)
+{
+    *stats = hostFsStats;
+}
+
+
+void HostSysFsStatsReset(void)
+{
+    memset(&hostFsStats, 0, sizeof(hostFsStats));
+}
+
+
+SYS_FS_HANDLE SYS_FS_FileOpen(const char* fname,
+        SYS_FS_FILE_OPEN_ATTRIBUTES attributes)
+{
+    static const int flags[] = {
+        O_RDONLY,                       /* SYS_FS_FILE_OPEN_READ */
+        O_WRONLY | O_CREAT | O_TRUNC,   /* SYS_FS_FILE_OPEN_WRITE */
+        O_WRONLY | O_CREAT,             /* SYS_FS_FILE_OPEN_APPEND */
+        O_RDWR,                         /* SYS_FS_FILE_OPEN_READ_PLUS */
+        O_RDWR | O_CREAT | O_TRUNC,     /* SYS_FS_FILE_OPEN_WRITE_PLUS */
+        O_RDWR | O_CREAT                /* SYS_FS_FILE_OPEN_APPEND_PLUS */
+    };
+    uint64_t start = HostFsNow();
+    int fd = -1;
+
+    errno = 0;
+    if ((unsigned)attributes < sizeof(flags) / sizeof(flags[0])) {
+        fd = open(fname, flags[attributes], 0644);
+    }
+    /* FatFs opens an append at the end, and a seek can still move it */
+    if (fd >= 0 && (attributes == SYS_FS_FILE_OPEN_APPEND ||
+            attributes == SYS_FS_FILE_OPEN_APPEND_PLUS)) {
+        (void)lseek(fd, 0, SEEK_END);
+    }
+    HostFsDone(HOST_FS_OTHER, start);
+    return (fd < 0) ? SYS_FS_HANDLE_INVALID : (SYS_FS_HANDLE)fd;
+}
+
+
+SYS_FS_RESULT SYS_FS_FileClose(SYS_FS_HANDLE handle)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(close((int)handle), HOST_FS_OTHER, start);
+}
+
+
+size_t SYS_FS_FileRead(SYS_FS_HANDLE handle, void* buf, size_t nbyte)
+{
+    uint64_t start = HostFsNow();
+    ssize_t ret;
+
+    errno = 0;
+    ret = read((int)handle, buf, nbyte);
+    HostFsDone(HOST_FS_READ, start);
+    return (size_t)ret;
+}
+
+
+size_t SYS_FS_FileWrite(SYS_FS_HANDLE handle, const void* buf, size_t nbyte)
+{
+    uint64_t start = HostFsNow();
+    ssize_t ret;
+
+    errno = 0;
+    ret = write((int)handle, buf, nbyte);
+    HostFsDone(HOST_FS_WRITE, start);
+    return (size_t)ret;
+}
+
+
+int32_t SYS_FS_FileSeek(SYS_FS_HANDLE handle, int32_t offset,
+        SYS_FS_FILE_SEEK_CONTROL whence)
+{
+    static const int how[] = { SEEK_SET, SEEK_CUR, SEEK_END };
+    uint64_t start = HostFsNow();
+    off_t ret = -1;
+
+    errno = 0;
+    if ((unsigned)whence < sizeof(how) / sizeof(how[0])) {
+        ret = lseek((int)handle, (off_t)offset, how[whence]);
+    }
+    HostFsDone(HOST_FS_SEEK, start);
+    return (ret < 0 || ret > INT32_MAX) ? -1 : (int32_t)ret;
+}
+
+
+int32_t SYS_FS_FileTell(SYS_FS_HANDLE handle)
+{
+    uint64_t start = HostFsNow();
+    off_t ret;
+
+    errno = 0;
+    ret = lseek((int)handle, 0, SEEK_CUR);
+    HostFsDone(HOST_FS_OTHER, start);
+    return (ret < 0 || ret > INT32_MAX) ? -1 : (int32_t)ret;
+}
+
+
+SYS_FS_RESULT SYS_FS_FileSync(SYS_FS_HANDLE handle)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(fsync((int)handle), HOST_FS_OTHER, start);
+}
+
+
+char* SYS_FS_FileStringGet(SYS_FS_HANDLE handle, char* buf, uint32_t size)
+{
+    uint64_t start = HostFsNow();
+    uint32_t i = 0;
+
+    errno = 0;
+    while (i + 1 < size && read((int)handle, buf + i, 1) == 1) {
+        if (buf[i++] == '\n') {
+            break;
+        }
+    }
+    if (size > 0) {
+        buf[i] = '\0';
+    }
+    HostFsDone(HOST_FS_READ, start);
+    return (i == 0) ? NULL : buf;
+}
+
+
+SYS_FS_RESULT SYS_FS_FileStringPut(SYS_FS_HANDLE handle, const char* string)
+{
+    uint64_t start = HostFsNow();
+    size_t sz = strlen(string);
+    int ret;
+
+    errno = 0;
+    ret = (write((int)handle, string, sz) == (ssize_t)sz) ? 0 : -1;
+    HostFsDone(HOST_FS_WRITE, start);
+    return (ret == 0) ? SYS_FS_RES_SUCCESS : SYS_FS_RES_FAILURE;
+}
+
+
+SYS_FS_RESULT SYS_FS_FileStat(const char* fname, SYS_FS_FSTAT* buf)
+{
+    uint64_t start = HostFsNow();
+    const char* name = strrchr(fname, '/');
+    struct stat st;
+    struct tm tm;
+    int ret;
+
+    errno = 0;
+    ret = stat(fname, &st);
+    if (ret == 0) {
+        memset(buf, 0, sizeof(SYS_FS_FSTAT));
+        buf->fsize = (uint32_t)st.st_size;
+        /* FAT date and time */
+        localtime_r(&st.st_mtime, &tm);
+        buf->fdate = (uint16_t)(((tm.tm_year - 80) << 9) |
+                ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+        buf->ftime = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) |
+                (tm.tm_sec / 2));
+        if (S_ISDIR(st.st_mode)) {
+            buf->fattrib |= SYS_FS_ATTR_DIR;
+        }
+        if ((st.st_mode & S_IWUSR) == 0) {
+            buf->fattrib |= SYS_FS_ATTR_RDO;
+        }
+        snprintf(buf->fname, sizeof(buf->fname), "%s",
+                (name != NULL) ? name + 1 : fname);
+    }
+    return HostFsResult(ret, HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_RESULT SYS_FS_FileDirectoryModeSet(const char* fname,
+        SYS_FS_FILE_DIR_ATTR attr, SYS_FS_FILE_DIR_ATTR mask)
+{
+    uint64_t start = HostFsNow();
+    struct stat st;
+    int ret;
+
+    errno = 0;
+    ret = stat(fname, &st);
+    if (ret == 0 && (mask & SYS_FS_ATTR_RDO)) {
+        mode_t mode = st.st_mode & 07777;
+
+        mode = (attr & SYS_FS_ATTR_RDO) ? (mode & ~0222) : (mode | S_IWUSR);
+        ret = chmod(fname, mode);
+    }
+    return HostFsResult(ret, HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_RESULT SYS_FS_FileDirectoryRemove(const char* fname)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(remove(fname), HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_RESULT SYS_FS_FileDirectoryRenameMove(const char* oldPath,
+        const char* newPath)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(rename(oldPath, newPath), HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_RESULT SYS_FS_DirectoryMake(const char* path)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(mkdir(path, 0755), HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_RESULT SYS_FS_DirectryChange(const char* path)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(chdir(path), HOST_FS_OTHER, start);
+}
+
+
+SYS_FS_HANDLE SYS_FS_DirOpen(const char* path)
+{
+    uint64_t start = HostFsNow();
+    DIR* dir;
+
+    errno = 0;
+    dir = opendir(path);
+    HostFsDone(HOST_FS_OTHER, start);
+    return (dir == NULL) ? SYS_FS_HANDLE_INVALID : (SYS_FS_HANDLE)dir;
+}
+
+
+SYS_FS_RESULT SYS_FS_DirClose(SYS_FS_HANDLE handle)
+{
+    uint64_t start = HostFsNow();
+
+    errno = 0;
+    return HostFsResult(closedir((DIR*)handle), HOST_FS_OTHER, start);
+}
+
+
+/* there are no drives, so no path is a drive's root */
+SYS_FS_RESULT SYS_FS_CurrentDriveGet(char* buffer)
+{
+    (void)buffer;
+    return SYS_FS_RES_FAILURE;
+}
+
+
+SYS_FS_RESULT SYS_FS_CurrentWorkingDirectoryGet(char* buf, uint32_t len)
+{
+    return (getcwd(buf, len) != NULL) ? SYS_FS_RES_SUCCESS :
+                                        SYS_FS_RES_FAILURE;
+}
+
+
+int SYS_FS_Error(void)
+{
+    return hostFsError;
+}
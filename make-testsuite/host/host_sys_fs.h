@@ -0,0 +1,44 @@
+/* host_sys_fs.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host side of the SYS_FS stand-in in host_sys_fs.c: the calls it has
+ * passed to the host, and a latency to give each of them, as the command
+ * overhead of an SD card on SPI. */
+
+#ifndef _HOST_SYS_FS_H_
+#define _HOST_SYS_FS_H_
+
+#include <stdint.h>
+
+/* Calls since the last HostSysFsStatsReset. */
+typedef struct HostSysFsStats {
+    uint64_t seeks;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t other;   /* opens, closes, stats and the rest */
+} HostSysFsStats;
+
+/* Make every file call take at least ns; 0, the default, for none. */
+void HostSysFsLatency(uint64_t ns);
+
+void HostSysFsStatsGet(HostSysFsStats* stats);
+void HostSysFsStatsReset(void);
+
+#endif /* _HOST_SYS_FS_H_ */
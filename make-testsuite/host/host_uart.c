@@ -0,0 +1,373 @@
+/* host_uart.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* The ESP-IDF UART driver calls the ESP32 server makes, on a pseudo
+ * terminal. A thread reads what the device sends into a driver buffer of
+ * the size given to uart_driver_install, and queues a UART_DATA event for
+ * each read, or UART_BUFFER_FULL when it did not all fit and the rest was
+ * dropped, as the driver does. With hardware flow control configured the
+ * thread stops reading instead, and the device is held back. When paced
+ * at a baud rate, a read smaller than the Rx threshold is announced after
+ * the Rx idle timeout, as on the board. */
+
+#ifndef _GNU_SOURCE
+    /* posix_openpt and friends */
+    #define _GNU_SOURCE
+#endif
+
+#include "driver/uart.h"
+#include "host_uart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/* the ESP32's UART Tx FIFO, in bytes */
+#define HOST_UART_TX_FIFO_SZ 128
+
+typedef struct HostUart {
+    pthread_mutex_t lock;
+    pthread_cond_t room;
+    pthread_t reader;
+    QueueHandle_t events;
+    int master;
+    int device;
+    int flowCtrl;
+    int rxThreshold;
+    int rxTimeout;
+    uint64_t byteNs;
+    uint64_t txDone;  /* when the last byte written leaves the wire */
+
+    uint8_t* rxBuf;
+    size_t rxSz;
+    size_t rxHead;
+    size_t rxUsed;
+
+    HostUartStats stats;
+} HostUart;
+
+static HostUart hostUart = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .room = PTHREAD_COND_INITIALIZER,
+    .master = -1,
+    .device = -1,
+    .rxThreshold = 120,
+    .rxTimeout = 10,
+};
+
+static uint64_t HostUartNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void HostUartSleepUntil(uint64_t at)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(at / 1000000000ULL);
+    ts.tv_nsec = (long)(at % 1000000000ULL);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)
+            == EINTR) {
+    }
+}
+
+int HostUartOpen(int baud)
+{
+    struct termios tio;
+    int master;
+    int device;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        if (master >= 0) {
+            close(master);
+        }
+        return -1;
+    }
+    device = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (device < 0 || tcgetattr(device, &tio) != 0) {
+        close(master);
+        if (device >= 0) {
+            close(device);
+        }
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tcsetattr(device, TCSANOW, &tio);
+
+    hostUart.master = master;
+    hostUart.device = device;
+    hostUart.byteNs = (baud > 0) ? 10ULL * 1000000000ULL / (uint64_t)baud : 0;
+    return device;
+}
+
+uint64_t HostUartByteNs(void)
+{
+    return hostUart.byteNs;
+}
+
+void HostUartStatsGet(HostUartStats* stats)
+{
+    pthread_mutex_lock(&hostUart.lock);
+    *stats = hostUart.stats;
+    pthread_mutex_unlock(&hostUart.lock);
+}
+
+static void* HostUartReader(void* arg)
+{
+    HostUart* u = (HostUart*)arg;
+    uint8_t data[256];
+
+    for (;;) {
+        uart_event_t event;
+        size_t want = sizeof(data);
+        int threshold;
+        int timeout;
+        size_t put;
+        size_t i;
+        ssize_t got;
+
+        pthread_mutex_lock(&u->lock);
+        while (u->flowCtrl && u->rxUsed == u->rxSz) {
+            pthread_cond_wait(&u->room, &u->lock);
+        }
+        if (u->flowCtrl && u->rxSz - u->rxUsed < want) {
+            want = u->rxSz - u->rxUsed;
+        }
+        threshold = u->rxThreshold;
+        timeout = u->rxTimeout;
+        pthread_mutex_unlock(&u->lock);
+
+        got = read(u->master, data, want);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            /* the device end closed */
+            break;
+        }
+
+        /* With pacing, less than the threshold in the FIFO waits for the
+         * line to be idle for the timeout before the event. */
+        if (u->byteNs > 0 && got < threshold) {
+            HostUartSleepUntil(HostUartNow() + u->byteNs * (uint64_t)timeout);
+        }
+
+        pthread_mutex_lock(&u->lock);
+        put = u->rxSz - u->rxUsed;
+        if (put > (size_t)got) {
+            put = (size_t)got;
+        }
+        for (i = 0; i < put; i++) {
+            u->rxBuf[(u->rxHead + u->rxUsed + i) % u->rxSz] = data[i];
+        }
+        u->rxUsed += put;
+        u->stats.rxBytes += put;
+        u->stats.rxDropped += (size_t)got - put;
+        if (put < (size_t)got) {
+            u->stats.fullEvents++;
+            event.type = UART_BUFFER_FULL;
+        }
+        else {
+            u->stats.rxEvents++;
+            event.type = UART_DATA;
+        }
+        pthread_mutex_unlock(&u->lock);
+
+        /* from the ISR, so never waiting for room in the queue */
+        event.size = put;
+        event.timeout_flag = false;
+        xQueueSend(u->events, &event, 0);
+    }
+    return NULL;
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufSz, int txBufSz,
+                              int queueSz, QueueHandle_t* queue,
+                              int intrFlags)
+{
+    (void)txBufSz;
+    (void)intrFlags;
+    if (port != UART_NUM_1 || hostUart.master < 0 || rxBufSz <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (hostUart.rxBuf != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    hostUart.rxBuf = (uint8_t*)malloc((size_t)rxBufSz);
+    hostUart.events = xQueueCreate((UBaseType_t)queueSz,
+                                   sizeof(uart_event_t));
+    if (hostUart.rxBuf == NULL || hostUart.events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    hostUart.rxSz = (size_t)rxBufSz;
+    if (queue != NULL) {
+        *queue = hostUart.events;
+    }
+    if (pthread_create(&hostUart.reader, NULL, HostUartReader,
+                       &hostUart) != 0) {
+        return ESP_FAIL;
+    }
+    pthread_detach(hostUart.reader);
+    return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t* config)
+{
+    if (port != UART_NUM_1 || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    hostUart.flowCtrl = (config->flow_ctrl == UART_HW_FLOWCTRL_CTS_RTS ||
+                         config->flow_ctrl == UART_HW_FLOWCTRL_RTS);
+    pthread_mutex_unlock(&hostUart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+    (void)tx;
+    (void)rx;
+    (void)rts;
+    (void)cts;
+    return (port == UART_NUM_1) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t uart_set_rx_full_threshold(uart_port_t port, int threshold)
+{
+    if (port != UART_NUM_1 || threshold <= 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    hostUart.rxThreshold = threshold;
+    pthread_mutex_unlock(&hostUart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_set_rx_timeout(uart_port_t port, uint8_t symbols)
+{
+    if (port != UART_NUM_1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    hostUart.rxTimeout = symbols;
+    pthread_mutex_unlock(&hostUart.lock);
+    return ESP_OK;
+}
+
+esp_err_t uart_get_buffered_data_len(uart_port_t port, size_t* sz)
+{
+    if (port != UART_NUM_1 || sz == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    *sz = hostUart.rxUsed;
+    pthread_mutex_unlock(&hostUart.lock);
+    return ESP_OK;
+}
+
+/* only what is already buffered; the server never waits here */
+int uart_read_bytes(uart_port_t port, void* buf, uint32_t sz,
+                    TickType_t ticks)
+{
+    uint8_t* out = (uint8_t*)buf;
+    size_t n;
+    size_t i;
+
+    (void)ticks;
+    if (port != UART_NUM_1 || buf == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    n = (hostUart.rxUsed < sz) ? hostUart.rxUsed : sz;
+    for (i = 0; i < n; i++) {
+        out[i] = hostUart.rxBuf[(hostUart.rxHead + i) % hostUart.rxSz];
+    }
+    hostUart.rxHead = (hostUart.rxHead + n) % hostUart.rxSz;
+    hostUart.rxUsed -= n;
+    pthread_cond_signal(&hostUart.room);
+    pthread_mutex_unlock(&hostUart.lock);
+    return (int)n;
+}
+
+int uart_write_bytes(uart_port_t port, const void* data, size_t sz)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    size_t done = 0;
+
+    if (port != UART_NUM_1 || data == NULL) {
+        return -1;
+    }
+
+    /* Only uart_tx_task writes. Without a driver Tx buffer the call
+     * returns once the last byte is in the Tx FIFO, so sleep until the
+     * line has that much left to send; what is in the FIFO keeps it busy
+     * until the next call. */
+    if (hostUart.byteNs > 0) {
+        uint64_t now = HostUartNow();
+        uint64_t fifoNs = hostUart.byteNs * HOST_UART_TX_FIFO_SZ;
+
+        if (hostUart.txDone < now) {
+            hostUart.txDone = now;
+        }
+        hostUart.txDone += hostUart.byteNs * sz;
+        if (hostUart.txDone > now + fifoNs) {
+            HostUartSleepUntil(hostUart.txDone - fifoNs);
+        }
+    }
+    while (done < sz) {
+        ssize_t ret = write(hostUart.master, p + done, sz - done);
+
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            break;
+        }
+        done += (size_t)ret;
+    }
+
+    pthread_mutex_lock(&hostUart.lock);
+    hostUart.stats.txBytes += done;
+    pthread_mutex_unlock(&hostUart.lock);
+    return (int)done;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    if (port != UART_NUM_1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&hostUart.lock);
+    hostUart.rxHead = 0;
+    hostUart.rxUsed = 0;
+    pthread_cond_signal(&hostUart.room);
+    pthread_mutex_unlock(&hostUart.lock);
+    return ESP_OK;
+}
@@ -0,0 +1,51 @@
+/* host_uart.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host side of the UART stand-in in host_uart.c: the ESP32 server's
+ * UART_NUM_1 is the controlling end of a pseudo terminal, and a test or
+ * benchmark plays the device attached to it on the other end. */
+
+#ifndef _HOST_UART_H_
+#define _HOST_UART_H_
+
+#include <stdint.h>
+
+/* Totals since HostUartOpen. */
+typedef struct HostUartStats {
+    uint64_t rxBytes;     /* from the device into the driver buffer */
+    uint64_t rxDropped;   /* from the device, lost to a full buffer */
+    uint64_t txBytes;     /* written by uart_write_bytes */
+    uint32_t rxEvents;    /* UART_DATA events queued */
+    uint32_t fullEvents;  /* UART_BUFFER_FULL events queued */
+} HostUartStats;
+
+/* Open the pseudo terminal, before init_UART. Returns the device end, in
+ * raw mode, or -1. With a non-zero baud, uart_write_bytes takes as long
+ * as the bytes would take on the wire at 10 bits each, less what the
+ * 128 byte Tx FIFO still holds when it returns, and the bytes reach the
+ * device as it returns. */
+int HostUartOpen(int baud);
+
+/* The time one byte takes on the wire, in ns; 0 when not paced. */
+uint64_t HostUartByteNs(void);
+
+void HostUartStatsGet(HostUartStats* stats);
+
+#endif /* _HOST_UART_H_ */
@@ -0,0 +1,98 @@
+/* sys_fs.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Stand-in for the part of the MPLAB Harmony file system service that
+ * restricting-sftp calls, over POSIX files on the host; see host_sys_fs.c
+ * and host_sys_fs.h. Paths are host paths, there are no drives. */
+
+#ifndef _HOST_SYSTEM_FS_SYS_FS_H_
+#define _HOST_SYSTEM_FS_SYS_FS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uintptr_t SYS_FS_HANDLE;
+
+#define SYS_FS_HANDLE_INVALID ((SYS_FS_HANDLE)(-1))
+
+typedef enum {
+    SYS_FS_RES_SUCCESS = 0,
+    SYS_FS_RES_FAILURE = -1
+} SYS_FS_RESULT;
+
+typedef enum {
+    SYS_FS_FILE_OPEN_READ = 0,
+    SYS_FS_FILE_OPEN_WRITE,
+    SYS_FS_FILE_OPEN_APPEND,
+    SYS_FS_FILE_OPEN_READ_PLUS,
+    SYS_FS_FILE_OPEN_WRITE_PLUS,
+    SYS_FS_FILE_OPEN_APPEND_PLUS
+} SYS_FS_FILE_OPEN_ATTRIBUTES;
+
+typedef enum {
+    SYS_FS_SEEK_SET,
+    SYS_FS_SEEK_CUR,
+    SYS_FS_SEEK_END
+} SYS_FS_FILE_SEEK_CONTROL;
+
+typedef enum {
+    SYS_FS_ATTR_RDO  = 0x01,
+    SYS_FS_ATTR_HID  = 0x02,
+    SYS_FS_ATTR_SYS  = 0x04,
+    SYS_FS_ATTR_VOL  = 0x08,
+    SYS_FS_ATTR_DIR  = 0x10,
+    SYS_FS_ATTR_ARC  = 0x20,
+    SYS_FS_ATTR_MASK = 0x3F
+} SYS_FS_FILE_DIR_ATTR;
+
+typedef struct SYS_FS_FSTAT {
+    uint32_t fsize;
+    uint16_t fdate;
+    uint16_t ftime;
+    uint8_t fattrib;
+    char fname[256];
+} SYS_FS_FSTAT;
+
+SYS_FS_HANDLE SYS_FS_FileOpen(const char* fname,
+        SYS_FS_FILE_OPEN_ATTRIBUTES attributes);
+SYS_FS_RESULT SYS_FS_FileClose(SYS_FS_HANDLE handle);
+size_t SYS_FS_FileRead(SYS_FS_HANDLE handle, void* buf, size_t nbyte);
+size_t SYS_FS_FileWrite(SYS_FS_HANDLE handle, const void* buf, size_t nbyte);
+int32_t SYS_FS_FileSeek(SYS_FS_HANDLE handle, int32_t offset,
+        SYS_FS_FILE_SEEK_CONTROL whence);
+int32_t SYS_FS_FileTell(SYS_FS_HANDLE handle);
+SYS_FS_RESULT SYS_FS_FileSync(SYS_FS_HANDLE handle);
+char* SYS_FS_FileStringGet(SYS_FS_HANDLE handle, char* buf, uint32_t size);
+SYS_FS_RESULT SYS_FS_FileStringPut(SYS_FS_HANDLE handle, const char* string);
+SYS_FS_RESULT SYS_FS_FileStat(const char* fname, SYS_FS_FSTAT* buf);
+SYS_FS_RESULT SYS_FS_FileDirectoryModeSet(const char* fname,
+        SYS_FS_FILE_DIR_ATTR attr, SYS_FS_FILE_DIR_ATTR mask);
+SYS_FS_RESULT SYS_FS_FileDirectoryRemove(const char* fname);
+SYS_FS_RESULT SYS_FS_FileDirectoryRenameMove(const char* oldPath,
+        const char* newPath);
+SYS_FS_RESULT SYS_FS_DirectoryMake(const char* path);
+SYS_FS_RESULT SYS_FS_DirectryChange(const char* path);
+SYS_FS_HANDLE SYS_FS_DirOpen(const char* path);
+SYS_FS_RESULT SYS_FS_DirClose(SYS_FS_HANDLE handle);
+SYS_FS_RESULT SYS_FS_CurrentDriveGet(char* buffer);
+SYS_FS_RESULT SYS_FS_CurrentWorkingDirectoryGet(char* buf, uint32_t len);
+int SYS_FS_Error(void);
+
+#endif /* _HOST_SYSTEM_FS_SYS_FS_H_ */
@@ -0,0 +1,305 @@
+/* test_coalesce.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's output coalescing. The flush rules are
+ * checked one at a time, then UART traffic is played through the policy
+ * on a simulated clock, driven as server_worker drives it: log lines and
+ * a byte stream at 115200 baud, and typing. For each it prints packets
+ * per second, bytes per packet and the latency added, with the server's
+ * default policy and with coalescing off. */
+
+#include "coalesce.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* the defaults in ssh_server_config.h */
+#define TEST_MAX_SZ   1024
+#define TEST_DELAY_US 5000
+
+/* one byte at 115200 baud, 8N1 */
+#define TEST_BYTE_US  87
+#define TEST_SIM_SZ   (16 * 1024)
+
+static const char* const prompts[] = { "$ ", "# ", "> ", NULL };
+
+typedef struct SimResult {
+    uint32_t packets;
+    uint32_t bytes;
+    int64_t spanUs;
+    int64_t latSum;
+    int64_t latMax;
+} SimResult;
+
+static uint8_t simData[TEST_SIM_SZ];
+static int64_t simAt[TEST_SIM_SZ];
+static size_t simSz;
+
+static void TestRules(void)
+{
+    coalesce_t c;
+
+    /* output after a quiet spell goes at once */
+    coalesce_init(&c, TEST_MAX_SZ, TEST_DELAY_US, 1, prompts);
+    coalesce_scan(&c, (const uint8_t*)"a", 1, 1000);
+    TEST_CHECK(coalesce_wait(&c, 1, 1000) == 0);
+    coalesce_sent(&c, 1, 0, 1000);
+
+    /* more soon after waits out the rest of the delay */
+    coalesce_scan(&c, (const uint8_t*)"b", 1, 1100);
+    TEST_CHECK(coalesce_wait(&c, 1, 1100) == TEST_DELAY_US);
+    coalesce_scan(&c, (const uint8_t*)"c", 1, 3100);
+    TEST_CHECK(coalesce_wait(&c, 2, 3100) == TEST_DELAY_US - 2000);
+    TEST_CHECK(coalesce_wait(&c, 2, 1100 + TEST_DELAY_US) == 0);
+
+    /* a full packet's worth goes at once */
+    TEST_CHECK(coalesce_wait(&c, TEST_MAX_SZ, 3100) == 0);
+
+    /* a newline, in any piece */
+    coalesce_scan(&c, (const uint8_t*)"d\r", 2, 3200);
+    TEST_CHECK(coalesce_wait(&c, 4, 3200) == 0);
+    coalesce_sent(&c, 4, 0, 3200);
+    TEST_CHECK(c.sends == 2 && c.bytes == 5);
+
+    /* a prompt split over several pieces */
+    coalesce_scan(&c, (const uint8_t*)"user@h", 6, 3300);
+    coalesce_scan(&c, (const uint8_t*)"ost$", 4, 3300);
+    TEST_CHECK(coalesce_wait(&c, 10, 3300) > 0);
+    coalesce_scan(&c, (const uint8_t*)" ", 1, 3300);
+    TEST_CHECK(coalesce_wait(&c, 11, 3300) == 0);
+
+    /* what is left of a flush still goes without waiting */
+    coalesce_sent(&c, 6, 5, 3400);
+    TEST_CHECK(c.scanned == 5);
+    TEST_CHECK(coalesce_wait(&c, 5, 3400) == 0);
+    coalesce_sent(&c, 5, 0, 3400);
+
+    /* without newline flushing a newline waits like anything else */
+    coalesce_init(&c, TEST_MAX_SZ, TEST_DELAY_US, 0, NULL);
+    coalesce_sent(&c, 1, 0, 0);
+    coalesce_scan(&c, (const uint8_t*)"a\nb$ ", 5, 10);
+    TEST_CHECK(coalesce_wait(&c, 5, 10) == TEST_DELAY_US);
+
+    /* a zero delay sends everything at once, and a zero size is one */
+    coalesce_init(&c, 0, 0, 0, NULL);
+    TEST_CHECK(c.maxSz == 1);
+    coalesce_sent(&c, 1, 0, 0);
+    coalesce_scan(&c, (const uint8_t*)"a", 1, 1);
+    TEST_CHECK(coalesce_wait(&c, 1, 1) == 0);
+
+    /* a new session starts quiet, with no totals */
+    coalesce_init(&c, TEST_MAX_SZ, TEST_DELAY_US, 1, prompts);
+    coalesce_sent(&c, 1, 0, 100);
+    coalesce_reset(&c);
+    TEST_CHECK(c.sends == 0 && c.bytes == 0 && c.scanned == 0);
+    coalesce_scan(&c, (const uint8_t*)"a", 1, 200);
+    TEST_CHECK(coalesce_wait(&c, 1, 200) == 0);
+}
+
+/*
+ * Play simData through the policy. The server wakes when data arrives or
+ * the wait it was given runs out, shows the coalescer what is new, and
+ * sends everything pending in one packet when told to.
+ */
+static void Simulate(coalesce_t* c, SimResult* r)
+{
+    size_t head = 0; /* first byte not sent */
+    size_t tail = 0; /* bytes arrived */
+    int64_t deadline = INT64_MAX;
+    int64_t now;
+    size_t pending;
+    int64_t wait;
+    size_t i;
+
+    memset(r, 0, sizeof(SimResult));
+    coalesce_reset(c);
+    while (head < simSz) {
+        now = (tail < simSz && simAt[tail] < deadline) ? simAt[tail] :
+                                                         deadline;
+        while (tail < simSz && simAt[tail] <= now) {
+            tail++;
+        }
+        pending = tail - head;
+        if (pending > c->scanned) {
+            coalesce_scan(c, simData + head + c->scanned,
+                          pending - c->scanned, now);
+        }
+        if (pending == 0) {
+            deadline = INT64_MAX;
+            continue;
+        }
+
+        wait = coalesce_wait(c, pending, now);
+        if (wait > 0) {
+            deadline = now + wait;
+            continue;
+        }
+        for (i = head; i < tail; i++) {
+            r->latSum += now - simAt[i];
+            if (now - simAt[i] > r->latMax) {
+                r->latMax = now - simAt[i];
+            }
+        }
+        coalesce_sent(c, pending, 0, now);
+        r->packets++;
+        r->bytes += (uint32_t)pending;
+        r->spanUs = now - simAt[0];
+        head = tail;
+        deadline = INT64_MAX;
+    }
+}
+
+static void SimAdd(const char* s, size_t sz, int64_t at, int64_t stepUs)
+{
+    size_t i;
+
+    for (i = 0; i < sz && simSz < TEST_SIM_SZ; i++) {
+        simData[simSz] = (uint8_t)s[i];
+        simAt[simSz++] = at + (int64_t)i * stepUs;
+    }
+}
+
+/* a boot log: lines of 40 to 100 bytes, back to back */
+static void SimLog(void)
+{
+    char line[128];
+    int64_t at = 0;
+    int n = 0;
+
+    simSz = 0;
+    srand(1);
+    while (simSz + sizeof(line) < TEST_SIM_SZ) {
+        int len = snprintf(line, sizeof(line), "I (%d) app: reading %d",
+                           n * 37, n);
+
+        while (len < 40 + rand() % 60) {
+            line[len++] = (char)('a' + rand() % 26);
+        }
+        line[len++] = '\n';
+        SimAdd(line, (size_t)len, at, TEST_BYTE_US);
+        at += len * TEST_BYTE_US;
+        n++;
+    }
+}
+
+/* a device streaming without newlines */
+static void SimStream(void)
+{
+    simSz = 0;
+    while (simSz < TEST_SIM_SZ) {
+        SimAdd("x", 1, (int64_t)simSz * TEST_BYTE_US, 0);
+    }
+}
+
+/* the echo of one key press every 150 ms; every tenth is Enter, which
+ * gets a newline and a prompt back */
+static void SimTyping(void)
+{
+    int k;
+
+    simSz = 0;
+    for (k = 0; k < 200; k++) {
+        int64_t at = (int64_t)k * 150000;
+
+        if (k % 10 == 9) {
+            SimAdd("\r\n$ ", 4, at, TEST_BYTE_US);
+        }
+        else {
+            SimAdd("abcdefghi" + k % 10, 1, at, 0);
+        }
+    }
+}
+
+static uint32_t SimLines(void)
+{
+    uint32_t lines = 0;
+    size_t i;
+
+    for (i = 0; i < simSz; i++) {
+        lines += (simData[i] == '\n');
+    }
+    return lines;
+}
+
+static void Report(const char* traffic, const char* policy,
+                   const SimResult* r)
+{
+    printf("%-8s %-9s %10.0f %10.1f %10.0f %10lld\n", traffic, policy,
+           (double)r->packets * 1e6 / (double)r->spanUs,
+           (double)r->bytes / r->packets,
+           (double)r->latSum / r->bytes, (long long)r->latMax);
+}
+
+static void TestTraffic(void)
+{
+    static void (*const gen[])(void) = { SimLog, SimStream, SimTyping };
+    static const char* const name[] = { "log", "stream", "typing" };
+    coalesce_t on;
+    coalesce_t off;
+    SimResult r[2];
+    size_t g;
+
+    coalesce_init(&on, TEST_MAX_SZ, TEST_DELAY_US, 1, prompts);
+    coalesce_init(&off, TEST_MAX_SZ, 0, 0, NULL);
+    printf("%-8s %-9s %10s %10s %10s %10s\n", "traffic", "policy",
+           "packets/s", "bytes/pkt", "mean us", "max us");
+
+    for (g = 0; g < sizeof(gen) / sizeof(gen[0]); g++) {
+        gen[g]();
+        Simulate(&off, &r[0]);
+        Simulate(&on, &r[1]);
+        Report(name[g], "off", &r[0]);
+        Report(name[g], "default", &r[1]);
+
+        /* everything arrives, nothing waits past the delay */
+        TEST_CHECK(r[0].bytes == simSz && r[1].bytes == simSz);
+        TEST_CHECK(r[0].latMax == 0);
+        TEST_CHECK(r[1].latMax <= TEST_DELAY_US);
+        TEST_CHECK(on.sends == r[1].packets && on.bytes == r[1].bytes);
+
+        if (gen[g] == SimTyping) {
+            /* an echo goes at once; the prompt after Enter comes a byte
+             * at a time, and its "$" waits for the " " */
+            TEST_CHECK(r[1].latMax <= TEST_BYTE_US);
+            TEST_CHECK(r[1].packets <= 200 + 20 * 2);
+        }
+        else if (gen[g] == SimLog) {
+            /* a line goes whole on its newline, or in two if it takes
+             * longer than the delay to arrive: up to 100 bytes is less
+             * than two delays */
+            TEST_CHECK(r[1].packets <= 2 * SimLines());
+            TEST_CHECK(r[1].bytes / r[1].packets >= 40);
+        }
+        else {
+            /* a packet every delay */
+            TEST_CHECK(r[1].bytes / r[1].packets >=
+                       TEST_DELAY_US / TEST_BYTE_US - 1);
+        }
+    }
+}
+
+int main(void)
+{
+    TEST_RUN(TestRules);
+    TEST_RUN(TestTraffic);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,61 @@
+/* test_common.h
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks shared by the test-* programs. Each program exits non-zero when
+ * any check fails, so "make test" stops at the first failing program. */
+
+#ifndef _TEST_COMMON_H_
+#define _TEST_COMMON_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+static int testFailures = 0;
+
+#define TEST_CHECK(cond) \
+    do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", \
+                    __FILE__, __LINE__, #cond); \
+            testFailures++; \
+        } \
+    } while (0)
+
+#define TEST_RUN(fn) \
+    do { \
+        int before = testFailures; \
+        fn(); \
+        printf("%-40s %s\n", #fn, \
+               (testFailures == before) ? "passed" : "FAILED"); \
+    } while (0)
+
+#define TEST_RESULT() ((testFailures == 0) ? 0 : 1)
+
+/* monotonic time in nanoseconds */
+static inline uint64_t TestNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+#endif /* _TEST_COMMON_H_ */
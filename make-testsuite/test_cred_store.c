@@ -0,0 +1,450 @@
+/* test_cred_store.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's credential store and its streaming
+ * passwd and authorized_keys loader. Random text made of pieces of real
+ * lines is then loaded whole and in random pieces, which must give the
+ * same table, and a 10000 line authorized_keys file is loaded from 4 KB
+ * chunks, as from flash, and timed. fuzz_cred_loader.c checks the same
+ * with libFuzzer. */
+
+#include "credential_store.h"
+#include "test_common.h"
+
+#include <esp_log.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PW  WOLFSSH_USERAUTH_PASSWORD
+#define PK  WOLFSSH_USERAUTH_PUBLICKEY
+
+#define TEST_FUZZ_RUNS   20000
+#define TEST_FUZZ_SZ     512
+#define TEST_KEYS_LINES  10000
+#define TEST_KEYS_CHUNK  4096
+/* MB/s the loader must reach over the authorized_keys file */
+#define TEST_KEYS_MIN_MBPS 5
+
+static int Check(const CredStore* store, byte type, const char* user,
+                 const char* secret, word32 secretSz)
+{
+    return CredStoreCheck(store, type, (const byte*)user,
+                          (word32)strlen(user), (const byte*)secret,
+                          secretSz);
+}
+
+static int Add(CredStore* store, byte type, const char* user,
+               const char* secret)
+{
+    return CredStoreAdd(store, type, (const byte*)user, (word32)strlen(user),
+                        (const byte*)secret, (word32)strlen(secret));
+}
+
+/* feed sz bytes of text to a new loader, chunk bytes at a time */
+static int LoadSz(CredStore* store, byte type, const char* text, word32 sz,
+                  word32 chunk)
+{
+    CredLoader loader;
+    word32 i;
+    int ret = CredLoaderInit(&loader, store, type);
+
+    for (i = 0; ret == 0 && i < sz; i += chunk) {
+        ret = CredLoaderUpdate(&loader, (const byte*)text + i,
+                               (sz - i < chunk) ? sz - i : chunk);
+    }
+    if (ret == 0) {
+        ret = CredLoaderFinal(&loader);
+    }
+    return ret;
+}
+
+static int Load(CredStore* store, byte type, const char* text, word32 chunk)
+{
+    return LoadSz(store, type, text, (word32)strlen(text), chunk);
+}
+
+static void TestAddCheck(void)
+{
+    CredStore store;
+    char user[16];
+    char pw[16];
+    int i;
+
+    TEST_CHECK(CredStoreInit(&store, 2) == 0);
+
+    /* well past the first size, so the table grows a few times */
+    for (i = 0; i < 500; i++) {
+        snprintf(user, sizeof(user), "user%d", i);
+        snprintf(pw, sizeof(pw), "pw%d", i);
+        TEST_CHECK(Add(&store, PW, user, pw) == 0);
+    }
+    TEST_CHECK(Add(&store, PK, "user7", "key1") == 0);
+    TEST_CHECK(Add(&store, PK, "user7", "key2") == 0);
+    TEST_CHECK(store.count == 502);
+
+    for (i = 0; i < 500; i++) {
+        snprintf(user, sizeof(user), "user%d", i);
+        snprintf(pw, sizeof(pw), "pw%d", i);
+        TEST_CHECK(Check(&store, PW, user, pw, (word32)strlen(pw)) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+    }
+    TEST_CHECK(Check(&store, PW, "user3", "pw4", 3) ==
+               WOLFSSH_USERAUTH_INVALID_PASSWORD);
+    TEST_CHECK(Check(&store, PW, "user3", "pw3x", 4) ==
+               WOLFSSH_USERAUTH_INVALID_PASSWORD);
+    TEST_CHECK(Check(&store, PK, "user7", "key2", 4) ==
+               WOLFSSH_USERAUTH_SUCCESS);
+    TEST_CHECK(Check(&store, PK, "user7", "key3", 4) ==
+               WOLFSSH_USERAUTH_INVALID_PUBLICKEY);
+    TEST_CHECK(Check(&store, PK, "user8", "key1", 4) ==
+               WOLFSSH_USERAUTH_INVALID_AUTHTYPE);
+    TEST_CHECK(Check(&store, PW, "nobody", "pw1", 3) ==
+               WOLFSSH_USERAUTH_INVALID_USER);
+    TEST_CHECK(Check(&store, PW, "user", "pw1", 3) ==
+               WOLFSSH_USERAUTH_INVALID_USER);
+
+    CredStoreFree(&store);
+}
+
+static void TestLongName(void)
+{
+    /* CRED_USERNAME_MAX_SZ bytes, then one more */
+    static const char name32[] = "abcdefghijklmnopqrstuvwxyz012345";
+    static const char name33[] = "abcdefghijklmnopqrstuvwxyz0123456";
+    CredStore store;
+
+    TEST_CHECK(sizeof(name32) - 1 == CRED_USERNAME_MAX_SZ);
+    TEST_CHECK(CredStoreInit(&store, 4) == 0);
+
+    TEST_CHECK(Add(&store, PW, name32, "pw") == 0);
+    TEST_CHECK(Check(&store, PW, name32, "pw", 2) ==
+               WOLFSSH_USERAUTH_SUCCESS);
+
+    /* refused, not cut down to a name someone else might have */
+    TEST_CHECK(Add(&store, PW, name33, "pw") != 0);
+    TEST_CHECK(store.count == 1);
+    TEST_CHECK(Check(&store, PW, name33, "pw", 2) ==
+               WOLFSSH_USERAUTH_INVALID_USER);
+
+    TEST_CHECK(Load(&store, PW, "abcdefghijklmnopqrstuvwxyz0123456:pw\n",
+                    64) != 0);
+    TEST_CHECK(Load(&store, PK, "ssh-rsa c3NoLXJzYS1rZXktYmxvYg== "
+                    "abcdefghijklmnopqrstuvwxyz0123456\n", 64) != 0);
+    TEST_CHECK(store.count == 1);
+
+    CredStoreFree(&store);
+}
+
+static void TestLoadPasswd(void)
+{
+    static const char passwd[] =
+        "# users\r\n"
+        "jill:upthehill\r\n"
+        "\n"
+        "  jack:fetchapail\n"
+        "empty:\n"
+        "colon:a:b";
+    word32 chunk;
+
+    /* the same result however the data is split up */
+    for (chunk = 1; chunk <= sizeof(passwd); chunk *= 3) {
+        CredStore store;
+
+        TEST_CHECK(CredStoreInit(&store, 4) == 0);
+        TEST_CHECK(Load(&store, PW, passwd, chunk) == 0);
+        TEST_CHECK(store.count == 4);
+        TEST_CHECK(Check(&store, PW, "jill", "upthehill", 9) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        TEST_CHECK(Check(&store, PW, "jack", "fetchapail", 10) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        TEST_CHECK(Check(&store, PW, "empty", "", 0) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        TEST_CHECK(Check(&store, PW, "colon", "a:b", 3) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        CredStoreFree(&store);
+    }
+}
+
+static void TestLoadKeys(void)
+{
+    static const char keys[] =
+        "ssh-rsa c3NoLXJzYS1rZXktYmxvYg== jill\n"
+        "# comment\n"
+        "ssh-ed25519\t"
+        "AAAAB3NzaC1lZDI1NTE5LXB1YmxpYy1rZXktMDEyMzQ1Njc4OQ==  jack";
+    static const char edKey[] =
+        "\0\0\0\x07" "ssh-ed25519-public-key-0123456789";
+    word32 chunk;
+
+    for (chunk = 1; chunk <= sizeof(keys); chunk *= 5) {
+        CredStore store;
+
+        TEST_CHECK(CredStoreInit(&store, 4) == 0);
+        TEST_CHECK(Load(&store, PK, keys, chunk) == 0);
+        TEST_CHECK(store.count == 2);
+        TEST_CHECK(Check(&store, PK, "jill", "ssh-rsa-key-blob", 16) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        TEST_CHECK(Check(&store, PK, "jack", edKey, sizeof(edKey) - 1) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+        TEST_CHECK(Check(&store, PK, "jack", "ssh-rsa-key-blob", 16) ==
+                   WOLFSSH_USERAUTH_INVALID_PUBLICKEY);
+        CredStoreFree(&store);
+    }
+}
+
+static void TestLoadErrors(void)
+{
+    static const char* bad[] = {
+        "nocolon\n",
+        "ssh-rsa\n",
+        "ssh-rsa c3NoLXJzYS1rZXktYmxvYg==\n",
+        "ssh-rsa c3NoLXJzYS1rZXktYmx jill\n",
+        "ssh-rsa c3No*XJzYS1rZXktYmxvYg== jill\n",
+        "ssh-rsa c3NoLXJzYS1rZXktYmxvYg==",
+    };
+    CredStore store;
+    size_t i;
+
+    TEST_CHECK(CredStoreInit(&store, 4) == 0);
+    TEST_CHECK(Load(&store, PW, bad[0], 64) != 0);
+    for (i = 1; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        TEST_CHECK(Load(&store, PK, bad[i], 64) != 0);
+    }
+    TEST_CHECK(store.count == 0);
+
+    /* a bad line stops the load, the lines before it are kept */
+    TEST_CHECK(Load(&store, PW, "a:1\nb\nc:3\n", 64) != 0);
+    TEST_CHECK(store.count == 1);
+    CredStoreFree(&store);
+}
+
+/* load text in random pieces of 1 to 64 bytes */
+static int LoadPieces(CredStore* store, byte type, const byte* text,
+                      word32 sz, unsigned int* seed)
+{
+    CredLoader loader;
+    word32 i = 0;
+    int ret = CredLoaderInit(&loader, store, type);
+
+    while (ret == 0 && i < sz) {
+        word32 piece = 1 + (word32)rand_r(seed) % 64;
+
+        if (piece > sz - i) {
+            piece = sz - i;
+        }
+        ret = CredLoaderUpdate(&loader, text + i, piece);
+        i += piece;
+    }
+    if (ret == 0) {
+        ret = CredLoaderFinal(&loader);
+    }
+    return ret;
+}
+
+/* pieces of passwd and authorized_keys lines, good and bad */
+static const char* const fuzzWords[] = {
+    "ssh-rsa", "ssh-ed25519", "ecdsa-sha2-nistp256", " ", "  ", "\t", "\n",
+    "\r\n", "#", ":", "=", "==", "AAAA", "c3No", "Zg==", "Zm8=", "jill",
+    "abcdefghijklmnopqrstuvwxyz0123456", "*", "\0",
+};
+
+static word32 FuzzText(byte* text, unsigned int* seed)
+{
+    word32 sz = 0;
+    int i;
+
+    while (sz < TEST_FUZZ_SZ - 40) {
+        const char* w = fuzzWords[rand_r(seed) %
+                                  (sizeof(fuzzWords) / sizeof(fuzzWords[0]))];
+        word32 wSz = (w[0] == '\0') ? 1 : (word32)strlen(w);
+
+        memcpy(text + sz, w, wSz);
+        sz += wSz;
+        if (rand_r(seed) % 8 == 0) {
+            break;
+        }
+    }
+    /* and a few bytes changed to anything */
+    for (i = rand_r(seed) % 4; i > 0; i--) {
+        text[rand_r(seed) % sz] = (byte)rand_r(seed);
+    }
+    return sz;
+}
+
+static void TestFuzz(void)
+{
+    static byte text[TEST_FUZZ_SZ];
+    unsigned int seed = 1;
+    int loaded = 0;
+    int run;
+
+    /* most of the text is malformed, and would log every line */
+    esp_log_level_set("cred_store", ESP_LOG_NONE);
+    for (run = 0; run < TEST_FUZZ_RUNS; run++) {
+        byte type = (run & 1) ? PK : PW;
+        word32 sz = FuzzText(text, &seed);
+        CredStore whole;
+        CredStore pieces;
+        int ret;
+        word32 i;
+
+        /* from the smallest table, so that it grows too */
+        TEST_CHECK(CredStoreInit(&whole, 0) == 0);
+        TEST_CHECK(CredStoreInit(&pieces, 0) == 0);
+        ret = LoadSz(&whole, type, (const char*)text, sz, sz);
+        TEST_CHECK(LoadPieces(&pieces, type, text, sz, &seed) == ret);
+
+        /* the same entries, in the same slots */
+        TEST_CHECK(whole.count == pieces.count && whole.mask == pieces.mask);
+        TEST_CHECK(memcmp(whole.entries, pieces.entries,
+                          (whole.mask + 1) * sizeof(CredEntry)) == 0);
+        for (i = 0; i <= whole.mask; i++) {
+            const CredEntry* e = &whole.entries[i];
+
+            TEST_CHECK(e->type == 0 || (e->type == type &&
+                       e->usernameSz <= CRED_USERNAME_MAX_SZ));
+        }
+        loaded += (whole.count > 0);
+        CredStoreFree(&whole);
+        CredStoreFree(&pieces);
+        if (testFailures > 0) {
+            fprintf(stderr, "run %d\n", run);
+            break;
+        }
+    }
+    esp_log_level_set("cred_store", ESP_LOG_INFO);
+
+    /* the pieces made some good lines too */
+    printf("%d runs, %d loaded entries\n", run, loaded);
+    TEST_CHECK(loaded > TEST_FUZZ_RUNS / 20);
+}
+
+static word32 Base64(const byte* in, word32 inSz, char* out)
+{
+    static const char digits[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    word32 sz = 0;
+    word32 i;
+
+    for (i = 0; i < inSz; i += 3) {
+        word32 v = (word32)in[i] << 16;
+
+        if (i + 1 < inSz) {
+            v |= (word32)in[i + 1] << 8;
+        }
+        if (i + 2 < inSz) {
+            v |= in[i + 2];
+        }
+        out[sz++] = digits[(v >> 18) & 63];
+        out[sz++] = digits[(v >> 12) & 63];
+        out[sz++] = (i + 1 < inSz) ? digits[(v >> 6) & 63] : '=';
+        out[sz++] = (i + 2 < inSz) ? digits[v & 63] : '=';
+    }
+    return sz;
+}
+
+/* the key blob of user k: an Ed25519, ECDSA P-256 or RSA 4096 size */
+static word32 KeyBlob(int k, byte* blob)
+{
+    static const word32 sizes[] = { 51, 104, 535 };
+    word32 sz = sizes[k % 3];
+    unsigned int seed = (unsigned int)k + 1;
+    word32 i;
+
+    for (i = 0; i < sz; i++) {
+        blob[i] = (byte)rand_r(&seed);
+    }
+    return sz;
+}
+
+static void TestManyKeys(void)
+{
+    static const char* const types[] = {
+        "ssh-ed25519", "ecdsa-sha2-nistp256", "ssh-rsa"
+    };
+    byte blob[600];
+    char user[16];
+    char* text;
+    size_t sz = 0;
+    size_t ofst;
+    CredLoader loader;
+    CredStore store;
+    uint64_t start;
+    double secs;
+    int ret;
+    int k;
+
+    text = (char*)malloc((size_t)TEST_KEYS_LINES * 900);
+    TEST_CHECK(text != NULL);
+    if (text == NULL) {
+        return;
+    }
+    for (k = 0; k < TEST_KEYS_LINES; k++) {
+        word32 blobSz = KeyBlob(k, blob);
+
+        sz += (size_t)sprintf(text + sz, "%s ", types[k % 3]);
+        sz += Base64(blob, blobSz, text + sz);
+        sz += (size_t)sprintf(text + sz, " user%d\n", k);
+    }
+
+    TEST_CHECK(CredStoreInit(&store, TEST_KEYS_LINES) == 0);
+    start = TestNow();
+    ret = CredLoaderInit(&loader, &store, PK);
+    for (ofst = 0; ret == 0 && ofst < sz; ofst += TEST_KEYS_CHUNK) {
+        ret = CredLoaderUpdate(&loader, (const byte*)text + ofst,
+                               (word32)((sz - ofst < TEST_KEYS_CHUNK) ?
+                                        sz - ofst : TEST_KEYS_CHUNK));
+    }
+    if (ret == 0) {
+        ret = CredLoaderFinal(&loader);
+    }
+    secs = (double)(TestNow() - start) / 1e9;
+    printf("%d keys, %zu bytes: %.1f MB/s, %.0f lines/s\n",
+           TEST_KEYS_LINES, sz, (double)sz / secs / 1e6,
+           TEST_KEYS_LINES / secs);
+
+    TEST_CHECK(ret == 0);
+    TEST_CHECK(store.count == TEST_KEYS_LINES);
+    for (k = 0; k < TEST_KEYS_LINES; k++) {
+        word32 blobSz = KeyBlob(k, blob);
+
+        snprintf(user, sizeof(user), "user%d", k);
+        TEST_CHECK(CredStoreCheck(&store, PK, (const byte*)user,
+                                  (word32)strlen(user), blob, blobSz) ==
+                   WOLFSSH_USERAUTH_SUCCESS);
+    }
+    TEST_CHECK((double)sz / secs / 1e6 >= TEST_KEYS_MIN_MBPS);
+
+    CredStoreFree(&store);
+    free(text);
+}
+
+int main(void)
+{
+    TEST_RUN(TestAddCheck);
+    TEST_RUN(TestLongName);
+    TEST_RUN(TestLoadPasswd);
+    TEST_RUN(TestLoadKeys);
+    TEST_RUN(TestLoadErrors);
+    TEST_RUN(TestFuzz);
+    TEST_RUN(TestManyKeys);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,325 @@
+/* test_escape.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's escape sequences. The memchr scan is
+ * checked against a byte at a time reference over random data split into
+ * pieces of every size, binary data is checked to pass untouched, and a
+ * 1 MB paste is timed against the reference. */
+
+#include "escape.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DATA_SZ  4096
+#define TEST_PASTE_SZ (1024 * 1024)
+#define TEST_CMD_MAX  1024
+
+/* MB/s escape_next must reach over a pasted 1 MB of text */
+#ifndef TEST_ESCAPE_MIN_RATE
+    #define TEST_ESCAPE_MIN_RATE 500.0
+#endif
+
+typedef struct TestCmd {
+    size_t at;  /* output bytes before the command */
+    int cmd;
+} TestCmd;
+
+typedef struct TestOut {
+    uint8_t data[2 * TEST_DATA_SZ];
+    size_t sz;
+    TestCmd cmd[TEST_CMD_MAX];
+    size_t cmdSz;
+} TestOut;
+
+static void OutCmd(TestOut* o, int cmd)
+{
+    if (o->cmdSz < TEST_CMD_MAX) {
+        o->cmd[o->cmdSz].at = o->sz;
+        o->cmd[o->cmdSz].cmd = cmd;
+    }
+    o->cmdSz++;
+}
+
+static int RefCmd(uint8_t c)
+{
+    switch (c) {
+        case '.': return ESCAPE_CMD_DISCONNECT;
+        case 'R': return ESCAPE_CMD_REKEY;
+        case '#': return ESCAPE_CMD_STATS;
+        case '?': return ESCAPE_CMD_HELP;
+        default:  return ESCAPE_CMD_NONE;
+    }
+}
+
+/* the escape sequences applied one byte at a time */
+static void RefApply(uint8_t escapeChar, const uint8_t* in, size_t sz,
+                     TestOut* o)
+{
+    int lineStart = 1;
+    int pending = 0;
+    size_t i;
+
+    for (i = 0; i < sz; i++) {
+        uint8_t c = in[i];
+
+        if (pending) {
+            pending = 0;
+            if (RefCmd(c) != ESCAPE_CMD_NONE) {
+                OutCmd(o, RefCmd(c));
+                continue;
+            }
+            o->data[o->sz++] = escapeChar;
+            lineStart = 0;
+            if (c == escapeChar) {
+                continue;
+            }
+        }
+        if (escapeChar != 0 && lineStart && c == escapeChar) {
+            pending = 1;
+            continue;
+        }
+        o->data[o->sz++] = c;
+        lineStart = (c == '\r' || c == '\n');
+    }
+}
+
+/* escape_next over in, handed over in pieces of at most piece bytes */
+static void Apply(escape_t* esc, const uint8_t* in, size_t sz, size_t piece,
+                  TestOut* o)
+{
+    size_t i = 0;
+
+    while (i < sz) {
+        size_t left = (sz - i < piece) ? sz - i : piece;
+
+        while (left > 0) {
+            const uint8_t* out;
+            size_t outSz;
+            int cmd;
+            size_t used = escape_next(esc, in + i, left, &out, &outSz, &cmd);
+
+            memcpy(o->data + o->sz, out, outSz);
+            o->sz += outSz;
+            if (cmd != ESCAPE_CMD_NONE) {
+                OutCmd(o, cmd);
+            }
+            i += used;
+            left -= used;
+        }
+    }
+}
+
+static int Same(const TestOut* a, const TestOut* b)
+{
+    return a->sz == b->sz && memcmp(a->data, b->data, a->sz) == 0 &&
+           a->cmdSz == b->cmdSz &&
+           memcmp(a->cmd, b->cmd, sizeof(TestCmd) *
+                  (a->cmdSz < TEST_CMD_MAX ? a->cmdSz : TEST_CMD_MAX)) == 0;
+}
+
+/* escape_next over a string, all at once */
+static void Run(const char* in, uint8_t escapeChar, TestOut* o)
+{
+    escape_t esc;
+
+    memset(o, 0, sizeof(TestOut));
+    escape_init(&esc, escapeChar);
+    Apply(&esc, (const uint8_t*)in, strlen(in), strlen(in) + 1, o);
+}
+
+static void TestCommands(void)
+{
+    static TestOut o;
+    escape_t esc;
+    const uint8_t* out;
+    size_t outSz;
+    int cmd;
+
+    Run("~.", '~', &o);
+    TEST_CHECK(o.sz == 0 && o.cmdSz == 1);
+    TEST_CHECK(o.cmd[0].cmd == ESCAPE_CMD_DISCONNECT);
+
+    /* only at the start of a line */
+    Run("ab~.", '~', &o);
+    TEST_CHECK(o.sz == 4 && memcmp(o.data, "ab~.", 4) == 0 && o.cmdSz == 0);
+    Run("ab\n~R", '~', &o);
+    TEST_CHECK(o.sz == 3 && o.cmdSz == 1 && o.cmd[0].at == 3);
+    TEST_CHECK(o.cmd[0].cmd == ESCAPE_CMD_REKEY);
+    Run("ab\r~#", '~', &o);
+    TEST_CHECK(o.cmdSz == 1 && o.cmd[0].cmd == ESCAPE_CMD_STATS);
+
+    /* a command leaves the line start armed */
+    Run("~?~.", '~', &o);
+    TEST_CHECK(o.sz == 0 && o.cmdSz == 2);
+    TEST_CHECK(o.cmd[0].cmd == ESCAPE_CMD_HELP);
+    TEST_CHECK(o.cmd[1].cmd == ESCAPE_CMD_DISCONNECT);
+
+    /* ~~ sends one ~ and ends the line start, other bytes pass with it */
+    Run("~~.", '~', &o);
+    TEST_CHECK(o.sz == 2 && memcmp(o.data, "~.", 2) == 0 && o.cmdSz == 0);
+    Run("~x\n~~~.", '~', &o);
+    TEST_CHECK(o.sz == 6 && memcmp(o.data, "~x\n~~.", 6) == 0);
+    TEST_CHECK(o.cmdSz == 0);
+    Run("~\n~.", '~', &o);
+    TEST_CHECK(o.sz == 2 && memcmp(o.data, "~\n", 2) == 0 && o.cmdSz == 1);
+
+    /* another escape character, and none */
+    Run("\n%.", '%', &o);
+    TEST_CHECK(o.sz == 1 && o.cmdSz == 1);
+    Run("~.\n~R", 0, &o);
+    TEST_CHECK(o.sz == 5 && o.cmdSz == 0);
+
+    /* split between calls: held back, then completed */
+    memset(&o, 0, sizeof(o));
+    escape_init(&esc, '~');
+    Apply(&esc, (const uint8_t*)"ls\n~", 4, 4, &o);
+    TEST_CHECK(o.sz == 3 && o.cmdSz == 0 && esc.pending);
+    Apply(&esc, (const uint8_t*)".", 1, 1, &o);
+    TEST_CHECK(o.sz == 3 && o.cmdSz == 1);
+    TEST_CHECK(o.cmd[0].cmd == ESCAPE_CMD_DISCONNECT);
+
+    /* nothing given, nothing done */
+    TEST_CHECK(escape_next(&esc, (const uint8_t*)"", 0, &out, &outSz,
+                           &cmd) == 0);
+    TEST_CHECK(outSz == 0 && cmd == ESCAPE_CMD_NONE);
+}
+
+/* Bytes that used to end the session or rekey anywhere, 0x03, 0x05 and
+ * 0x06, pass through with all the others. */
+static void TestBinary(void)
+{
+    static uint8_t in[TEST_DATA_SZ];
+    static TestOut o;
+    escape_t esc;
+    size_t i;
+
+    srand(2);
+    for (i = 0; i < sizeof(in); i++) {
+        do {
+            in[i] = (uint8_t)rand();
+        } while (in[i] == '~');
+    }
+    in[0] = 0x03;
+    in[1] = 0x05;
+    in[2] = 0x06;
+
+    memset(&o, 0, sizeof(o));
+    escape_init(&esc, '~');
+    Apply(&esc, in, sizeof(in), sizeof(in), &o);
+    TEST_CHECK(o.sz == sizeof(in) && memcmp(o.data, in, sizeof(in)) == 0);
+    TEST_CHECK(o.cmdSz == 0);
+}
+
+/* random lines with escape characters in every position */
+static void TestRandom(void)
+{
+    static const uint8_t pick[] = { '~', '~', '.', 'R', '#', '?', '\r',
+                                    '\n', '\n', 'x', 0x03, 0x00 };
+    static const size_t pieces[] = { 1, 2, 3, 7, 64, TEST_DATA_SZ };
+    static uint8_t in[TEST_DATA_SZ];
+    static TestOut ref;
+    static TestOut o;
+    escape_t esc;
+    size_t p, i;
+    int round;
+
+    srand(1);
+    for (round = 0; round < 16; round++) {
+        for (i = 0; i < sizeof(in); i++) {
+            in[i] = (rand() % 2 == 0) ? pick[rand() % sizeof(pick)] :
+                    (uint8_t)('a' + rand() % 26);
+        }
+        memset(&ref, 0, sizeof(ref));
+        RefApply('~', in, sizeof(in), &ref);
+        TEST_CHECK(ref.cmdSz > 0);
+
+        for (p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++) {
+            memset(&o, 0, sizeof(o));
+            escape_init(&esc, '~');
+            Apply(&esc, in, sizeof(in), pieces[p], &o);
+            TEST_CHECK(Same(&o, &ref));
+        }
+    }
+}
+
+/* a pasted 1 MB of 64 byte lines, with a ~ inside every line */
+static void TestRate(void)
+{
+    static uint8_t in[TEST_PASTE_SZ];
+    escape_t esc;
+    size_t passed = 0;
+    size_t i;
+    uint64_t start, ns, refNs;
+    double rate;
+    int rounds = 16;
+    int r;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (i % 64 == 63) ? '\n' : (i % 64 == 20) ? '~' :
+                (uint8_t)('a' + i % 26);
+    }
+
+    start = TestNow();
+    for (r = 0; r < rounds; r++) {
+        escape_init(&esc, '~');
+        for (i = 0; i < sizeof(in); ) {
+            const uint8_t* out;
+            size_t outSz;
+            int cmd;
+
+            i += escape_next(&esc, in + i, sizeof(in) - i, &out, &outSz,
+                             &cmd);
+            passed += outSz;
+        }
+    }
+    ns = TestNow() - start;
+    TEST_CHECK(passed == (size_t)rounds * sizeof(in));
+
+    /* the byte at a time scan it replaced, for comparison */
+    start = TestNow();
+    for (r = 0; r < rounds; r++) {
+        int lineStart = 1;
+
+        for (i = 0; i < sizeof(in); i++) {
+            if (lineStart && in[i] == '~') {
+                passed--;
+            }
+            lineStart = (in[i] == '\r' || in[i] == '\n');
+        }
+    }
+    refNs = TestNow() - start;
+
+    rate = (double)rounds * sizeof(in) * 1e3 / (double)ns;
+    printf("1 MB paste: %.0f MB/s, byte at a time %.0f MB/s (%zu)\n",
+           rate, (double)rounds * sizeof(in) * 1e3 / (double)refNs, passed);
+    TEST_CHECK(rate >= TEST_ESCAPE_MIN_RATE);
+}
+
+int main(void)
+{
+    TEST_RUN(TestCommands);
+    TEST_RUN(TestBinary);
+    TEST_RUN(TestRandom);
+    TEST_RUN(TestRate);
+
+    return TEST_RESULT();
+}
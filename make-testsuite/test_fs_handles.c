@@ -0,0 +1,290 @@
+/* test_fs_handles.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the open file table in restricting-sftp, built with its
+ * POSIX backend: 1000 files open at once, FSTAT on each by its handle
+ * answered from the table and kept current by writes, a file opened past
+ * a full table, and the FSTAT rate against fstat.
+ *
+ * MY_FS_MAX_OPEN is the size of the table, across all sessions, and is 8
+ * by default, for the Harmony boards. The Makefile builds this test with
+ * -DMY_FS_MAX_OPEN=1024, as a server expecting clients to keep hundreds
+ * of handles open would; a file opened once the table is full can still
+ * be read, and FSTAT on it goes to the filesystem by name, but an open
+ * that would write is refused. */
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+#include <wolfssh/wolfsftp.h>
+#include "myFilesystem.h"
+#include "test_common.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#ifndef MY_FILESYSTEM_STATS
+    #error test_fs_handles.c needs MY_FILESYSTEM_STATS
+#endif
+
+#define TEST_HANDLES        1000
+#define TEST_HANDLES_ROUNDS 1000
+
+/* cached FSTATs per second the table must reach */
+#ifndef TEST_HANDLES_MIN_RATE
+    #define TEST_HANDLES_MIN_RATE 1000000.0
+#endif
+
+static char tmpDir[] = "/tmp/test_fs_handles.XXXXXX";
+static char path[TEST_HANDLES][64];
+static WFD fds[TEST_HANDLES];
+static MY_FS_SESSION s;
+
+/* FSTAT as wolfSSH makes it, with the handle made from the WFD */
+static int TestFstat(int i, WS_SFTP_FILEATRB* atr)
+{
+    return SFTP_GetAttributes_Handle(NULL, (unsigned char*)&fds[i],
+            (int)sizeof(WFD), path[i], atr);
+}
+
+static word64 TestSize(const WS_SFTP_FILEATRB* atr)
+{
+    return ((word64)atr->sz[1] << 32) | atr->sz[0];
+}
+
+static void TestOpen(void)
+{
+    unsigned int ofst[2] = { 0, 0 };
+    static byte buf[TEST_HANDLES];
+    int i;
+
+    memset(buf, 'h', sizeof(buf));
+    /* file i holds i + 1 bytes */
+    for (i = 0; i < TEST_HANDLES; i++) {
+        snprintf(path[i], sizeof(path[i]), "%s/f%d", tmpDir, i);
+        fds[i] = wOpen(&s, path[i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+        TEST_CHECK(fds[i] >= 0);
+        TEST_CHECK(wPwrite(&s, fds[i], buf, (unsigned int)i + 1, ofst) ==
+                   i + 1);
+    }
+}
+
+static void TestCached(void)
+{
+    WS_SFTP_FILEATRB atr;
+    MY_FS_STATS stats;
+    int bad = 0;
+    int i;
+
+    /* the first FSTAT of each handle goes to the file, the second not */
+    wFsStatsReset();
+    for (i = 0; i < TEST_HANDLES; i++) {
+        if (TestFstat(i, &atr) != WS_SUCCESS ||
+                TestSize(&atr) != (word64)i + 1) {
+            bad++;
+        }
+    }
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.attrHits == 0);
+    for (i = 0; i < TEST_HANDLES; i++) {
+        if (TestFstat(i, &atr) != WS_SUCCESS ||
+                TestSize(&atr) != (word64)i + 1) {
+            bad++;
+        }
+    }
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.attrHits == TEST_HANDLES);
+    TEST_CHECK(bad == 0);
+}
+
+static void TestWrite(void)
+{
+    unsigned int ofst[2] = { 0, 0 };
+    byte buf[16];
+    WS_SFTP_FILEATRB atr;
+    MY_FS_STATS stats;
+    WSTAT_T st;
+    int i;
+
+    /* extend every tenth file; FSTAT sees it without going to the file */
+    memset(buf, 'w', sizeof(buf));
+    wFsStatsReset();
+    for (i = 0; i < TEST_HANDLES; i += 10) {
+        ofst[0] = 5000;
+        TEST_CHECK(wPwrite(&s, fds[i], buf, sizeof(buf), ofst) ==
+                   (int)sizeof(buf));
+    }
+    for (i = 0; i < TEST_HANDLES; i++) {
+        word64 want = (i % 10 == 0) ? 5000 + sizeof(buf) : (word64)i + 1;
+
+        TEST_CHECK(TestFstat(i, &atr) == WS_SUCCESS);
+        TEST_CHECK(TestSize(&atr) == want);
+    }
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.attrHits == TEST_HANDLES);
+
+    /* and agrees with the file */
+    TEST_CHECK(fstat(fds[990], &st) == 0 &&
+               st.st_size == 5000 + sizeof(buf));
+    TEST_CHECK(fstat(fds[991], &st) == 0 && st.st_size == 992);
+}
+
+static void TestFull(void)
+{
+    static WFD fill[MY_FS_MAX_OPEN];
+    char past[64];
+    WFILE* f = NULL;
+    WFD fd;
+    WS_SFTP_FILEATRB atr;
+    MY_FS_STATS stats;
+    unsigned int ofst[2] = { 0, 0 };
+    byte buf[4];
+    int count = 0;
+    int i;
+
+    snprintf(past, sizeof(past), "%s/past", tmpDir);
+    fd = open(past, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0 && write(fd, "abcdefg", 7) == 7);
+    close(fd);
+
+    /* fill the rest of the table, then open one more */
+    for (i = TEST_HANDLES; i < MY_FS_MAX_OPEN; i++) {
+        fill[count] = wOpen(&s, past, O_RDONLY, 0);
+        TEST_CHECK(fill[count] >= 0);
+        count++;
+    }
+    fd = wOpen(&s, past, O_RDONLY, 0);
+    TEST_CHECK(fd >= 0);
+
+    /* it reads, and FSTAT finds it by name */
+    wFsStatsReset();
+    TEST_CHECK(wPread(fd, buf, sizeof(buf), ofst) == (int)sizeof(buf));
+    TEST_CHECK(memcmp(buf, "abcd", 4) == 0);
+    memset(&atr, 0, sizeof(atr));
+    TEST_CHECK(SFTP_GetAttributes_Handle(NULL, (unsigned char*)&fd,
+               (int)sizeof(WFD), past, &atr) == WS_SUCCESS);
+    TEST_CHECK(TestSize(&atr) == 7);
+
+    /* one that would write is refused, through either open, and leaves
+     * the file alone */
+    errno = 0;
+    TEST_CHECK(wOpen(&s, past, O_RDWR, 0) < 0 && errno == EMFILE);
+    TEST_CHECK(wOpen(&s, past, O_WRONLY | O_TRUNC, 0) < 0);
+    TEST_CHECK(wfopen(&s, &f, past, "r+") != 0 && f == NULL);
+    TEST_CHECK(wfopen(&s, &f, past, "r") == 0 && f != NULL);
+    TEST_CHECK(f != NULL && wFclose(f) == 0);
+    TEST_CHECK(wPread(fd, buf, sizeof(buf), ofst) == (int)sizeof(buf));
+    TEST_CHECK(memcmp(buf, "abcd", 4) == 0);
+
+    /* the files in the table are still answered from it */
+    TEST_CHECK(TestFstat(0, &atr) == WS_SUCCESS);
+    TEST_CHECK(TestSize(&atr) == 5000 + 16);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.attrHits == 1);
+
+    wClose(fd);
+    for (i = 0; i < count; i++) {
+        wClose(fill[i]);
+    }
+    unlink(past);
+}
+
+static void TestRate(void)
+{
+    WS_SFTP_FILEATRB atr;
+    WSTAT_T st;
+    unsigned long sum = 0;
+    uint64_t start, ns, sysNs;
+    double rate;
+    int r;
+    int i;
+
+    start = TestNow();
+    for (r = 0; r < TEST_HANDLES_ROUNDS; r++) {
+        for (i = 0; i < TEST_HANDLES; i++) {
+            TestFstat(i, &atr);
+            sum += atr.sz[0];
+        }
+    }
+    ns = TestNow() - start;
+
+    start = TestNow();
+    for (r = 0; r < TEST_HANDLES_ROUNDS / 10; r++) {
+        for (i = 0; i < TEST_HANDLES; i++) {
+            fstat(fds[i], &st);
+            sum += (unsigned long)st.st_size;
+        }
+    }
+    sysNs = (TestNow() - start) * 10;
+
+    rate = (double)TEST_HANDLES_ROUNDS * TEST_HANDLES * 1e9 / (double)ns;
+    printf("%d handles: %.2f M FSTAT/s, fstat %.2f M/s (%lu)\n",
+           TEST_HANDLES, rate / 1e6,
+           (double)TEST_HANDLES_ROUNDS * TEST_HANDLES * 1e3 / (double)sysNs,
+           sum);
+    TEST_CHECK(rate >= TEST_HANDLES_MIN_RATE);
+}
+
+int main(void)
+{
+    MY_FS_RULE rule = { "*", tmpDir, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    struct rlimit lim;
+    int i;
+
+    /* every open file is an fd, and the usual soft limit is 1024 */
+    if (getrlimit(RLIMIT_NOFILE, &lim) == 0 &&
+            lim.rlim_cur < MY_FS_MAX_OPEN + 64) {
+        lim.rlim_cur = (lim.rlim_max < MY_FS_MAX_OPEN + 64) ?
+                lim.rlim_max : MY_FS_MAX_OPEN + 64;
+        setrlimit(RLIMIT_NOFILE, &lim);
+    }
+    if (MY_FS_MAX_OPEN < TEST_HANDLES) {
+        printf("MY_FS_MAX_OPEN is %d, build with -DMY_FS_MAX_OPEN=1024\n",
+               MY_FS_MAX_OPEN);
+        return 1;
+    }
+    if (mkdtemp(tmpDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    wolfSSH_Init();
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        return 1;
+    }
+
+    TEST_RUN(TestOpen);
+    TEST_RUN(TestCached);
+    TEST_RUN(TestWrite);
+    TEST_RUN(TestFull);
+    TEST_RUN(TestRate);
+
+    wFsSessionFree(&s);
+    for (i = 0; i < TEST_HANDLES; i++) {
+        wClose(fds[i]);
+        unlink(path[i]);
+    }
+    wolfSSH_Cleanup();
+    rmdir(tmpDir);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,262 @@
+/* test_fs_large.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for 64-bit offsets in restricting-sftp, built with its POSIX
+ * backend: writes and reads at random offsets past 4 GB in a sparse file,
+ * through wPwrite and wPread with the offset split in two halves, and the
+ * size reported by stat and FSTAT. Built as test-fs-large, and as
+ * test-fs-large-cached with read-ahead, write-behind and mapped reads. */
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+#include <wolfssh/wolfsftp.h>
+#include "myFilesystem.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_LARGE_BASE   0x100000000ULL   /* 4 GB */
+#define TEST_LARGE_BAND   (256ULL << 20)   /* one write in each band */
+#define TEST_LARGE_WRITES 240              /* so the file ends near 64 GB */
+#define TEST_LARGE_MAX_SZ 4096
+
+typedef struct TestWrite {
+    word64 ofst;
+    word32 sz;
+} TestWrite;
+
+static char tmpDir[] = "/tmp/test_fs_large.XXXXXX";
+static char path[256];
+static TestWrite writes[TEST_LARGE_WRITES];
+static MY_FS_SESSION s;
+
+static void TestSplit(word64 ofst, unsigned int* halves)
+{
+    halves[0] = (unsigned int)ofst;
+    halves[1] = (unsigned int)(ofst >> 32);
+}
+
+/* the byte at ofst, different in every 4 GB of the file */
+static byte TestByte(word64 ofst)
+{
+    return (byte)(ofst ^ (ofst >> 8) ^ (ofst >> 32) ^ 0x5A);
+}
+
+static void TestFill(byte* buf, word64 ofst, word32 sz)
+{
+    word32 i;
+
+    for (i = 0; i < sz; i++) {
+        buf[i] = TestByte(ofst + i);
+    }
+}
+
+static int TestMatches(const byte* buf, word64 ofst, word32 sz)
+{
+    word32 i;
+
+    for (i = 0; i < sz; i++) {
+        if (buf[i] != TestByte(ofst + i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void TestShuffle(int* order, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (i = count - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+/* read every write back through fd, in a random order */
+static int TestReadBack(int fd)
+{
+    static byte buf[TEST_LARGE_MAX_SZ];
+    unsigned int ofst[2];
+    int order[TEST_LARGE_WRITES];
+    int bad = 0;
+    int i;
+
+    TestShuffle(order, TEST_LARGE_WRITES);
+    for (i = 0; i < TEST_LARGE_WRITES; i++) {
+        const TestWrite* w = &writes[order[i]];
+
+        memset(buf, 0, w->sz);
+        TestSplit(w->ofst, ofst);
+        if (wPread(fd, buf, w->sz, ofst) != (int)w->sz ||
+                !TestMatches(buf, w->ofst, w->sz)) {
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static void TestSparse(void)
+{
+    static byte buf[TEST_LARGE_MAX_SZ];
+    unsigned int ofst[2];
+    int order[TEST_LARGE_WRITES];
+    word64 end = 0;
+    word64 hole;
+    int fd;
+    int i;
+
+    /* one write of up to 4 KB at a random place in each band, the first
+     * across the 4 GB line */
+    srand(1);
+    for (i = 0; i < TEST_LARGE_WRITES; i++) {
+        writes[i].ofst = TEST_LARGE_BASE + (word64)i * TEST_LARGE_BAND +
+                ((word64)rand() * 4099) % (TEST_LARGE_BAND - TEST_LARGE_MAX_SZ);
+        writes[i].sz = 1 + (word32)rand() % TEST_LARGE_MAX_SZ;
+    }
+    writes[0].ofst = TEST_LARGE_BASE - 100;
+    writes[0].sz = 300;
+
+    fd = wOpen(&s, path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+    if (fd < 0) {
+        return;
+    }
+
+    TestShuffle(order, TEST_LARGE_WRITES);
+    for (i = 0; i < TEST_LARGE_WRITES; i++) {
+        const TestWrite* w = &writes[order[i]];
+
+        TestFill(buf, w->ofst, w->sz);
+        TestSplit(w->ofst, ofst);
+        TEST_CHECK(wPwrite(&s, fd, buf, w->sz, ofst) == (int)w->sz);
+        if (w->ofst + w->sz > end) {
+            end = w->ofst + w->sz;
+        }
+    }
+
+    /* through the handle that wrote them, then a new read-only one */
+    TEST_CHECK(TestReadBack(fd) == 0);
+    TEST_CHECK(wClose(fd) == 0);
+    fd = wOpen(&s, path, O_RDONLY, 0);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK(TestReadBack(fd) == 0);
+
+    /* a read across the 4 GB line, and holes read back as zeros */
+    TestSplit(TEST_LARGE_BASE - 8, ofst);
+    TEST_CHECK(wPread(fd, buf, 16, ofst) == 16);
+    TEST_CHECK(TestMatches(buf, TEST_LARGE_BASE - 8, 16));
+    hole = writes[1].ofst + writes[1].sz + 1000;
+    TestSplit(hole, ofst);
+    memset(buf, 0xFF, 64);
+    TEST_CHECK(wPread(fd, buf, 64, ofst) == 64);
+    for (i = 0; i < 64; i++) {
+        TEST_CHECK(buf[i] == 0);
+    }
+
+    /* the last byte, then nothing past the end */
+    TestSplit(end - 1, ofst);
+    TEST_CHECK(wPread(fd, buf, 16, ofst) == 1);
+    TEST_CHECK(buf[0] == TestByte(end - 1));
+    TestSplit(end, ofst);
+    TEST_CHECK(wPread(fd, buf, 16, ofst) == 0);
+
+#ifdef MY_FS_MMAP
+    /* the same bytes in place, as far as the mapping goes */
+    {
+        const byte* data = NULL;
+
+        TestSplit(TEST_LARGE_BASE - 8, ofst);
+        TEST_CHECK(wFsMapPeek(fd, 16, ofst, &data) == 16 &&
+                   TestMatches(data, TEST_LARGE_BASE - 8, 16));
+        TestSplit(end - 1, ofst);
+        TEST_CHECK(wFsMapPeek(fd, 16, ofst, &data) == 1 &&
+                   data[0] == TestByte(end - 1));
+        TestSplit(end, ofst);
+        TEST_CHECK(wFsMapPeek(fd, 16, ofst, &data) == 0);
+    }
+#endif
+
+    TEST_CHECK(wClose(fd) == 0);
+    writes[0].ofst = end; /* for TestSize */
+}
+
+static void TestSize(void)
+{
+    word64 end = writes[0].ofst;
+    WS_SFTP_FILEATRB atr;
+    WSTAT_T st;
+    int fd;
+
+    TEST_CHECK(wStat(path, &st) == 0);
+    TEST_CHECK((word64)st.st_size == end);
+    memset(&atr, 0, sizeof(atr));
+    TEST_CHECK(SFTP_GetAttributesStat(&atr, &st) == 0);
+    TEST_CHECK(atr.sz[1] == (word32)(end >> 32) && atr.sz[1] >= 15);
+    TEST_CHECK(atr.sz[0] == (word32)end);
+
+    /* FSTAT, by the handle wolfSSH would make from the fd */
+    fd = wOpen(&s, path, O_RDONLY, 0);
+    TEST_CHECK(fd >= 0);
+    memset(&atr, 0, sizeof(atr));
+    TEST_CHECK(SFTP_GetAttributes_Handle(NULL, (unsigned char*)&fd,
+               (int)sizeof(fd), path, &atr) == 0);
+    TEST_CHECK(atr.sz[1] == (word32)(end >> 32));
+    TEST_CHECK(atr.sz[0] == (word32)end);
+    wClose(fd);
+}
+
+int main(void)
+{
+    MY_FS_RULE rule = { "*", tmpDir, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+
+    if (sizeof(off_t) < 8) {
+        printf("off_t is 32-bit, build with -D_FILE_OFFSET_BITS=64\n");
+        return 1;
+    }
+    if (mkdtemp(tmpDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/sparse", tmpDir);
+    wolfSSH_Init();
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        return 1;
+    }
+
+    TEST_RUN(TestSparse);
+    TEST_RUN(TestSize);
+
+    wFsSessionFree(&s);
+    unlink(path);
+    rmdir(tmpDir);
+    wolfSSH_Cleanup();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,312 @@
+/* test_fs_policy.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the path policy in restricting-sftp, built with its POSIX
+ * backend: rule matching, refusal of a handle that is not a session,
+ * opens that would create or truncate, and the decision rate with 1000
+ * rules. */
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+#include "myFilesystem.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* decisions per second wFsSessionAllowed must reach with 1000 rules */
+#ifndef TEST_POLICY_MIN_RATE
+    #define TEST_POLICY_MIN_RATE 1000000.0
+#endif
+#define TEST_POLICY_RULES   1000
+#define TEST_POLICY_PATHS   4096
+#define TEST_POLICY_ROUNDS  1024
+
+static WOLFSSH_CTX* ctx;
+
+static WOLFSSH* TestUser(const char* user)
+{
+    WOLFSSH* ssh = wolfSSH_new(ctx);
+
+    if (ssh != NULL && wolfSSH_SetUsername(ssh, user) != WS_SUCCESS) {
+        wolfSSH_free(ssh);
+        ssh = NULL;
+    }
+    return ssh;
+}
+
+static const MY_FS_RULE matchRules[] = {
+    { "*",       "/pub",          MY_FS_OP_WRITE },
+    { "jill",    "/home/jill",    MY_FS_OP_ALL },
+    { "jill",    "/home/jill/ro", 0 },
+    { "@upload", "/in/",          MY_FS_OP_WRITE },
+    { "@upload", "/in",           MY_FS_OP_MKDIR },
+    { "jack",    "/home/jack",    MY_FS_OP_ALL },
+    { "jill",    "/",             MY_FS_OP_CHMOD },
+};
+static const MY_FS_MEMBER matchMembers[] = {
+    { "upload", "jill" },
+};
+static const MY_FS_POLICY matchPolicy = {
+    matchRules, sizeof(matchRules) / sizeof(matchRules[0]),
+    matchMembers, sizeof(matchMembers) / sizeof(matchMembers[0])
+};
+
+static void TestMatch(void)
+{
+    MY_FS_SESSION s;
+    WOLFSSH* ssh = TestUser("jill");
+
+    TEST_CHECK(ssh != NULL);
+    TEST_CHECK(wFsSessionInit(&s, ssh, &matchPolicy, NULL) == WS_SUCCESS);
+
+    /* the longest prefix, on whole path components, decides */
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill") == MY_FS_OP_ALL);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill/a/b") == MY_FS_OP_ALL);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill/ro") == 0);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill/ro/f") == 0);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill/rox") == MY_FS_OP_ALL);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jillx") == MY_FS_OP_CHMOD);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jack/f") == MY_FS_OP_CHMOD);
+    TEST_CHECK(wFsSessionAllowed(&s, "/etc") == MY_FS_OP_CHMOD);
+
+    /* everyone's rule, and a group's rules with the same prefix add up */
+    TEST_CHECK(wFsSessionAllowed(&s, "/pub/f") == MY_FS_OP_WRITE);
+    TEST_CHECK(wFsSessionAllowed(&s, "/pubx") == MY_FS_OP_CHMOD);
+    TEST_CHECK(wFsSessionAllowed(&s, "/in/f") ==
+               (MY_FS_OP_WRITE | MY_FS_OP_MKDIR));
+    wFsSessionFree(&s);
+    TEST_CHECK(wFsSessionAllowed(&s, "/pub/f") == 0);
+
+    /* no user name: only the rules for everyone */
+    TEST_CHECK(wFsSessionInit(&s, NULL, &matchPolicy, NULL) == WS_SUCCESS);
+    TEST_CHECK(wFsSessionAllowed(&s, "/pub/f") == MY_FS_OP_WRITE);
+    TEST_CHECK(wFsSessionAllowed(&s, "/home/jill/a") == 0);
+    TEST_CHECK(wFsSessionAllowed(&s, "/in/f") == 0);
+    wFsSessionFree(&s);
+
+    /* the default policy is for admin only */
+    TEST_CHECK(wFsSessionInit(&s, ssh, NULL, NULL) == WS_SUCCESS);
+    TEST_CHECK(wFsSessionAllowed(&s, "/pub/f") == 0);
+    wFsSessionFree(&s);
+
+    wolfSSH_free(ssh);
+}
+
+static char tmpDir[] = "/tmp/test_fs_policy.XXXXXX";
+
+static const char* TestPath(const char* name)
+{
+    static char path[4][256];
+    static int next = 0;
+    char* p = path[next++ % 4];
+
+    snprintf(p, sizeof(path[0]), "%s/%s", tmpDir, name);
+    return p;
+}
+
+static int TestExists(const char* name)
+{
+    WSTAT_T st;
+
+    return stat(TestPath(name), &st) == 0;
+}
+
+static void TestHandle(void)
+{
+    MY_FS_SESSION s;
+    MY_FS_RULE rule = { "*", tmpDir, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    WOLFSSH* ssh = TestUser("jill");
+
+    TEST_CHECK(wFsSessionInit(&s, ssh, &policy, NULL) == WS_SUCCESS);
+
+    /* the WOLFSSH is not a session, so it is allowed nothing */
+    TEST_CHECK(wMkdir(ssh, (unsigned char*)TestPath("d1")) != 0);
+    TEST_CHECK(!TestExists("d1"));
+    TEST_CHECK(wOpen(ssh, TestPath("f1"), O_WRONLY | O_CREAT, 0644) < 0);
+    TEST_CHECK(!TestExists("f1"));
+
+    TEST_CHECK(wMkdir(&s, (unsigned char*)TestPath("d1")) == 0);
+    TEST_CHECK(TestExists("d1"));
+    TEST_CHECK(wRmdir(&s, (unsigned char*)TestPath("d1")) == 0);
+
+    wFsSessionFree(&s);
+    /* nor is a session once it has been freed */
+    TEST_CHECK(wMkdir(&s, (unsigned char*)TestPath("d1")) != 0);
+    TEST_CHECK(!TestExists("d1"));
+
+    wolfSSH_free(ssh);
+}
+
+static void TestOpen(void)
+{
+    MY_FS_SESSION s;
+    MY_FS_RULE rules[] = {
+        { "*", tmpDir, MY_FS_OP_ALL },
+        { "*", NULL, 0 },
+    };
+    MY_FS_POLICY policy = { rules, 2, NULL, 0 };
+    unsigned int ofst[2] = { 0, 0 };
+    char ro[256];
+    unsigned char buf[8];
+    WSTAT_T st;
+    WFILE* f;
+    int fd;
+
+    /* a file outside the writable directory, with known contents */
+    snprintf(ro, sizeof(ro), "%s.ro", tmpDir);
+    fd = open(ro, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0 && write(fd, "keep", 4) == 4);
+    close(fd);
+
+    TEST_CHECK(wFsSessionInit(&s, NULL, &policy, NULL) == WS_SUCCESS);
+
+    /* truncating, creating or writing where not allowed fails up front */
+    TEST_CHECK(wOpen(&s, ro, O_WRONLY | O_TRUNC, 0644) < 0);
+    TEST_CHECK(wOpen(&s, ro, O_RDWR, 0644) < 0);
+    TEST_CHECK(WFOPEN(&s, &f, ro, "w") != 0);
+    TEST_CHECK(WFOPEN(&s, &f, ro, "r+") != 0);
+    fd = open(ro, O_RDONLY);
+    TEST_CHECK(fd >= 0 && read(fd, buf, sizeof(buf)) == 4);
+    TEST_CHECK(memcmp(buf, "keep", 4) == 0);
+    close(fd);
+    unlink(ro);
+    TEST_CHECK(wOpen(&s, ro, O_WRONLY | O_CREAT, 0644) < 0);
+    TEST_CHECK(access(ro, F_OK) != 0);
+
+    /* reading is always allowed */
+    fd = wOpen(&s, TestPath("f2"), O_WRONLY | O_CREAT, 0644);
+    TEST_CHECK(fd >= 0);
+    wClose(fd);
+    fd = wOpen(&s, TestPath("f2"), O_RDONLY, 0);
+    TEST_CHECK(fd >= 0);
+    wClose(fd);
+
+    fd = wOpen(&s, TestPath("f2"), O_WRONLY | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK(wPwrite(&s, fd, (unsigned char*)"abc", 3, ofst) == 3);
+    wClose(fd);
+    /* a stream write drops the file's cached attributes */
+    TEST_CHECK(WFOPEN(&s, &f, TestPath("f3"), "w") == 0);
+    TEST_CHECK(wStat(TestPath("f3"), &st) == 0 && st.st_size == 0);
+    TEST_CHECK(WFWRITE(&s, (unsigned char*)"abcd", 1, 4, f) == 4);
+    WFFLUSH(f);
+    TEST_CHECK(wStat(TestPath("f3"), &st) == 0 && st.st_size == 4);
+    WFCLOSE(&s, f);
+    TEST_CHECK(WFOPEN(&s, &f, TestPath("f3"), "r") == 0);
+    TEST_CHECK(WFWRITE(&s, (unsigned char*)"abcd", 1, 4, f) <= 0);
+    WFCLOSE(&s, f);
+
+    wFsSessionFree(&s);
+}
+
+static void TestRate(void)
+{
+    static MY_FS_RULE rules[TEST_POLICY_RULES];
+    static char prefix[TEST_POLICY_RULES][32];
+    static char path[TEST_POLICY_PATHS][64];
+    MY_FS_POLICY policy = { rules, TEST_POLICY_RULES, NULL, 0 };
+    MY_FS_SESSION s;
+    unsigned int i;
+    unsigned int r;
+    unsigned long sum = 0;
+    uint64_t start, ns;
+    double rate;
+
+    /* 100 projects of 10 areas each, all for everyone */
+    for (i = 0; i < TEST_POLICY_RULES; i++) {
+        snprintf(prefix[i], sizeof(prefix[i]), "/srv/proj%02u/area%u",
+                 i / 10, i % 10);
+        rules[i].user = "*";
+        rules[i].prefix = prefix[i];
+        rules[i].allow = (unsigned char)(1 << (i % 6));
+    }
+    /* hits at several depths, near misses and paths outside every rule */
+    srand(1);
+    for (i = 0; i < TEST_POLICY_PATHS; i++) {
+        unsigned int p = (unsigned int)rand() % 110;
+
+        switch (i % 4) {
+            case 0:
+                snprintf(path[i], sizeof(path[i]),
+                         "/srv/proj%02u/area%u/file%u", p, i % 10, i);
+                break;
+            case 1:
+                snprintf(path[i], sizeof(path[i]),
+                         "/srv/proj%02u/area%u/sub/dir/file%u", p, i % 10, i);
+                break;
+            case 2:
+                snprintf(path[i], sizeof(path[i]),
+                         "/srv/proj%02u/area%ux/file", p, i % 10);
+                break;
+            default:
+                snprintf(path[i], sizeof(path[i]), "/home/user%u/file", i);
+                break;
+        }
+    }
+
+    TEST_CHECK(wFsSessionInit(&s, NULL, &policy, NULL) == WS_SUCCESS);
+    /* rule 73 */
+    TEST_CHECK(wFsSessionAllowed(&s, "/srv/proj07/area3/f") == (1 << 1));
+    TEST_CHECK(wFsSessionAllowed(&s, "/srv/proj07/area3x/f") == 0);
+
+    start = TestNow();
+    for (r = 0; r < TEST_POLICY_ROUNDS; r++) {
+        for (i = 0; i < TEST_POLICY_PATHS; i++) {
+            sum += wFsSessionAllowed(&s, path[i]);
+        }
+    }
+    ns = TestNow() - start;
+    rate = (double)TEST_POLICY_ROUNDS * TEST_POLICY_PATHS * 1e9 / (double)ns;
+
+    printf("%u rules, %u nodes: %.2f M decisions/s (%lu)\n",
+           TEST_POLICY_RULES, s.nodeCount, rate / 1e6, sum);
+    TEST_CHECK(rate >= TEST_POLICY_MIN_RATE);
+
+    wFsSessionFree(&s);
+}
+
+int main(void)
+{
+    if (mkdtemp(tmpDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    wolfSSH_Init();
+    ctx = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_SERVER, NULL);
+    if (ctx == NULL) {
+        fprintf(stderr, "Couldn't create a wolfSSH CTX\n");
+        return 1;
+    }
+
+    TEST_RUN(TestMatch);
+    TEST_RUN(TestHandle);
+    TEST_RUN(TestOpen);
+    TEST_RUN(TestRate);
+
+    unlink(TestPath("f2"));
+    unlink(TestPath("f3"));
+    rmdir(tmpDir);
+    wolfSSH_CTX_free(ctx);
+    wolfSSH_Cleanup();
+
+    return TEST_RESULT();
+}
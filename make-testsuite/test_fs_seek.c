@@ -0,0 +1,288 @@
+/* test_fs_seek.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for restricting-sftp's SYS_FS backend, over the SYS_FS
+ * stand-in in host/. SYS_FS has no positional read or write, so each open
+ * file remembers where its file pointer is, and a wPread or wPwrite that
+ * starts there is made without a seek. A download and an upload in order
+ * must then make no seeks at all; requests out of order, relative seeks,
+ * short reads and appends must still read and write the right bytes. */
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+#include "host_sys_fs.h"
+#include "myFilesystem.h"
+#include "test_common.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(MY_FILESYSTEM_POSIX) || !defined(MY_FILESYSTEM_STATS)
+    #error build with MY_FILESYSTEM_STATS and without MY_FILESYSTEM_POSIX
+#endif
+
+#define TEST_CHUNK   32768
+#define TEST_CHUNKS  32
+#define TEST_FILE_SZ (TEST_CHUNKS * TEST_CHUNK)
+
+static char tmpDir[] = "/tmp/test_fs_seek.XXXXXX";
+static char path[256];
+static byte data[TEST_FILE_SZ];
+static byte buf[TEST_FILE_SZ];
+static MY_FS_SESSION s;
+
+
+/* the file as it is on disk, read past the layer */
+static long TestRead(byte* out, size_t sz)
+{
+    int fd = open(path, O_RDONLY);
+    long got;
+
+    if (fd < 0) {
+        return -1;
+    }
+    got = (long)read(fd, out, sz);
+    close(fd);
+    return got;
+}
+
+static int TestMake(size_t sz)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int ok;
+
+    ok = fd >= 0 && write(fd, data, sz) == (ssize_t)sz;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+static int TestPread(WFILE f, word32 ofst, word32 sz)
+{
+    unsigned int o[2] = { ofst, 0 };
+
+    return wPread(f, buf + ofst, sz, o);
+}
+
+static int TestPwrite(WFILE f, word32 ofst, word32 sz)
+{
+    unsigned int o[2] = { ofst, 0 };
+
+    return wPwrite(&s, f, data + ofst, sz, o);
+}
+
+static void TestReset(void)
+{
+    wFsStatsReset();
+    HostSysFsStatsReset();
+}
+
+
+/* a download in order seeks nowhere, the file pointer is always there */
+static void TestDownload(void)
+{
+    unsigned int end[2] = { TEST_FILE_SZ, 0 };
+    MY_FS_STATS stats;
+    HostSysFsStats fs;
+    WFILE f = WBADFILE;
+    word32 ofst;
+    byte one;
+
+    TEST_CHECK(TestMake(TEST_FILE_SZ));
+    TEST_CHECK(wfopen(&s, &f, path, SYS_FS_FILE_OPEN_READ) == 0);
+    TestReset();
+    memset(buf, 0, sizeof(buf));
+    for (ofst = 0; ofst < TEST_FILE_SZ; ofst += TEST_CHUNK) {
+        TEST_CHECK(TestPread(f, ofst, TEST_CHUNK) == TEST_CHUNK);
+    }
+    /* and the read at the end that tells the client it is done */
+    TEST_CHECK(wPread(f, &one, 1, end) == 0);
+    TEST_CHECK(memcmp(buf, data, TEST_FILE_SZ) == 0);
+
+    wFsStatsGet(&stats);
+    HostSysFsStatsGet(&fs);
+    TEST_CHECK(stats.seeks == 0 && fs.seeks == 0);
+    TEST_CHECK(stats.seeksSkipped == TEST_CHUNKS + 1);
+    TEST_CHECK(fs.reads == TEST_CHUNKS + 1);
+    TEST_CHECK(wFclose(&f) == 0);
+}
+
+/* and so does an upload */
+static void TestUpload(void)
+{
+    MY_FS_STATS stats;
+    HostSysFsStats fs;
+    WFILE f = WBADFILE;
+    word32 ofst;
+
+    TEST_CHECK(wfopen(&s, &f, path, SYS_FS_FILE_OPEN_WRITE_PLUS) == 0);
+    TestReset();
+    for (ofst = 0; ofst < TEST_FILE_SZ; ofst += TEST_CHUNK) {
+        TEST_CHECK(TestPwrite(f, ofst, TEST_CHUNK) == TEST_CHUNK);
+    }
+    wFsStatsGet(&stats);
+    HostSysFsStatsGet(&fs);
+    TEST_CHECK(stats.seeks == 0 && fs.seeks == 0);
+    TEST_CHECK(fs.writes == TEST_CHUNKS);
+    TEST_CHECK(wFclose(&f) == 0);
+
+    memset(buf, 0, sizeof(buf));
+    TEST_CHECK(TestRead(buf, sizeof(buf)) == TEST_FILE_SZ);
+    TEST_CHECK(memcmp(buf, data, TEST_FILE_SZ) == 0);
+}
+
+/* requests out of order seek, once per break in the run */
+static void TestOutOfOrder(void)
+{
+    int order[TEST_CHUNKS];
+    HostSysFsStats fs;
+    WFILE f = WBADFILE;
+    word32 next = 0;
+    int breaks = 0;
+    int i;
+
+    for (i = 0; i < TEST_CHUNKS; i++) {
+        order[i] = i;
+    }
+    srand(1);
+    for (i = TEST_CHUNKS - 1; i > 0; i--) {
+        int j = rand() % (i + 1);
+        int t = order[i];
+
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    TEST_CHECK(TestMake(TEST_FILE_SZ));
+    TEST_CHECK(wfopen(&s, &f, path, SYS_FS_FILE_OPEN_READ) == 0);
+    TestReset();
+    memset(buf, 0, sizeof(buf));
+    for (i = 0; i < TEST_CHUNKS; i++) {
+        word32 ofst = (word32)order[i] * TEST_CHUNK;
+
+        breaks += (ofst != next);
+        TEST_CHECK(TestPread(f, ofst, TEST_CHUNK) == TEST_CHUNK);
+        next = ofst + TEST_CHUNK;
+    }
+    TEST_CHECK(memcmp(buf, data, TEST_FILE_SZ) == 0);
+    HostSysFsStatsGet(&fs);
+    TEST_CHECK(fs.seeks == (uint64_t)breaks);
+    TEST_CHECK(wFclose(&f) == 0);
+}
+
+/* a seek the layer cannot follow, a short read, and a read past the end */
+static void TestPosition(void)
+{
+    MY_FS_STATS stats;
+    WFILE f = WBADFILE;
+    unsigned int far[2] = { 0x80000000U, 0 };
+    byte one;
+
+    TEST_CHECK(TestMake(1000));
+    TEST_CHECK(wfopen(&s, &f, path, SYS_FS_FILE_OPEN_READ) == 0);
+
+    /* only an absolute seek leaves a known position */
+    TEST_CHECK(WFSEEK(NULL, &f, 100, SYS_FS_SEEK_CUR) == 100);
+    TestReset();
+    TEST_CHECK(TestPread(f, 100, 10) == 10);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.seeks == 1);
+    TEST_CHECK(WFSEEK(NULL, &f, 500, SYS_FS_SEEK_SET) == 500);
+    TestReset();
+    TEST_CHECK(TestPread(f, 500, 10) == 10);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.seeks == 0 && stats.seeksSkipped == 1);
+
+    /* a short read moves the file pointer as far as it read */
+    TEST_CHECK(TestPread(f, 900, 200) == 100);
+    TestReset();
+    TEST_CHECK(TestPread(f, 1000, 200) == 0);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.seeks == 0);
+    TEST_CHECK(memcmp(buf + 900, data + 900, 100) == 0);
+
+    /* SYS_FS cannot seek past 2 GB, and says so */
+    TEST_CHECK(wPread(f, &one, 1, far) == -1);
+    TEST_CHECK(TestPread(f, 0, 10) == 10);
+    TEST_CHECK(memcmp(buf, data, 10) == 0);
+    TEST_CHECK(wFclose(&f) == 0);
+}
+
+/* an append starts at the end, so a write elsewhere still seeks there */
+static void TestAppend(void)
+{
+    unsigned int start[2] = { 0, 0 };
+    byte mark[10];
+    WFILE f = WBADFILE;
+    byte want[1100];
+
+    memset(mark, 'X', sizeof(mark));
+    TEST_CHECK(TestMake(1000));
+    TEST_CHECK(wfopen(&s, &f, path, SYS_FS_FILE_OPEN_APPEND_PLUS) == 0);
+    TEST_CHECK(wPwrite(&s, f, mark, sizeof(mark), start) ==
+               (int)sizeof(mark));
+    TEST_CHECK(TestRead(buf, sizeof(buf)) == 1000);
+    TEST_CHECK(TestPwrite(f, 1000, 100) == 100);
+    TEST_CHECK(wFclose(&f) == 0);
+
+    memcpy(want, data, sizeof(want));
+    memcpy(want, mark, sizeof(mark));
+    memset(buf, 0, sizeof(buf));
+    TEST_CHECK(TestRead(buf, sizeof(buf)) == (long)sizeof(want));
+    TEST_CHECK(memcmp(buf, want, sizeof(want)) == 0);
+}
+
+int main(void)
+{
+    MY_FS_RULE rule = { "*", tmpDir, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    size_t i;
+
+    if (mkdtemp(tmpDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/file", tmpDir);
+    srand(2);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (byte)rand();
+    }
+    wolfSSH_Init();
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        return 1;
+    }
+
+    TEST_RUN(TestDownload);
+    TEST_RUN(TestUpload);
+    TEST_RUN(TestOutOfOrder);
+    TEST_RUN(TestPosition);
+    TEST_RUN(TestAppend);
+
+    wFsSessionFree(&s);
+    unlink(path);
+    rmdir(tmpDir);
+    wolfSSH_Cleanup();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,220 @@
+/* test_fs_write_behind.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for write-behind in restricting-sftp, built with its POSIX
+ * backend and a 4 KB MY_FS_WRITE_BEHIND_SZ: an upload in small writes
+ * reaches the file in whole blocks, and what is held back is written out
+ * before a write elsewhere, a read or stat through any handle, a write
+ * through a stdio stream, and on close. */
+
+#include <wolfssl/wolfcrypt/settings.h>
+#include <wolfssh/ssh.h>
+#include "myFilesystem.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(MY_FILESYSTEM_STATS) || MY_FS_WRITE_BEHIND_SZ != 4096
+    #error build with MY_FILESYSTEM_STATS and MY_FS_WRITE_BEHIND_SZ=4096
+#endif
+
+#define TEST_WB_BLOCK  MY_FS_WRITE_BEHIND_SZ
+#define TEST_WB_FILE   (16 * TEST_WB_BLOCK + 500)
+#define TEST_WB_PIECE  1000
+
+static char tmpDir[] = "/tmp/test_fs_write_behind.XXXXXX";
+static char path[256];
+static byte data[TEST_WB_FILE];
+static MY_FS_SESSION s;
+
+static int TestWrite(WFD fd, word32 ofst, word32 sz)
+{
+    unsigned int o[2] = { ofst, 0 };
+
+    return wPwrite(&s, fd, data + ofst, sz, o);
+}
+
+/* bytes on disk, read past the layer */
+static long TestOnDisk(void)
+{
+    struct stat st;
+
+    return (stat(path, &st) == 0) ? (long)st.st_size : -1;
+}
+
+static int TestMatches(const byte* want, word32 sz)
+{
+    static byte got[TEST_WB_FILE];
+    int fd = open(path, O_RDONLY);
+    int ok;
+
+    ok = fd >= 0 && read(fd, got, sz) == (ssize_t)sz &&
+         memcmp(got, want, sz) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+static int TestContents(word32 sz)
+{
+    return TestMatches(data, sz);
+}
+
+/* an upload in pieces that do not line up with the blocks */
+static void TestUpload(void)
+{
+    MY_FS_STATS stats;
+    word32 ofst;
+    WFD fd;
+
+    fd = wOpen(&s, path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+    wFsStatsReset();
+    for (ofst = 0; ofst < TEST_WB_FILE; ofst += TEST_WB_PIECE) {
+        word32 sz = (TEST_WB_FILE - ofst < TEST_WB_PIECE) ?
+                TEST_WB_FILE - ofst : TEST_WB_PIECE;
+
+        TEST_CHECK(TestWrite(fd, ofst, sz) == (int)sz);
+    }
+
+    /* one media write per whole block so far, the tail still held */
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.writes == TEST_WB_FILE / TEST_WB_BLOCK);
+    TEST_CHECK(stats.writesBuffered ==
+               (TEST_WB_FILE + TEST_WB_PIECE - 1) / TEST_WB_PIECE);
+    TEST_CHECK(TestOnDisk() == TEST_WB_FILE / TEST_WB_BLOCK * TEST_WB_BLOCK);
+
+    TEST_CHECK(wClose(fd) == 0);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.writes == TEST_WB_FILE / TEST_WB_BLOCK + 1);
+    TEST_CHECK(TestOnDisk() == TEST_WB_FILE);
+    TEST_CHECK(TestContents(TEST_WB_FILE));
+}
+
+/* a write through a stdio stream on the same file comes after what a
+ * handle holds back, as the client sent them */
+static void TestStream(void)
+{
+    unsigned char mark[4] = { 'X', 'X', 'X', 'X' };
+    WFILE* f = NULL;
+    byte want[200];
+    WFD fd;
+
+    fd = wOpen(&s, path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+    TEST_CHECK(TestWrite(fd, 0, 200) == 200);
+    TEST_CHECK(TestOnDisk() == 0);
+
+    TEST_CHECK(wfopen(&s, &f, path, "r+") == 0 && f != NULL);
+    TEST_CHECK(wFwrite(&s, mark, 1, sizeof(mark), f) == (int)sizeof(mark));
+    TEST_CHECK(wFclose(f) == 0);
+    TEST_CHECK(wClose(fd) == 0);
+
+    memcpy(want, data, sizeof(want));
+    memcpy(want, mark, sizeof(mark));
+    TEST_CHECK(TestOnDisk() == (long)sizeof(want));
+    TEST_CHECK(TestMatches(want, sizeof(want)));
+}
+
+/* what is held back goes out before anything that needs it */
+static void TestFlush(void)
+{
+    MY_FS_STATS stats;
+    unsigned int o[2] = { 0, 0 };
+    byte buf[16];
+    WSTAT_T st;
+    WFD fd;
+    WFD rd;
+
+    fd = wOpen(&s, path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    TEST_CHECK(fd >= 0);
+    rd = wOpen(&s, path, O_RDONLY, 0);
+    TEST_CHECK(rd >= 0);
+
+    /* a stat, through the layer */
+    TEST_CHECK(TestWrite(fd, 0, 100) == 100);
+    TEST_CHECK(TestOnDisk() == 0);
+    TEST_CHECK(wStat(path, &st) == 0 && st.st_size == 100);
+    TEST_CHECK(TestOnDisk() == 100);
+
+    /* a read through another handle on the same file */
+    TEST_CHECK(TestWrite(fd, 100, 100) == 100);
+    TEST_CHECK(TestOnDisk() == 100);
+    o[0] = 150;
+    TEST_CHECK(wPread(rd, buf, sizeof(buf), o) == (int)sizeof(buf));
+    TEST_CHECK(memcmp(buf, data + 150, sizeof(buf)) == 0);
+
+    /* a write that does not follow on */
+    TEST_CHECK(TestWrite(fd, 200, 50) == 50);
+    wFsStatsReset();
+    TEST_CHECK(TestWrite(fd, 1000, 50) == 50);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.writes == 1);
+    TEST_CHECK(TestOnDisk() == 250);
+
+    /* a block or more goes straight out, after what is held */
+    wFsStatsReset();
+    TEST_CHECK(TestWrite(fd, 1050, TEST_WB_BLOCK) == TEST_WB_BLOCK);
+    wFsStatsGet(&stats);
+    TEST_CHECK(stats.writes == 2 && stats.writesBuffered == 0);
+    TEST_CHECK(TestOnDisk() == 1050 + TEST_WB_BLOCK);
+
+    /* and close */
+    TEST_CHECK(TestWrite(fd, 250, 750) == 750);
+    TEST_CHECK(TestContents(250) && !TestContents(1000));
+    TEST_CHECK(wClose(fd) == 0);
+    TEST_CHECK(TestContents(1050 + TEST_WB_BLOCK));
+    TEST_CHECK(wClose(rd) == 0);
+}
+
+int main(void)
+{
+    MY_FS_RULE rule = { "*", tmpDir, MY_FS_OP_ALL };
+    MY_FS_POLICY policy = { &rule, 1, NULL, 0 };
+    size_t i;
+
+    if (mkdtemp(tmpDir) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(path, sizeof(path), "%s/upload", tmpDir);
+    srand(1);
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = (byte)rand();
+    }
+    wolfSSH_Init();
+    if (wFsSessionInit(&s, NULL, &policy, NULL) != WS_SUCCESS) {
+        fprintf(stderr, "Couldn't set up the filesystem session\n");
+        return 1;
+    }
+
+    TEST_RUN(TestUpload);
+    TEST_RUN(TestFlush);
+    TEST_RUN(TestStream);
+
+    wFsSessionFree(&s);
+    unlink(path);
+    rmdir(tmpDir);
+    wolfSSH_Cleanup();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,285 @@
+/* test_ring_buffer.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's SPSC byte ring: empty, full,
+ * wraparound and peek_at on one thread, then a producer and a consumer
+ * thread passing a counted byte stream through a small ring. */
+
+#include "ring_buffer.h"
+#include "test_common.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#define TEST_RING_SZ     64
+#define TEST_STREAM_SZ   (16 * 1024 * 1024)
+
+static void TestInit(void)
+{
+    ring_buffer_t rb;
+    uint8_t storage[TEST_RING_SZ];
+
+    TEST_CHECK(ring_buffer_init(&rb, storage, 0) != 0);
+    TEST_CHECK(ring_buffer_init(&rb, storage, 48) != 0);
+    TEST_CHECK(ring_buffer_init(&rb, NULL, TEST_RING_SZ) != 0);
+    TEST_CHECK(ring_buffer_init(&rb, storage, TEST_RING_SZ) == 0);
+    TEST_CHECK(ring_buffer_capacity(&rb) == TEST_RING_SZ);
+}
+
+static void TestEmpty(void)
+{
+    uint8_t storage[TEST_RING_SZ];
+    ring_buffer_t rb = RING_BUFFER_INIT(storage, TEST_RING_SZ);
+    const uint8_t* region;
+    uint8_t out[8];
+
+    TEST_CHECK(ring_buffer_used(&rb) == 0);
+    TEST_CHECK(ring_buffer_free(&rb) == TEST_RING_SZ);
+    TEST_CHECK(ring_buffer_read(&rb, out, sizeof(out)) == 0);
+    TEST_CHECK(ring_buffer_peek(&rb, &region) == 0);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 0, &region) == 0);
+
+    /* drained back to empty */
+    TEST_CHECK(ring_buffer_write(&rb, (const uint8_t*)"abc", 3) == 3);
+    TEST_CHECK(ring_buffer_read(&rb, out, sizeof(out)) == 3);
+    TEST_CHECK(memcmp(out, "abc", 3) == 0);
+    TEST_CHECK(ring_buffer_used(&rb) == 0);
+    TEST_CHECK(ring_buffer_peek(&rb, &region) == 0);
+}
+
+static void TestFull(void)
+{
+    uint8_t storage[TEST_RING_SZ];
+    uint8_t in[TEST_RING_SZ + 16];
+    uint8_t out[TEST_RING_SZ];
+    ring_buffer_t rb;
+    size_t i;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (uint8_t)i;
+    }
+    ring_buffer_init(&rb, storage, TEST_RING_SZ);
+
+    /* a write larger than the space is cut short, never wrapped over */
+    TEST_CHECK(ring_buffer_write(&rb, in, sizeof(in)) == TEST_RING_SZ);
+    TEST_CHECK(ring_buffer_used(&rb) == TEST_RING_SZ);
+    TEST_CHECK(ring_buffer_free(&rb) == 0);
+    TEST_CHECK(ring_buffer_write(&rb, in, 1) == 0);
+
+    /* one byte out makes room for exactly one byte in */
+    TEST_CHECK(ring_buffer_read(&rb, out, 1) == 1);
+    TEST_CHECK(out[0] == 0);
+    TEST_CHECK(ring_buffer_write(&rb, in + TEST_RING_SZ, 2) == 1);
+    TEST_CHECK(ring_buffer_read(&rb, out, sizeof(out)) == TEST_RING_SZ);
+    TEST_CHECK(memcmp(out, in + 1, TEST_RING_SZ) == 0);
+
+    ring_buffer_write(&rb, in, 10);
+    ring_buffer_discard(&rb);
+    TEST_CHECK(ring_buffer_used(&rb) == 0);
+    TEST_CHECK(ring_buffer_free(&rb) == TEST_RING_SZ);
+}
+
+static void TestWrap(void)
+{
+    uint8_t storage[TEST_RING_SZ];
+    uint8_t in[TEST_RING_SZ];
+    uint8_t out[TEST_RING_SZ];
+    const uint8_t* region;
+    ring_buffer_t rb;
+    size_t n;
+    size_t i;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (uint8_t)(0xA0 + i);
+    }
+    ring_buffer_init(&rb, storage, TEST_RING_SZ);
+
+    /* move head and tail to 50, then write 30 bytes across the end */
+    ring_buffer_write(&rb, in, 50);
+    ring_buffer_read(&rb, out, 50);
+    TEST_CHECK(ring_buffer_write(&rb, in, 30) == 30);
+    TEST_CHECK(ring_buffer_used(&rb) == 30);
+
+    /* peek stops at the physical end; the rest is after the wrap */
+    n = ring_buffer_peek(&rb, &region);
+    TEST_CHECK(n == TEST_RING_SZ - 50);
+    TEST_CHECK(region == storage + 50);
+    TEST_CHECK(memcmp(region, in, n) == 0);
+    ring_buffer_consume(&rb, n);
+    n = ring_buffer_peek(&rb, &region);
+    TEST_CHECK(n == 30 - (TEST_RING_SZ - 50));
+    TEST_CHECK(region == storage);
+    TEST_CHECK(memcmp(region, in + (TEST_RING_SZ - 50), n) == 0);
+    ring_buffer_consume(&rb, n);
+    TEST_CHECK(ring_buffer_used(&rb) == 0);
+
+    /* read copies straight across the wrap */
+    ring_buffer_write(&rb, in, 40);
+    TEST_CHECK(ring_buffer_read(&rb, out, sizeof(out)) == 40);
+    TEST_CHECK(memcmp(out, in, 40) == 0);
+}
+
+static void TestPeekAt(void)
+{
+    uint8_t storage[TEST_RING_SZ];
+    uint8_t in[TEST_RING_SZ];
+    uint8_t out[TEST_RING_SZ];
+    const uint8_t* region;
+    ring_buffer_t rb;
+    size_t n;
+    size_t i;
+
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (uint8_t)i;
+    }
+    ring_buffer_init(&rb, storage, TEST_RING_SZ);
+
+    ring_buffer_write(&rb, in, 20);
+    n = ring_buffer_peek_at(&rb, 5, &region);
+    TEST_CHECK(n == 15);
+    TEST_CHECK(region[0] == 5);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 19, &region) == 1);
+    TEST_CHECK(region[0] == 19);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 20, &region) == 0);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 100, &region) == 0);
+    /* peeking leaves the bytes waiting */
+    TEST_CHECK(ring_buffer_used(&rb) == 20);
+
+    /* tail at 56 with 20 waiting: 8 before the wrap, 12 after */
+    ring_buffer_read(&rb, out, 20);
+    ring_buffer_write(&rb, in, 36);
+    ring_buffer_read(&rb, out, 36);
+    ring_buffer_write(&rb, in, 20);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 0, &region) == 8);
+    TEST_CHECK(ring_buffer_peek_at(&rb, 3, &region) == 5);
+    TEST_CHECK(region[0] == 3);
+    n = ring_buffer_peek_at(&rb, 8, &region);
+    TEST_CHECK(n == 12);
+    TEST_CHECK(region == storage);
+    TEST_CHECK(region[0] == 8);
+    n = ring_buffer_peek_at(&rb, 10, &region);
+    TEST_CHECK(n == 10);
+    TEST_CHECK(region[0] == 10);
+}
+
+typedef struct TestStream {
+    ring_buffer_t rb;
+    uint8_t storage[TEST_RING_SZ];
+    size_t errors;
+} TestStream;
+
+static void* TestProducer(void* arg)
+{
+    TestStream* s = (TestStream*)arg;
+    uint8_t chunk[23];
+    size_t sent = 0;
+
+    while (sent < TEST_STREAM_SZ) {
+        size_t want = sizeof(chunk);
+        size_t i;
+
+        if (want > TEST_STREAM_SZ - sent) {
+            want = TEST_STREAM_SZ - sent;
+        }
+        for (i = 0; i < want; i++) {
+            chunk[i] = (uint8_t)((sent + i) * 7);
+        }
+        for (i = 0; i < want; ) {
+            size_t n = ring_buffer_write(&s->rb, chunk + i, want - i);
+
+            if (n == 0) {
+                sched_yield();
+            }
+            i += n;
+        }
+        sent += want;
+    }
+
+    return NULL;
+}
+
+static void* TestConsumer(void* arg)
+{
+    TestStream* s = (TestStream*)arg;
+    size_t got = 0;
+    int usePeek = 0;
+
+    /* alternate between copying reads and zero-copy peek/consume */
+    while (got < TEST_STREAM_SZ) {
+        uint8_t buf[17];
+        const uint8_t* region = buf;
+        size_t n;
+        size_t i;
+
+        if (usePeek) {
+            n = ring_buffer_peek(&s->rb, &region);
+        }
+        else {
+            n = ring_buffer_read(&s->rb, buf, sizeof(buf));
+        }
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (region[i] != (uint8_t)((got + i) * 7)) {
+                s->errors++;
+            }
+        }
+        if (usePeek) {
+            ring_buffer_consume(&s->rb, n);
+        }
+        got += n;
+        usePeek = !usePeek;
+    }
+
+    return NULL;
+}
+
+static void TestThreads(void)
+{
+    static TestStream s;
+    pthread_t producer;
+    pthread_t consumer;
+
+    ring_buffer_init(&s.rb, s.storage, TEST_RING_SZ);
+    s.errors = 0;
+
+    TEST_CHECK(pthread_create(&consumer, NULL, TestConsumer, &s) == 0);
+    TEST_CHECK(pthread_create(&producer, NULL, TestProducer, &s) == 0);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    TEST_CHECK(s.errors == 0);
+    TEST_CHECK(ring_buffer_used(&s.rb) == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(TestInit);
+    TEST_RUN(TestEmpty);
+    TEST_RUN(TestFull);
+    TEST_RUN(TestWrap);
+    TEST_RUN(TestPeekAt);
+    TEST_RUN(TestThreads);
+
+    return TEST_RESULT();
+}
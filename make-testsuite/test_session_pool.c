@@ -0,0 +1,380 @@
+/* test_session_pool.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's session pool, session_pool.c, over the
+ * FreeRTOS stand-in in host/, built with SSH_SERVER_MAX_SESSIONS of 4. An
+ * accept loop shaped like server_test's takes a free slot, accepts on a
+ * loopback TCP socket and hands the client to that slot's task. Each
+ * session sends the client the time it was accepted, reads until the
+ * client hangs up, and closes.
+ *
+ * A client connects and disconnects 1000 times in a row, and the time
+ * from each hang-up to the first byte of the next session is the
+ * reconnect latency; the SSH handshake on top of it is bench-handshake's.
+ * Every slot must be free again after each session, and no session may
+ * start on a slot that is still running one.
+ *
+ * Then 16 client threads make 100 connections each, holding each for up
+ * to a millisecond, so that most wait in the listen backlog for a slot.
+ * The same checks hold, no more than 4 sessions run at once, and the
+ * time from accept to the client's first byte is printed, as well as
+ * from connect, which includes the wait for a slot. */
+
+#include "session_pool.h"
+#include "ssh_server_config.h"
+#include "test_common.h"
+
+#include <freertos/task.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if SSH_SERVER_MAX_SESSIONS != 4
+    #error build with SSH_SERVER_MAX_SESSIONS=4
+#endif
+
+#define TEST_SLOTS      SSH_SERVER_MAX_SESSIONS
+#define TEST_RECONNECTS 1000
+#define TEST_THREADS    16
+#define TEST_PER_THREAD 100
+#define TEST_CLIENTS    (TEST_THREADS * TEST_PER_THREAD)
+/* the longest a client keeps its session, in us */
+#define TEST_HOLD_US    1000
+/* how long to wait for a slot to come back, in ms */
+#define TEST_STALL_MS   1000
+
+/* what the accept loop hands each slot, as server_test fills threadCtx */
+typedef struct TestSession {
+    int fd;
+    uint64_t acceptTime;
+    atomic_int busy;       /* running a client now */
+    atomic_uint runs;      /* clients run to the end */
+} TestSession;
+
+static TestSession session[TEST_SLOTS];
+static int listenFd = -1;
+static struct sockaddr_in listenAddr;
+static atomic_int overlaps;
+static atomic_int active;
+static atomic_int mostActive;
+
+typedef struct TestAcceptor {
+    int clients;           /* accept this many, then stop */
+    int ok;
+} TestAcceptor;
+
+/* the session: the accept time first, then wait for the client to hang
+ * up, as server_worker waits on its socket */
+static void TestRun(int slot, void* arg)
+{
+    TestSession* s = &session[slot];
+    uint64_t at = s->acceptTime;
+    uint8_t buf[64];
+
+    int now;
+    int most;
+
+    (void)arg;
+    if (atomic_exchange(&s->busy, 1) != 0) {
+        atomic_fetch_add(&overlaps, 1);
+    }
+    now = atomic_fetch_add(&active, 1) + 1;
+    most = atomic_load(&mostActive);
+    while (now > most &&
+           !atomic_compare_exchange_weak(&mostActive, &most, now)) {
+    }
+    if (write(s->fd, &at, sizeof(at)) == (ssize_t)sizeof(at)) {
+        while (read(s->fd, buf, sizeof(buf)) > 0) {
+        }
+    }
+    close(s->fd);
+    s->fd = -1;
+    atomic_fetch_add(&s->runs, 1);
+    atomic_fetch_sub(&active, 1);
+    atomic_store(&s->busy, 0);
+}
+
+/* server_test's loop: a free slot first, then the next client */
+static void* TestAccept(void* arg)
+{
+    TestAcceptor* acc = (TestAcceptor*)arg;
+    int i;
+
+    acc->ok = 1;
+    for (i = 0; i < acc->clients; i++) {
+        int slot = SessionPoolTake(portMAX_DELAY);
+        int fd;
+
+        if (slot < 0 || slot >= TEST_SLOTS) {
+            acc->ok = 0;
+            break;
+        }
+        fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            SessionPoolGive(slot);
+            acc->ok = 0;
+            break;
+        }
+        session[slot].fd = fd;
+        session[slot].acceptTime = TestNow();
+        SessionPoolStart(slot);
+    }
+    return NULL;
+}
+
+/* connect, and wait for the session's first bytes; returns the socket,
+ * or -1 */
+static int TestConnect(uint64_t* acceptTime)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (connect(fd, (struct sockaddr*)&listenAddr,
+                sizeof(listenAddr)) != 0 ||
+        read(fd, acceptTime, sizeof(*acceptTime)) !=
+                (ssize_t)sizeof(*acceptTime)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* wait for all but held slots to be back on the free list */
+static int TestFree(int held)
+{
+    uint64_t until = TestNow() + TEST_STALL_MS * 1000000ULL;
+
+    while (SessionPoolFree() != TEST_SLOTS - held && TestNow() < until) {
+        usleep(100);
+    }
+    return SessionPoolFree() == TEST_SLOTS - held;
+}
+
+static int CompareU64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint64_t Percentile(uint64_t* v, int n, int pct)
+{
+    qsort(v, (size_t)n, sizeof(*v), CompareU64);
+    return v[(size_t)((n - 1) * pct / 100)];
+}
+
+static unsigned TestRuns(void)
+{
+    unsigned runs = 0;
+    int i;
+
+    for (i = 0; i < TEST_SLOTS; i++) {
+        runs += atomic_load(&session[i].runs);
+    }
+    return runs;
+}
+
+/* one client after another, each connecting as soon as the last hangs up */
+static void TestReconnect(void)
+{
+    static uint64_t lat[TEST_RECONNECTS];
+    TestAcceptor acc = { TEST_RECONNECTS, 0 };
+    unsigned before = TestRuns();
+    uint64_t hangUp;
+    pthread_t th;
+    int leaked = 0;
+    int i;
+
+    TEST_CHECK(pthread_create(&th, NULL, TestAccept, &acc) == 0);
+    hangUp = TestNow();
+    for (i = 0; i < TEST_RECONNECTS; i++) {
+        uint64_t at;
+        int fd = TestConnect(&at);
+
+        if (fd < 0) {
+            fprintf(stderr, "client %d couldn't connect\n", i);
+            break;
+        }
+        lat[i] = TestNow() - hangUp;
+        close(fd);
+        hangUp = TestNow();
+
+        /* the slot comes back once the session sees the hang-up; any
+         * that doesn't is gone for good. The accept loop holds one while
+         * it waits for the next client. */
+        if (i % 100 == 99 && !TestFree(1)) {
+            leaked = 1;
+        }
+    }
+    pthread_join(th, NULL);
+
+    TEST_CHECK(i == TEST_RECONNECTS);
+    TEST_CHECK(acc.ok);
+    TEST_CHECK(!leaked && TestFree(0));
+    TEST_CHECK(TestRuns() - before == TEST_RECONNECTS);
+    TEST_CHECK(atomic_load(&overlaps) == 0);
+    if (i == TEST_RECONNECTS) {
+        printf("%d reconnects: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               TEST_RECONNECTS,
+               (double)Percentile(lat, TEST_RECONNECTS, 50) / 1e3,
+               (double)Percentile(lat, TEST_RECONNECTS, 99) / 1e3,
+               (double)Percentile(lat, TEST_RECONNECTS, 100) / 1e3);
+    }
+}
+
+typedef struct TestClient {
+    int index;
+    int ok;
+    uint64_t* firstByte;   /* from accept, per connection */
+    uint64_t* connect;     /* from connect */
+} TestClient;
+
+/* one thread's clients, each holding its session a random while */
+static void* TestClientThread(void* arg)
+{
+    TestClient* c = (TestClient*)arg;
+    unsigned int seed = (unsigned int)c->index + 1;
+    int i;
+
+    c->ok = 1;
+    for (i = 0; i < TEST_PER_THREAD; i++) {
+        uint64_t start = TestNow();
+        uint64_t at;
+        uint64_t now;
+        int fd = TestConnect(&at);
+
+        if (fd < 0) {
+            c->ok = 0;
+            break;
+        }
+        now = TestNow();
+        c->firstByte[i] = now - at;
+        c->connect[i] = now - start;
+        usleep((useconds_t)(rand_r(&seed) % TEST_HOLD_US));
+        close(fd);
+    }
+    return NULL;
+}
+
+/* more clients at once than there are sessions */
+static void TestConcurrent(void)
+{
+    static uint64_t firstByte[TEST_CLIENTS];
+    static uint64_t connect[TEST_CLIENTS];
+    TestClient client[TEST_THREADS];
+    pthread_t th[TEST_THREADS];
+    TestAcceptor acc = { TEST_CLIENTS, 0 };
+    unsigned before = TestRuns();
+    unsigned slotRuns[TEST_SLOTS];
+    pthread_t accTh;
+    int ok = 1;
+    int i;
+
+    for (i = 0; i < TEST_SLOTS; i++) {
+        slotRuns[i] = atomic_load(&session[i].runs);
+    }
+    atomic_store(&mostActive, 0);
+    TEST_CHECK(pthread_create(&accTh, NULL, TestAccept, &acc) == 0);
+    for (i = 0; i < TEST_THREADS; i++) {
+        client[i].index = i;
+        client[i].ok = 0;
+        client[i].firstByte = firstByte + i * TEST_PER_THREAD;
+        client[i].connect = connect + i * TEST_PER_THREAD;
+        TEST_CHECK(pthread_create(&th[i], NULL, TestClientThread,
+                                  &client[i]) == 0);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        pthread_join(th[i], NULL);
+        ok &= client[i].ok;
+    }
+    pthread_join(accTh, NULL);
+
+    TEST_CHECK(ok);
+    TEST_CHECK(acc.ok);
+    TEST_CHECK(TestFree(0));
+    TEST_CHECK(TestRuns() - before == TEST_CLIENTS);
+    TEST_CHECK(atomic_load(&overlaps) == 0);
+    TEST_CHECK(atomic_load(&mostActive) <= TEST_SLOTS);
+    for (i = 0; i < TEST_SLOTS; i++) {
+        TEST_CHECK(atomic_load(&session[i].runs) > slotRuns[i]);
+    }
+    if (ok) {
+        printf("%d clients on %d threads, %d sessions at most at once\n",
+               TEST_CLIENTS, TEST_THREADS, atomic_load(&mostActive));
+        printf("accept to first byte:  p50 %.1f us, p99 %.1f us, "
+               "max %.1f us\n",
+               (double)Percentile(firstByte, TEST_CLIENTS, 50) / 1e3,
+               (double)Percentile(firstByte, TEST_CLIENTS, 99) / 1e3,
+               (double)Percentile(firstByte, TEST_CLIENTS, 100) / 1e3);
+        printf("connect to first byte: p50 %.1f us, p99 %.1f us, "
+               "max %.1f us\n",
+               (double)Percentile(connect, TEST_CLIENTS, 50) / 1e3,
+               (double)Percentile(connect, TEST_CLIENTS, 99) / 1e3,
+               (double)Percentile(connect, TEST_CLIENTS, 100) / 1e3);
+    }
+}
+
+int main(void)
+{
+    socklen_t addrSz = sizeof(listenAddr);
+    int one = 1;
+
+    memset(&listenAddr, 0, sizeof(listenAddr));
+    listenAddr.sin_family = AF_INET;
+    listenAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0 ||
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one,
+                   sizeof(one)) != 0 ||
+        bind(listenFd, (struct sockaddr*)&listenAddr,
+             sizeof(listenAddr)) != 0 ||
+        listen(listenFd, TEST_THREADS) != 0 ||
+        getsockname(listenFd, (struct sockaddr*)&listenAddr,
+                    &addrSz) != 0) {
+        perror("listen");
+        return 1;
+    }
+    if (SessionPoolInit(TestRun, NULL) != 0) {
+        fprintf(stderr, "Couldn't start the session pool\n");
+        return 1;
+    }
+    TEST_CHECK(SessionPoolFree() == TEST_SLOTS);
+    TEST_CHECK(SessionPoolInit(TestRun, NULL) == 0);
+    TEST_CHECK(SessionPoolFree() == TEST_SLOTS);
+
+    TEST_RUN(TestReconnect);
+    TEST_RUN(TestConcurrent);
+
+    close(listenFd);
+
+    return TEST_RESULT();
+}
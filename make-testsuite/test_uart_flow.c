@@ -0,0 +1,390 @@
+/* test_uart_flow.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's flow control from SSH client to UART,
+ * over the same stand-ins as test_uart_worker.c, with the UART paced at
+ * TEST_BAUD. The worker loop plays wolfSSH and the client as well: the
+ * client keeps no more than SSH_FLOW_WINDOW_FOR(TEST_BAUD) unacknowledged,
+ * its packets land half a round trip after they are sent, and the window
+ * adjust for what the worker reads lands half a round trip after that.
+ * The worker reads only as far as the Receive ring has room, as
+ * server_worker_read_ssh does.
+ *
+ * 10 MB goes to the device with a round trip well inside the window, and
+ * must arrive byte for byte at 90% of the line rate or better. Then 1 MB
+ * goes to a device that stops reading for a while every 256 KB, which on
+ * the pseudo terminal holds uart_write_bytes off as CTS would, and must
+ * still arrive whole; and 1 MB with a round trip longer than the window,
+ * to show the rate the window then allows. */
+
+#include "host_uart.h"
+#include "ssh_server_config.h"
+#include "test_common.h"
+#include "tx_rx_buffer.h"
+#include "uart_helper.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#if SSH_UART_MAP_NEWLINE != 0 || SSH_UART_MAP_DEL != 0 || \
+    SSH_UART_MAP_CTRL != 0
+    #error build with the SSH_UART_MAP_* options off, for binary data
+#endif
+
+#define TEST_BAUD       8000000
+#define TEST_WINDOW     SSH_FLOW_WINDOW_FOR(TEST_BAUD)
+#define TEST_DATA_SZ    (10 * 1024 * 1024)
+#define TEST_SHORT_SZ   (1024 * 1024)
+/* the most a client puts in one packet */
+#define TEST_PACKET_SZ  4096
+/* the device stops reading for TEST_PAUSE_MS every TEST_PAUSE_EVERY */
+#define TEST_PAUSE_EVERY (256 * 1024)
+#define TEST_PAUSE_MS   50
+/* how long a side may wait with nothing happening, in ms */
+#define TEST_STALL_MS   1000
+/* packets or window adjusts in flight at once */
+#define TEST_EVENTS     4096
+
+static byte toDevice[TEST_DATA_SZ];
+static int device = -1;
+
+/* packets on their way to the server, or window adjusts on their way
+ * back, in the order they land */
+typedef struct TestQueue {
+    uint64_t at[TEST_EVENTS];
+    size_t sz[TEST_EVENTS];
+    size_t head;
+    size_t tail;
+    int overflow;
+} TestQueue;
+
+static TestQueue packets;
+static TestQueue adjusts;
+
+typedef struct TestDevice {
+    size_t sz;           /* bytes to read */
+    size_t pauseEvery;   /* 0 to read without stopping */
+    uint64_t done;       /* when the last byte came */
+    int ok;              /* all arrived, in order */
+} TestDevice;
+
+typedef struct TestResult {
+    uint64_t ns;         /* first byte sent to last byte read */
+    int waits;           /* times the worker found the ring full */
+} TestResult;
+
+static void TestQueueInit(TestQueue* q)
+{
+    q->head = q->tail = 0;
+    q->overflow = 0;
+}
+
+static void TestQueuePut(TestQueue* q, uint64_t at, size_t sz)
+{
+    if (q->tail - q->head == TEST_EVENTS) {
+        q->overflow = 1;
+        return;
+    }
+    q->at[q->tail % TEST_EVENTS] = at;
+    q->sz[q->tail % TEST_EVENTS] = sz;
+    q->tail++;
+}
+
+/* the total of everything landed by now */
+static size_t TestQueueTake(TestQueue* q, uint64_t now)
+{
+    size_t sz = 0;
+
+    while (q->head < q->tail && q->at[q->head % TEST_EVENTS] <= now) {
+        sz += q->sz[q->head % TEST_EVENTS];
+        q->head++;
+    }
+    return sz;
+}
+
+/* when the next one lands, or 0 when none is on its way */
+static uint64_t TestQueueNext(const TestQueue* q)
+{
+    return (q->head < q->tail) ? q->at[q->head % TEST_EVENTS] : 0;
+}
+
+/* the device end, checking what it reads and pausing if asked */
+static void* TestDeviceRead(void* arg)
+{
+    TestDevice* dev = (TestDevice*)arg;
+    byte buf[4096];
+    size_t got = 0;
+    size_t pauseAt = dev->pauseEvery;
+
+    dev->ok = 1;
+    while (got < dev->sz) {
+        struct pollfd pfd = { device, POLLIN, 0 };
+        ssize_t sz;
+
+        if (dev->pauseEvery > 0 && got >= pauseAt) {
+            usleep(TEST_PAUSE_MS * 1000);
+            pauseAt += dev->pauseEvery;
+        }
+        if (poll(&pfd, 1, TEST_STALL_MS) <= 0) {
+            fprintf(stderr, "device read stalled at %zu\n", got);
+            dev->ok = 0;
+            break;
+        }
+        sz = read(device, buf, sizeof(buf));
+        if (sz <= 0 || got + (size_t)sz > dev->sz ||
+            memcmp(buf, toDevice + got, (size_t)sz) != 0) {
+            fprintf(stderr, "device read wrong data at %zu\n", got);
+            dev->ok = 0;
+            break;
+        }
+        got += (size_t)sz;
+    }
+    dev->done = TestNow();
+    return NULL;
+}
+
+/*
+ * Send sz bytes from the client to the device over a round trip of rttNs,
+ * with the worker on this thread.
+ */
+static void TestPass(size_t sz, uint64_t rttNs, size_t pauseEvery,
+                     TestResult* r)
+{
+    int evFd = ExternalTransmitBuffer_EventFd(0);
+    TestDevice dev = { sz, pauseEvery, 0, 0 };
+    HostUartStats before;
+    HostUartStats after;
+    pthread_t rd;
+    size_t window = TEST_WINDOW;  /* the client may send this much more */
+    size_t sent = 0;              /* by the client */
+    size_t held = 0;              /* landed, not yet read by the worker */
+    size_t pushed = 0;            /* read, and in the Receive ring */
+    uint64_t start;
+    int ok = 1;
+
+    memset(r, 0, sizeof(TestResult));
+    TestQueueInit(&packets);
+    TestQueueInit(&adjusts);
+    HostUartStatsGet(&before);
+    TEST_CHECK(pthread_create(&rd, NULL, TestDeviceRead, &dev) == 0);
+
+    start = TestNow();
+    while (ok && pushed < sz) {
+        uint64_t now = TestNow();
+        uint64_t next;
+        struct timeval timeout;
+        fd_set readFds;
+        int ret;
+
+        /* the client sends all its window allows */
+        window += TestQueueTake(&adjusts, now);
+        while (sent < sz && window > 0) {
+            size_t n = window;
+
+            if (n > TEST_PACKET_SZ) {
+                n = TEST_PACKET_SZ;
+            }
+            if (n > sz - sent) {
+                n = sz - sent;
+            }
+            TestQueuePut(&packets, now + rttNs / 2, n);
+            window -= n;
+            sent += n;
+        }
+
+        /* the worker reads what has landed as far as there is room, and
+         * the window adjust for it goes back */
+        held += TestQueueTake(&packets, now);
+        while (held > 0) {
+            int room = ExternalReceiveBufferFree(0);
+            int n;
+
+            if (room <= 0) {
+                ExternalReceiveBuffer_WantSpace(0);
+                room = ExternalReceiveBufferFree(0);
+                if (room <= 0) {
+                    r->waits++;
+                    break;
+                }
+            }
+            n = ((size_t)room < held) ? room : (int)held;
+            if (Set_ExternalReceiveBuffer(0, toDevice + pushed, n) != n) {
+                fprintf(stderr, "worker overran the ring at %zu\n", pushed);
+                ok = 0;
+                break;
+            }
+            pushed += (size_t)n;
+            held -= (size_t)n;
+            TestQueuePut(&adjusts, now + rttNs / 2, (size_t)n);
+        }
+        if (!ok || pushed == sz) {
+            break;
+        }
+
+        /* sleep until something lands or the ring has room */
+        next = TestQueueNext(&packets);
+        if (next == 0 || (TestQueueNext(&adjusts) != 0 &&
+                          TestQueueNext(&adjusts) < next)) {
+            next = TestQueueNext(&adjusts);
+        }
+        if (next == 0) {
+            next = now + TEST_STALL_MS * 1000000ULL;
+        }
+        next = (next > now) ? next - now : 0;
+        timeout.tv_sec = (time_t)(next / 1000000000ULL);
+        timeout.tv_usec = (suseconds_t)(next % 1000000000ULL / 1000);
+        FD_ZERO(&readFds);
+        FD_SET(evFd, &readFds);
+        ret = select(evFd + 1, &readFds, NULL, NULL, &timeout);
+        if (ret < 0 || (ret == 0 && held > 0 && TestQueueNext(&packets) == 0
+                        && TestQueueNext(&adjusts) == 0)) {
+            fprintf(stderr, "worker stalled: read %zu of %zu\n", pushed, sz);
+            ok = 0;
+            break;
+        }
+        if (ret > 0) {
+            ExternalTransmitBuffer_ClearEvent(0);
+        }
+    }
+
+    pthread_join(rd, NULL);
+    HostUartStatsGet(&after);
+    r->ns = dev.done - start;
+
+    TEST_CHECK(ok);
+    TEST_CHECK(!packets.overflow && !adjusts.overflow);
+    TEST_CHECK(dev.ok);
+    TEST_CHECK(after.txBytes - before.txBytes == sz);
+    TEST_CHECK(ExternalReceiveBufferSz() == 0);
+}
+
+static double TestLineRate(void)
+{
+    return 1e9 / (double)HostUartByteNs();
+}
+
+/* how long the line takes to send a whole window */
+static uint64_t TestWindowNs(void)
+{
+    return HostUartByteNs() * TEST_WINDOW;
+}
+
+static void TestReport(const char* name, size_t sz, uint64_t rttNs,
+                       const TestResult* r)
+{
+    double rate = (double)sz * 1e9 / (double)r->ns;
+
+    printf("%-8s %6zu KB %8.1f ms %8.2f MB/s %5.0f%% of line %6d waits\n",
+           name, sz / 1024, (double)rttNs / 1e6, rate / 1e6,
+           100.0 * rate / TestLineRate(), r->waits);
+}
+
+/* a round trip of a quarter of the window keeps the line busy */
+static void TestFullRate(void)
+{
+    uint64_t rtt = TestWindowNs() / 4;
+    TestResult r;
+
+    TestPass(TEST_DATA_SZ, rtt, 0, &r);
+    TestReport("line", TEST_DATA_SZ, rtt, &r);
+    TEST_CHECK((double)TEST_DATA_SZ * 1e9 / (double)r.ns >=
+               0.9 * TestLineRate());
+    TEST_CHECK(r.waits > 0);
+}
+
+/* a device that stops reading holds the client back, losing nothing */
+static void TestDevicePause(void)
+{
+    uint64_t rtt = TestWindowNs() / 4;
+    TestResult r;
+
+    TestPass(TEST_SHORT_SZ, rtt, TEST_PAUSE_EVERY, &r);
+    TestReport("pausing", TEST_SHORT_SZ, rtt, &r);
+    TEST_CHECK(r.ns >= (uint64_t)(TEST_SHORT_SZ / TEST_PAUSE_EVERY - 1) *
+                       TEST_PAUSE_MS * 1000000ULL);
+}
+
+/* past the window the client waits on the adjusts */
+static void TestLongRtt(void)
+{
+    uint64_t rtt = TestWindowNs() * 4;
+    TestResult r;
+
+    TestPass(TEST_SHORT_SZ, rtt, 0, &r);
+    TestReport("long rtt", TEST_SHORT_SZ, rtt, &r);
+    TEST_CHECK((double)TEST_SHORT_SZ * 1e9 / (double)r.ns <=
+               0.5 * TestLineRate());
+}
+
+int main(void)
+{
+    HostUartStats stats;
+    size_t i;
+
+    srand(1);
+    for (i = 0; i < TEST_DATA_SZ; i++) {
+        toDevice[i] = (byte)rand();
+    }
+
+    device = HostUartOpen(TEST_BAUD);
+    if (device < 0) {
+        perror("HostUartOpen");
+        return 1;
+    }
+    if (init_tx_rx_buffer_events() != ESP_OK) {
+        fprintf(stderr, "Couldn't set up the session buffers\n");
+        return 1;
+    }
+    init_UART();
+    if (xTaskCreate(uart_tx_task, "uart_tx_task", 4096, NULL, 2,
+                    NULL) != pdPASS ||
+        xTaskCreate(uart_rx_task, "uart_rx_task", 4096, NULL, 2,
+                    NULL) != pdPASS) {
+        fprintf(stderr, "Couldn't start the UART tasks\n");
+        return 1;
+    }
+
+    /* a session attaches, and its welcome message goes */
+    init_tx_rx_buffer(0, TXD_PIN, RXD_PIN);
+    while (ExternalTransmitBufferSz(0) > 0) {
+        byte* data;
+
+        Consume_ExternalTransmitBuffer(0, Get_ExternalTransmitBuffer(0,
+                                       &data));
+    }
+
+    printf("%d baud, window %d bytes (%.1f ms); at %d baud, %d bytes\n",
+           TEST_BAUD, TEST_WINDOW, (double)TestWindowNs() / 1e6,
+           BAUD_RATE, SSH_FLOW_WINDOW_SZ);
+    TEST_RUN(TestFullRate);
+    TEST_RUN(TestDevicePause);
+    TEST_RUN(TestLongRtt);
+
+    HostUartStatsGet(&stats);
+    TEST_CHECK(stats.rxDropped == 0);
+
+    close_tx_rx_buffer(0);
+
+    return TEST_RESULT();
+}
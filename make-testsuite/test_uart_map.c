@@ -0,0 +1,306 @@
+/* test_uart_map.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's SSH-to-UART byte map. The word at a
+ * time scan is checked against a byte at a time reference over random
+ * data, every configuration and every alignment. Random binary data is
+ * then passed through a ring buffer and the map in random pieces, as
+ * uart_tx_task takes it, and must come out as it went in, with only the
+ * bytes the newline rule adds. */
+
+#include "ring_buffer.h"
+#include "uart_map.h"
+#include "test_common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DATA_SZ 4096
+
+/* the map applied one byte at a time */
+static size_t RefApply(const uart_map_t* map, const uint8_t* in, size_t inSz,
+                       uint8_t* out)
+{
+    size_t o = 0;
+    size_t i;
+
+    for (i = 0; i < inSz; i++) {
+        memcpy(out + o, map->out[in[i]], map->len[in[i]]);
+        o += map->len[in[i]];
+    }
+    return o;
+}
+
+static size_t RefSpan(const uart_map_t* map, const uint8_t* in, size_t sz)
+{
+    size_t i;
+
+    for (i = 0; i < sz; i++) {
+        if (map->len[in[i]] != 1 || map->out[in[i]][0] != in[i]) {
+            break;
+        }
+    }
+    return i;
+}
+
+/* mostly printable text with control bytes, DEL and high bytes mixed in */
+static void FillText(uint8_t* data, size_t sz, int ctrlEvery)
+{
+    size_t i;
+
+    for (i = 0; i < sz; i++) {
+        int r = rand();
+
+        if (r % ctrlEvery == 0) {
+            static const uint8_t ctrl[] = { '\t', '\n', '\r', 0x07, 0x1B,
+                                            0x7F, 0x00, 0x1F };
+            data[i] = ctrl[(r / ctrlEvery) % sizeof(ctrl)];
+        }
+        else if (r % 13 == 0) {
+            data[i] = (uint8_t)(0x80 + r % 0x80);
+        }
+        else {
+            data[i] = (uint8_t)(0x20 + r % 0x5F);
+        }
+    }
+}
+
+static void TestConfig(void)
+{
+    uart_map_t map;
+    uint8_t out[8];
+    size_t used;
+
+    TEST_CHECK(uart_map_config(&map, UART_MAP_NL_KEEP, 0,
+                               UART_MAP_CTRL_KEEP) == 0);
+    TEST_CHECK(map.ctrlOnly);
+    TEST_CHECK(uart_map_config(&map, 99, 0, UART_MAP_CTRL_KEEP) != 0);
+    TEST_CHECK(uart_map_config(&map, UART_MAP_NL_KEEP, 0, 99) != 0);
+    TEST_CHECK(uart_map_set(&map, 'a', out, 3) != 0);
+
+    TEST_CHECK(uart_map_config(&map, UART_MAP_NL_LF_CRLF, 1,
+                               UART_MAP_CTRL_ESCAPE) == 0);
+    TEST_CHECK(uart_map_apply(&map, (const uint8_t*)"a\n\x7f\x07", 4,
+                              out, sizeof(out), &used) == 6);
+    TEST_CHECK(used == 4);
+    TEST_CHECK(memcmp(out, "a\r\n\b^G", 6) == 0);
+
+    /* an expansion that does not fit is left for the next call */
+    TEST_CHECK(uart_map_apply(&map, (const uint8_t*)"ab\n", 3,
+                              out, 3, &used) == 2);
+    TEST_CHECK(used == 2);
+
+    /* mapping a printable byte turns off the word scan */
+    TEST_CHECK(uart_map_set(&map, 'x', (const uint8_t*)"y", 1) == 0);
+    TEST_CHECK(!map.ctrlOnly);
+    TEST_CHECK(uart_map_span(&map, (const uint8_t*)"abcdefghijklmnox", 16)
+               == 15);
+}
+
+static void TestRandom(void)
+{
+    static const int nl[] = { UART_MAP_NL_KEEP, UART_MAP_NL_CR_CRLF,
+                              UART_MAP_NL_LF_CRLF, UART_MAP_NL_LF_CR };
+    static const int ctrl[] = { UART_MAP_CTRL_KEEP, UART_MAP_CTRL_DROP,
+                                UART_MAP_CTRL_ESCAPE };
+    static const int density[] = { 2, 7, 40, 1000000 };
+    static uint8_t in[TEST_DATA_SZ + 16];
+    static uint8_t out[2 * TEST_DATA_SZ];
+    static uint8_t ref[2 * TEST_DATA_SZ];
+    uart_map_t map;
+    size_t n, d, c, del, align;
+
+    srand(1);
+    for (n = 0; n < sizeof(nl) / sizeof(nl[0]); n++)
+    for (c = 0; c < sizeof(ctrl) / sizeof(ctrl[0]); c++)
+    for (del = 0; del < 2; del++)
+    for (d = 0; d < sizeof(density) / sizeof(density[0]); d++)
+    for (align = 0; align < 8; align++) {
+        size_t refSz, outSz, used, done, i;
+
+        uart_map_config(&map, nl[n], (int)del, ctrl[c]);
+        FillText(in + align, TEST_DATA_SZ, density[d]);
+        refSz = RefApply(&map, in + align, TEST_DATA_SZ, ref);
+
+        TEST_CHECK(uart_map_span(&map, in + align, TEST_DATA_SZ) ==
+                   RefSpan(&map, in + align, TEST_DATA_SZ));
+        for (i = 0; i < 64; i++) {
+            size_t at = (size_t)rand() % TEST_DATA_SZ;
+
+            TEST_CHECK(uart_map_span(&map, in + align + at,
+                                     TEST_DATA_SZ - at) ==
+                       RefSpan(&map, in + align + at, TEST_DATA_SZ - at));
+        }
+
+        /* all at once, then through a small output buffer */
+        outSz = uart_map_apply(&map, in + align, TEST_DATA_SZ,
+                               out, sizeof(out), &used);
+        TEST_CHECK(used == TEST_DATA_SZ);
+        TEST_CHECK(outSz == refSz && memcmp(out, ref, refSz) == 0);
+
+        for (i = 0, done = 0, outSz = 0; i < TEST_DATA_SZ; i += used) {
+            done = uart_map_apply(&map, in + align + i, TEST_DATA_SZ - i,
+                                  out + outSz, 7, &used);
+            outSz += done;
+            if (used == 0 && done == 0) {
+                break;
+            }
+        }
+        TEST_CHECK(outSz == refSz && memcmp(out, ref, refSz) == 0);
+    }
+}
+
+/* A control byte that passes unchanged in every word, the case that used
+ * to cost a stack frame per word. */
+static void TestLongSpan(void)
+{
+    static uint8_t in[1024 * 1024];
+    uart_map_t map;
+    size_t i;
+
+    uart_map_config(&map, UART_MAP_NL_KEEP, 0, UART_MAP_CTRL_KEEP);
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (i % 8 == 3) ? '\t' : 'a';
+    }
+    TEST_CHECK(uart_map_span(&map, in, sizeof(in)) == sizeof(in));
+
+    in[sizeof(in) - 5] = 0x7F;
+    uart_map_config(&map, UART_MAP_NL_KEEP, 1, UART_MAP_CTRL_KEEP);
+    TEST_CHECK(uart_map_span(&map, in, sizeof(in)) == sizeof(in) - 5);
+}
+
+/* Binary data through a ring in random pieces and through the map the way
+ * uart_tx_task sends it: a region the map passes whole goes as it is, any
+ * other through a small buffer. Returns the output size. */
+static size_t RoundTrip(const uart_map_t* map, const uint8_t* in,
+                        size_t inSz, uint8_t* out)
+{
+    static uint8_t storage[512];
+    ring_buffer_t rb;
+    size_t written = 0;
+    size_t outSz = 0;
+
+    ring_buffer_init(&rb, storage, sizeof(storage));
+    while (written < inSz || ring_buffer_used(&rb) > 0) {
+        size_t piece = 1 + (size_t)rand() % sizeof(storage);
+        const uint8_t* data;
+        size_t dataSz;
+        size_t done = 0;
+
+        if (piece > inSz - written) {
+            piece = inSz - written;
+        }
+        written += ring_buffer_write(&rb, in + written, piece);
+
+        dataSz = ring_buffer_peek(&rb, &data);
+        if (uart_map_span(map, data, dataSz) == dataSz) {
+            memcpy(out + outSz, data, dataSz);
+            outSz += dataSz;
+            done = dataSz;
+        }
+        while (done < dataSz) {
+            uint8_t mapped[64];
+            size_t used = 0;
+            size_t sz = uart_map_apply(map, data + done, dataSz - done,
+                                       mapped, sizeof(mapped), &used);
+
+            memcpy(out + outSz, mapped, sz);
+            outSz += sz;
+            done += used;
+        }
+        ring_buffer_consume(&rb, dataSz);
+    }
+    return outSz;
+}
+
+/* Drop the byte next to each of the newline rule's, before it for
+ * UART_MAP_NL_LF_CRLF and after it for UART_MAP_NL_CR_CRLF: what the map
+ * added. Returns the size left. */
+static size_t RemoveAdded(uint8_t* data, size_t sz, int newline)
+{
+    size_t o = 0;
+    size_t i;
+
+    for (i = 0; i < sz; i++) {
+        if (newline == UART_MAP_NL_LF_CRLF && i + 1 < sz &&
+                data[i + 1] == '\n') {
+            continue;
+        }
+        data[o++] = data[i];
+        if (newline == UART_MAP_NL_CR_CRLF && data[i] == '\r') {
+            i++;
+        }
+    }
+    return o;
+}
+
+static size_t CountByte(const uint8_t* data, size_t sz, uint8_t b)
+{
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < sz; i++) {
+        n += (data[i] == b);
+    }
+    return n;
+}
+
+static void TestRoundTrip(void)
+{
+    static uint8_t in[256 * 1024];
+    static uint8_t out[2 * sizeof(in)];
+    uart_map_t map;
+    size_t outSz;
+    size_t i;
+
+    srand(3);
+    for (i = 0; i < sizeof(in); i++) {
+        in[i] = (uint8_t)rand();
+    }
+
+    /* with translation off every byte value passes untouched */
+    uart_map_config(&map, UART_MAP_NL_KEEP, 0, UART_MAP_CTRL_KEEP);
+    outSz = RoundTrip(&map, in, sizeof(in), out);
+    TEST_CHECK(outSz == sizeof(in) && memcmp(out, in, sizeof(in)) == 0);
+
+    /* CR to CR LF only adds an LF after each CR */
+    uart_map_config(&map, UART_MAP_NL_CR_CRLF, 0, UART_MAP_CTRL_KEEP);
+    outSz = RoundTrip(&map, in, sizeof(in), out);
+    TEST_CHECK(outSz == sizeof(in) + CountByte(in, sizeof(in), '\r'));
+    outSz = RemoveAdded(out, outSz, UART_MAP_NL_CR_CRLF);
+    TEST_CHECK(outSz == sizeof(in) && memcmp(out, in, sizeof(in)) == 0);
+
+    /* LF to CR LF only adds a CR before each LF */
+    uart_map_config(&map, UART_MAP_NL_LF_CRLF, 0, UART_MAP_CTRL_KEEP);
+    outSz = RoundTrip(&map, in, sizeof(in), out);
+    TEST_CHECK(outSz == sizeof(in) + CountByte(in, sizeof(in), '\n'));
+    outSz = RemoveAdded(out, outSz, UART_MAP_NL_LF_CRLF);
+    TEST_CHECK(outSz == sizeof(in) && memcmp(out, in, sizeof(in)) == 0);
+}
+
+int main(void)
+{
+    TEST_RUN(TestConfig);
+    TEST_RUN(TestRandom);
+    TEST_RUN(TestLongSpan);
+    TEST_RUN(TestRoundTrip);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,306 @@
+/* test_uart_worker.c
+ *
+ * Copyright (C) 2014-2024 wolfSSL Inc.
+ *
+ * This file is part of wolfSSH.
+ *
+ * wolfSSH is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * wolfSSH is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with wolfSSH.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host test for the ESP32 server's UART path as its session worker drives
+ * it. uart_helper.c and tx_rx_buffer.c run over the FreeRTOS and UART
+ * driver stand-ins in host/, with the UART on a pseudo terminal and two
+ * threads playing the device on the other end. The test's worker loop is
+ * server_worker's without wolfSSH and the socket: it sleeps in select()
+ * on the session eventfd, takes what the Transmit ring holds, and puts
+ * client data in the Receive ring only as far as it has room, asking
+ * with ExternalReceiveBuffer_WantSpace to be woken when it has more.
+ *
+ * 1 MB of random bytes goes each way, in random pieces, one way at a time
+ * and then both at once, and must arrive byte for byte. A wakeup that is
+ * lost shows as the worker waiting a second with nothing to do. */
+
+#include "host_uart.h"
+#include "ssh_server_config.h"
+#include "test_common.h"
+#include "tx_rx_buffer.h"
+#include "uart_helper.h"
+
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <unistd.h>
+
+#if SSH_UART_MAP_NEWLINE != 0 || SSH_UART_MAP_DEL != 0 || \
+    SSH_UART_MAP_CTRL != 0
+    #error build with the SSH_UART_MAP_* options off, for binary data
+#endif
+
+#define TEST_DATA_SZ   (1024 * 1024)
+/* how long a side may wait with nothing happening, in ms */
+#define TEST_STALL_MS  1000
+/* the device keeps no more than this unread by the worker, as an SSH
+ * client keeps within its window; the Transmit ring drops the rest */
+#define TEST_WINDOW    (EXT_TX_BUF_MAX_SZ / 2)
+
+static byte toDevice[TEST_DATA_SZ];
+static byte fromDevice[TEST_DATA_SZ];
+static int device = -1;
+
+/* how far each side has got, for the other to see */
+static atomic_size_t deviceGot;
+static atomic_size_t workerGot;
+
+typedef struct TestSide {
+    size_t sz;     /* bytes to pass */
+    int ok;        /* all arrived, in order */
+} TestSide;
+
+/* the device end reading what the worker sent, in whatever pieces the
+ * pty hands over */
+static void* TestDeviceRead(void* arg)
+{
+    TestSide* side = (TestSide*)arg;
+    byte buf[4096];
+    size_t got = 0;
+
+    side->ok = 1;
+    while (got < side->sz) {
+        struct pollfd pfd = { device, POLLIN, 0 };
+        ssize_t sz;
+
+        if (poll(&pfd, 1, TEST_STALL_MS) <= 0) {
+            fprintf(stderr, "device read stalled at %zu\n", got);
+            side->ok = 0;
+            break;
+        }
+        sz = read(device, buf, sizeof(buf));
+        if (sz <= 0 || got + (size_t)sz > side->sz ||
+            memcmp(buf, toDevice + got, (size_t)sz) != 0) {
+            fprintf(stderr, "device read wrong data at %zu\n", got);
+            side->ok = 0;
+            break;
+        }
+        got += (size_t)sz;
+        atomic_store(&deviceGot, got);
+    }
+    return NULL;
+}
+
+/* the device end sending, in random pieces, within its window */
+static void* TestDeviceWrite(void* arg)
+{
+    TestSide* side = (TestSide*)arg;
+    unsigned int seed = 2;
+    size_t sent = 0;
+    uint64_t since = TestNow();
+
+    side->ok = 1;
+    while (sent < side->sz) {
+        size_t sz = 1 + (size_t)rand_r(&seed) % 512;
+        size_t open = TEST_WINDOW - (sent - atomic_load(&workerGot));
+
+        if (sz > side->sz - sent) {
+            sz = side->sz - sent;
+        }
+        if (sz > open) {
+            if (TestNow() - since > TEST_STALL_MS * 1000000ULL) {
+                fprintf(stderr, "device write stalled at %zu\n", sent);
+                side->ok = 0;
+                break;
+            }
+            usleep(50);
+            continue;
+        }
+        if (write(device, fromDevice + sent, sz) != (ssize_t)sz) {
+            side->ok = 0;
+            break;
+        }
+        sent += sz;
+        since = TestNow();
+    }
+    return NULL;
+}
+
+/*
+ * Pass toSz bytes to the device and fromSz bytes from it, with the
+ * worker on this thread. Returns the number of times the worker found the
+ * Receive ring full and waited to be told it had drained.
+ */
+static int TestPass(size_t toSz, size_t fromSz)
+{
+    int evFd = ExternalTransmitBuffer_EventFd(0);
+    TestSide reader = { toSz, 0 };
+    TestSide writer = { fromSz, 0 };
+    pthread_t rd;
+    pthread_t wr;
+    size_t pushed = 0;
+    size_t got = 0;
+    int waits = 0;
+    int ok = 1;
+
+    atomic_store(&deviceGot, 0);
+    atomic_store(&workerGot, 0);
+    TEST_CHECK(pthread_create(&rd, NULL, TestDeviceRead, &reader) == 0);
+    TEST_CHECK(pthread_create(&wr, NULL, TestDeviceWrite, &writer) == 0);
+
+    while (ok && (pushed < toSz || got < fromSz)) {
+        struct timeval timeout = { 0, TEST_STALL_MS * 1000 };
+        fd_set readFds;
+        byte* data;
+        int sz;
+
+        /* client data, as far as there is room, as server_worker_read_ssh
+         * takes it: ask, then look again, so a drain is not missed */
+        while (pushed < toSz) {
+            int room = ExternalReceiveBufferFree(0);
+            int piece = 1 + rand() % EXT_RX_BUF_MAX_SZ;
+
+            if (room <= 0) {
+                ExternalReceiveBuffer_WantSpace(0);
+                room = ExternalReceiveBufferFree(0);
+                if (room <= 0) {
+                    waits++;
+                    break;
+                }
+            }
+            if (piece > room) {
+                piece = room;
+            }
+            if ((size_t)piece > toSz - pushed) {
+                piece = (int)(toSz - pushed);
+            }
+            if (Set_ExternalReceiveBuffer(0, toDevice + pushed,
+                                          piece) != piece) {
+                ok = 0;
+                break;
+            }
+            pushed += (size_t)piece;
+        }
+        if (!ok || (pushed == toSz && got == fromSz)) {
+            break;
+        }
+
+        /* then sleep until the UART side has something, or room */
+        FD_ZERO(&readFds);
+        FD_SET(evFd, &readFds);
+        if (select(evFd + 1, &readFds, NULL, NULL, &timeout) <= 0) {
+            fprintf(stderr, "worker stalled: sent %zu of %zu, got %zu of "
+                    "%zu, device has %zu\n", pushed, toSz, got, fromSz,
+                    atomic_load(&deviceGot));
+            ok = 0;
+            break;
+        }
+        ExternalTransmitBuffer_ClearEvent(0);
+        while ((sz = Get_ExternalTransmitBuffer(0, &data)) > 0) {
+            if (got + (size_t)sz > fromSz ||
+                memcmp(data, fromDevice + got, (size_t)sz) != 0) {
+                fprintf(stderr, "worker got wrong data at %zu\n", got);
+                ok = 0;
+                break;
+            }
+            Consume_ExternalTransmitBuffer(0, sz);
+            got += (size_t)sz;
+            atomic_store(&workerGot, got);
+        }
+    }
+
+    pthread_join(rd, NULL);
+    pthread_join(wr, NULL);
+    TEST_CHECK(ok);
+    TEST_CHECK(reader.ok && atomic_load(&deviceGot) == toSz);
+    TEST_CHECK(writer.ok && got == fromSz);
+    TEST_CHECK(ExternalReceiveBufferSz() == 0);
+    TEST_CHECK(ExternalTransmitBufferSz(0) == 0);
+
+    return waits;
+}
+
+/* only client data: the only wakeups are for room in the Receive ring */
+static void TestToDevice(void)
+{
+    int waits = TestPass(TEST_DATA_SZ, 0);
+
+    printf("to the device: waited for room %d times\n", waits);
+    TEST_CHECK(waits > 0);
+}
+
+static void TestFromDevice(void)
+{
+    TestPass(0, TEST_DATA_SZ);
+}
+
+static void TestBoth(void)
+{
+    int waits = TestPass(TEST_DATA_SZ, TEST_DATA_SZ);
+
+    printf("both ways: waited for room %d times\n", waits);
+}
+
+int main(void)
+{
+    HostUartStats stats;
+    uint64_t start;
+    size_t i;
+
+    srand(1);
+    for (i = 0; i < TEST_DATA_SZ; i++) {
+        toDevice[i] = (byte)rand();
+        fromDevice[i] = (byte)rand();
+    }
+
+    device = HostUartOpen(0);
+    if (device < 0) {
+        perror("HostUartOpen");
+        return 1;
+    }
+    if (init_tx_rx_buffer_events() != ESP_OK) {
+        fprintf(stderr, "Couldn't set up the session buffers\n");
+        return 1;
+    }
+    init_UART();
+    if (xTaskCreate(uart_tx_task, "uart_tx_task", 4096, NULL, 2,
+                    NULL) != pdPASS ||
+        xTaskCreate(uart_rx_task, "uart_rx_task", 4096, NULL, 2,
+                    NULL) != pdPASS) {
+        fprintf(stderr, "Couldn't start the UART tasks\n");
+        return 1;
+    }
+
+    /* a session attaches, and its welcome message goes */
+    init_tx_rx_buffer(0, TXD_PIN, RXD_PIN);
+    while (ExternalTransmitBufferSz(0) > 0) {
+        byte* data;
+
+        Consume_ExternalTransmitBuffer(0, Get_ExternalTransmitBuffer(0,
+                                       &data));
+    }
+
+    start = TestNow();
+    TEST_RUN(TestToDevice);
+    TEST_RUN(TestFromDevice);
+    TEST_RUN(TestBoth);
+    printf("4 MB in %.2f s\n", (double)(TestNow() - start) / 1e9);
+
+    /* the device never outran the driver */
+    HostUartStatsGet(&stats);
+    TEST_CHECK(stats.rxDropped == 0 && stats.fullEvents == 0);
+
+    close_tx_rx_buffer(0);
+
+    return TEST_RESULT();
+}
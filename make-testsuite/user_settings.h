@@ -17,6 +17,9 @@
     #define SP_WORD_SIZE 64
 #elif defined(MATH_CHOICE_FAST)
     #define USE_FAST_MATH
+    /* the fixed-point ECC cache the ESP32 server uses, which
+     * bench-handshake -c compares against */
+    #define FP_ECC
 #endif
 
 #define WOLFSSL_KEY_GEN
@@ -31,6 +34,8 @@
 #define WC_RSA_BLINDING
 #define HAVE_AESGCM
 #define HAVE_AESCCM
+#define WOLFSSL_AES_COUNTER
+#define WOLFSSL_AES_DIRECT
 #define WOLFSSL_SHA384
 #define WOLFSSL_SHA512
 
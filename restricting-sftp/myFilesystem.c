@@ -23,54 +23,1252 @@
 #include <wolfssh/log.h>
 #include <stdlib.h>
 #include <stdio.h>
-#include "system/fs/sys_fs.h"
+#ifdef MY_FILESYSTEM_POSIX
+    #include <errno.h>
+    #include <time.h>
+    #include <string.h>
+    #ifdef MY_FS_MMAP
+        #include <sys/mman.h>
+    #endif
+#else
+    #include "system/fs/sys_fs.h"
+#endif
+
+#ifdef MY_FILESYSTEM_POSIX
+#ifdef MY_FS_PREAD
+ssize_t MY_FS_PREAD(int fd, void* buf, size_t sz, off_t ofst);
+#else
+#define MY_FS_PREAD pread
+#endif
+#ifdef MY_FS_FADVISE
+int MY_FS_FADVISE(int fd, off_t ofst, off_t len, int advice);
+#else
+#define MY_FS_FADVISE posix_fadvise
+#endif
+#endif
 
 #ifdef WOLFSSH_USER_FILESYSTEM
+/*******************************************************************************
+ Open file table
+
+ Every file opened through this layer has an entry, found by its handle.
+ The handle is hashed to a slot, with linear probing past slots in use, so
+ a lookup stays a step or two with MY_FS_MAX_OPEN raised for many open
+ files. A slot freed in the middle of a probe run stays "used" until the
+ run behind it is empty.
+
+ With SYS_FS there is no positional read or write, so the entry remembers
+ where the handle's file pointer is; wPread and wPwrite skip the seek when
+ the request starts there, which is the usual case for a sequential
+ transfer. POSIX uses pread and pwrite and never moves the file pointer.
+
+ The entry also keeps the file's attributes once they have been asked for
+ by handle, updated by writes through it, so FSTAT does not go to the media.
+
+ The table is not locked, the Harmony example runs all sessions from one
+ task.
+*******************************************************************************/
+
+typedef struct MY_FS_FILE {
+    WFD fd;
+    word64 pos;      /* file pointer, when posValid */
+    word32 pathHash; /* to drop cached attributes when it is written */
+    byte allow;      /* MY_FS_OP_* for this file, from the session policy */
+    byte inUse;
+    byte used;       /* in use since the probe run was last empty */
+    byte posValid;
+    byte attrValid;
+    WSTAT_T attr;    /* when attrValid */
+#if MY_FS_READ_AHEAD_SZ > 0
+    byte seqRun;     /* reads in a row that started where the last ended */
+    word64 nextOfst; /* where the last wPread ended */
+    word64 raOfst;   /* file offset of raBuf[0] */
+    word32 raSz;     /* bytes held in raBuf, 0 when empty */
+    byte* raBuf;
+#endif
+#if MY_FS_WRITE_BEHIND_SZ > 0
+    int wbErr;       /* a failed write-behind, for the next call */
+    word64 wbOfst;   /* file offset of wbBuf[0] */
+    word32 wbSz;     /* bytes waiting in wbBuf */
+    byte* wbBuf;
+#endif
+#ifdef MY_FS_MMAP
+    word64 mapSz;    /* bytes mapped at map, 0 when not mapped */
+    byte* map;
+#endif
+#ifdef MY_FS_ADVISE
+    word64 advNext;  /* where the last media read ended */
+    word64 advEnd;   /* the kernel has been asked to read up to here */
+#endif
+} MY_FS_FILE;
+
+static MY_FS_FILE openFiles[MY_FS_MAX_OPEN];
+
+#ifdef MY_FILESYSTEM_STATS
+static MY_FS_STATS fsStats;
+#define MY_FS_COUNT(x) (fsStats.x++)
+
+void wFsStatsGet(MY_FS_STATS* stats)
+{
+    WMEMCPY(stats, &fsStats, sizeof(MY_FS_STATS));
+}
+
+void wFsStatsReset(void)
+{
+    WMEMSET(&fsStats, 0, sizeof(MY_FS_STATS));
+}
+#else
+#define MY_FS_COUNT(x)
+#endif
+
+
+/* FNV-1a */
+static word32 myFsPathHash(const char* path)
+{
+    word32 hash = 2166136261U;
+
+    while (*path != '\0') {
+        hash ^= (byte)*path++;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+
+/* first slot to probe for a handle */
+static int myFsFileSlot(WFD fd)
+{
+    return (int)(((word32)fd * 2654435761U) % MY_FS_MAX_OPEN);
+}
+
+
+static MY_FS_FILE* myFsFileFind(WFD fd)
+{
+    int idx = myFsFileSlot(fd);
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN && openFiles[idx].used; i++) {
+        if (openFiles[idx].inUse && openFiles[idx].fd == fd) {
+            return &openFiles[idx];
+        }
+        idx = (idx + 1) % MY_FS_MAX_OPEN;
+    }
+    return NULL;
+}
+
+
+/* 1 if myFsFileAdd has a free slot. An open that writes checks first, so
+ * that a full table refuses it before it creates or truncates anything */
+static int myFsFileRoom(const char* path)
+{
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        if (!openFiles[i].inUse) {
+            return 1;
+        }
+    }
+    WLOG(WS_LOG_SFTP, "Open file table full, not opening %s for writing",
+            path);
+    return 0;
+}
+
+
+/* start tracking a newly opened file, the file pointer is at 0. Returns
+ * -1 if the table is full; the caller refuses an open that writes, as a
+ * write needs the entry, and one that only reads goes on untracked */
+static int myFsFileAdd(WFD fd, const char* path, byte allow)
+{
+    int idx = myFsFileSlot(fd);
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        if (!openFiles[idx].inUse) {
+            WMEMSET(&openFiles[idx], 0, sizeof(MY_FS_FILE));
+            openFiles[idx].fd = fd;
+            openFiles[idx].inUse = 1;
+            openFiles[idx].used = 1;
+            openFiles[idx].posValid = 1;
+            openFiles[idx].pathHash = myFsPathHash(path);
+            openFiles[idx].allow = allow;
+            return 0;
+        }
+        idx = (idx + 1) % MY_FS_MAX_OPEN;
+    }
+    WLOG(WS_LOG_SFTP, "Open file table full for %s", path);
+    return -1;
+}
+
+
+/* a free slot with a never used slot after it ends no probe run */
+static void myFsFileUnused(int idx)
+{
+    int next = (idx + 1) % MY_FS_MAX_OPEN;
+
+    while (openFiles[idx].used && !openFiles[idx].inUse &&
+            !openFiles[next].used) {
+        openFiles[idx].used = 0;
+        next = idx;
+        idx = (idx + MY_FS_MAX_OPEN - 1) % MY_FS_MAX_OPEN;
+    }
+}
+
+
+static void myFsFileRemove(WFD fd)
+{
+    MY_FS_FILE* file = myFsFileFind(fd);
+
+    if (file != NULL) {
+#if MY_FS_READ_AHEAD_SZ > 0
+        if (file->raBuf != NULL) {
+            WFREE(file->raBuf, NULL, DYNTYPE_SFTP);
+            file->raBuf = NULL;
+        }
+#endif
+#if MY_FS_WRITE_BEHIND_SZ > 0
+        if (file->wbBuf != NULL) {
+            WFREE(file->wbBuf, NULL, DYNTYPE_SFTP);
+            file->wbBuf = NULL;
+        }
+#endif
+#ifdef MY_FS_MMAP
+        if (file->mapSz > 0) {
+            munmap(file->map, (size_t)file->mapSz);
+            file->mapSz = 0;
+        }
+#endif
+        file->inUse = 0;
+        myFsFileUnused((int)(file - openFiles));
+    }
+}
+
+
+/* forget the attributes of open files with this path hash, except keep */
+static void myFsAttrDrop(word32 hash, const MY_FS_FILE* keep)
+{
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        if (openFiles[i].pathHash == hash && &openFiles[i] != keep) {
+            openFiles[i].attrValid = 0;
+        }
+    }
+}
+
+
+/* keep the attributes current after a write through this file that ended
+ * at end. SYS_FS sets the modified time itself when the file is closed. */
+static void myFsAttrWrote(MY_FS_FILE* file, word64 end)
+{
+    if (file->attrValid) {
+#ifdef MY_FILESYSTEM_POSIX
+        if ((word64)file->attr.st_size < end) {
+            file->attr.st_size = (off_t)end;
+        }
+        file->attr.st_mtime = time(NULL);
+#else
+        if ((word64)file->attr.fsize < end) {
+            file->attr.fsize = (word32)end;
+        }
+#endif
+    }
+}
+
+
+/*******************************************************************************
+ Attribute cache
+
+ Directory walks stat every name, often more than once. Up to
+ MY_FS_STAT_CACHE_SZ successful wStat results are kept, by path. The path
+ hash picks a set of MY_FS_STAT_WAYS entries, and the least recently used
+ one in the set is replaced, so a lookup costs the same however large the
+ cache is made. Up to 16 entries are one set, a plain LRU. Every operation in this layer that
+ changes a file or directory drops what it may have changed; changes made
+ to the media by other means need a call to wFsCacheFlush.
+*******************************************************************************/
+
+#if MY_FS_STAT_CACHE_SZ > 0
+#if MY_FS_STAT_CACHE_SZ < 16
+    #define MY_FS_STAT_WAYS MY_FS_STAT_CACHE_SZ
+#else
+    #define MY_FS_STAT_WAYS 16
+#endif
+#define MY_FS_STAT_SETS (MY_FS_STAT_CACHE_SZ / MY_FS_STAT_WAYS)
+
+typedef struct MY_FS_STAT_ENTRY {
+    word32 hash;
+    word32 lastUse;  /* 0 when empty */
+    WSTAT_T stats;
+    char path[MY_FS_STAT_PATH_SZ];
+} MY_FS_STAT_ENTRY;
+
+static MY_FS_STAT_ENTRY statCache[MY_FS_STAT_SETS][MY_FS_STAT_WAYS];
+static word32 statCacheTick;
+
+
+static MY_FS_STAT_ENTRY* myFsStatFind(const char* path, word32 hash)
+{
+    MY_FS_STAT_ENTRY* set = statCache[hash % MY_FS_STAT_SETS];
+    int i;
+
+    for (i = 0; i < MY_FS_STAT_WAYS; i++) {
+        if (set[i].lastUse != 0 && set[i].hash == hash &&
+                WSTRCMP(set[i].path, path) == 0) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void myFsStatStore(const char* path, word32 hash,
+        const WSTAT_T* stats)
+{
+    MY_FS_STAT_ENTRY* set = statCache[hash % MY_FS_STAT_SETS];
+    MY_FS_STAT_ENTRY* entry = &set[0];
+    word32 pathSz = (word32)WSTRLEN(path);
+    int i;
+
+    if (pathSz >= MY_FS_STAT_PATH_SZ) {
+        return;
+    }
+
+    /* an empty slot has lastUse 0, so it is picked first */
+    for (i = 1; i < MY_FS_STAT_WAYS; i++) {
+        if (set[i].lastUse < entry->lastUse) {
+            entry = &set[i];
+        }
+    }
+
+    entry->hash = hash;
+    entry->lastUse = ++statCacheTick;
+    WMEMCPY(&entry->stats, stats, sizeof(WSTAT_T));
+    WMEMCPY(entry->path, path, pathSz + 1);
+}
+
+
+/* drop every entry with this hash; a collision only costs a re-stat */
+static void myFsStatDropHash(word32 hash)
+{
+    MY_FS_STAT_ENTRY* set = statCache[hash % MY_FS_STAT_SETS];
+    int i;
+
+    for (i = 0; i < MY_FS_STAT_WAYS; i++) {
+        if (set[i].hash == hash) {
+            set[i].lastUse = 0;
+        }
+    }
+}
+#else
+#define myFsStatDropHash(hash) WOLFSSH_UNUSED(hash)
+#endif /* MY_FS_STAT_CACHE_SZ > 0 */
+
+#ifndef MY_FILESYSTEM_POSIX
+static char mountPoint[255];
+static byte mountPointSet = 0;
+#endif
+
+
+static void myFsStatDrop(const char* path)
+{
+    word32 hash;
+
+    if (path != NULL) {
+        hash = myFsPathHash(path);
+        myFsStatDropHash(hash);
+        myFsAttrDrop(hash, NULL);
+    }
+}
+
+
+void wFsCacheFlush(void)
+{
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        openFiles[i].attrValid = 0;
+#if MY_FS_READ_AHEAD_SZ > 0
+        openFiles[i].raSz = 0;
+#endif
+    }
+#if MY_FS_STAT_CACHE_SZ > 0
+    WMEMSET(statCache, 0, sizeof(statCache));
+    statCacheTick = 0;
+#endif
+#ifndef MY_FILESYSTEM_POSIX
+    mountPointSet = 0;
+#endif
+}
+
+
+#ifdef MY_FILESYSTEM_POSIX
+/* without _FILE_OFFSET_BITS=64 a 32-bit system has a 32-bit off_t */
+#define MY_FS_OFST_OK(o) (sizeof(off_t) >= 8 || (o) <= 0x7FFFFFFFUL)
+#endif
+
+/* SFTP offsets come as two 32-bit halves, low first */
+static word64 myFsOffset(const unsigned int* shortOffset)
+{
+    return ((word64)shortOffset[1] << 32) | (word64)shortOffset[0];
+}
+
+
+#ifndef MY_FILESYSTEM_POSIX
+/* record where the file pointer is after a read or write of ret bytes
+ * starting at pos; on error its position is unknown */
+static void myFsFileMoved(MY_FS_FILE* file, word64 pos, int ret)
+{
+    if (file != NULL) {
+        if (ret >= 0) {
+            file->pos = pos + (word64)ret;
+            file->posValid = 1;
+        }
+        else {
+            file->posValid = 0;
+        }
+    }
+}
+
+
+/* move the file pointer to ofst unless it is already there.
+ * returns 0 on success */
+static int myFsFileSeek(MY_FS_FILE* file, WFD fd, word64 ofst)
+{
+    if (file != NULL && file->posValid && file->pos == ofst) {
+        MY_FS_COUNT(seeksSkipped);
+        return 0;
+    }
+
+    /* SYS_FS seeks take a signed 32-bit offset */
+    if (ofst > 0x7FFFFFFFUL) {
+        WLOG(WS_LOG_SFTP, "Offset past what SYS_FS can seek to");
+        return -1;
+    }
+
+    MY_FS_COUNT(seeks);
+    if (SYS_FS_FileSeek(fd, (int32_t)ofst, SYS_FS_SEEK_SET) == -1) {
+        if (file != NULL) {
+            file->posValid = 0;
+        }
+        return -1;
+    }
+    return 0;
+}
+#endif /* !MY_FILESYSTEM_POSIX */
+
+
+#ifdef MY_FS_ADVISE
+/* ask the kernel to read the file from ofst up to end in the background,
+ * past what it has already been asked for */
+static void myFsAdviseTo(MY_FS_FILE* file, WFD fd, word64 ofst, word64 end)
+{
+    if (file->advEnd > ofst) {
+        ofst = file->advEnd;
+    }
+    if (end > ofst && MY_FS_OFST_OK(end)) {
+        MY_FS_COUNT(advises);
+        (void)MY_FS_FADVISE(fd, (off_t)ofst, (off_t)(end - ofst),
+                POSIX_FADV_WILLNEED);
+        file->advEnd = end;
+    }
+}
+
+
+/* Reads that follow on from the last keep the kernel reading up to
+ * MY_FS_ADVISE_SZ bytes past them, topped up once half of that is used.
+ * The kernel fetches the pages while this task sends the reply, so the next
+ * reads come from the page cache. Any other read stops it. */
+static void myFsAdvise(MY_FS_FILE* file, WFD fd, word64 ofst, int ret)
+{
+    word64 end;
+
+    if (file == NULL || ret <= 0) {
+        return;
+    }
+
+    end = ofst + (word64)ret;
+    if (ofst != file->advNext) {
+        file->advEnd = 0;
+    }
+    else if (end + MY_FS_ADVISE_SZ / 2 > file->advEnd) {
+        myFsAdviseTo(file, fd, end, end + MY_FS_ADVISE_SZ);
+    }
+    file->advNext = end;
+}
+#endif /* MY_FS_ADVISE */
+
+
+/* one read of sz bytes at ofst from the media */
+static int myFsRead(MY_FS_FILE* file, WFD fd, byte* buf, word32 sz,
+        word64 ofst)
+{
+    int ret;
+
+#ifdef MY_FILESYSTEM_POSIX
+#ifndef MY_FS_ADVISE
+    WOLFSSH_UNUSED(file);
+#endif
+    if (!MY_FS_OFST_OK(ofst)) {
+        return -1;
+    }
+    MY_FS_COUNT(reads);
+    ret = (int)MY_FS_PREAD(fd, buf, sz, (off_t)ofst);
+#ifdef MY_FS_ADVISE
+    myFsAdvise(file, fd, ofst, ret);
+#endif
+#else
+    ret = myFsFileSeek(file, fd, ofst);
+    if (ret != -1) {
+        MY_FS_COUNT(reads);
+        ret = (int)SYS_FS_FileRead(fd, buf, sz);
+        myFsFileMoved(file, ofst, ret);
+    }
+#endif
+    return ret;
+}
+
+
+/* one write of sz bytes at ofst to the media */
+static int myFsWrite(MY_FS_FILE* file, WFD fd, const byte* buf, word32 sz,
+        word64 ofst)
+{
+    int ret;
+
+#ifdef MY_FILESYSTEM_POSIX
+    WOLFSSH_UNUSED(file);
+    if (!MY_FS_OFST_OK(ofst)) {
+        return -1;
+    }
+    MY_FS_COUNT(writes);
+    ret = (int)pwrite(fd, buf, sz, (off_t)ofst);
+#else
+    ret = myFsFileSeek(file, fd, ofst);
+    if (ret != -1) {
+        MY_FS_COUNT(writes);
+        ret = (int)SYS_FS_FileWrite(fd, buf, sz);
+        myFsFileMoved(file, ofst, ret);
+    }
+#endif
+    return ret;
+}
+
+
+/*******************************************************************************
+ Write-behind
+
+ An upload is a run of wPwrite calls, each following on from the last and
+ often not a whole sector, which flash media handles slowly. With
+ MY_FS_WRITE_BEHIND_SZ set they are gathered in a per file buffer that is
+ written out when it reaches a multiple of MY_FS_WRITE_BEHIND_SZ in the
+ file, so after the first every media write is a whole aligned block.
+
+ The buffer is also written out when a write does not follow on from it,
+ before any read or stat of the file, on WFFLUSH and on close. A failure
+ is returned by the call that caused the write, or when that was a stat,
+ by the next write or close of the file.
+*******************************************************************************/
+#if MY_FS_WRITE_BEHIND_SZ > 0
+/* open files with bytes waiting, so a read can skip looking for them */
+static int wbHeld = 0;
+
+/* write out what is waiting. returns 0 on success */
+static int myFsWriteBehindFlush(MY_FS_FILE* file, WFD fd)
+{
+    int ret = 0;
+
+    if (file->wbSz > 0) {
+        wbHeld--;
+        ret = myFsWrite(file, fd, file->wbBuf, file->wbSz, file->wbOfst);
+        ret = (ret == (int)file->wbSz) ? 0 : -1;
+        if (ret != 0) {
+            WLOG(WS_LOG_SFTP, "Write-behind of %u bytes failed",
+                    file->wbSz);
+        }
+        file->wbSz = 0;
+    }
+    return ret;
+}
+
+
+/* flush every open file with this path hash, keeping any error */
+static void myFsWriteBehindSync(word32 hash)
+{
+    int i;
+
+    for (i = 0; wbHeld > 0 && i < MY_FS_MAX_OPEN; i++) {
+        if (openFiles[i].inUse && openFiles[i].wbSz > 0 &&
+                openFiles[i].pathHash == hash &&
+                myFsWriteBehindFlush(&openFiles[i], openFiles[i].fd) != 0) {
+            openFiles[i].wbErr = -1;
+        }
+    }
+}
+
+
+/* before a read through file: write out its own bytes, failing the read
+ * if that fails, then those of other handles on the same path. Returns 0
+ * on success */
+static int myFsWriteBehindRead(MY_FS_FILE* file, WFD fd)
+{
+    if (file == NULL || wbHeld == 0) {
+        return 0;
+    }
+    if (myFsWriteBehindFlush(file, fd) != 0) {
+        return -1;
+    }
+    myFsWriteBehindSync(file->pathHash);
+    return 0;
+}
+
+
+/* a failure from an earlier write-behind, cleared once reported */
+static int myFsWriteBehindErr(MY_FS_FILE* file)
+{
+    int ret = file->wbErr;
+
+    file->wbErr = 0;
+    return ret;
+}
+
+
+/* gather sz bytes at ofst, returns sz or -1. A write of a block or more
+ * is not gathered */
+static int myFsWriteBehind(MY_FS_FILE* file, WFD fd, const byte* buf,
+        word32 sz, word64 ofst)
+{
+    word32 limit;
+    word32 n;
+    word32 done = 0;
+
+    if (myFsWriteBehindErr(file) != 0) {
+        return -1;
+    }
+
+    /* a large write goes straight out, after what is held back */
+    if (sz >= MY_FS_WRITE_BEHIND_SZ) {
+        if (myFsWriteBehindFlush(file, fd) != 0) {
+            return -1;
+        }
+        return myFsWrite(file, fd, buf, sz, ofst);
+    }
+
+    if (file->wbSz > 0 && ofst != file->wbOfst + file->wbSz) {
+        if (myFsWriteBehindFlush(file, fd) != 0) {
+            return -1;
+        }
+    }
+
+    if (file->wbBuf == NULL) {
+        file->wbBuf = (byte*)WMALLOC(MY_FS_WRITE_BEHIND_SZ, NULL,
+                DYNTYPE_SFTP);
+        if (file->wbBuf == NULL) {
+            return myFsWrite(file, fd, buf, sz, ofst);
+        }
+    }
+
+    while (done < sz) {
+        if (file->wbSz == 0) {
+            file->wbOfst = ofst + done;
+            wbHeld++;
+        }
+
+        /* the buffer ends at the next block boundary in the file */
+        limit = MY_FS_WRITE_BEHIND_SZ -
+                (word32)(file->wbOfst % MY_FS_WRITE_BEHIND_SZ);
+        n = limit - file->wbSz;
+        if (n > sz - done) {
+            n = sz - done;
+        }
+        WMEMCPY(file->wbBuf + file->wbSz, buf + done, n);
+        file->wbSz += n;
+        done += n;
+
+        if (file->wbSz == limit && myFsWriteBehindFlush(file, fd) != 0) {
+            return -1;
+        }
+    }
+
+    MY_FS_COUNT(writesBuffered);
+    return (int)sz;
+}
+
+
+/* write out what a file holds back, for close and WFFLUSH. Returns 0 on
+ * success */
+static int myFsWriteBehindClose(WFD fd)
+{
+    MY_FS_FILE* file = myFsFileFind(fd);
+    int ret = 0;
+
+    if (file != NULL) {
+        ret = myFsWriteBehindErr(file);
+        if (myFsWriteBehindFlush(file, fd) != 0) {
+            ret = -1;
+        }
+    }
+    return ret;
+}
+#else
+#define myFsWriteBehindSync(hash) WOLFSSH_UNUSED(hash)
+#define myFsWriteBehindRead(file, fd) 0
+#define myFsWriteBehindClose(fd) 0
+#endif /* MY_FS_WRITE_BEHIND_SZ > 0 */
+
+
+/*******************************************************************************
+ Read-ahead
+
+ A download is a run of wPread calls, each starting where the last one
+ ended and each a round trip to the media. Once MY_FS_READ_AHEAD_MIN reads
+ in a row have followed on, a wPread smaller than MY_FS_READ_AHEAD_SZ reads
+ a whole MY_FS_READ_AHEAD_SZ block instead, and the next requests are
+ copied out of it. Any read that falls inside the block is served from it,
+ so requests arriving slightly out of order still hit.
+
+ The block is filled when a request needs it, there is no task here to
+ fill it in the background. With MY_FS_ADVISE each fill also asks the
+ kernel for the block after it, which it reads while the replies are
+ copied out of this one, so the next fill comes from the page cache.
+ Writes through this layer to a file with the same path empty its
+ blocks.
+*******************************************************************************/
+#if MY_FS_READ_AHEAD_SZ > 0
+/* copy what the block holds for ofst, returns the bytes copied */
+static word32 myFsReadAheadCopy(MY_FS_FILE* file, byte* buf, word32 sz,
+        word64 ofst)
+{
+    word32 idx;
+
+    if (file->raSz == 0 || ofst < file->raOfst ||
+            ofst - file->raOfst >= file->raSz) {
+        return 0;
+    }
+
+    idx = (word32)(ofst - file->raOfst);
+    if (sz > file->raSz - idx) {
+        sz = file->raSz - idx;
+    }
+    WMEMCPY(buf, file->raBuf + idx, sz);
+    MY_FS_COUNT(readAheadHits);
+    return sz;
+}
+
+
+/* refill the block from ofst and copy out of it */
+static int myFsReadAheadFill(MY_FS_FILE* file, WFD fd, byte* buf,
+        word32 sz, word64 ofst)
+{
+    int ret;
+
+    if (file->raBuf == NULL) {
+        file->raBuf = (byte*)WMALLOC(MY_FS_READ_AHEAD_SZ, NULL,
+                DYNTYPE_SFTP);
+        if (file->raBuf == NULL) {
+            return myFsRead(file, fd, buf, sz, ofst);
+        }
+    }
+
+    file->raSz = 0;
+    MY_FS_COUNT(readAheadFills);
+    ret = myFsRead(file, fd, file->raBuf, MY_FS_READ_AHEAD_SZ, ofst);
+    if (ret > 0) {
+        file->raOfst = ofst;
+        file->raSz = (word32)ret;
+#ifdef MY_FS_ADVISE
+        if (ret == MY_FS_READ_AHEAD_SZ) {
+            myFsAdviseTo(file, fd, ofst + MY_FS_READ_AHEAD_SZ,
+                    ofst + 2 * (word64)MY_FS_READ_AHEAD_SZ);
+        }
+#endif
+        ret = (int)myFsReadAheadCopy(file, buf, sz, ofst);
+    }
+    return ret;
+}
+
+
+/* empty the blocks of every open file with this path hash */
+static void myFsReadAheadDrop(word32 hash)
+{
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        if (openFiles[i].pathHash == hash) {
+            openFiles[i].raSz = 0;
+        }
+    }
+}
+#else
+#define myFsReadAheadDrop(hash) WOLFSSH_UNUSED(hash)
+#endif /* MY_FS_READ_AHEAD_SZ > 0 */
+
+
+/*******************************************************************************
+ Mapped reads
+
+ With MY_FS_MMAP a file opened read only is mapped whole, and wPread copies
+ from the mapping instead of calling pread, one system call less per SFTP
+ read. wolfSSH's SFTP READ handler reads into a buffer of its own and packs
+ that into its output buffer, so through wPread the copies stay as they
+ were. wFsMapPeek hands out the mapped bytes themselves, for a caller that
+ can pack them straight into its output.
+
+ Writes through other handles show up in a shared mapping, and reads past
+ the mapped size fall back to pread. A file truncated while mapped would
+ fault on access, so an open through this layer that writes or truncates
+ the same path unmaps it first; files are expected not to be truncated by
+ other means while being downloaded.
+*******************************************************************************/
+#ifdef MY_FS_MMAP
+static void myFsMapOpen(WFD fd)
+{
+    MY_FS_FILE* file = myFsFileFind(fd);
+    struct stat st;
+    void* map;
+
+    if (file == NULL || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) ||
+            st.st_size <= 0 || (word64)st.st_size > (size_t)-1) {
+        return;
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map != MAP_FAILED) {
+        file->map = (byte*)map;
+        file->mapSz = (word64)st.st_size;
+    }
+}
+
+
+/* unmap every open file with this path hash, they fall back to pread */
+static void myFsMapDrop(word32 hash)
+{
+    int i;
+
+    for (i = 0; i < MY_FS_MAX_OPEN; i++) {
+        if (openFiles[i].inUse && openFiles[i].mapSz > 0 &&
+                openFiles[i].pathHash == hash) {
+            munmap(openFiles[i].map, (size_t)openFiles[i].mapSz);
+            openFiles[i].mapSz = 0;
+        }
+    }
+}
+
+
+static word32 myFsMapAvail(const MY_FS_FILE* file, word64 ofst, word32 sz)
+{
+    if (file == NULL || ofst >= file->mapSz) {
+        return 0;
+    }
+    if ((word64)sz > file->mapSz - ofst) {
+        sz = (word32)(file->mapSz - ofst);
+    }
+    return sz;
+}
+
+
+/* Point *data at the mapped bytes of fd at shortOffset and return how many
+ * of the sz asked for are there, as wPread would have read them. Returns 0
+ * when none are mapped, and the caller falls back to wPread. The bytes stay
+ * valid until the handle is closed or the file opened for writing. */
+int wFsMapPeek(WFD fd, unsigned int sz, const unsigned int* shortOffset,
+        const unsigned char** data)
+{
+    MY_FS_FILE* file = myFsFileFind(fd);
+    word64 ofst = myFsOffset(shortOffset);
+    word32 avail;
+
+    if (data == NULL || myFsWriteBehindRead(file, fd) != 0) {
+        return 0;
+    }
+    avail = myFsMapAvail(file, ofst, sz);
+    if (avail > 0) {
+        MY_FS_COUNT(mapReads);
+        *data = file->map + ofst;
+    }
+    return (int)avail;
+}
+
+#endif /* MY_FS_MMAP */
+
+
+int wPread(WFD fd, unsigned char* buf, unsigned int sz,
+        const unsigned int* shortOffset)
+{
+    MY_FS_FILE* file = myFsFileFind(fd);
+    word64 ofst = myFsOffset(shortOffset);
+    int ret;
+#if MY_FS_READ_AHEAD_SZ > 0
+    word32 got = 0;
+#endif
+
+    if (myFsWriteBehindRead(file, fd) != 0) {
+        return -1;
+    }
+#ifdef MY_FS_MMAP
+    /* the whole request must be mapped, a short read here would end a
+     * download early */
+    if (myFsMapAvail(file, ofst, sz) == sz) {
+        MY_FS_COUNT(mapReads);
+        WMEMCPY(buf, file->map + ofst, sz);
+        return (int)sz;
+    }
+#endif
+#if MY_FS_READ_AHEAD_SZ > 0
+
+    if (file != NULL) {
+        if (ofst == file->nextOfst) {
+            if (file->seqRun < MY_FS_READ_AHEAD_MIN) {
+                file->seqRun++;
+            }
+        }
+        else {
+            file->seqRun = 0;
+        }
+
+        got = myFsReadAheadCopy(file, buf, sz, ofst);
+        if (got == sz) {
+            file->nextOfst = ofst + got;
+            return (int)got;
+        }
+
+        /* the block only held the start of the request, or nothing */
+        if (file->seqRun >= MY_FS_READ_AHEAD_MIN &&
+                sz - got < MY_FS_READ_AHEAD_SZ) {
+            ret = myFsReadAheadFill(file, fd, buf + got, sz - got,
+                    ofst + got);
+        }
+        else {
+            ret = myFsRead(file, fd, buf + got, sz - got, ofst + got);
+        }
+
+        /* a failed read after a partial copy still returns the copy */
+        if (ret >= 0) {
+            ret += (int)got;
+        }
+        else if (got > 0) {
+            ret = (int)got;
+        }
+        if (ret >= 0) {
+            file->nextOfst = ofst + (word64)ret;
+        }
+        return ret;
+    }
+#endif
+
+    ret = myFsRead(file, fd, buf, sz, ofst);
+    return ret;
+}
+
+
 /*******************************************************************************
  Restricted function implementations
 *******************************************************************************/
 
+struct MY_FS_TRIE_NODE {
+    word16 child;   /* first child, 0 for none */
+    word16 sibling; /* next child of the same parent, 0 for none */
+    char c;
+    byte allow;     /* MY_FS_OP_* when a rule ends here */
+    byte isRule;
+};
+
+/* the trie is indexed with word16 */
+#define MY_FS_TRIE_MAX 0xFFFF
+
+static const MY_FS_RULE defaultRules[] = {
+    { "admin", NULL, MY_FS_OP_ALL },
+};
+
+const MY_FS_POLICY wFsDefaultPolicy = {
+    defaultRules, sizeof(defaultRules) / sizeof(defaultRules[0]), NULL, 0
+};
+
+
+static int myFsRuleApplies(const MY_FS_POLICY* policy,
+        const MY_FS_RULE* rule, const char* user)
+{
+    unsigned int i;
+
+    if (rule->user == NULL) {
+        return 0;
+    }
+    if (WSTRCMP(rule->user, "*") == 0) {
+        return 1;
+    }
+    if (rule->user[0] == '@') {
+        for (i = 0; i < policy->memberCount; i++) {
+            if (WSTRCMP(policy->members[i].group, rule->user + 1) == 0 &&
+                    WSTRCMP(policy->members[i].user, user) == 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    return WSTRCMP(rule->user, user) == 0;
+}
+
+
+/* rule prefix length, without a trailing '/' other than a lone "/" */
+static word32 myFsRulePrefixSz(const MY_FS_RULE* rule)
+{
+    word32 sz = 0;
+
+    if (rule->prefix != NULL) {
+        sz = (word32)WSTRLEN(rule->prefix);
+        if (sz > 1 && rule->prefix[sz - 1] == '/') {
+            sz--;
+        }
+    }
+    return sz;
+}
+
+
+static MY_FS_TRIE_NODE* myFsTrieInsert(MY_FS_SESSION* session,
+        const char* prefix, word32 prefixSz)
+{
+    MY_FS_TRIE_NODE* nodes = session->nodes;
+    word16 cur = 0;
+    word16 child;
+    word32 i;
+
+    for (i = 0; i < prefixSz; i++) {
+        child = nodes[cur].child;
+        while (child != 0 && nodes[child].c != prefix[i]) {
+            child = nodes[child].sibling;
+        }
+        if (child == 0) {
+            child = (word16)session->nodeCount++;
+            WMEMSET(&nodes[child], 0, sizeof(MY_FS_TRIE_NODE));
+            nodes[child].c = prefix[i];
+            nodes[child].sibling = nodes[cur].child;
+            nodes[cur].child = child;
+        }
+        cur = child;
+    }
+    return &nodes[cur];
+}
+
+
+int wFsSessionInit(MY_FS_SESSION* session, void* ssh,
+        const MY_FS_POLICY* policy, void* heap)
+{
+    const char* user = NULL;
+    MY_FS_TRIE_NODE* node;
+    word32 maxNodes = 1;
+    unsigned int i;
+
+    if (session == NULL) {
+        return WS_BAD_ARGUMENT;
+    }
+    if (policy == NULL) {
+        policy = &wFsDefaultPolicy;
+    }
+
+    WMEMSET(session, 0, sizeof(MY_FS_SESSION));
+    session->magic = MY_FS_SESSION_MAGIC;
+    session->ssh = ssh;
+    session->heap = heap;
+    if (ssh != NULL) {
+        user = wolfSSH_GetUsername((WOLFSSH*)ssh);
+    }
+    if (user == NULL) {
+        user = ""; /* only rules for everyone apply */
+    }
+
+    for (i = 0; i < policy->ruleCount; i++) {
+        if (myFsRuleApplies(policy, &policy->rules[i], user)) {
+            maxNodes += myFsRulePrefixSz(&policy->rules[i]);
+        }
+    }
+    if (maxNodes > MY_FS_TRIE_MAX) {
+        WLOG(WS_LOG_SFTP, "Policy for %s is too large", user);
+        return WS_BAD_ARGUMENT;
+    }
+
+    session->nodes = (MY_FS_TRIE_NODE*)WMALLOC(
+            sizeof(MY_FS_TRIE_NODE) * maxNodes, heap, DYNTYPE_SFTP);
+    if (session->nodes == NULL) {
+        return WS_MEMORY_E;
+    }
+    WMEMSET(&session->nodes[0], 0, sizeof(MY_FS_TRIE_NODE));
+    session->nodeCount = 1;
+
+    for (i = 0; i < policy->ruleCount; i++) {
+        const MY_FS_RULE* rule = &policy->rules[i];
+
+        if (myFsRuleApplies(policy, rule, user)) {
+            node = myFsTrieInsert(session, rule->prefix,
+                    myFsRulePrefixSz(rule));
+            node->allow |= rule->allow;
+            node->isRule = 1;
+            session->anyAllow |= rule->allow;
+        }
+    }
+
+    WLOG(WS_LOG_SFTP, "Policy for %s built, %u nodes", user,
+            session->nodeCount);
+    return WS_SUCCESS;
+}
+
+
+void wFsSessionFree(MY_FS_SESSION* session)
+{
+    if (session != NULL) {
+        if (session->nodes != NULL) {
+            WFREE(session->nodes, session->heap, DYNTYPE_SFTP);
+        }
+        WMEMSET(session, 0, sizeof(MY_FS_SESSION));
+    }
+}
+
+
+unsigned char wFsSessionAllowed(const MY_FS_SESSION* session,
+        const char* path)
+{
+    const MY_FS_TRIE_NODE* nodes;
+    word16 cur = 0;
+    word16 child;
+    byte allow;
+
+    if (session == NULL || session->magic != MY_FS_SESSION_MAGIC ||
+            session->nodes == NULL) {
+        return 0;
+    }
+
+    nodes = session->nodes;
+    allow = nodes[0].allow;
+    for (; path != NULL && *path != '\0'; path++) {
+        child = nodes[cur].child;
+        while (child != 0 && nodes[child].c != *path) {
+            child = nodes[child].sibling;
+        }
+        if (child == 0) {
+            break;
+        }
+        cur = child;
+
+        /* only a whole path component matches a rule */
+        if (nodes[cur].isRule &&
+                (path[1] == '\0' || path[1] == '/' || *path == '/')) {
+            allow = nodes[cur].allow;
+        }
+    }
+    return allow;
+}
+
+
+/* the filesystem handle as a session, or NULL when it is not one set up by
+ * wFsSessionInit, so that a wrong handle fails closed */
+static const MY_FS_SESSION* myFsSession(void* fs)
+{
+    const MY_FS_SESSION* session = (const MY_FS_SESSION*)fs;
+
+    if (session == NULL || session->magic != MY_FS_SESSION_MAGIC) {
+        if (session != NULL) {
+            WLOG(WS_LOG_SFTP, "Filesystem handle is not a MY_FS_SESSION");
+        }
+        return NULL;
+    }
+    return session;
+}
+
+
 /* helper function to check if the user is allowed to do an operation */
-static int isUserAllowed(void* fs)
+static int isUserAllowed(void* fs, byte op, const char* path)
 {
-    char* currentUser;
-    WOLFSSH* ssh = (WOLFSSH*)fs;
+    const MY_FS_SESSION* session = myFsSession(fs);
 
-    if (ssh == NULL) {
+    if (session == NULL || (session->anyAllow & op) == 0) {
         return 0;
     }
+    return (wFsSessionAllowed(session, path) & op) != 0;
+}
 
-    currentUser = wolfSSH_GetUsername(ssh);
-    if (currentUser && XSTRCMP(currentUser, "admin") == 0) {
-        return 1;
+
+/* the rights for a file being opened, worked out once for all its writes */
+static byte myFsOpenAllow(void* fs, const char* path)
+{
+    const MY_FS_SESSION* session = myFsSession(fs);
+
+    if (session == NULL || session->anyAllow == 0) {
+        return 0;
     }
-    return 0;
+    return wFsSessionAllowed(session, path);
 }
 
 
 int wFwrite(void *fs, unsigned char* b, int s, int a, WFILE* f)
 {
-    if (isUserAllowed(fs)) {
-        return SYS_FS_FileWrite(*f, b, s * a);
+#ifdef MY_FILESYSTEM_POSIX
+    MY_FS_FILE* file = myFsFileFind(fileno(f));
+
+    WOLFSSH_UNUSED(fs);
+    if (file != NULL && (file->allow & MY_FS_OP_WRITE)) {
+        /* bytes held back for a wPwrite on this path go first, or they
+         * would land over this write when flushed later */
+        myFsWriteBehindSync(file->pathHash);
+        MY_FS_COUNT(writes);
+        myFsStatDropHash(file->pathHash);
+        myFsAttrDrop(file->pathHash, NULL);
+        myFsReadAheadDrop(file->pathHash);
+        return (int)fwrite(b, s, a, f);
     }
-    else {
-        return -1;
+#else
+    MY_FS_FILE* file = myFsFileFind(*f);
+
+    WOLFSSH_UNUSED(fs);
+    if (file != NULL && (file->allow & MY_FS_OP_WRITE)) {
+        int ret;
+
+#if MY_FS_WRITE_BEHIND_SZ > 0
+        /* stream writes go straight out, after anything gathered */
+        if (myFsWriteBehindErr(file) != 0 ||
+                myFsWriteBehindFlush(file, *f) != 0) {
+            return -1;
+        }
+#endif
+        MY_FS_COUNT(writes);
+        ret = (int)SYS_FS_FileWrite(*f, b, s * a);
+        myFsStatDropHash(file->pathHash);
+        myFsAttrDrop(file->pathHash, file);
+        myFsReadAheadDrop(file->pathHash);
+        if (file->posValid) {
+            myFsFileMoved(file, file->pos, ret);
+            if (ret > 0) {
+                myFsAttrWrote(file, file->pos);
+            }
+        }
+        else {
+            file->attrValid = 0;
+        }
+        return ret;
     }
+#endif
+    return -1;
 }
 
 
 int wChmod(void* fs, const char* path, int mode)
 {
+#ifdef MY_FILESYSTEM_POSIX
+    if (isUserAllowed(fs, MY_FS_OP_CHMOD, path)) {
+        myFsStatDrop(path);
+        return chmod(path, (mode_t)mode);
+    }
+    else {
+        return -1;
+    }
+#else
     SYS_FS_RESULT ret;
     SYS_FS_FILE_DIR_ATTR attr = 0;
 
-    if (isUserAllowed(fs)) {
+    if (isUserAllowed(fs, MY_FS_OP_CHMOD, path)) {
         /* mode is the octal value i.e 666 is 0x1B6 */
         if ((mode & 0x180) != 0x180) { /* not octal 6XX read only */
             attr |= SYS_FS_ATTR_RDO;
         }
 
         /* toggle the read only attribute */
+        myFsStatDrop(path);
         ret = SYS_FS_FileDirectoryModeSet(path, attr, SYS_FS_ATTR_RDO);
         if (ret != SYS_FS_RES_SUCCESS) {
             return -1;
@@ -80,18 +1278,31 @@ int wChmod(void* fs, const char* path, int mode)
     else {
         return -1;
     }
+#endif
 }
 
 
 int wPwrite(void* fs, WFD fd, unsigned char* buf, unsigned int sz,
         const unsigned int* shortOffset)
 {
+    MY_FS_FILE* file = myFsFileFind(fd);
+    word64 ofst = myFsOffset(shortOffset);
     int ret = -1;
 
-    if (isUserAllowed(fs)) {
-        ret = (int)WFSEEK(NULL, &fd, shortOffset[0], SYS_FS_SEEK_SET);
-        if (ret != -1) {
-            ret = (int)WFWRITE(NULL, buf, 1, sz, &fd);
+    WOLFSSH_UNUSED(fs);
+
+    /* the rights were worked out when the file was opened */
+    if (file != NULL && (file->allow & MY_FS_OP_WRITE)) {
+        myFsStatDropHash(file->pathHash);
+        myFsAttrDrop(file->pathHash, file);
+        myFsReadAheadDrop(file->pathHash);
+#if MY_FS_WRITE_BEHIND_SZ > 0
+        ret = myFsWriteBehind(file, fd, buf, sz, ofst);
+#else
+        ret = myFsWrite(file, fd, buf, sz, ofst);
+#endif
+        if (ret > 0) {
+            myFsAttrWrote(file, ofst + (word64)ret);
         }
     }
 
@@ -100,8 +1311,13 @@ int wPwrite(void* fs, WFD fd, unsigned char* buf, unsigned int sz,
 
 int wMkdir(void* fs, unsigned char* path)
 {
-    if (isUserAllowed(fs)) {
-        return SYS_FS_DirectoryMake(path);
+    if (isUserAllowed(fs, MY_FS_OP_MKDIR, (const char*)path)) {
+        myFsStatDrop((const char*)path);
+#ifdef MY_FILESYSTEM_POSIX
+        return mkdir((const char*)path, 0755);
+#else
+        return SYS_FS_DirectoryMake((const char*)path);
+#endif
     }
     else {
         return -1;
@@ -111,8 +1327,13 @@ int wMkdir(void* fs, unsigned char* path)
 
 int wRmdir(void* fs, unsigned char* dir)
 {
-    if (isUserAllowed(fs)) {
-        return SYS_FS_FileDirectoryRemove(dir);
+    if (isUserAllowed(fs, MY_FS_OP_RMDIR, (const char*)dir)) {
+        myFsStatDrop((const char*)dir);
+#ifdef MY_FILESYSTEM_POSIX
+        return rmdir((const char*)dir);
+#else
+        return SYS_FS_FileDirectoryRemove((const char*)dir);
+#endif
     }
     else {
         return -1;
@@ -121,8 +1342,13 @@ int wRmdir(void* fs, unsigned char* dir)
 
 int wRemove(void* fs, unsigned char* dir)
 {
-    if (isUserAllowed(fs)) {
-        return SYS_FS_FileDirectoryRemove(dir);
+    if (isUserAllowed(fs, MY_FS_OP_REMOVE, (const char*)dir)) {
+        myFsStatDrop((const char*)dir);
+#ifdef MY_FILESYSTEM_POSIX
+        return remove((const char*)dir);
+#else
+        return SYS_FS_FileDirectoryRemove((const char*)dir);
+#endif
     }
     else {
         return -1;
@@ -132,8 +1358,16 @@ int wRemove(void* fs, unsigned char* dir)
 
 int wRename(void* fs, unsigned char* orig, unsigned char* newName)
 {
-    if (isUserAllowed(fs)) {
-        return SYS_FS_FileDirectoryRenameMove(orig, newName);
+    if (isUserAllowed(fs, MY_FS_OP_RENAME, (const char*)orig) &&
+            isUserAllowed(fs, MY_FS_OP_RENAME, (const char*)newName)) {
+        /* a renamed directory moves everything under it */
+        wFsCacheFlush();
+#ifdef MY_FILESYSTEM_POSIX
+        return rename((const char*)orig, (const char*)newName);
+#else
+        return SYS_FS_FileDirectoryRenameMove((const char*)orig,
+                (const char*)newName);
+#endif
     }
     else {
         return -1;
@@ -144,6 +1378,181 @@ int wRename(void* fs, unsigned char* orig, unsigned char* newName)
 /*******************************************************************************
  "SAFE" function implementations any user is ok
 *******************************************************************************/
+#ifdef MY_FILESYSTEM_POSIX
+int wDirOpen(void* heap, WDIR* dir, const char* path)
+{
+    WOLFSSH_UNUSED(heap);
+
+    *dir = opendir(path);
+    if (*dir == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+static int myFsStat(const char* path, WSTAT_T* st)
+{
+    WMEMSET(st, 0, sizeof(WSTAT_T));
+    /* follows links, as WSTAT should; WLSTAT is lstat() */
+    if (stat(path, st) != 0) {
+        WLOG(WS_LOG_SFTP, "Return from stat [%s], errno = %d", path, errno);
+        return -1;
+    }
+    return 0;
+}
+
+char* wGetCwd(char *r, int rSz)
+{
+    if (getcwd(r, (size_t)rSz) == NULL && rSz > 0) {
+        r[0] = '\0';
+    }
+    return r;
+}
+
+
+/* Before an open with these flags: creating or truncating is a write, so
+ * it is refused here without MY_FS_OP_WRITE or with the open file table
+ * full, and what it may change is dropped. Returns 1 for an open that
+ * writes, 0 for one that only reads, or -1 if it is not allowed. */
+static int myFsOpenCheck(const char* path, int flags, byte allow)
+{
+    if ((flags & O_ACCMODE) == O_RDONLY && !(flags & (O_CREAT | O_TRUNC))) {
+        return 0;
+    }
+    if ((allow & MY_FS_OP_WRITE) == 0) {
+        WLOG(WS_LOG_SFTP, "Not allowed to open %s for writing", path);
+        errno = EACCES;
+        return -1;
+    }
+    if (!myFsFileRoom(path)) {
+        errno = EMFILE;
+        return -1;
+    }
+    myFsStatDrop(path);
+#ifdef MY_FS_MMAP
+    myFsMapDrop(myFsPathHash(path));
+#endif
+    return 1;
+}
+
+
+/* start tracking a file opened after myFsOpenCheck. Returns -1 when an
+ * open that writes could not be tracked; the caller closes fd */
+static int myFsOpened(WFD fd, const char* path, byte allow, int writing)
+{
+    if (myFsFileAdd(fd, path, allow) != 0 && writing) {
+        errno = EMFILE;
+        return -1;
+    }
+    WLOG(WS_LOG_SFTP, "Opened file %s", path);
+#ifdef MY_FS_MMAP
+    if (!writing) {
+        myFsMapOpen(fd);
+    }
+#else
+    WOLFSSH_UNUSED(writing);
+#endif
+#ifdef MY_FS_ADVISE
+    /* a larger kernel read-ahead window for the whole file */
+    (void)MY_FS_FADVISE(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return 0;
+}
+
+
+int wOpen(void* fs, const char* path, int flags, int mode)
+{
+    byte allow = myFsOpenAllow(fs, path);
+    int writing = myFsOpenCheck(path, flags, allow);
+    int fd;
+
+    if (writing < 0) {
+        return -1;
+    }
+    fd = open(path, flags, mode);
+    if (fd < 0) {
+        WLOG(WS_LOG_SFTP, "Failed to open file %s", path);
+    }
+    else if (myFsOpened(fd, path, allow, writing) != 0) {
+        close(fd);
+        fd = -1;
+        errno = EMFILE;
+    }
+    return fd;
+}
+
+
+int wfopen(void* fs, WFILE** f, const char* filename, const char* mode)
+{
+    byte allow = myFsOpenAllow(fs, filename);
+
+    /* "w", "a" and "+" modes create, truncate or write */
+    if (strpbrk(mode, "wa+") != NULL) {
+        if ((allow & MY_FS_OP_WRITE) == 0) {
+            WLOG(WS_LOG_SFTP, "Not allowed to open %s for writing",
+                    filename);
+            *f = NULL;
+            return 1;
+        }
+        if (!myFsFileRoom(filename)) {
+            *f = NULL;
+            return 1;
+        }
+        myFsStatDrop(filename);
+#ifdef MY_FS_MMAP
+        myFsMapDrop(myFsPathHash(filename));
+#endif
+    }
+    *f = fopen(filename, mode);
+    if (*f == NULL) {
+        WLOG(WS_LOG_SFTP, "Failed to open file %s", filename);
+        return 1;
+    }
+    /* tracked like any other file, so a write knows its path */
+    if (myFsFileAdd(fileno(*f), filename, allow) != 0 &&
+            strpbrk(mode, "wa+") != NULL) {
+        fclose(*f);
+        *f = NULL;
+        return 1;
+    }
+    return 0;
+}
+
+
+int wFclose(WFILE* f)
+{
+    myFsFileRemove(fileno(f));
+    return fclose(f);
+}
+
+
+int wClose(WFD fd)
+{
+    int ret = myFsWriteBehindClose(fd);
+
+    myFsFileRemove(fd);
+    if (close(fd) != 0) {
+        ret = -1;
+    }
+    return ret;
+}
+
+
+int wFread(void *fs, unsigned char* b, int s, int a, WFILE* f)
+{
+#if MY_FS_WRITE_BEHIND_SZ > 0
+    MY_FS_FILE* file = myFsFileFind(fileno(f));
+
+    if (file != NULL) {
+        myFsWriteBehindSync(file->pathHash);
+    }
+#endif
+    WOLFSSH_UNUSED(fs);
+    MY_FS_COUNT(reads);
+    return (int)fread(b, s, a, f);
+}
+
+#else
 int wDirOpen(void* heap, WDIR* dir, const char* path)
 {
     *dir = SYS_FS_DirOpen(path);
@@ -153,7 +1562,7 @@ int wDirOpen(void* heap, WDIR* dir, const char* path)
     return 0;
 }
 
-int wStat(const char* path, WSTAT_T* stat)
+static int myFsStat(const char* path, WSTAT_T* stat)
 {
     int ret;
 
@@ -184,15 +1593,44 @@ char* wGetCwd(char *r, int rSz)
 }
 
 
-int wfopen(WFILE* f, const char* filename, SYS_FS_FILE_OPEN_ATTRIBUTES mode)
+int wfopen(void* fs, WFILE* f, const char* filename,
+        SYS_FS_FILE_OPEN_ATTRIBUTES mode)
 {
+    byte allow = myFsOpenAllow(fs, filename);
+
     if (f != NULL) {
+        if (mode != SYS_FS_FILE_OPEN_READ) {
+            /* creating or truncating is a write, so check before the open */
+            if ((allow & MY_FS_OP_WRITE) == 0) {
+                WLOG(WS_LOG_SFTP, "Not allowed to open %s for writing",
+                        filename);
+                return 1;
+            }
+            if (!myFsFileRoom(filename)) {
+                return 1;
+            }
+            myFsStatDrop(filename);
+        }
         *f = SYS_FS_FileOpen(filename, mode);
         if (*f == WBADFILE) {
             WLOG(WS_LOG_SFTP, "Failed to open file %s", filename);
             return 1;
         }
+        else if (myFsFileAdd(*f, filename, allow) != 0 &&
+                mode != SYS_FS_FILE_OPEN_READ) {
+            /* a write needs the entry */
+            SYS_FS_FileClose(*f);
+            *f = WBADFILE;
+            return 1;
+        }
         else {
+            MY_FS_FILE* file = myFsFileFind(*f);
+
+            /* an append starts at the end, wherever that is */
+            if (file != NULL && (mode == SYS_FS_FILE_OPEN_APPEND ||
+                    mode == SYS_FS_FILE_OPEN_APPEND_PLUS)) {
+                file->posValid = 0;
+            }
             WLOG(WS_LOG_SFTP, "Opened file %s", filename);
             return 0;
         }
@@ -201,39 +1639,123 @@ int wfopen(WFILE* f, const char* filename, SYS_FS_FILE_OPEN_ATTRIBUTES mode)
 }
 
 
-int wPread(WFD fd, unsigned char* buf, unsigned int sz,
-        const unsigned int* shortOffset)
+int wFclose(WFILE* f)
+{
+    int ret = myFsWriteBehindClose(*f);
+
+    myFsFileRemove(*f);
+    if (SYS_FS_FileClose(*f) != SYS_FS_RES_SUCCESS) {
+        ret = -1;
+    }
+    return ret;
+}
+
+
+int wFflush(WFD fd)
+{
+    int ret = myFsWriteBehindClose(fd);
+
+    if (SYS_FS_FileSync(fd) != SYS_FS_RES_SUCCESS) {
+        ret = -1;
+    }
+    return ret;
+}
+
+
+int wFseek(WFILE* f, long offset, int whence)
 {
+    MY_FS_FILE* file = myFsFileFind(*f);
     int ret;
 
-    ret = (int)WFSEEK(NULL, &fd, shortOffset[0], SYS_FS_SEEK_SET);
-    if (ret != -1)
-        ret = (int)WFREAD(NULL, buf, 1, sz, &fd);
+    MY_FS_COUNT(seeks);
+    ret = (int)SYS_FS_FileSeek(*f, (int32_t)offset,
+            (SYS_FS_FILE_SEEK_CONTROL)whence);
+    if (file != NULL) {
+        /* only an absolute seek leaves a known position */
+        file->pos = (word64)offset;
+        file->posValid = (ret != -1 && whence == SYS_FS_SEEK_SET);
+    }
+    return ret;
+}
+
+
+int wFread(void *fs, unsigned char* b, int s, int a, WFILE* f)
+{
+    MY_FS_FILE* file = myFsFileFind(*f);
+    int ret;
 
+    WOLFSSH_UNUSED(fs);
+    MY_FS_COUNT(reads);
+    ret = (int)SYS_FS_FileRead(*f, b, s * a);
+    if (file != NULL && file->posValid) {
+        myFsFileMoved(file, file->pos, ret);
+    }
     return ret;
 }
+#endif /* MY_FILESYSTEM_POSIX */
+
+
+int wStat(const char* path, WSTAT_T* stat)
+{
+#if MY_FS_STAT_CACHE_SZ > 0
+    word32 hash = myFsPathHash(path);
+    MY_FS_STAT_ENTRY* entry = myFsStatFind(path, hash);
+
+    if (entry == NULL) {
+        /* the size has to include writes still held back */
+        myFsWriteBehindSync(hash);
+    }
+
+    if (entry != NULL) {
+        MY_FS_COUNT(statHits);
+        WMEMCPY(stat, &entry->stats, sizeof(WSTAT_T));
+        entry->lastUse = ++statCacheTick;
+        if (statCacheTick == 0) {
+            /* the counter wrapped, start over rather than misorder */
+            wFsCacheFlush();
+        }
+        return 0;
+    }
+
+    MY_FS_COUNT(statMisses);
+    if (myFsStat(path, stat) != 0) {
+        return -1;
+    }
+    myFsStatStore(path, hash, stat);
+    return 0;
+#else
+    myFsWriteBehindSync(myFsPathHash(path));
+    MY_FS_COUNT(statMisses);
+    return myFsStat(path, stat);
+#endif
+}
 
 
 /*******************************************************************************
  File attribute functions
 *******************************************************************************/
 
-typedef struct WS_HANDLE_LIST {
-    byte handle[WOLFSSH_MAX_HANDLE];
-    word32 handleSz;
-    char name[WOLFSSH_MAX_FILENAME];
-    struct WS_HANDLE_LIST* next;
-    struct WS_HANDLE_LIST* prev;
-} WS_HANDLE_LIST;
-
 int SFTP_GetAttributesStat(void* atrIn, void* statsIn)
 {
     WS_SFTP_FILEATRB* atr = (WS_SFTP_FILEATRB*)atrIn;
     WSTAT_T* stats = (WSTAT_T*)statsIn;
+#ifdef MY_FILESYSTEM_POSIX
+    /* file size */
+    atr->flags |= WOLFSSH_FILEATRB_SIZE;
+    atr->sz[0] = (word32)((word64)stats->st_size & 0xFFFFFFFF);
+    atr->sz[1] = (word32)((word64)stats->st_size >> 32);
+
+    /* file type and permissions as they are */
+    atr->flags |= WOLFSSH_FILEATRB_PERM;
+    atr->per = (word32)stats->st_mode;
+
+    /* last modified time */
+    atr->mtime = (word32)stats->st_mtime;
+#else
     /* file size */
     atr->flags |= WOLFSSH_FILEATRB_SIZE;
     atr->sz[0] = (word32)stats->fsize;
-    atr->sz[1] = (word32)(0);
+    atr->sz[1] = (word32)(0); /* SYS_FS sizes are 32-bit */
 
     /* file permissions */
     atr->flags |= WOLFSSH_FILEATRB_PERM;
@@ -255,6 +1777,8 @@ int SFTP_GetAttributesStat(void* atrIn, void* statsIn)
     /* last modified time */
     atr->mtime = stats->ftime;
 
+#endif
+
     return WS_SUCCESS;
 }
 
@@ -262,14 +1786,18 @@ int SFTP_GetAttributesStat(void* atrIn, void* statsIn)
 static int SFTP_GetAttributesHelper(WS_SFTP_FILEATRB* atr, const char* fName)
 {
     WSTAT_T stats;
-    SYS_FS_RESULT res;
-    char buffer[255];
 
     WMEMSET(atr, 0, sizeof(WS_SFTP_FILEATRB));
-    WMEMSET(buffer, 0, sizeof(buffer));
-    res = SYS_FS_CurrentDriveGet(buffer);
-    if (res == SYS_FS_RES_SUCCESS) {
-        if (WSTRCMP(fName, buffer) == 0) {
+#ifndef MY_FILESYSTEM_POSIX
+    /* the drive is looked up once, not per request */
+    if (!mountPointSet) {
+        WMEMSET(mountPoint, 0, sizeof(mountPoint));
+        if (SYS_FS_CurrentDriveGet(mountPoint) == SYS_FS_RES_SUCCESS) {
+            mountPointSet = 1;
+        }
+    }
+    if (mountPointSet) {
+        if (WSTRCMP(fName, mountPoint) == 0) {
             atr->flags |= WOLFSSH_FILEATRB_PERM;
             atr->per |= 0x41ED; /* 755 with directory */
             atr->per |= 0x1ED;  /* octal 755 */
@@ -283,6 +1811,7 @@ static int SFTP_GetAttributesHelper(WS_SFTP_FILEATRB* atr, const char* fName)
             return WS_SUCCESS;
         }
     }
+#endif
 
     if (WSTAT(ssh->fs, fName, &stats) != 0) {
         WLOG(WS_LOG_SFTP, "Issue with WSTAT call");
@@ -314,6 +1843,40 @@ int SFTP_GetAttributes(void* fs, const char* fileName, void* atr,
 int SFTP_GetAttributes_Handle(void* ssh, unsigned char* handle, int handleSz,
         char* name, void* atr)
 {
-    return SFTP_GetAttributesHelper((WS_SFTP_FILEATRB*)atr, name);
+    MY_FS_FILE* file = NULL;
+    WFD fd;
+    int ret;
+
+    WOLFSSH_UNUSED(ssh);
+
+    /* wolfSSH makes the handle of an open file from its WFD */
+    if (handle != NULL && handleSz == (int)sizeof(WFD)) {
+        WMEMCPY(&fd, handle, sizeof(WFD));
+        file = myFsFileFind(fd);
+    }
+    if (file == NULL) {
+        return SFTP_GetAttributesHelper((WS_SFTP_FILEATRB*)atr, name);
+    }
+
+    if (!file->attrValid) {
+        /* the size has to include writes still held back */
+        myFsWriteBehindSync(file->pathHash);
+#ifdef MY_FILESYSTEM_POSIX
+        ret = fstat(fd, &file->attr);
+#else
+        ret = myFsStat(name, &file->attr);
+#endif
+        if (ret != 0) {
+            WLOG(WS_LOG_SFTP, "Issue getting attributes of open file");
+            return WS_BAD_FILE_E;
+        }
+        file->attrValid = 1;
+    }
+    else {
+        MY_FS_COUNT(attrHits);
+    }
+
+    WMEMSET(atr, 0, sizeof(WS_SFTP_FILEATRB));
+    return SFTP_GetAttributesStat(atr, &file->attr);
 }
 #endif /* WOLFSSH_USER_FILESYSTEM */
@@ -37,15 +37,172 @@ extern "C" {
 
 #include <stdlib.h>
 #include <stdio.h>
-#include "system/fs/sys_fs.h"
+
+/* Define MY_FILESYSTEM_POSIX to build this layer over POSIX file calls, e.g.
+ * to try out the restrictions on Linux. By default it uses the Microchip
+ * Harmony SYS_FS API. */
+#ifdef MY_FILESYSTEM_POSIX
+    #include <dirent.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #include "system/fs/sys_fs.h"
+#endif
+
+/* most files open at once, across all sessions. Each keeps a copy of its
+ * attributes, so raising this costs a WSTAT_T per file. Past it a file can
+ * still be opened to read, but an open that writes is refused */
+#ifndef MY_FS_MAX_OPEN
+    #define MY_FS_MAX_OPEN 8
+#endif
+
+/* number of wStat results kept, 0 to disable, and the longest path kept.
+ * Past 16 they are kept in sets of 16, so use a multiple of 16. */
+#ifndef MY_FS_STAT_CACHE_SZ
+    #define MY_FS_STAT_CACHE_SZ 16
+#endif
+#ifndef MY_FS_STAT_PATH_SZ
+    #define MY_FS_STAT_PATH_SZ 128
+#endif
+
+/* bytes to read ahead for a file being read in order, 0 to disable, and
+ * how many reads in a row must follow on from the last before it starts.
+ * The buffer is allocated the first time it is needed, one per file, and
+ * filled by the read that needs it; there is no background fill. */
+#ifndef MY_FS_READ_AHEAD_SZ
+    #define MY_FS_READ_AHEAD_SZ 0
+#endif
+#ifndef MY_FS_READ_AHEAD_MIN
+    #define MY_FS_READ_AHEAD_MIN 2
+#endif
+
+/* bytes of SFTP writes to gather per file before writing them out, 0 to
+ * disable. Use a multiple of the media's sector size; the buffer is written
+ * out when it reaches a multiple of this size in the file. */
+#ifndef MY_FS_WRITE_BEHIND_SZ
+    #define MY_FS_WRITE_BEHIND_SZ 0
+#endif
+
+/* Define MY_FS_MMAP with MY_FILESYSTEM_POSIX to map files opened read only
+ * and answer wPread from the mapping instead of a pread call each time.
+ * wPread still copies into the buffer it is given; a caller that can use
+ * the bytes where they are gets a pointer into the mapping from
+ * wFsMapPeek and skips that copy. */
+#if defined(MY_FS_MMAP) && !defined(MY_FILESYSTEM_POSIX)
+    #error MY_FS_MMAP needs MY_FILESYSTEM_POSIX
+#endif
+
+/* Define MY_FS_ADVISE with MY_FILESYSTEM_POSIX to have the kernel read
+ * MY_FS_ADVISE_SZ bytes ahead of a file being read in order, in the
+ * background, while the SFTP reply is on its way. */
+#if defined(MY_FS_ADVISE) && !defined(MY_FILESYSTEM_POSIX)
+    #error MY_FS_ADVISE needs MY_FILESYSTEM_POSIX
+#endif
+#ifndef MY_FS_ADVISE_SZ
+    #define MY_FS_ADVISE_SZ (256 * 1024)
+#endif
+
+/* With MY_FILESYSTEM_POSIX, define MY_FS_PREAD to the name of a function
+ * with pread's signature to read the media through it instead, such as a
+ * throttled one to benchmark against slow media. MY_FS_FADVISE does the
+ * same for posix_fadvise, for MY_FS_ADVISE. */
+
+/*******************************************************************************
+ Permission policy
+
+ A policy is a table of rules. Each rule gives a user, a group ("@name") or
+ everyone ("*") a mask of the restricted operations below, under a path
+ prefix. A prefix matches whole path components, "/a/b" covers "/a/b" and
+ "/a/b/c" but not "/a/bc"; an empty prefix covers everything. For a path
+ the longest matching prefix decides; rules with the same prefix add up,
+ so a longer prefix with a mask of 0 takes rights away again.
+
+ wFsSessionInit picks out the rules for the logged in user once, and
+ builds them into a small prefix trie in the session. The session is
+ then the filesystem handle given to wolfSSH_SetFilesystemHandle. Any
+ other handle, such as the WOLFSSH itself, is refused every restricted
+ operation.
+*******************************************************************************/
+#define MY_FS_OP_WRITE   0x01
+#define MY_FS_OP_CHMOD   0x02
+#define MY_FS_OP_MKDIR   0x04
+#define MY_FS_OP_RMDIR   0x08
+#define MY_FS_OP_REMOVE  0x10
+#define MY_FS_OP_RENAME  0x20
+#define MY_FS_OP_ALL     0x3F
+
+typedef struct MY_FS_RULE {
+    const char* user;    /* user name, "@group" or "*" */
+    const char* prefix;  /* path prefix, NULL or "" for all paths */
+    unsigned char allow; /* MY_FS_OP_* */
+} MY_FS_RULE;
+
+typedef struct MY_FS_MEMBER {
+    const char* group;   /* without the '@' */
+    const char* user;
+} MY_FS_MEMBER;
+
+typedef struct MY_FS_POLICY {
+    const MY_FS_RULE* rules;
+    unsigned int ruleCount;
+    const MY_FS_MEMBER* members;
+    unsigned int memberCount;
+} MY_FS_POLICY;
+
+typedef struct MY_FS_TRIE_NODE MY_FS_TRIE_NODE;
+
+/* MY_FS_SESSION.magic of a session set up by wFsSessionInit */
+#define MY_FS_SESSION_MAGIC 0x77465301 /* "wFS" and version 1 */
+
+/* one per SFTP session */
+typedef struct MY_FS_SESSION {
+    unsigned int magic;     /* MY_FS_SESSION_MAGIC, checked on every use */
+    void* ssh;
+    void* heap;
+    MY_FS_TRIE_NODE* nodes; /* nodes[0] is the root, the empty prefix */
+    unsigned int nodeCount;
+    unsigned char anyAllow; /* every operation allowed somewhere */
+} MY_FS_SESSION;
+
+/* The policy used when wFsSessionInit is given NULL: only "admin" may
+ * change anything, anywhere. */
+extern const MY_FS_POLICY wFsDefaultPolicy;
+
+/* call once the user is authenticated. Returns 0 on success */
+int wFsSessionInit(MY_FS_SESSION* session, void* ssh,
+        const MY_FS_POLICY* policy, void* heap);
+void wFsSessionFree(MY_FS_SESSION* session);
+
+/* the MY_FS_OP_* mask the session has for path */
+unsigned char wFsSessionAllowed(const MY_FS_SESSION* session,
+        const char* path);
 
 /*******************************************************************************
  mapping of file handles and modes
 *******************************************************************************/
+#ifdef MY_FILESYSTEM_POSIX
+#define WDIR              DIR*
+#define WSTAT_T           struct stat
+#define WS_DELIM          '/'
+#define WFFLUSH(s)        fflush((s))
+#define WFILE             FILE
+#define WSEEK_END         SEEK_END
+#define WBADFILE          NULL
+#define WOLFSSH_O_RDWR    O_RDWR
+#define WOLFSSH_O_RDONLY  O_RDONLY
+#define WOLFSSH_O_WRONLY  O_WRONLY
+#define WOLFSSH_O_APPEND  O_APPEND
+#define WOLFSSH_O_CREAT   O_CREAT
+#define WOLFSSH_O_TRUNC   O_TRUNC
+#define WOLFSSH_O_EXCL    O_EXCL
+#define FLUSH_STD(a)      fflush((a))
+#define WFD               int
+#else
 #define WDIR              SYS_FS_HANDLE
 #define WSTAT_T           SYS_FS_FSTAT
 #define WS_DELIM          '/'
-#define WFFLUSH(s)        SYS_FS_FileSync((s))
+#define WFFLUSH(s)        wFflush((s))
 #define WFILE             SYS_FS_HANDLE
 #define WSEEK_END         SYS_FS_SEEK_END
 #define WBADFILE          SYS_FS_HANDLE_INVALID
@@ -57,32 +214,69 @@ extern "C" {
 #define WOLFSSH_O_TRUNC   0
 #define WOLFSSH_O_EXCL    0
 #define FLUSH_STD(a)
+#define WFD               SYS_FS_HANDLE
+#endif
 
 /*******************************************************************************
  function declerations for operations that do not have a user check
 *******************************************************************************/
-#define WFD SYS_FS_HANDLE
 int wPread(WFD, unsigned char*, unsigned int, const unsigned int*);
+#ifdef MY_FS_MMAP
+int wFsMapPeek(WFD fd, unsigned int sz, const unsigned int* shortOffset,
+        const unsigned char** data);
+#endif
 char* wGetCwd(char *r, int rSz);
 int wStat(const char* path, WSTAT_T* stat);
 int wDirOpen(void* heap, WDIR* dir, const char* path);
+void wFsCacheFlush(void);
+#ifdef MY_FILESYSTEM_POSIX
+int wOpen(void* fs, const char* path, int flags, int mode);
+int wClose(WFD fd);
+int wfopen(void* fs, WFILE** f, const char* filename, const char* mode);
+int wFclose(WFILE* f);
+#else
+int wfopen(void* fs, WFILE* f, const char* filename,
+        SYS_FS_FILE_OPEN_ATTRIBUTES mode);
+int wFclose(WFILE* f);
+int wFseek(WFILE* f, long offset, int whence);
+int wFflush(WFD fd);
+#endif
 
 
 /*******************************************************************************
  mapping "SAFE" operations, any user can do
 *******************************************************************************/
-#define WFOPEN(fs,f,fn,m)   wfopen(*(f),(fn),(m))
-#define WFCLOSE(fs,f)       SYS_FS_FileClose(*(f))
-#define WFREAD(fs,b,s,a,f)  SYS_FS_FileRead(*(f),(b),(s)*(a))
-#define WFSEEK(fs,s,o,w)    SYS_FS_FileSeek(*(s),(o),(w))
+#ifdef MY_FILESYSTEM_POSIX
+#define WFOPEN(fs,f,fn,m)   wfopen((fs),(f),(fn),(m))
+#define WFCLOSE(fs,f)       wFclose((f))
+#define WFREAD(fs,b,s,a,f)  fread((b),(s),(a),(f))
+#define WFSEEK(fs,s,o,w)    fseek((s),(o),(w))
+#define WFTELL(fs,s)        ftell((s))
+#define WREWIND(fs,s)       rewind((s))
+#define WCHDIR(fs,b)        chdir((b))
+#define WOPENDIR(fs,h,c,d)  wDirOpen((h),(c),(d))
+#define WREADDIR(fs,d)      readdir(*(d))
+#define WCLOSEDIR(fs,d)     closedir(*(d))
+#define WSTAT(fs,p,b)       wStat((p),(b))
+#define WLSTAT(fs,p,b)      lstat((p),(b))
+#define WOPEN(fs,p,m,per)   wOpen((fs),(p),(m),(per))
+#define WCLOSE(fs,fd)       wClose((fd))
+#define WPREAD(fs,fd,b,s,o) wPread((fd),(b),(s),(o))
+#define WGETCWD(fs,r,rSz)   wGetCwd(r,(rSz))
+#else
+#define WFOPEN(fs,f,fn,m)   wfopen((fs),*(f),(fn),(m))
+#define WFCLOSE(fs,f)       wFclose((f))
+#define WFREAD(fs,b,s,a,f)  wFread((fs),(b),(s),(a),(f))
+#define WFSEEK(fs,s,o,w)    wFseek((s),(o),(w))
 #define WFTELL(fs,s)        SYS_FS_FileTell(*(s))
-#define WREWIND(fs,s)       SYS_FS_FileSeek(*(s), 0, SYS_FS_SEEK_SET)
+#define WREWIND(fs,s)       wFseek((s), 0, SYS_FS_SEEK_SET)
 #define WCHDIR(fs,b)        SYS_FS_DirectryChange((b))
 #define WOPENDIR(fs,h,c,d)  wDirOpen((h), (c),(d))
 #define WCLOSEDIR(fs,d)     SYS_FS_DirClose(*(d))
 #define WSTAT(fs,p,b)       wStat((p), (b))
 #define WPREAD(fs,fd,b,s,o) wPread((fd),(b),(s),(o))
 #define WGETCWD(fs,r,rSz)   wGetCwd(r,(rSz))
+#endif
 
 
 /*******************************************************************************
@@ -114,9 +308,14 @@ int wFread(void *fs, unsigned char* b, int s, int a, WFILE* f);
  FPUTS/FGETS only used in SFTP client example
 *******************************************************************************/
 #undef  WFGETS
-#define WFGETS(b,s,f)       SYS_FS_FileStringGet((f), (b), (s))
 #undef  WFPUTS
+#ifdef MY_FILESYSTEM_POSIX
+#define WFGETS(b,s,f)       fgets((b),(s),(f))
+#define WFPUTS(b,f)         fputs((b),(f))
+#else
+#define WFGETS(b,s,f)       SYS_FS_FileStringGet((f), (b), (s))
 #define WFPUTS(b,f)         SYS_FS_FileStringPut((f), (b))
+#endif
 
 
 /*******************************************************************************
@@ -128,6 +327,30 @@ int wFread(void *fs, unsigned char* b, int s, int a, WFILE* f);
 #define WFCHMOD(fs,fd,m)     (0)
 
 
+/*******************************************************************************
+ Filesystem call counters, define MY_FILESYSTEM_STATS to enable
+*******************************************************************************/
+#ifdef MY_FILESYSTEM_STATS
+typedef struct MY_FS_STATS {
+    unsigned long seeks;        /* seeks issued to the filesystem */
+    unsigned long seeksSkipped; /* seeks not needed, cursor already there */
+    unsigned long reads;
+    unsigned long writes;       /* writes issued to the filesystem */
+    unsigned long writesBuffered; /* wPwrite calls held for write-behind */
+    unsigned long statHits;     /* wStat answered from the cache */
+    unsigned long statMisses;   /* wStat that went to the filesystem */
+    unsigned long attrHits;     /* FSTAT answered from the open file table */
+    unsigned long readAheadHits;  /* wPread served from a read-ahead buffer */
+    unsigned long readAheadFills; /* reads made to refill one */
+    unsigned long mapReads;       /* wPread served from a mapped file */
+    unsigned long advises;        /* background reads asked of the kernel */
+} MY_FS_STATS;
+
+void wFsStatsGet(MY_FS_STATS* stats);
+void wFsStatsReset(void);
+#endif
+
+
 /*******************************************************************************
  File attribute functions
 *******************************************************************************/